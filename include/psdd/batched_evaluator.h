@@ -0,0 +1,227 @@
+#ifndef PSDD_BATCHED_EVALUATOR_H
+#define PSDD_BATCHED_EVALUATOR_H
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <psdd/compiled_psdd.h>
+#include <psdd/psdd_parameter.h>
+#include <psdd/thread_pool.h>
+
+// Instruction sets for the log-space kernels, in increasing order.
+enum SimdLevel {
+  SCALAR_SIMD_LEVEL = 0,
+  AVX2_SIMD_LEVEL = 1,
+  AVX512_SIMD_LEVEL = 2
+};
+
+// Number representations for sum-product evaluation. LOG_DOMAIN keeps
+// log-space values, as PsddParameter does. LINEAR_DOMAIN keeps each value as
+// a mantissa in [0.5, 1) times a power of two, renormalized at every node, so
+// sums need no exp or log; only the results are converted back to log space.
+enum EvaluationDomain { LOG_DOMAIN = 0, LINEAR_DOMAIN = 1 };
+
+// Evaluates a CompiledPsdd on many evidence rows at once. Rows are processed
+// in chunks of batch_width lanes; every node keeps one contiguous array of
+// log-space values per chunk, and each decision node is computed with
+// element-wise log-multiply and log-add-exp (or max) kernels over that array.
+// The kernels use AVX-512 or AVX2 when the running CPU supports them, and
+// fall back to scalar code otherwise.
+//
+// With a thread pool, nodes are evaluated level by level (see
+// CompiledPsdd::level_positions()); the nodes of a level, and for narrow
+// levels also the lanes, are split across the workers.
+//
+// Sparse evidence: the evaluator caches the evidence-free value of every
+// node. When the observed variables of a chunk have small ancestor cones,
+// only the cones are recomputed and every other node keeps its cached value,
+// so a chunk costs O(|cone|) instead of O(|circuit|).
+//
+// An evidence row lists observed literals: variable_index for true and
+// -variable_index for false. Variables not in the row are marginalized out
+// (Evaluate) or maximized out (EvaluateMax). The evaluator keeps pointers to
+// compiled_psdd and thread_pool, which must outlive it, and is not safe to
+// use from several threads at once.
+//
+// T is the type of the lane values, float or double. Parameters are rounded
+// to T when they are loaded and results are returned as PsddParameter; a
+// float evaluator moves half the bytes and fits twice as many lanes in a
+// vector, at single precision.
+template <typename T> class BasicBatchedEvaluator {
+public:
+  explicit BasicBatchedEvaluator(const CompiledPsdd *compiled_psdd,
+                                 uint32_t batch_width = 64);
+  // simd_level is clamped to the level supported by the running CPU.
+  BasicBatchedEvaluator(const CompiledPsdd *compiled_psdd,
+                        uint32_t batch_width, SimdLevel simd_level);
+  // thread_pool may be nullptr, in which case evaluation is single-threaded.
+  BasicBatchedEvaluator(const CompiledPsdd *compiled_psdd,
+                        uint32_t batch_width, SimdLevel simd_level,
+                        ThreadPool *thread_pool);
+  static SimdLevel DetectSimdLevel();
+  SimdLevel simd_level() const;
+  uint32_t batch_width() const;
+  // The domain of Evaluate and GetMarginals, LOG_DOMAIN by default. The max
+  // and boolean semirings always work in log space, and the sparse evidence
+  // shortcut is only taken in log space.
+  void set_domain(EvaluationDomain domain);
+  EvaluationDomain domain() const;
+  // Probability of each evidence row.
+  std::vector<Probability>
+  Evaluate(const std::vector<std::vector<int32_t>> &evidence_rows);
+  // Probability of the most likely completion of each evidence row.
+  std::vector<Probability>
+  EvaluateMax(const std::vector<std::vector<int32_t>> &evidence_rows);
+  // Whether each evidence row is consistent with the base of the PSDD,
+  // ignoring parameters (the boolean semiring).
+  std::vector<bool>
+  IsConsistent(const std::vector<std::vector<int32_t>> &evidence_rows);
+  // Posterior marginals of every variable given each evidence row, from one
+  // upward and one downward (derivative) pass per chunk of rows. The result
+  // is a row-major evidence_rows.size() x compiled_psdd->variable_size()
+  // matrix of (false, true) pairs. Variables not in the PSDD, and all
+  // variables of a row with zero probability, get a pair of zeros.
+  std::vector<std::pair<Probability, Probability>>
+  GetMarginals(const std::vector<std::vector<int32_t>> &evidence_rows);
+  // The most likely completion of each evidence row, with its probability
+  // (the EvaluateMax result). The upward max pass records the maximizing
+  // element of every decision node per lane, and each row is decoded from
+  // the root down. Assignments are indexed by variable index and have
+  // compiled_psdd->variable_size() entries; variables not in the PSDD, and
+  // all variables of a row with zero probability, are false.
+  std::vector<std::pair<std::vector<bool>, Probability>>
+  GetMPESolutions(const std::vector<std::vector<int32_t>> &evidence_rows);
+  // Number of chunks evaluated on the ancestor cones of their evidence only.
+  uint64_t cone_chunk_count() const;
+
+private:
+  enum Semiring {
+    SUM_SEMIRING = 0,
+    MAX_SEMIRING = 1,
+    BOOLEAN_SEMIRING = 2,
+    NO_SEMIRING = 3
+  };
+  // Fills root_values with the log-space root value of every row.
+  void EvaluateRows(const std::vector<std::vector<int32_t>> &evidence_rows,
+                    Semiring semiring, std::vector<double> *root_values);
+  // Upward pass for rows [row_begin, row_begin + lane_size). With
+  // record_argmax, a max-semiring pass also fills the argmax lanes.
+  void EvaluateChunk(const std::vector<std::vector<int32_t>> &evidence_rows,
+                     size_t row_begin, uint32_t lane_size, Semiring semiring,
+                     bool record_argmax);
+  // Sum-semiring upward pass in the linear domain. The root lanes are
+  // converted back to log space at the end; every other node keeps its
+  // mantissa in lanes() and its exponent in exponent_lanes().
+  void EvaluateChunkLinear(
+      const std::vector<std::vector<int32_t>> &evidence_rows, size_t row_begin,
+      uint32_t lane_size);
+  // Downward pass after a sum-semiring EvaluateChunk. Fills the derivative
+  // lanes with the partial derivative of the root with respect to each node.
+  void DifferentiateChunk(uint32_t lane_size);
+  // Calls body(position, lane_begin, lane_size, product_buffer) for every
+  // node of level, split across the thread pool by nodes and, for narrow
+  // levels, by lanes.
+  void ForEachLevelNode(
+      uint32_t level, uint32_t active_size,
+      const std::function<void(uint32_t, uint32_t, uint32_t, T *)> &body);
+  // Writes the evidence of rows [row_begin, row_begin + lane_size) into the
+  // lanes of the leaves of the observed variables. Other lanes are left as
+  // they are.
+  void SetEvidenceLanes(const std::vector<std::vector<int32_t>> &evidence_rows,
+                        size_t row_begin, uint32_t lane_size,
+                        Semiring semiring);
+  // Evaluates only the ancestor cones of the observed variables of the
+  // chunk, if they are small enough. Returns false, changing nothing, if
+  // the full upward pass is cheaper.
+  bool EvaluateChunkCone(const std::vector<std::vector<int32_t>> &evidence_rows,
+                         size_t row_begin, uint32_t lane_size,
+                         Semiring semiring);
+  // The evidence-free value of every node, computed on first use.
+  const std::vector<double> &BaselineValues(Semiring semiring);
+  // The decision nodes above any leaf of variable_index, in increasing
+  // position, computed on first use.
+  const std::vector<uint32_t> &VariableCone(uint32_t variable_index);
+  // Computes lanes [lane_begin, lane_begin + lane_size) of a decision node,
+  // and with record_argmax also its argmax lanes.
+  void EvaluateDecisionNode(uint32_t position, uint32_t lane_begin,
+                            uint32_t lane_size, Semiring semiring,
+                            bool record_argmax, T *product_buffer);
+  // Writes the assignment that the argmax lanes of lane select from the
+  // root. observations holds the observed literal of every variable of the
+  // lane's row, or 0.
+  void DecodeLane(uint32_t lane, const std::vector<int32_t> &observations,
+                  std::vector<uint32_t> *node_stack,
+                  std::vector<bool> *assignment);
+  // Linear-domain version of EvaluateDecisionNode for the sum semiring.
+  void EvaluateDecisionNodeLinear(uint32_t position, uint32_t lane_begin,
+                                  uint32_t lane_size);
+  // Computes derivative lanes [lane_begin, lane_begin + lane_size) of a
+  // non-root node from its parents.
+  void DifferentiateNode(uint32_t position, uint32_t lane_begin,
+                         uint32_t lane_size, T *product_buffer);
+  // Linear-domain version of DifferentiateNode.
+  void DifferentiateNodeLinear(uint32_t position, uint32_t lane_begin,
+                               uint32_t lane_size);
+  // Writes log Pr(X=false, e) and log Pr(X=true, e) of the first
+  // active_size lanes into false_acc and true_acc, from linear-domain
+  // derivatives. exponent_buffer holds 2 * lane_stride_ values.
+  void LinearVariableJoints(uint32_t variable_index, uint32_t active_size,
+                            T *false_acc, T *true_acc, T *exponent_buffer);
+  // Calls body(begin, end, worker_index) over chunks of [0, size), on the
+  // thread pool if there is one.
+  void ParallelFor(size_t size, size_t min_chunk_size,
+                   const std::function<void(size_t, size_t, uint32_t)> &body);
+  T *lanes(uint32_t position);
+  T *derivative_lanes(uint32_t position);
+  T *exponent_lanes(uint32_t position);
+  T *derivative_exponent_lanes(uint32_t position);
+  uint32_t *argmax_lanes(uint32_t position);
+  const CompiledPsdd *compiled_psdd_;
+  uint32_t batch_width_;
+  // batch_width_ rounded up to a multiple of the widest vector.
+  uint32_t lane_stride_;
+  SimdLevel simd_level_;
+  ThreadPool *thread_pool_;
+  EvaluationDomain domain_;
+  std::vector<uint32_t> leaf_positions_;
+  std::vector<uint32_t> node_levels_;
+  std::vector<double> baseline_values_[NO_SEMIRING];
+  std::vector<std::vector<uint32_t>> variable_cones_;
+  std::vector<uint8_t> variable_cone_built_;
+  // Marks of the last cone union; a node is marked if it holds cone_stamp_.
+  std::vector<uint64_t> cone_marks_;
+  uint64_t cone_stamp_;
+  uint64_t cone_chunk_count_;
+  // If not NO_SEMIRING, every lane of every node holds the baseline value of
+  // this semiring, except the lanes of dirty_positions_.
+  Semiring baseline_semiring_;
+  std::vector<uint32_t> dirty_positions_;
+  // node_size * lane_stride_ values, node-major.
+  std::vector<T> lane_values_;
+  // Same layout as lane_values_, allocated by the first GetMarginals.
+  std::vector<T> derivative_values_;
+  // Same layout as lane_values_, allocated by the first GetMPESolutions. For
+  // a decision node, the index (from its first element) of the element
+  // achieving the max in each lane.
+  std::vector<uint32_t> argmax_values_;
+  // Linear domain only: the exponents of lane_values_ and
+  // derivative_values_, every parameter split into mantissa and exponent,
+  // and lane_stride_ ones and zeros used as a neutral factor.
+  std::vector<T> lane_exponents_;
+  std::vector<T> derivative_exponents_;
+  std::vector<T> parameter_mantissas_;
+  std::vector<T> parameter_exponents_;
+  std::vector<T> unit_mantissas_;
+  std::vector<T> unit_exponents_;
+  // lane_stride_ values per worker.
+  std::vector<T> product_buffers_;
+};
+
+extern template class BasicBatchedEvaluator<float>;
+extern template class BasicBatchedEvaluator<double>;
+using BatchedEvaluator = BasicBatchedEvaluator<double>;
+using FloatBatchedEvaluator = BasicBatchedEvaluator<float>;
+
+#endif // PSDD_BATCHED_EVALUATOR_H
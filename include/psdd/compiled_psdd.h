@@ -0,0 +1,130 @@
+#ifndef PSDD_COMPILED_PSDD_H
+#define PSDD_COMPILED_PSDD_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <gmpxx.h>
+#include <psdd/psdd_node.h>
+#include <psdd/psdd_parameter.h>
+#include <psdd/query_workspace.h>
+#include <psdd/thread_pool.h>
+
+// A read-only, pointer-free copy of the PSDD rooted at a PsddNode, built once
+// and queried many times. Nodes are identified by their position, which is a
+// topological order with children before parents; the root is always the last
+// node.
+//
+// Node data is stored as struct-of-arrays. Elements use a CSR layout: the
+// elements of node i are the slots [element_offsets()[i],
+// element_offsets()[i + 1]) of primes(), subs() and parameters(). A decision
+// node owns one slot per element. A top node owns two slots whose parameters
+// are its false and true parameters (in that order); the prime and sub entries
+// of these slots are unused. A literal node owns no slot.
+//
+// For parallel traversals the circuit also records:
+//  - levels: the level of a node is the longest path from it to a leaf, so a
+//    node only depends on nodes of lower levels. level_positions() lists the
+//    nodes grouped by level, with level_offsets() in CSR form.
+//  - parents: parent_elements() lists, for every node in CSR form by
+//    parent_offsets(), the element slots that use it as a prime or a sub;
+//    element_owners() maps a slot to its decision node.
+//  - variable leaves: the literal and top nodes of every variable, in CSR
+//    form by variable_leaf_offsets().
+class CompiledPsdd {
+public:
+  explicit CompiledPsdd(PsddNode *root_node);
+  uint32_t node_size() const;
+  uint32_t root_position() const;
+  // the largest variable index appearing in the circuit plus one.
+  uint32_t variable_size() const;
+  int node_type(uint32_t position) const;
+  // For literal nodes, the literal. For top nodes, the variable index. 0 for
+  // decision nodes.
+  int32_t literal(uint32_t position) const;
+  uint32_t variable_index(uint32_t position) const;
+  const std::vector<uint8_t> &node_types() const;
+  const std::vector<int32_t> &literals() const;
+  const std::vector<uintmax_t> &element_offsets() const;
+  const std::vector<uint32_t> &primes() const;
+  const std::vector<uint32_t> &subs() const;
+  const std::vector<PsddParameter> &parameters() const;
+  uint32_t level_size() const;
+  const std::vector<uint32_t> &level_offsets() const;
+  const std::vector<uint32_t> &level_positions() const;
+  const std::vector<uintmax_t> &parent_offsets() const;
+  const std::vector<uintmax_t> &parent_elements() const;
+  const std::vector<uint32_t> &element_owners() const;
+  const std::vector<uint32_t> &variable_leaf_offsets() const;
+  const std::vector<uint32_t> &variable_leaves() const;
+
+private:
+  void BuildSchedules();
+  std::vector<uint8_t> node_types_;
+  std::vector<int32_t> literals_;
+  std::vector<uintmax_t> element_offsets_;
+  std::vector<uint32_t> primes_;
+  std::vector<uint32_t> subs_;
+  std::vector<PsddParameter> parameters_;
+  uint32_t variable_size_;
+  std::vector<uint32_t> level_offsets_;
+  std::vector<uint32_t> level_positions_;
+  std::vector<uintmax_t> parent_offsets_;
+  std::vector<uintmax_t> parent_elements_;
+  std::vector<uint32_t> element_owners_;
+  std::vector<uint32_t> variable_leaf_offsets_;
+  std::vector<uint32_t> variable_leaves_;
+};
+
+// Each query has an overload taking a QueryWorkspace, which holds the scratch
+// buffers so repeated queries do not allocate. Evaluate and GetMarginals also
+// take a LogSumAccuracy; the overloads without one are exact.
+namespace psdd_node_util {
+std::pair<std::bitset<MAX_VAR>, Probability>
+GetMPESolution(const CompiledPsdd &compiled_psdd);
+std::pair<std::bitset<MAX_VAR>, Probability>
+GetMPESolution(const CompiledPsdd &compiled_psdd, QueryWorkspace *workspace);
+mpz_class ModelCount(const CompiledPsdd &compiled_psdd);
+mpz_class ModelCount(const CompiledPsdd &compiled_psdd,
+                     QueryWorkspace *workspace);
+Probability Evaluate(const std::bitset<MAX_VAR> &variables,
+                     const std::bitset<MAX_VAR> &instantiation,
+                     const CompiledPsdd &compiled_psdd);
+Probability Evaluate(const std::bitset<MAX_VAR> &variables,
+                     const std::bitset<MAX_VAR> &instantiation,
+                     const CompiledPsdd &compiled_psdd,
+                     QueryWorkspace *workspace);
+Probability Evaluate(const std::bitset<MAX_VAR> &variables,
+                     const std::bitset<MAX_VAR> &instantiation,
+                     const CompiledPsdd &compiled_psdd,
+                     QueryWorkspace *workspace, LogSumAccuracy accuracy);
+bool IsConsistent(const CompiledPsdd &compiled_psdd,
+                  const std::bitset<MAX_VAR> &variable_mask,
+                  const std::bitset<MAX_VAR> &partial_instantiation);
+bool IsConsistent(const CompiledPsdd &compiled_psdd,
+                  const std::bitset<MAX_VAR> &variable_mask,
+                  const std::bitset<MAX_VAR> &partial_instantiation,
+                  QueryWorkspace *workspace);
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd);
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd, QueryWorkspace *workspace);
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd, QueryWorkspace *workspace,
+             LogSumAccuracy accuracy);
+// Computes the derivatives level by level from the root, pulling from the
+// parents of every node, with the nodes of a level and then the variables
+// split across thread_pool.
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd, ThreadPool *thread_pool);
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd, ThreadPool *thread_pool,
+             LogSumAccuracy accuracy);
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd, ThreadPool *thread_pool,
+             QueryWorkspace *workspace, LogSumAccuracy accuracy);
+} // namespace psdd_node_util
+
+#endif // PSDD_COMPILED_PSDD_H
@@ -0,0 +1,67 @@
+#ifndef PSDD_INFERENCE_SESSION_H
+#define PSDD_INFERENCE_SESSION_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <psdd/compiled_psdd.h>
+#include <psdd/psdd_parameter.h>
+
+// Marginal queries under evidence that changes one observation at a time.
+// The session keeps the value of every node under the current evidence and
+// the derivative of the root with respect to every node. Observe and Retract
+// recompute only the ancestors whose value actually changes; Marginals then
+// recomputes only the derivatives that depend on a changed value, and the
+// marginals of the variables whose leaves were touched. Results are
+// identical to recomputing everything from scratch.
+class InferenceSession {
+public:
+  explicit InferenceSession(PsddNode *root_node);
+  const CompiledPsdd &compiled_psdd() const;
+  // literal is variable_index for true and -variable_index for false. It
+  // replaces any earlier observation of the same variable.
+  void Observe(int32_t literal);
+  void Retract(uint32_t variable_index);
+  // The observed literal of variable_index, or 0 if it is not observed.
+  int32_t observation(uint32_t variable_index) const;
+  // Probability of the current evidence.
+  Probability EvidenceProbability() const;
+  // Posterior marginals of every variable in the PSDD, first is false and
+  // second is true. All pairs are zero if the evidence has zero
+  // probability.
+  std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+  Marginals();
+  // The number of node values or derivatives recomputed by the last call to
+  // Observe, Retract or Marginals.
+  uintmax_t last_recomputed_size() const;
+
+private:
+  double LeafValue(uint32_t position) const;
+  double DecisionValue(uint32_t position) const;
+  double Derivative(uint32_t position) const;
+  std::pair<Probability, Probability>
+  VariableMarginal(uint32_t variable_index) const;
+  // Recomputes the leaves of variable_index and every ancestor whose value
+  // changes as a result.
+  void PropagateValues(uint32_t variable_index);
+  // Recomputes the derivatives that depend on values changed since the last
+  // call.
+  void PropagateDerivatives();
+  CompiledPsdd compiled_psdd_;
+  std::vector<int32_t> observations_;
+  std::vector<double> values_;
+  std::vector<double> derivatives_;
+  std::vector<std::pair<Probability, Probability>> variable_marginals_;
+  // Nodes whose value changed since derivatives_ was last brought up to
+  // date, and variables whose marginal must be recomputed.
+  std::vector<uint32_t> changed_value_positions_;
+  std::vector<uint8_t> dirty_variables_;
+  std::vector<uint32_t> dirty_variable_list_;
+  // Scratch flags for the worklists.
+  std::vector<uint8_t> queued_;
+  uintmax_t last_recomputed_size_;
+};
+
+#endif // PSDD_INFERENCE_SESSION_H
@@ -0,0 +1,42 @@
+#ifndef PSDD_LEARNING_WORKSPACE_H
+#define PSDD_LEARNING_WORKSPACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One bit per example.
+using BatchedPsddValue = std::vector<bool>;
+
+// Per-node buffers for PsddManager::LearnPsddParameters, indexed by the
+// position of the node in the serialized PSDD, and the data counts the job
+// collects. Keeping them here instead of in the nodes leaves nodes that are
+// only used for inference without them, and lets each learning job bring its
+// own. Buffers only grow, so a caller
+// that keeps one workspace alive across jobs does no allocation after the
+// first job. A workspace must not be used by two jobs at the same time.
+class LearningWorkspace {
+public:
+  LearningWorkspace() = default;
+  // Each accessor returns at least node_size buffers, the first node_size of
+  // which hold data_size entries. The entries of MutableValues are left over
+  // from the previous job.
+  std::vector<BatchedPsddValue> *MutableValues(size_t node_size,
+                                               size_t data_size);
+  // All entries are reset to false.
+  std::vector<BatchedPsddValue> *MutableContextValues(size_t node_size,
+                                                      size_t data_size);
+  // Returns a buffer holding at least size entries, left over from the
+  // previous job.
+  std::vector<size_t> *MutableCountOffsets(size_t size);
+  // All entries are reset to 0.
+  std::vector<uintmax_t> *MutableDataCounts(size_t size);
+
+private:
+  std::vector<BatchedPsddValue> values_;
+  std::vector<BatchedPsddValue> context_values_;
+  std::vector<size_t> count_offsets_;
+  std::vector<uintmax_t> data_counts_;
+};
+
+#endif // PSDD_LEARNING_WORKSPACE_H
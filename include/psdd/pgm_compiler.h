@@ -3,6 +3,7 @@
 #include <string>
 
 #include "psdd/psdd_manager.h"
+#include "psdd/thread_pool.h"
 #include "psdd/uai_network.h"
 
 #define VTREE_METHOD_MINFILL 4
@@ -16,15 +17,21 @@ class PgmCompiler {
   void init_psdd_manager_from_vtree(const char *vtree_fname);
   void read_uai_file(const char *uai_file);
   PsddManager *psdd_manager() const;
+  // compile_network_dc multiplies on the workers of thread_pool if it is
+  // not nullptr. By default there is none and it multiplies sequentially.
+  void set_thread_pool(ThreadPool *thread_pool);
   std::pair<PsddNode *, PsddParameter> compile_factor(size_t factor_index);
   std::pair<PsddNode *, PsddParameter> compile_network(size_t gc_freq);
   std::pair<PsddNode *, PsddParameter> compile_network_with_vtree(
       size_t gc_freq);
-  std::pair<PsddNode *, PsddParameter> compile_network_dc(size_t gc_freq);
+  // Intermediate results are reference counted and freed as soon as they
+  // are used up. The result is null if the network has no models.
+  std::pair<PsddRef, PsddParameter> compile_network_dc();
 
  private:
   UaiNetwork *m_network;
   PsddManager *m_pm;
+  ThreadPool *m_thread_pool;
   std::string working_dir_;
 };
 
@@ -0,0 +1,98 @@
+#ifndef PSDD_PSDD_COMPUTED_TABLE_H
+#define PSDD_PSDD_COMPUTED_TABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include <psdd/psdd_node.h>
+#include <psdd/psdd_parameter.h>
+
+class PsddNodeArena;
+
+// Lookups of a computed table so far. A stale lookup found its operands but
+// the product, or a node under it, might have been freed since, and counts as
+// a miss.
+struct PsddComputedTableStats {
+  size_t entry_size = 0;
+  size_t lookup_size = 0;
+  size_t hit_size = 0;
+  size_t stale_size = 0;
+  double hit_rate() const;
+};
+
+// Products of decision nodes that outlive the Multiply call that computed
+// them, like the computed table of CUDD. The table is direct-mapped and
+// lossy: each pair of operands has one entry, and a new product overwrites
+// whatever was there. Operands are identified by address and node index, so
+// an entry can never answer for a node that reuses a freed one's storage.
+// Products are checked against the arena on lookup, which lets reference
+// counting free them without touching the table. Freeing a live node can
+// also leave a product that was never live with a dangling descendant, so
+// each entry records the release generation it was inserted in, and a
+// product that is not live now is only returned if no live node has been
+// freed since. A live product needs no such check, as everything under it
+// is live too. The bulk deletes of the manager clear the table instead. Safe
+// to call from several threads at once, except for Clear and
+// AdvanceGeneration.
+class PsddComputedTable {
+public:
+  // entry_size must be a power of two. The entries are allocated on first
+  // use, so a manager that never multiplies does not pay for them.
+  PsddComputedTable(const PsddNodeArena *node_arena, size_t entry_size);
+  PsddComputedTable(const PsddComputedTable &) = delete;
+  PsddComputedTable &operator=(const PsddComputedTable &) = delete;
+  // Returns whether the product of first and second under flag_index was
+  // found. If so, *product and *partition are set to what InsertProduct was
+  // given, where a null product is the product of contradicting operands.
+  bool FindProduct(const PsddNode *first, const PsddNode *second,
+                   uintmax_t flag_index, LogSumAccuracy accuracy,
+                   PsddDecisionNode **product, PsddParameter *partition);
+  void InsertProduct(const PsddNode *first, const PsddNode *second,
+                     uintmax_t flag_index, LogSumAccuracy accuracy,
+                     PsddDecisionNode *product, PsddParameter partition);
+  PsddComputedTableStats stats() const;
+  // Drops every entry, keeping the lookup counts. Must not run concurrently
+  // with any other call.
+  void Clear();
+  // Called after live nodes have been freed, which makes the products found
+  // later check that they are live. Must not run concurrently with any other
+  // call.
+  void AdvanceGeneration();
+
+private:
+  struct Entry {
+    const PsddNode *first = nullptr;
+    const PsddNode *second = nullptr;
+    uintmax_t first_index = 0;
+    uintmax_t second_index = 0;
+    uintmax_t flag_index = 0;
+    LogSumAccuracy accuracy = EXACT_LOG_SUM;
+    PsddDecisionNode *product = nullptr;
+    uintmax_t product_index = 0;
+    uint64_t generation = 0;
+    PsddParameter partition;
+  };
+  // Entries are guarded by the lock of their stripe, which also keeps the
+  // lookup counts of those entries.
+  struct Stripe {
+    std::mutex mutex;
+    size_t lookup_size = 0;
+    size_t hit_size = 0;
+    size_t stale_size = 0;
+  };
+  static const size_t kStripeSize = 64;
+  size_t EntryIndex(const PsddNode *first, const PsddNode *second,
+                    uintmax_t flag_index, LogSumAccuracy accuracy) const;
+  void AllocateEntries();
+  const PsddNodeArena *node_arena_;
+  size_t entry_size_;
+  std::once_flag allocate_flag_;
+  std::atomic<uint64_t> generation_;
+  std::unique_ptr<Entry[]> entries_;
+  std::unique_ptr<Stripe[]> stripes_;
+};
+
+#endif // PSDD_PSDD_COMPUTED_TABLE_H
@@ -4,12 +4,26 @@
 
 #ifndef PSDD_PSDD_MANAGER_H
 #define PSDD_PSDD_MANAGER_H
+#include <atomic>
+
+#include <psdd/psdd_computed_table.h>
 #include <psdd/psdd_node.h>
+#include <psdd/psdd_node_arena.h>
+#include <psdd/psdd_ref.h>
 #include <psdd/psdd_unique_table.h>
 extern "C" {
 #include <sdd/sddapi.h>
 };
 
+class ThreadPool;
+
+// Nodes may be built from several threads at once, for example by
+// concurrent calls to Multiply. Calls that annotate their inputs must not
+// share them with a concurrent call. ConvertSddToPsdd and FromSdd tag the SDD
+// vtree, and LoadPsddNode, SampleParameters and LearnPsddParameters set the
+// user data of the input nodes. Deleting nodes, whether through
+// DeleteUnusedPsddNodes or by reference counting, must not overlap with
+// anything else on the manager.
 class PsddManager {
 public:
   static PsddManager *GetPsddManagerFromSddVtree(
@@ -17,7 +31,21 @@ public:
       const std::unordered_map<uint32_t, uint32_t> &variable_mapping);
   static PsddManager *GetPsddManagerFromVtree(Vtree *psdd_vtree);
   ~PsddManager();
-  void DeleteUnusedPsddNodes(const std::vector<PsddNode *> &used_nodes);
+  // Frees every node not reachable from used_nodes and returns the number of
+  // bytes reclaimed. Pointers to the freed nodes must not be used afterwards.
+  size_t DeleteUnusedPsddNodes(const std::vector<PsddNode *> &used_nodes);
+  // Frees the nodes created since next_node_index returned first_node_index
+  // that have no references, and returns the number of bytes reclaimed.
+  // Unreferenced nodes created since must not be held elsewhere, but older
+  // nodes are left alone.
+  size_t DeleteUnreferencedPsddNodes(uintmax_t first_node_index);
+  // The index of the next node to be created. Every node created later has
+  // an index at least as large.
+  uintmax_t next_node_index() const;
+  // Reference counting behind PsddRef; see psdd_ref.h. DerefPsddNode returns
+  // the number of bytes reclaimed.
+  void RefPsddNode(PsddNode *node);
+  size_t DerefPsddNode(PsddNode *node);
   PsddNode *ConvertSddToPsdd(SddNode *root_node, Vtree *sdd_vtree,
                              uintmax_t flag_index);
   // variable_mapping : key is the sdd literal in the root_node, and the
@@ -35,6 +63,14 @@ public:
                                const std::vector<PsddNode *> &subs,
                                const std::vector<PsddParameter> &params,
                                uintmax_t flag_index);
+  // Keeps the true nodes built to conform primes and subs in true_node_map,
+  // keyed by vtree position, and reuses the ones already there. All of them
+  // must have flag_index.
+  PsddDecisionNode *GetConformedPsddDecisionNode(
+      const std::vector<PsddNode *> &primes,
+      const std::vector<PsddNode *> &subs,
+      const std::vector<PsddParameter> &params, uintmax_t flag_index,
+      std::unordered_map<SddLiteral, PsddNode *> *true_node_map);
   PsddLiteralNode *GetPsddLiteralNode(int32_t literal, uintmax_t flag_index);
   PsddNode *NormalizePsddNode(Vtree *target_vtree_node,
                               PsddNode *target_psdd_node, uintmax_t flag_index);
@@ -43,10 +79,56 @@ public:
   PsddNode *LoadPsddNode(Vtree *target_vtree, PsddNode *root_psdd_node,
                          uintmax_t flag_index);
   // arguments assumed to conformed to the same vtree as the one used by this
-  // manager.
+  // manager. Products of decision nodes are kept in a bounded table across
+  // calls, so operands that share subcircuits with earlier ones reuse those
+  // products for as long as they are alive.
   std::pair<PsddNode *, PsddParameter> Multiply(PsddNode *arg1, PsddNode *arg2,
                                                 uintmax_t flag_index);
+  // Multiply with the given accuracy for the partitions that normalize the
+  // parameters of the product.
+  std::pair<PsddNode *, PsddParameter> Multiply(PsddNode *arg1, PsddNode *arg2,
+                                                uintmax_t flag_index,
+                                                LogSumAccuracy accuracy);
+  // Multiply on referenced arguments. The nodes built for partial products
+  // that do not end up in the result are freed before returning.
+  std::pair<PsddRef, PsddParameter> Multiply(const PsddRef &arg1,
+                                             const PsddRef &arg2,
+                                             uintmax_t flag_index);
+  std::pair<PsddRef, PsddParameter> Multiply(const PsddRef &arg1,
+                                             const PsddRef &arg2,
+                                             uintmax_t flag_index,
+                                             LogSumAccuracy accuracy);
+  // Multiply on the workers of thread_pool, which must not be running
+  // anything else. The element pairs of large decision nodes are multiplied
+  // as separate tasks, and the product is the same as that of Multiply.
+  std::pair<PsddNode *, PsddParameter>
+  ParallelMultiply(PsddNode *arg1, PsddNode *arg2, uintmax_t flag_index,
+                   ThreadPool *thread_pool);
+  std::pair<PsddRef, PsddParameter> ParallelMultiply(const PsddRef &arg1,
+                                                     const PsddRef &arg2,
+                                                     uintmax_t flag_index,
+                                                     ThreadPool *thread_pool);
+  // ParallelMultiply with the given accuracy, as for Multiply.
+  std::pair<PsddNode *, PsddParameter>
+  ParallelMultiply(PsddNode *arg1, PsddNode *arg2, uintmax_t flag_index,
+                   LogSumAccuracy accuracy, ThreadPool *thread_pool);
+  std::pair<PsddRef, PsddParameter>
+  ParallelMultiply(const PsddRef &arg1, const PsddRef &arg2,
+                   uintmax_t flag_index, LogSumAccuracy accuracy,
+                   ThreadPool *thread_pool);
   Vtree *vtree() const;
+  PsddUniqueTableStats unique_table_stats() const;
+  PsddComputedTableStats computed_table_stats() const;
+  // Each Multiply call caches its products in a table of at most
+  // entry_size entries, a power of two, overwriting old products once the
+  // table is full. Must not be changed during a Multiply. The bound does not
+  // cover the list of created products that Multiply on PsddRefs keeps to
+  // free its garbage, which takes a pointer per product, or the true nodes
+  // it uses, at most one per vtree node.
+  void set_multiply_cache_size(size_t entry_size);
+  // The most memory the cache of any Multiply call has taken, in bytes,
+  // counting the table, the created products and the true nodes.
+  size_t multiply_cache_memory_size() const;
   PsddNode *ReadPsddFile(const char *psdd_filename, uintmax_t flag_index);
   std::vector<PsddNode *> SampleParametersForMultiplePsdds(
       RandomDoubleGenerator *generator,
@@ -57,9 +139,27 @@ public:
       PsddNode *target_structure,
       const std::unordered_map<int32_t, BatchedPsddValue> &examples,
       size_t data_size, PsddParameter alpha, uintmax_t flag_index);
+  // Keeps the per-node learning state in workspace, which can be reused
+  // across calls.
+  PsddNode *LearnPsddParameters(
+      PsddNode *target_structure,
+      const std::unordered_map<int32_t, BatchedPsddValue> &examples,
+      size_t data_size, PsddParameter alpha, uintmax_t flag_index,
+      LearningWorkspace *workspace);
 
 private:
-  PsddManager(Vtree *vtree, PsddUniqueTable *unique_table);
+  explicit PsddManager(Vtree *vtree);
+  uintmax_t NewNodeIndex();
+  void RecordMultiplyCacheMemory(size_t memory_size);
+  // Return the node with the given fields, creating it only if the unique
+  // table does not have it yet.
+  PsddLiteralNode *GetUniqueLiteralNode(Vtree *vtree_node,
+                                        uintmax_t flag_index, int32_t literal);
+  PsddDecisionNode *
+  GetUniqueDecisionNode(Vtree *vtree_node, uintmax_t flag_index,
+                        const std::vector<PsddNode *> &primes,
+                        const std::vector<PsddNode *> &subs,
+                        const std::vector<PsddParameter> &parameters);
   PsddNode *
   GetTrueNode(Vtree *target_vtree_node, uintmax_t flag_index,
               std::unordered_map<SddLiteral, PsddNode *> *true_node_map);
@@ -68,8 +168,16 @@ private:
                     uintmax_t flag_index,
                     std::unordered_map<SddLiteral, PsddNode *> *true_node_map);
   Vtree *vtree_;
+  // Owns every node of this manager; declared before unique_table_, which
+  // hands duplicates back to it.
+  PsddNodeArena node_arena_;
   PsddUniqueTable *unique_table_;
-  uintmax_t node_index_;
+  PsddComputedTable computed_table_;
+  // Every node gets a fresh index when it is created, including the ones
+  // the unique table then rejects as duplicates, so indices have gaps.
+  std::atomic<uintmax_t> node_index_;
+  size_t multiply_cache_size_;
+  std::atomic<size_t> multiply_cache_memory_size_;
   std::unordered_map<uint32_t, Vtree *>
       leaf_vtree_map_; // keys are variable index
 };
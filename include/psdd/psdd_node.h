@@ -5,7 +5,10 @@
 #ifndef STRUCTURED_BAYESIAN_NETWORK_PSDD_NODE_H
 #define STRUCTURED_BAYESIAN_NETWORK_PSDD_NODE_H
 
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
+#include <memory_resource>
 #include <random>
 #include <unordered_map>
 #include <utility>
@@ -15,7 +18,9 @@ extern "C" {
 };
 #include <gmpxx.h>
 #include <psdd/binary_data.h>
+#include <psdd/learning_workspace.h>
 #include <psdd/psdd_parameter.h>
+#include <psdd/query_workspace.h>
 #include <psdd/random_double_generator.h>
 #include <unordered_set>
 
@@ -23,25 +28,85 @@ extern "C" {
 #define DECISION_NODE_TYPE 2
 #define TOP_NODE_TYPE 3
 
-using BatchedPsddValue = std::vector<bool>;
+class PsddNode;
 class PsddTopNode;
 class PsddLiteralNode;
 class PsddDecisionNode;
 
+// An element of a decision node. The elements of a node are stored together,
+// so a traversal touches one cache line per element.
+struct PsddElement {
+  PsddNode *prime;
+  PsddNode *sub;
+  PsddParameter parameter;
+};
+
+// Read-only view of one field across the elements of a decision node. It
+// indexes and iterates like a const std::vector of the field, and is valid
+// as long as the node is.
+template <typename T, T PsddElement::*Field> class PsddElementFieldView {
+public:
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+    explicit const_iterator(const PsddElement *element) : element_(element) {}
+    reference operator*() const { return element_->*Field; }
+    const_iterator &operator++() {
+      ++element_;
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator result = *this;
+      ++element_;
+      return result;
+    }
+    bool operator==(const const_iterator &other) const {
+      return element_ == other.element_;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return element_ != other.element_;
+    }
+
+  private:
+    const PsddElement *element_;
+  };
+  PsddElementFieldView(const PsddElement *elements, size_t size)
+      : elements_(elements), size_(size) {}
+  const T &operator[](size_t index) const { return elements_[index].*Field; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const_iterator begin() const { return const_iterator(elements_); }
+  const_iterator end() const { return const_iterator(elements_ + size_); }
+
+private:
+  const PsddElement *elements_;
+  size_t size_;
+};
+
+using PsddPrimeView = PsddElementFieldView<PsddNode *, &PsddElement::prime>;
+using PsddSubView = PsddElementFieldView<PsddNode *, &PsddElement::sub>;
+using PsddParameterView =
+    PsddElementFieldView<PsddParameter, &PsddElement::parameter>;
+
+// The node types are told apart by a tag in the base instead of virtual
+// functions, so visiting a node costs no indirect call. The downcasts return
+// nullptr for a node of another type.
 class PsddNode {
 public:
-  PsddNode(uintmax_t node_index, Vtree *vtree_node, uintmax_t flag_index);
-  PsddNode(uintmax_t node_index, Vtree *vtree_node);
-  virtual ~PsddNode() = default;
-  virtual int node_type() const = 0; // 1 is literal node, 2 is decision node, 3
-                                     // is top node with variable index
+  int node_type() const { return node_type_; } // 1 is literal node, 2 is
+                                               // decision node, 3 is top node
+                                               // with variable index
   uintmax_t node_index() const;
   uintmax_t flag_index() const;
-  virtual PsddTopNode *psdd_top_node() { return nullptr; }
-  virtual PsddDecisionNode *psdd_decision_node() { return nullptr; }
-  virtual PsddLiteralNode *psdd_literal_node() { return nullptr; }
-  virtual bool IsConsistent(const std::unordered_map<uint32_t, bool>
-                                &partial_instantiation) const = 0;
+  PsddTopNode *psdd_top_node();
+  PsddDecisionNode *psdd_decision_node();
+  PsddLiteralNode *psdd_literal_node();
+  bool IsConsistent(
+      const std::unordered_map<uint32_t, bool> &partial_instantiation) const;
   bool IsConsistent(const std::bitset<MAX_VAR> &instantiation,
                     uint32_t variable_size);
   std::size_t hash_value() const;
@@ -51,27 +116,19 @@ public:
   bool activation_flag() const;
   void SetActivationFlag();
   void ResetActivationFlag();
-  virtual void ResetDataCount() = 0;
-  virtual void DirectSample(std::bitset<MAX_VAR> *instantiation,
-                            RandomDoubleFromUniformGenerator *generator) = 0;
-  void SetBatchedPsddValue(BatchedPsddValue value) {
-    batched_psdd_value_ = std::move(value);
-  }
-  const BatchedPsddValue &batched_psdd_value() const {
-    return batched_psdd_value_;
-  }
-  BatchedPsddValue *MutableBatchedPsddValue() { return &batched_psdd_value_; }
-  void SetBatchedPsddContextValue(BatchedPsddValue context_value) {
-    batched_psdd_context_value_ = std::move(context_value);
-  }
-  const BatchedPsddValue &batched_psdd_context_value() const {
-    return batched_psdd_context_value_;
-  }
-  BatchedPsddValue *MutableBatchedPsddContextValue() {
-    return &batched_psdd_context_value_;
-  }
+  // Number of PsddRef handles and live parents holding this node. Only
+  // PsddManager changes it.
+  uint32_t ref_count() const;
+  void IncreaseRefCount();
+  void DecreaseRefCount();
+  void DirectSample(std::bitset<MAX_VAR> *instantiation,
+                    RandomDoubleFromUniformGenerator *generator);
 
 protected:
+  PsddNode(int node_type, uintmax_t node_index, Vtree *vtree_node,
+           uintmax_t flag_index);
+  // Not virtual: nodes are destroyed as their own type, by the arena.
+  ~PsddNode() = default;
   void set_hash_value(std::size_t hash_value);
 
 private:
@@ -80,9 +137,9 @@ private:
   uintmax_t user_data_;
   uintmax_t flag_index_;
   std::size_t hash_value_;
+  uint32_t ref_count_;
+  uint8_t node_type_;
   bool activation_flag_;
-  BatchedPsddValue batched_psdd_value_;
-  BatchedPsddValue batched_psdd_context_value_;
 };
 
 class PsddLiteralNode : public PsddNode {
@@ -93,17 +150,16 @@ public:
                   uintmax_t flag_index, int32_t literal);
   PsddLiteralNode(uintmax_t *node_index, Vtree *vtree_node, int32_t literal);
   bool operator==(const PsddLiteralNode &other) const;
-  ~PsddLiteralNode() override = default;
-  int node_type() const override;
-  PsddLiteralNode *psdd_literal_node() override { return this; }
+  ~PsddLiteralNode() = default;
   bool IsConsistent(const std::unordered_map<uint32_t, bool>
-                        &partial_instantiation) const override;
+                        &partial_instantiation) const;
   bool sign() const;
   uint32_t variable_index() const;
   int32_t literal() const;
-  void ResetDataCount() override;
   void DirectSample(std::bitset<MAX_VAR> *instantiation,
-                    RandomDoubleFromUniformGenerator *generator) override;
+                    RandomDoubleFromUniformGenerator *generator);
+  // The hash_value() of a node with these fields.
+  static std::size_t HashValue(uintmax_t flag_index, int32_t literal);
 
 private:
   void CalculateHashValue();
@@ -116,6 +172,18 @@ public:
                    uintmax_t flag_index, const std::vector<PsddNode *> &primes,
                    const std::vector<PsddNode *> &subs,
                    const std::vector<PsddParameter> &parameters);
+  // The elements are allocated from element_resource, which must outlive the
+  // node.
+  PsddDecisionNode(uintmax_t node_index, Vtree *vtree_node,
+                   uintmax_t flag_index, const std::vector<PsddNode *> &primes,
+                   const std::vector<PsddNode *> &subs,
+                   const std::vector<PsddParameter> &parameters,
+                   std::pmr::memory_resource *element_resource);
+  // elements must already be sorted by the node index of their primes.
+  PsddDecisionNode(uintmax_t node_index, Vtree *vtree_node,
+                   uintmax_t flag_index,
+                   const std::vector<PsddElement> &elements,
+                   std::pmr::memory_resource *element_resource);
   PsddDecisionNode(uintmax_t *node_index, Vtree *vtree_node,
                    uintmax_t flag_index, const std::vector<PsddNode *> &primes,
                    const std::vector<PsddNode *> &subs,
@@ -127,26 +195,25 @@ public:
                    const std::vector<PsddNode *> &primes,
                    const std::vector<PsddNode *> &subs);
   bool operator==(const PsddDecisionNode &other) const;
-  ~PsddDecisionNode() override = default;
-  int node_type() const override;
-  PsddDecisionNode *psdd_decision_node() override { return this; }
+  ~PsddDecisionNode() = default;
   bool IsConsistent(const std::unordered_map<uint32_t, bool>
-                        &partial_instantiation) const override;
-  const std::vector<PsddNode *> &primes() const;
-  const std::vector<PsddNode *> &subs() const;
-  const std::vector<PsddParameter> &parameters() const;
-  void IncrementDataCount(uintmax_t index, uintmax_t increment_size);
-  void ResetDataCount() override;
+                        &partial_instantiation) const;
+  // Elements are sorted by the node index of their primes.
+  const std::pmr::vector<PsddElement> &elements() const;
+  PsddPrimeView primes() const;
+  PsddSubView subs() const;
+  PsddParameterView parameters() const;
   void DirectSample(std::bitset<MAX_VAR> *instantiation,
-                    RandomDoubleFromUniformGenerator *generator) override;
-  const std::vector<uintmax_t> &data_counts() const;
+                    RandomDoubleFromUniformGenerator *generator);
+  // The hash_value() of a node with these fields, for elements sorted like
+  // elements().
+  static std::size_t HashValue(uintmax_t flag_index,
+                               const PsddElement *elements,
+                               size_t element_size);
 
 private:
   void CalculateHashValue();
-  std::vector<PsddNode *> primes_;
-  std::vector<PsddNode *> subs_;
-  std::vector<PsddParameter> parameters_;
-  std::vector<uintmax_t> data_counts_;
+  std::pmr::vector<PsddElement> elements_;
 };
 
 class PsddTopNode : public PsddNode {
@@ -159,31 +226,41 @@ public:
   PsddTopNode(uintmax_t *node_index, Vtree *vtree_node,
               uint32_t variable_index);
   bool operator==(const PsddTopNode &other) const;
-  ~PsddTopNode() override = default;
-  int node_type() const override;
+  ~PsddTopNode() = default;
   PsddParameter true_parameter() const;
   PsddParameter false_parameter() const;
-  PsddTopNode *psdd_top_node() override { return this; }
   bool IsConsistent(const std::unordered_map<uint32_t, bool>
-                        &partial_instantiation) const override;
+                        &partial_instantiation) const;
   uint32_t variable_index() const;
-  void IncrementTrueDataCount(uintmax_t increment_size);
-  void IncrementFalseDataCount(uintmax_t increment_size);
-  void ResetDataCount() override;
   void DirectSample(std::bitset<MAX_VAR> *instantiation,
-                    RandomDoubleFromUniformGenerator *generator) override;
-  uintmax_t true_data_count() const;
-  uintmax_t false_data_count() const;
+                    RandomDoubleFromUniformGenerator *generator);
+  // The hash_value() of a node with these fields.
+  static std::size_t HashValue(uintmax_t flag_index, uint32_t variable_index,
+                               PsddParameter true_parameter);
 
 private:
   void CalculateHashValue();
   uint32_t variable_index_;
   PsddParameter true_parameter_;
   PsddParameter false_parameter_;
-  uintmax_t true_data_count_;
-  uintmax_t false_data_count_;
 };
 
+inline PsddTopNode *PsddNode::psdd_top_node() {
+  return node_type_ == TOP_NODE_TYPE ? static_cast<PsddTopNode *>(this)
+                                     : nullptr;
+}
+
+inline PsddDecisionNode *PsddNode::psdd_decision_node() {
+  return node_type_ == DECISION_NODE_TYPE
+             ? static_cast<PsddDecisionNode *>(this)
+             : nullptr;
+}
+
+inline PsddLiteralNode *PsddNode::psdd_literal_node() {
+  return node_type_ == LITERAL_NODE_TYPE ? static_cast<PsddLiteralNode *>(this)
+                                         : nullptr;
+}
+
 namespace vtree_util {
 std::vector<Vtree *> SerializeVtree(Vtree *root);
 Vtree *CopyVtree(Vtree *root);
@@ -199,6 +276,13 @@ std::vector<SddLiteral> LeftToRightLeafTraverse(Vtree *root);
 } // namespace vtree_util
 
 namespace psdd_node_util {
+// Dispatch on the type tag of node to the IsConsistent and DirectSample of
+// its type.
+bool IsConsistent(
+    const PsddNode *node,
+    const std::unordered_map<uint32_t, bool> &partial_instantiation);
+void DirectSample(PsddNode *node, std::bitset<MAX_VAR> *instantiation,
+                  RandomDoubleFromUniformGenerator *generator);
 std::vector<PsddNode *> SerializePsddNodes(PsddNode *root);
 std::vector<PsddNode *>
 SerializePsddNodes(const std::vector<PsddNode *> &root_nodes);
@@ -209,11 +293,20 @@ void SetActivationFlag(const std::bitset<MAX_VAR> &evidence,
 std::pair<std::bitset<MAX_VAR>, Probability>
 GetMPESolution(const std::vector<PsddNode *> &serialized_psdd_nodes);
 std::pair<std::bitset<MAX_VAR>, Probability>
+GetMPESolution(const std::vector<PsddNode *> &serialized_psdd_nodes,
+               QueryWorkspace *workspace);
+std::pair<std::bitset<MAX_VAR>, Probability>
 GetMPESolution(PsddNode *psdd_node);
 mpz_class ModelCount(const std::vector<PsddNode *> &serialized_nodes);
+mpz_class ModelCount(const std::vector<PsddNode *> &serialized_nodes,
+                     QueryWorkspace *workspace);
 Probability Evaluate(const std::bitset<MAX_VAR> &variables,
                      const std::bitset<MAX_VAR> &instantiation,
                      const std::vector<PsddNode *> &serialized_nodes);
+Probability Evaluate(const std::bitset<MAX_VAR> &variables,
+                     const std::bitset<MAX_VAR> &instantiation,
+                     const std::vector<PsddNode *> &serialized_nodes,
+                     QueryWorkspace *workspace);
 Probability Evaluate(const std::bitset<MAX_VAR> &variables,
                      const std::bitset<MAX_VAR> &instantiation,
                      PsddNode *root_node);
@@ -232,6 +325,9 @@ void WritePsddToFile(PsddNode *root_node, const char *output_filename);
 
 std::unordered_map<uint32_t, std::pair<Probability, Probability>>
 GetMarginals(const std::vector<PsddNode *> &serialized_nodes);
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const std::vector<PsddNode *> &serialized_nodes,
+             QueryWorkspace *workspace);
 
 uintmax_t GetPsddSize(PsddNode *root_node);
 
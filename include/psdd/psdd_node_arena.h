@@ -0,0 +1,171 @@
+#ifndef PSDD_PSDD_NODE_ARENA_H
+#define PSDD_PSDD_NODE_ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <limits>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <psdd/psdd_node.h>
+
+// Fixed-size slots for nodes of one type, carved out of slabs that grow
+// geometrically. Each slot starts with a header that links it into the free
+// list while it is empty and records the index of the node it holds, so the
+// nodes still alive when the slab goes away can be destroyed without a
+// registry. The header also names the shard of the slab, so a node can be
+// deleted without knowing where it was created. Only Holds may be called
+// without the lock of the shard.
+template <typename Node> class PsddNodeSlab {
+public:
+  explicit PsddNodeSlab(uint32_t shard_index)
+      : slabs_(), free_slot_(nullptr), next_slab_size_(kFirstSlabSize),
+        live_size_(0), shard_index_(shard_index) {}
+  PsddNodeSlab(const PsddNodeSlab &) = delete;
+  PsddNodeSlab &operator=(const PsddNodeSlab &) = delete;
+  ~PsddNodeSlab() {
+    for (const auto &slab : slabs_) {
+      for (size_t i = 0; i < slab.second; ++i) {
+        if (slab.first[i].node_index.load() != kNoNode) {
+          reinterpret_cast<Node *>(slab.first[i].storage)->~Node();
+        }
+      }
+    }
+  }
+  template <typename... Args> Node *New(Args &&... args) {
+    if (free_slot_ == nullptr) {
+      Grow();
+    }
+    Slot *slot = free_slot_;
+    // The slot stays on the free list if the constructor throws.
+    auto node = new (slot->storage) Node(std::forward<Args>(args)...);
+    free_slot_ = slot->next_free;
+    slot->node_index.store(node->node_index(), std::memory_order_release);
+    ++live_size_;
+    return node;
+  }
+  // node must have been returned by New of this slab. Returns the size of the
+  // slot it frees.
+  size_t Delete(Node *node) {
+    Slot *slot = SlotOf(node);
+    slot->node_index.store(kNoNode, std::memory_order_release);
+    node->~Node();
+    slot->next_free = free_slot_;
+    free_slot_ = slot;
+    --live_size_;
+    return sizeof(Slot);
+  }
+  // Whether the slot of node, which New of some slab returned at some point,
+  // still holds the node with node_index rather than nothing or a later one.
+  // Reads only the slot header, so it never waits on a lock.
+  static bool Holds(const Node *node, uintmax_t node_index) {
+    return SlotOf(node)->node_index.load(std::memory_order_acquire) ==
+           node_index;
+  }
+  // The shard of the slab that node, returned by New of some slab, lives in.
+  static uint32_t ShardIndex(const Node *node) {
+    return SlotOf(node)->shard_index;
+  }
+  size_t live_size() const { return live_size_; }
+
+private:
+  static constexpr uintmax_t kNoNode = std::numeric_limits<uintmax_t>::max();
+  struct Slot {
+    Slot *next_free;
+    // kNoNode while the slot is empty.
+    std::atomic<uintmax_t> node_index;
+    uint32_t shard_index;
+    alignas(Node) unsigned char storage[sizeof(Node)];
+  };
+  static Slot *SlotOf(const Node *node) {
+    auto storage =
+        reinterpret_cast<unsigned char *>(const_cast<Node *>(node));
+    return reinterpret_cast<Slot *>(storage - offsetof(Slot, storage));
+  }
+  static const size_t kFirstSlabSize = 64;
+  static const size_t kMaxSlabSize = 4096;
+  void Grow() {
+    size_t slab_size = next_slab_size_;
+    std::unique_ptr<Slot[]> slab(new Slot[slab_size]);
+    // Linked back to front, so slots are handed out in address order.
+    for (size_t i = slab_size; i > 0; --i) {
+      slab[i - 1].node_index.store(kNoNode, std::memory_order_relaxed);
+      slab[i - 1].shard_index = shard_index_;
+      slab[i - 1].next_free = free_slot_;
+      free_slot_ = &slab[i - 1];
+    }
+    slabs_.emplace_back(std::move(slab), slab_size);
+    next_slab_size_ = std::min(2 * next_slab_size_, kMaxSlabSize);
+  }
+  std::vector<std::pair<std::unique_ptr<Slot[]>, size_t>> slabs_;
+  Slot *free_slot_;
+  size_t next_slab_size_;
+  size_t live_size_;
+  uint32_t shard_index_;
+};
+
+// Storage for the nodes of a PsddManager. Each node type has slabs of its
+// own, and the element arrays of decision nodes come from a pooled memory
+// resource, so building a PSDD does not call malloc per node or per element
+// array. Nodes that are never deleted are released with the arena. The slabs
+// and pools are split into shards with a lock each, and each thread creates
+// its nodes in a shard of its own, so threads building nodes at once seldom
+// wait on each other. A node is deleted in the shard it came from,
+// whichever thread deletes it.
+class PsddNodeArena {
+public:
+  PsddNodeArena();
+  PsddNodeArena(const PsddNodeArena &) = delete;
+  PsddNodeArena &operator=(const PsddNodeArena &) = delete;
+  PsddLiteralNode *NewLiteralNode(uintmax_t node_index, Vtree *vtree_node,
+                                  uintmax_t flag_index, int32_t literal);
+  PsddTopNode *NewTopNode(uintmax_t node_index, Vtree *vtree_node,
+                          uintmax_t flag_index, uint32_t variable_index,
+                          PsddParameter true_parameter,
+                          PsddParameter false_parameter);
+  PsddDecisionNode *NewDecisionNode(uintmax_t node_index, Vtree *vtree_node,
+                                    uintmax_t flag_index,
+                                    const std::vector<PsddNode *> &primes,
+                                    const std::vector<PsddNode *> &subs,
+                                    const std::vector<PsddParameter> &params);
+  // elements must already be sorted by the node index of their primes.
+  PsddDecisionNode *NewDecisionNode(uintmax_t node_index, Vtree *vtree_node,
+                                    uintmax_t flag_index,
+                                    const std::vector<PsddElement> &elements);
+  // Destroys node, which must come from this arena, and reuses its storage.
+  // Returns the number of bytes freed for reuse, counting its element array.
+  size_t DeleteNode(PsddNode *node);
+  // Whether node, a decision node this arena created at some point, is still
+  // alive as the node with node_index. Slabs are only released with the
+  // arena, so this is safe to ask after node has been deleted. Takes no lock.
+  bool HoldsDecisionNode(const PsddDecisionNode *node,
+                         uintmax_t node_index) const;
+  // Number of nodes created and not deleted.
+  size_t node_size() const;
+
+private:
+  struct Shard {
+    explicit Shard(uint32_t shard_index)
+        : mutex(), element_resource(), literal_nodes(shard_index),
+          top_nodes(shard_index), decision_nodes(shard_index) {}
+    mutable std::mutex mutex;
+    // Declared before the slabs so that it outlives the decision nodes using
+    // it.
+    std::pmr::unsynchronized_pool_resource element_resource;
+    PsddNodeSlab<PsddLiteralNode> literal_nodes;
+    PsddNodeSlab<PsddTopNode> top_nodes;
+    PsddNodeSlab<PsddDecisionNode> decision_nodes;
+  };
+  static const uint32_t kShardSize = 16;
+  // The shard the calling thread creates nodes in.
+  Shard &LocalShard();
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+#endif // PSDD_PSDD_NODE_ARENA_H
@@ -5,9 +5,33 @@
 #ifndef PSDD_PSDD_PARAMETER_HPP
 #define PSDD_PSDD_PARAMETER_HPP
 
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 
+// How a sum of two parameters, log(exp(a) + exp(b)), is computed.
+enum LogSumAccuracy {
+  // std::exp and std::log1p, as operator+ and operator+= do.
+  EXACT_LOG_SUM,
+  // FastLog1pExpNegative, within kFastLogSumError of the exact logarithm.
+  FAST_LOG_SUM
+};
+
+// Largest absolute error of FastLog1pExpNegative, and so of the logarithm of
+// a FAST_LOG_SUM sum. The relative error of the sum itself is about the same.
+const double kFastLogSumError = 1e-7;
+
+// Returns log1p(exp(-x)) for x >= 0 from a second order Taylor expansion
+// around the nearest of a table of points 1/32 apart, and 0 from about x = 17
+// on, including for inf and NaN.
+double FastLog1pExpNegative(double x);
+
+// A probability stored as its natural logarithm. The type holds nothing but
+// the double, so vectors of parameters can be read as raw arrays. Equality
+// and hash_value() work on the logarithm rounded to APPX_LEVEL decimal
+// digits, which lets hash-consing merge nodes whose parameters differ only
+// by rounding noise; both are computed on demand.
 class PsddParameter {
 public:
   PsddParameter();
@@ -19,6 +43,8 @@ public:
   bool operator<(const PsddParameter &other) const;
   bool operator>(const PsddParameter &other) const;
   PsddParameter operator+(const PsddParameter &other) const;
+  // operator+ with the given accuracy.
+  PsddParameter Add(const PsddParameter &other, LogSumAccuracy accuracy) const;
   PsddParameter operator/(const PsddParameter &other) const;
   PsddParameter operator*(const PsddParameter &other) const;
   PsddParameter &operator+=(const PsddParameter &other);
@@ -28,9 +54,61 @@ public:
 
 private:
   explicit PsddParameter(double parameter);
+  intmax_t quantized_parameter() const;
   double parameter_;
-  uintmax_t hash_value_;
 };
 
+static_assert(sizeof(PsddParameter) == sizeof(double),
+              "PsddParameter must be exactly as large as a double");
+
 typedef PsddParameter Probability;
+
+// Returns term(0) + ... + term(size - 1) for a term returning PsddParameter.
+// One pass finds the largest logarithm m and one pass computes
+// m + log1p(sum of exp(term(i) - m) over the other terms), which is size - 1
+// exps and one log1p where folding with operator+ costs size of each, and
+// rounds the small terms once instead of after every addition. term is
+// called twice per index, so it should be cheap. FAST_LOG_SUM folds with Add
+// instead, which evaluates no transcendentals.
+template <typename Term>
+PsddParameter SumParameters(size_t size, Term term, LogSumAccuracy accuracy) {
+  if (accuracy == FAST_LOG_SUM) {
+    // Two running sums, so consecutive additions do not wait on each other.
+    PsddParameter even_sum;
+    PsddParameter odd_sum;
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2) {
+      even_sum = even_sum.Add(term(i), FAST_LOG_SUM);
+      odd_sum = odd_sum.Add(term(i + 1), FAST_LOG_SUM);
+    }
+    if (i < size) {
+      even_sum = even_sum.Add(term(i), FAST_LOG_SUM);
+    }
+    return even_sum.Add(odd_sum, FAST_LOG_SUM);
+  }
+  double max_log = -std::numeric_limits<double>::infinity();
+  size_t max_index = 0;
+  for (size_t i = 0; i < size; ++i) {
+    double cur_log = term(i).parameter();
+    if (cur_log > max_log) {
+      max_log = cur_log;
+      max_index = i;
+    }
+  }
+  if (max_log == -std::numeric_limits<double>::infinity()) {
+    return PsddParameter::CreateFromLog(max_log);
+  }
+  double rest = 0;
+  for (size_t i = 0; i < size; ++i) {
+    if (i != max_index) {
+      rest += std::exp(term(i).parameter() - max_log);
+    }
+  }
+  return PsddParameter::CreateFromLog(max_log + std::log1p(rest));
+}
+
+template <typename Term>
+PsddParameter SumParameters(size_t size, Term term) {
+  return SumParameters(size, term, EXACT_LOG_SUM);
+}
 #endif // PSDD_PSDD_PARAMETER_HPP
@@ -0,0 +1,36 @@
+#ifndef PSDD_PSDD_REF_H
+#define PSDD_PSDD_REF_H
+
+class PsddManager;
+class PsddNode;
+
+// A counted reference to a node of a PsddManager, like sdd_ref and sdd_deref
+// of the SDD library. A node held by a PsddRef, or by a live decision node,
+// is live. When the last reference to a live node goes away, the manager
+// frees it at once and releases its children in turn. Nodes that were never
+// live are left alone and are reclaimed by DeleteUnusedPsddNodes. Freeing a
+// live node does not look at the nodes that were never live, so one of them
+// that uses the node is left with a dangling child. Multiply does not hand
+// out such a node from its computed table again, but raw nodes the caller
+// holds should not be built on nodes whose references may go away. A PsddRef to nullptr stands
+// for false, as a null node pointer does. Every PsddRef must be gone before
+// its manager is deleted.
+class PsddRef {
+public:
+  PsddRef();
+  PsddRef(PsddManager *manager, PsddNode *node);
+  PsddRef(const PsddRef &other);
+  PsddRef(PsddRef &&other) noexcept;
+  PsddRef &operator=(PsddRef other) noexcept;
+  ~PsddRef();
+  PsddNode *get() const { return node_; }
+  PsddManager *manager() const { return manager_; }
+  // Drops the reference, leaving this PsddRef null.
+  void Reset();
+
+private:
+  PsddManager *manager_;
+  PsddNode *node_;
+};
+
+#endif // PSDD_PSDD_REF_H
@@ -4,20 +4,82 @@
 
 #ifndef STRUCTURED_BAYESIAN_NETWORK_PSDD_UNIQUE_TABLE_H
 #define STRUCTURED_BAYESIAN_NETWORK_PSDD_UNIQUE_TABLE_H
+#include <cstddef>
 #include <vector>
 #include <unordered_set>
+#include <psdd/psdd_node.h>
 extern "C" {
 #include <sdd/sddapi.h>
 };
-class PsddNode;
+class PsddNodeArena;
+
+// The fields that tell nodes apart in a unique table, so that a node can be
+// looked up before it is created. The elements of a decision key are not
+// copied, and must be sorted like PsddDecisionNode::elements().
+struct PsddNodeKey {
+  static PsddNodeKey LiteralNodeKey(Vtree *vtree_node, uintmax_t flag_index,
+                                    int32_t literal);
+  static PsddNodeKey TopNodeKey(Vtree *vtree_node, uintmax_t flag_index,
+                                uint32_t variable_index,
+                                PsddParameter true_parameter);
+  static PsddNodeKey DecisionNodeKey(Vtree *vtree_node, uintmax_t flag_index,
+                                     const PsddElement *elements,
+                                     size_t element_size);
+  // Whether node equals the node this key describes, by the operator== of
+  // its type.
+  bool Matches(const PsddNode *node) const;
+  int node_type;
+  Vtree *vtree_node;
+  uintmax_t flag_index;
+  std::size_t hash_value;
+  int32_t literal;
+  uint32_t variable_index;
+  PsddParameter true_parameter;
+  const PsddElement *elements;
+  size_t element_size;
+};
+
+// Occupancy of a unique table and the cost of its lookups so far. A probe is
+// one slot inspected by GetUniqueNode.
+struct PsddUniqueTableStats {
+  size_t node_size = 0;
+  size_t slot_size = 0;
+  size_t lookup_size = 0;
+  size_t probe_size = 0;
+  size_t max_probe_length = 0;
+  double load_factor() const;
+  double average_probe_length() const;
+};
 
 class PsddUniqueTable {
  public:
   virtual ~PsddUniqueTable() = default;
-  virtual PsddNode *GetUniqueNode(PsddNode *node, uintmax_t *node_index)= 0;
-  virtual void DeletePsddNodesWithoutFlagIndexes(const std::unordered_set<uintmax_t> &flag_index) = 0;
-  virtual void DeleteUnusedPsddNodes(const std::vector<PsddNode *> &used_psdd_nodes) = 0;
-  static PsddUniqueTable *GetPsddUniqueTable();
+  // Returns the node equal to node, which is node itself if it is new. Safe
+  // to call from several threads at once.
+  virtual PsddNode *GetUniqueNode(PsddNode *node) = 0;
+  // Returns the node described by key, or nullptr if there is none yet, so
+  // that a node is only created when it is new. Safe to call from several
+  // threads at once.
+  virtual PsddNode *FindUniqueNode(const PsddNodeKey &key) = 0;
+  // The Delete functions free the nodes they drop back to the arena and
+  // return the number of bytes reclaimed. The bulk ones keep every node
+  // still reachable from a kept node, and every node with references. None
+  // of them may run concurrently with any other call.
+  virtual size_t DeletePsddNode(PsddNode *node) = 0;
+  virtual size_t DeletePsddNodesWithoutFlagIndexes(
+      const std::unordered_set<uintmax_t> &flag_index) = 0;
+  // Keeps only the nodes reachable from used_psdd_nodes.
+  virtual size_t
+  DeleteUnusedPsddNodes(const std::vector<PsddNode *> &used_psdd_nodes) = 0;
+  // Drops the nodes without references whose index is at least
+  // first_node_index. Older nodes are kept even if they are unreachable.
+  virtual size_t DeleteUnreferencedPsddNodes(uintmax_t first_node_index) = 0;
+  virtual PsddUniqueTableStats stats() const = 0;
+  // Nodes given to GetUniqueNode must come from node_arena, which gets back
+  // the ones that turn out to be duplicates, and must be normalized for a
+  // node of vtree.
+  static PsddUniqueTable *GetPsddUniqueTable(PsddNodeArena *node_arena,
+                                             Vtree *vtree);
 };
 
 #endif //STRUCTURED_BAYESIAN_NETWORK_PSDD_UNIQUE_TABLE_H
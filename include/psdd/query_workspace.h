@@ -0,0 +1,106 @@
+#ifndef PSDD_QUERY_WORKSPACE_H
+#define PSDD_QUERY_WORKSPACE_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <gmpxx.h>
+#include <psdd/psdd_parameter.h>
+
+class PsddNode;
+
+// Scratch buffers for the traversal-based queries in psdd_node_util. Queries
+// give every node a dense position 0..N-1 and keep their per-node state in
+// these flat buffers. Buffers only grow, so a caller that keeps one workspace
+// alive across queries does no scratch allocation after the first query. A
+// workspace must not be used by two queries at the same time, but the nodes
+// are left untouched, so queries with workspaces of their own may share them.
+class QueryWorkspace {
+public:
+  QueryWorkspace() = default;
+  // Gives serialized_nodes[i] position i and records the positions of the
+  // children of every decision node among them. serialized_nodes must be
+  // SerializePsddNodes of its first node. The index is kept when the same
+  // vector comes back with the same size and root as in the last call, so
+  // repeated queries on one vector index it once; a vector whose nodes are
+  // replaced in place must be given a new root or size.
+  void IndexNodes(const std::vector<PsddNode *> &serialized_nodes);
+  // The positions of the prime and the sub of each element of the decision
+  // node at position, interleaved, as of the last IndexNodes.
+  const uintmax_t *ElementPositions(size_t position) const {
+    return element_positions_.data() + element_offsets_[position];
+  }
+  // Records the elements using each node and the leaves of each variable
+  // among the nodes of the last IndexNodes, which must be serialized_nodes.
+  // Only the first call after each new index does any work.
+  void IndexParents(const std::vector<PsddNode *> &serialized_nodes);
+  // The elements using the node at position, as of the last IndexParents.
+  // Each is the position of its decision node and its index in that node.
+  size_t ParentElementSize(size_t position) const {
+    return parent_offsets_[position + 1] - parent_offsets_[position];
+  }
+  const std::pair<uintmax_t, uintmax_t> *ParentElements(size_t position) const {
+    return parent_elements_.data() + parent_offsets_[position];
+  }
+  // One more than the largest variable index among the leaves, and the
+  // positions of the leaves of each variable, as of the last IndexParents.
+  uint32_t variable_size() const { return variable_size_; }
+  size_t VariableLeafSize(uint32_t variable_index) const {
+    return variable_leaf_offsets_[variable_index + 1] -
+           variable_leaf_offsets_[variable_index];
+  }
+  const uintmax_t *VariableLeaves(uint32_t variable_index) const {
+    return variable_leaves_.data() + variable_leaf_offsets_[variable_index];
+  }
+  // Each accessor returns a buffer holding at least size entries. The contents
+  // are left over from the previous query unless noted otherwise.
+  std::vector<Probability> *MutableValues(size_t size);
+  // All entries are reset to zero probability.
+  std::vector<Probability> *MutableDerivatives(size_t size);
+  std::vector<mpz_class> *MutableCounts(size_t size);
+  // All entries are reset to 0.
+  std::vector<uint8_t> *MutableFlags(size_t size);
+  std::vector<uintmax_t> *MutableChoices(size_t size);
+  // All entries are reset to a pair of zero probabilities.
+  std::vector<std::pair<Probability, Probability>> *
+  MutableVariableMarginals(size_t size);
+  // Empty on return.
+  std::vector<uintmax_t> *MutableStack();
+  // Terms gathered for one reduction, and a second buffer for queries that
+  // reduce two sums side by side. Both are empty on return.
+  std::vector<Probability> *MutableTerms();
+  std::vector<Probability> *MutableTrueTerms();
+  // At least size term buffers, one or more for each worker of a parallel
+  // query. Each is empty on return.
+  std::vector<std::vector<Probability>> *MutableWorkerTerms(size_t size);
+
+private:
+  bool IsIndexed(const std::vector<PsddNode *> &serialized_nodes) const;
+  PsddNode *const *indexed_data_ = nullptr;
+  size_t indexed_size_ = 0;
+  const PsddNode *indexed_root_ = nullptr;
+  uintmax_t indexed_root_index_ = 0;
+  std::unordered_map<const PsddNode *, uintmax_t> node_positions_;
+  std::vector<size_t> element_offsets_;
+  std::vector<uintmax_t> element_positions_;
+  bool parents_indexed_ = false;
+  std::vector<size_t> parent_offsets_;
+  std::vector<std::pair<uintmax_t, uintmax_t>> parent_elements_;
+  uint32_t variable_size_ = 0;
+  std::vector<size_t> variable_leaf_offsets_;
+  std::vector<uintmax_t> variable_leaves_;
+  std::vector<Probability> values_;
+  std::vector<Probability> derivatives_;
+  std::vector<mpz_class> counts_;
+  std::vector<uint8_t> flags_;
+  std::vector<uintmax_t> choices_;
+  std::vector<std::pair<Probability, Probability>> variable_marginals_;
+  std::vector<uintmax_t> stack_;
+  std::vector<Probability> terms_;
+  std::vector<Probability> true_terms_;
+  std::vector<std::vector<Probability>> worker_terms_;
+};
+
+#endif // PSDD_QUERY_WORKSPACE_H
@@ -0,0 +1,48 @@
+#ifndef PSDD_THREAD_POOL_H
+#define PSDD_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for data-parallel loops. The thread calling
+// Run or ParallelFor takes part as worker 0, so a pool of thread_size 1
+// starts no threads and runs everything inline. Only one Run may be in
+// progress at a time.
+class ThreadPool {
+public:
+  explicit ThreadPool(uint32_t thread_size);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  uint32_t thread_size() const;
+  // Calls task(task_index, worker_index) once for every task_index in
+  // [0, task_size) and returns when all calls have finished. worker_index is
+  // in [0, thread_size()).
+  void Run(size_t task_size,
+           const std::function<void(size_t, uint32_t)> &task);
+  // Splits [0, size) into contiguous chunks of at least min_chunk_size
+  // indices and calls body(begin, end, worker_index) for each chunk.
+  void ParallelFor(size_t size, size_t min_chunk_size,
+                   const std::function<void(size_t, size_t, uint32_t)> &body);
+
+private:
+  void WorkerLoop(uint32_t worker_index);
+  void RunTasks(uint32_t worker_index);
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable work_done_;
+  const std::function<void(size_t, uint32_t)> *task_;
+  size_t task_size_;
+  std::atomic<size_t> next_task_;
+  uint32_t busy_workers_;
+  uint64_t generation_;
+  bool stop_;
+};
+
+#endif // PSDD_THREAD_POOL_H
@@ -2,11 +2,15 @@
 // Created by Jason Shen on 4/22/18.
 //
 
+#include <psdd/batched_evaluator.h>
 #include <psdd/cnf.h>
+#include <psdd/compiled_psdd.h>
 #include <psdd/optionparser.h>
 
 #include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 extern "C" {
 #include <sdd/sddapi.h>
 }
@@ -35,7 +39,14 @@ struct Arg : public option::Arg {
     return option::ARG_ILLEGAL;
   }
 };
-enum optionIndex { UNKNOWN, HELP, MPE_QUERY, MAR_QUERY, CNF_EVID };
+enum optionIndex {
+  UNKNOWN,
+  HELP,
+  MPE_QUERY,
+  MAR_QUERY,
+  CNF_EVID,
+  LITERAL_EVID
+};
 
 const option::Descriptor usage[] = {
     {UNKNOWN, 0, "", "", option::Arg::None,
@@ -46,6 +57,10 @@ const option::Descriptor usage[] = {
     {MAR_QUERY, 0, "", "mar_query", option::Arg::None, ""},
     {CNF_EVID, 0, "", "cnf_evid", Arg::Required,
      "--cnf_evid  evid file, represented using CNF."},
+    {LITERAL_EVID, 0, "", "literal_evid", Arg::Required,
+     "--literal_evid  evid file with one evidence row per line, each a list "
+     "of literals. With --mar_query, prints the posterior marginals of every "
+     "row."},
     {UNKNOWN, 0, "", "", option::Arg::None,
      "\nExamples:\n./psdd_inference  psdd_filename vtree_filename \n"},
     {0, 0, 0, 0, 0, 0}};
@@ -85,9 +100,9 @@ int main(int argc, const char *argv[]) {
   std::vector<SddLiteral> variables =
       vtree_util::VariablesUnderVtree(psdd_manager->vtree());
   std::sort(variables.begin(), variables.end());
-  auto serialized_psdd = psdd_node_util::SerializePsddNodes(result_node);
+  CompiledPsdd compiled_psdd(result_node);
   if (options[MPE_QUERY]) {
-    auto mpe_result = psdd_node_util::GetMPESolution(serialized_psdd);
+    auto mpe_result = psdd_node_util::GetMPESolution(compiled_psdd);
     std::cout << "MPE result=";
     for (SddLiteral variable_index : variables) {
       std::cout << variable_index << ":" << mpe_result.first[variable_index]
@@ -96,8 +111,40 @@ int main(int argc, const char *argv[]) {
     std::cout << std::endl;
     std::cout << "MPE pr=" << mpe_result.second.parameter() << std::endl;
   }
-  if (options[MAR_QUERY]) {
-    auto mar_result = psdd_node_util::GetMarginals(serialized_psdd);
+  if (options[MAR_QUERY] && options[LITERAL_EVID]) {
+    std::vector<std::vector<int32_t>> evidence_rows;
+    std::ifstream evidence_file(options[LITERAL_EVID].arg);
+    std::string line;
+    while (std::getline(evidence_file, line)) {
+      std::istringstream line_stream(line);
+      std::vector<int32_t> evidence_row;
+      int32_t literal;
+      while (line_stream >> literal) {
+        if (literal != 0) {
+          evidence_row.push_back(literal);
+        }
+      }
+      evidence_rows.push_back(evidence_row);
+    }
+    BatchedEvaluator evaluator(&compiled_psdd);
+    auto mar_results = evaluator.GetMarginals(evidence_rows);
+    uint32_t variable_size = compiled_psdd.variable_size();
+    for (size_t i = 0; i < evidence_rows.size(); ++i) {
+      std::cout << "MAR result=";
+      for (SddLiteral variable_index : variables) {
+        std::pair<Probability, Probability> cur_mar_result =
+            std::make_pair(Probability::CreateFromDecimal(0),
+                           Probability::CreateFromDecimal(0));
+        if ((uint32_t)variable_index < variable_size) {
+          cur_mar_result = mar_results[i * variable_size + variable_index];
+        }
+        std::cout << variable_index << ":" << cur_mar_result.first.parameter()
+                  << "|" << cur_mar_result.second.parameter() << ",";
+      }
+      std::cout << std::endl;
+    }
+  } else if (options[MAR_QUERY]) {
+    auto mar_result = psdd_node_util::GetMarginals(compiled_psdd);
     std::cout << "MAR result=";
     for (SddLiteral variable_index : variables) {
       auto cur_mar_result = mar_result[variable_index];
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "psdd/compiled_psdd.h"
+#include "psdd/psdd_manager.h"
+#include "psdd/psdd_parameter.h"
+#include "psdd/query_workspace.h"
+extern "C" {
+#include <sdd/sddapi.h>
+}
+
+namespace {
+// Computes firsts[i] + seconds[i] into sums round_size times. The pairs fit in
+// cache, so this times the additions rather than memory.
+double TimeSums(const std::vector<PsddParameter> &firsts,
+                const std::vector<PsddParameter> &seconds,
+                LogSumAccuracy accuracy, int round_size,
+                std::vector<PsddParameter> *sums) {
+  auto start = std::chrono::steady_clock::now();
+  for (auto round = 0; round < round_size; ++round) {
+    for (size_t i = 0; i < firsts.size(); ++i) {
+      (*sums)[i] = firsts[i].Add(seconds[i], accuracy);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         ((double)firsts.size() * round_size);
+}
+
+double MaxLogError(const std::vector<PsddParameter> &expected,
+                   const std::vector<PsddParameter> &actual) {
+  double max_error = 0;
+  for (size_t i = 0; i < expected.size(); ++i) {
+    if (expected[i].parameter() != actual[i].parameter()) {
+      max_error = std::max(max_error, std::abs(expected[i].parameter() -
+                                               actual[i].parameter()));
+    }
+  }
+  return max_error;
+}
+
+template <typename Query> double TimeQuery(Query query, int round_size) {
+  auto start = std::chrono::steady_clock::now();
+  for (auto round = 0; round < round_size; ++round) {
+    query();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() /
+         round_size;
+}
+} // namespace
+
+// Usage: psdd_log_sum_benchmark [psdd_file vtree_file]
+// Compares EXACT_LOG_SUM and FAST_LOG_SUM on random pairs of logarithms and,
+// when a PSDD is given, on GetMarginals over it. Prints the time of each and
+// the largest absolute error of the fast logarithms.
+int main(int argc, const char *argv[]) {
+  const size_t pair_size = 1 << 10;
+  const int sum_round_size = 1 << 12;
+  std::mt19937 engine(0);
+  std::uniform_real_distribution<double> log_sampler(-30, 0);
+  std::vector<PsddParameter> firsts(pair_size);
+  std::vector<PsddParameter> seconds(pair_size);
+  for (size_t i = 0; i < pair_size; ++i) {
+    firsts[i] = PsddParameter::CreateFromLog(log_sampler(engine));
+    seconds[i] = PsddParameter::CreateFromLog(log_sampler(engine));
+  }
+  std::vector<PsddParameter> exact_sums(pair_size);
+  std::vector<PsddParameter> fast_sums(pair_size);
+  double exact_time =
+      TimeSums(firsts, seconds, EXACT_LOG_SUM, sum_round_size, &exact_sums);
+  double fast_time =
+      TimeSums(firsts, seconds, FAST_LOG_SUM, sum_round_size, &fast_sums);
+  std::cout << "ExactLogSumNs: " << exact_time << std::endl;
+  std::cout << "FastLogSumNs: " << fast_time << std::endl;
+  std::cout << "LogSumSpeedup: " << exact_time / fast_time << std::endl;
+  std::cout << "LogSumLogError: " << MaxLogError(exact_sums, fast_sums)
+            << " (bound " << kFastLogSumError << ")" << std::endl;
+  if (argc < 3) {
+    return 0;
+  }
+
+  Vtree *psdd_vtree = sdd_vtree_read(argv[2]);
+  PsddManager *psdd_manager = PsddManager::GetPsddManagerFromVtree(psdd_vtree);
+  sdd_vtree_free(psdd_vtree);
+  PsddNode *result_node = psdd_manager->ReadPsddFile(argv[1], 0);
+  CompiledPsdd compiled_psdd(result_node);
+  std::cout << "PSDD size " << compiled_psdd.node_size() << std::endl;
+  QueryWorkspace workspace;
+  const int round_size = 10;
+  std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+      exact_marginals;
+  std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+      fast_marginals;
+  double exact_marginal_time = TimeQuery(
+      [&]() {
+        exact_marginals = psdd_node_util::GetMarginals(
+            compiled_psdd, &workspace, EXACT_LOG_SUM);
+      },
+      round_size);
+  double fast_marginal_time = TimeQuery(
+      [&]() {
+        fast_marginals = psdd_node_util::GetMarginals(compiled_psdd, &workspace,
+                                                      FAST_LOG_SUM);
+      },
+      round_size);
+  double marginal_error = 0;
+  for (const auto &exact_marginal : exact_marginals) {
+    double expected = exact_marginal.second.second.parameter();
+    double actual = fast_marginals[exact_marginal.first].second.parameter();
+    if (expected != actual) {
+      marginal_error = std::max(marginal_error, std::abs(expected - actual));
+    }
+  }
+  std::cout << "ExactMarQueryMs: " << exact_marginal_time << std::endl;
+  std::cout << "FastMarQueryMs: " << fast_marginal_time << std::endl;
+  std::cout << "MarSpeedup: " << exact_marginal_time / fast_marginal_time
+            << std::endl;
+  std::cout << "MarLogError: " << marginal_error << std::endl;
+  delete psdd_manager;
+  return 0;
+}
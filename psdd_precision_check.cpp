@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "psdd/batched_evaluator.h"
+#include "psdd/compiled_psdd.h"
+#include "psdd/psdd_manager.h"
+#include "psdd/psdd_parameter.h"
+extern "C" {
+#include <sdd/sddapi.h>
+}
+
+namespace {
+// Largest |log a - log b| over pairs where either side is nonzero. A pair
+// where only one side is zero counts as infinite error.
+double MaxLogError(const std::vector<Probability> &expected,
+                   const std::vector<Probability> &actual) {
+  double max_error = 0;
+  for (size_t i = 0; i < expected.size(); ++i) {
+    double a = expected[i].parameter();
+    double b = actual[i].parameter();
+    if (a == b) {
+      continue;
+    }
+    max_error = std::max(max_error, std::abs(a - b));
+  }
+  return max_error;
+}
+
+std::vector<Probability>
+TrueMarginals(const std::vector<std::pair<Probability, Probability>> &pairs) {
+  std::vector<Probability> result;
+  result.reserve(pairs.size());
+  for (const auto &cur_pair : pairs) {
+    result.push_back(cur_pair.second);
+  }
+  return result;
+}
+
+template <typename T>
+void Report(const char *name, BasicBatchedEvaluator<T> *evaluator,
+            const std::vector<std::vector<int32_t>> &evids,
+            const std::vector<Probability> &expected_sums,
+            const std::vector<Probability> &expected_maxes,
+            const std::vector<Probability> &expected_marginals) {
+  std::cout << name << " EvaluateLogError: "
+            << MaxLogError(expected_sums, evaluator->Evaluate(evids))
+            << std::endl;
+  std::cout << name << " EvaluateMaxLogError: "
+            << MaxLogError(expected_maxes, evaluator->EvaluateMax(evids))
+            << std::endl;
+  std::cout << name << " MarginalLogError: "
+            << MaxLogError(expected_marginals,
+                           TrueMarginals(evaluator->GetMarginals(evids)))
+            << std::endl;
+}
+} // namespace
+
+// Usage: psdd_precision_check <psdd_file> <vtree_file> [row_size]
+// Compares float evaluation against double evaluation on random evidence
+// rows, each observing every variable with probability one half, and prints
+// the maximum absolute error of the log probabilities.
+int main(int argc, const char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <psdd_file> <vtree_file> [row_size]"
+              << std::endl;
+    return 1;
+  }
+  const char *psdd_filename = argv[1];
+  const char *vtree_filename = argv[2];
+  size_t row_size = argc > 3 ? (size_t)std::atol(argv[3]) : 1024;
+
+  Vtree *psdd_vtree = sdd_vtree_read(vtree_filename);
+  PsddManager *psdd_manager = PsddManager::GetPsddManagerFromVtree(psdd_vtree);
+  sdd_vtree_free(psdd_vtree);
+  PsddNode *result_node = psdd_manager->ReadPsddFile(psdd_filename, 0);
+  CompiledPsdd compiled_psdd(result_node);
+  std::cout << "PSDD size " << compiled_psdd.node_size() << std::endl;
+
+  std::mt19937 engine(0);
+  std::uniform_int_distribution<> coin(0, 1);
+  std::vector<std::vector<int32_t>> evids(row_size);
+  for (auto &row : evids) {
+    for (uint32_t v = 1; v < compiled_psdd.variable_size(); ++v) {
+      if (coin(engine)) {
+        row.push_back(coin(engine) ? (int32_t)v : -(int32_t)v);
+      }
+    }
+  }
+
+  BatchedEvaluator double_evaluator(&compiled_psdd);
+  auto expected_sums = double_evaluator.Evaluate(evids);
+  auto expected_maxes = double_evaluator.EvaluateMax(evids);
+  auto expected_marginals =
+      TrueMarginals(double_evaluator.GetMarginals(evids));
+  FloatBatchedEvaluator float_evaluator(&compiled_psdd);
+  Report("Float", &float_evaluator, evids, expected_sums, expected_maxes,
+         expected_marginals);
+  float_evaluator.set_domain(LINEAR_DOMAIN);
+  Report("FloatLinear", &float_evaluator, evids, expected_sums,
+         expected_maxes, expected_marginals);
+  BatchedEvaluator linear_evaluator(&compiled_psdd);
+  linear_evaluator.set_domain(LINEAR_DOMAIN);
+  Report("DoubleLinear", &linear_evaluator, evids, expected_sums,
+         expected_maxes, expected_marginals);
+  delete psdd_manager;
+  return 0;
+}
@@ -0,0 +1,973 @@
+#include <psdd/batched_evaluator.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <limits>
+
+#include "linear_space_kernels.h"
+#include "log_space_kernels.h"
+
+namespace {
+// Lanes of every node are padded to a multiple of the AVX-512 width so the
+// kernels never run a scalar tail.
+const uint32_t kVectorBytes = 64;
+// A level is cut into about this many tasks per thread; narrow levels are
+// cut along the lanes as well.
+const uint32_t kTasksPerThread = 4;
+// A chunk is evaluated on its evidence cones only if they cover at most
+// this fraction of the nodes; beyond that the full pass is as cheap.
+const double kMaxConeFraction = 0.5;
+
+template <typename T> constexpr uint32_t LaneAlignment() {
+  return kVectorBytes / sizeof(T);
+}
+
+template <typename T> uint32_t RoundUpToLaneAlignment(uint32_t size) {
+  return (size + LaneAlignment<T>() - 1) / LaneAlignment<T>() *
+         LaneAlignment<T>();
+}
+} // namespace
+
+template <typename T>
+BasicBatchedEvaluator<T>::BasicBatchedEvaluator(
+    const CompiledPsdd *compiled_psdd, uint32_t batch_width)
+    : BasicBatchedEvaluator(compiled_psdd, batch_width, DetectSimdLevel()) {}
+
+template <typename T>
+BasicBatchedEvaluator<T>::BasicBatchedEvaluator(
+    const CompiledPsdd *compiled_psdd, uint32_t batch_width,
+    SimdLevel simd_level)
+    : BasicBatchedEvaluator(compiled_psdd, batch_width, simd_level, nullptr) {}
+
+template <typename T>
+BasicBatchedEvaluator<T>::BasicBatchedEvaluator(
+    const CompiledPsdd *compiled_psdd, uint32_t batch_width,
+    SimdLevel simd_level, ThreadPool *thread_pool)
+    : compiled_psdd_(compiled_psdd), batch_width_(std::max(batch_width, 1u)),
+      lane_stride_(RoundUpToLaneAlignment<T>(batch_width_)),
+      simd_level_(std::min(simd_level, DetectSimdLevel())),
+      thread_pool_(thread_pool), domain_(LOG_DOMAIN), cone_stamp_(0),
+      cone_chunk_count_(0),
+      baseline_semiring_(NO_SEMIRING) {
+  uint32_t node_size = compiled_psdd_->node_size();
+  node_levels_.resize(node_size);
+  const auto &level_offsets = compiled_psdd_->level_offsets();
+  for (uint32_t level = 0; level < compiled_psdd_->level_size(); ++level) {
+    for (uint32_t k = level_offsets[level]; k < level_offsets[level + 1]; ++k) {
+      node_levels_[compiled_psdd_->level_positions()[k]] = level;
+    }
+  }
+  variable_cones_.resize(compiled_psdd_->variable_size());
+  variable_cone_built_.resize(compiled_psdd_->variable_size(), 0);
+  cone_marks_.resize(node_size, 0);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    if (compiled_psdd_->node_type(i) != DECISION_NODE_TYPE) {
+      leaf_positions_.push_back(i);
+    }
+  }
+  lane_values_.resize((size_t)node_size * lane_stride_);
+  uint32_t thread_size = thread_pool_ ? thread_pool_->thread_size() : 1;
+  product_buffers_.resize((size_t)thread_size * lane_stride_);
+}
+
+template <typename T>
+SimdLevel BasicBatchedEvaluator<T>::DetectSimdLevel() {
+  return static_cast<SimdLevel>(log_space_kernels::DetectIsa());
+}
+
+template <typename T>
+SimdLevel BasicBatchedEvaluator<T>::simd_level() const { return simd_level_; }
+
+template <typename T>
+uint32_t BasicBatchedEvaluator<T>::batch_width() const { return batch_width_; }
+
+template <typename T>
+void BasicBatchedEvaluator<T>::set_domain(EvaluationDomain domain) {
+  domain_ = domain;
+  if (domain_ != LINEAR_DOMAIN || !lane_exponents_.empty()) {
+    return;
+  }
+  const auto &params = compiled_psdd_->parameters();
+  lane_exponents_.resize(lane_values_.size());
+  parameter_mantissas_.resize(params.size());
+  parameter_exponents_.resize(params.size());
+  for (size_t j = 0; j < params.size(); ++j) {
+    linear_space_kernels::SplitLog(params[j].parameter(),
+                                   &parameter_mantissas_[j],
+                                   &parameter_exponents_[j]);
+  }
+  unit_mantissas_.resize(lane_stride_, 1.0);
+  unit_exponents_.resize(lane_stride_, 0.0);
+}
+
+template <typename T>
+EvaluationDomain BasicBatchedEvaluator<T>::domain() const { return domain_; }
+
+template <typename T>
+uint64_t BasicBatchedEvaluator<T>::cone_chunk_count() const {
+  return cone_chunk_count_;
+}
+
+template <typename T>
+std::vector<Probability> BasicBatchedEvaluator<T>::Evaluate(
+    const std::vector<std::vector<int32_t>> &evidence_rows) {
+  std::vector<double> root_values;
+  EvaluateRows(evidence_rows, SUM_SEMIRING, &root_values);
+  std::vector<Probability> results;
+  results.reserve(root_values.size());
+  for (double root_value : root_values) {
+    results.push_back(Probability::CreateFromLog(root_value));
+  }
+  return results;
+}
+
+template <typename T>
+std::vector<Probability> BasicBatchedEvaluator<T>::EvaluateMax(
+    const std::vector<std::vector<int32_t>> &evidence_rows) {
+  std::vector<double> root_values;
+  EvaluateRows(evidence_rows, MAX_SEMIRING, &root_values);
+  std::vector<Probability> results;
+  results.reserve(root_values.size());
+  for (double root_value : root_values) {
+    results.push_back(Probability::CreateFromLog(root_value));
+  }
+  return results;
+}
+
+template <typename T>
+std::vector<bool> BasicBatchedEvaluator<T>::IsConsistent(
+    const std::vector<std::vector<int32_t>> &evidence_rows) {
+  std::vector<double> root_values;
+  EvaluateRows(evidence_rows, BOOLEAN_SEMIRING, &root_values);
+  std::vector<bool> results;
+  results.reserve(root_values.size());
+  for (double root_value : root_values) {
+    results.push_back(root_value != -std::numeric_limits<double>::infinity());
+  }
+  return results;
+}
+
+template <typename T>
+T *BasicBatchedEvaluator<T>::lanes(uint32_t position) {
+  return lane_values_.data() + (size_t)position * lane_stride_;
+}
+
+template <typename T>
+T *BasicBatchedEvaluator<T>::derivative_lanes(uint32_t position) {
+  return derivative_values_.data() + (size_t)position * lane_stride_;
+}
+
+template <typename T>
+T *BasicBatchedEvaluator<T>::exponent_lanes(uint32_t position) {
+  return lane_exponents_.data() + (size_t)position * lane_stride_;
+}
+
+template <typename T>
+T *BasicBatchedEvaluator<T>::derivative_exponent_lanes(uint32_t position) {
+  return derivative_exponents_.data() + (size_t)position * lane_stride_;
+}
+
+template <typename T>
+uint32_t *BasicBatchedEvaluator<T>::argmax_lanes(uint32_t position) {
+  return argmax_values_.data() + (size_t)position * lane_stride_;
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::ParallelFor(
+    size_t size, size_t min_chunk_size,
+    const std::function<void(size_t, size_t, uint32_t)> &body) {
+  if (thread_pool_) {
+    thread_pool_->ParallelFor(size, min_chunk_size, body);
+  } else if (size > 0) {
+    body(0, size, 0);
+  }
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::SetEvidenceLanes(
+    const std::vector<std::vector<int32_t>> &evidence_rows, size_t row_begin,
+    uint32_t lane_size, Semiring semiring) {
+  const auto &element_offsets = compiled_psdd_->element_offsets();
+  const auto &params = compiled_psdd_->parameters();
+  const auto &variable_leaf_offsets = compiled_psdd_->variable_leaf_offsets();
+  const auto &variable_leaves = compiled_psdd_->variable_leaves();
+  uint32_t variable_size = compiled_psdd_->variable_size();
+  bool linear = domain_ == LINEAR_DOMAIN && semiring == SUM_SEMIRING;
+  for (uint32_t lane = 0; lane < lane_size; ++lane) {
+    for (int32_t literal : evidence_rows[row_begin + lane]) {
+      auto variable_index = (uint32_t)std::abs(literal);
+      if (variable_index >= variable_size) {
+        continue;
+      }
+      for (uint32_t j = variable_leaf_offsets[variable_index];
+           j < variable_leaf_offsets[variable_index + 1]; ++j) {
+        uint32_t position = variable_leaves[j];
+        double value;
+        if (compiled_psdd_->node_type(position) == LITERAL_NODE_TYPE) {
+          value = compiled_psdd_->literal(position) == literal
+                      ? 0
+                      : -std::numeric_limits<double>::infinity();
+        } else if (semiring != BOOLEAN_SEMIRING) {
+          value = params[element_offsets[position] + (literal > 0 ? 1 : 0)]
+                      .parameter();
+        } else {
+          continue;
+        }
+        if (linear) {
+          linear_space_kernels::SplitLog(value, &lanes(position)[lane],
+                                         &exponent_lanes(position)[lane]);
+        } else {
+          lanes(position)[lane] = value;
+        }
+      }
+    }
+  }
+}
+
+template <typename T>
+const std::vector<double> &
+BasicBatchedEvaluator<T>::BaselineValues(Semiring semiring) {
+  std::vector<double> &baseline = baseline_values_[semiring];
+  if (!baseline.empty()) {
+    return baseline;
+  }
+  const auto &element_offsets = compiled_psdd_->element_offsets();
+  const auto &primes = compiled_psdd_->primes();
+  const auto &subs = compiled_psdd_->subs();
+  const auto &params = compiled_psdd_->parameters();
+  uint32_t node_size = compiled_psdd_->node_size();
+  baseline.resize(node_size);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    if (compiled_psdd_->node_type(i) == LITERAL_NODE_TYPE) {
+      baseline[i] = 0;
+    } else if (compiled_psdd_->node_type(i) == TOP_NODE_TYPE) {
+      baseline[i] = semiring == MAX_SEMIRING
+                        ? std::max(params[element_offsets[i]].parameter(),
+                                   params[element_offsets[i] + 1].parameter())
+                        : 0;
+    } else {
+      Probability value = Probability::CreateFromDecimal(0);
+      for (uintmax_t j = element_offsets[i]; j < element_offsets[i + 1]; ++j) {
+        double weight =
+            semiring == BOOLEAN_SEMIRING ? 0 : params[j].parameter();
+        Probability product =
+            Probability::CreateFromLog(baseline[primes[j]] + baseline[subs[j]] +
+                                       weight);
+        if (semiring == SUM_SEMIRING) {
+          value = value + product;
+        } else if (product.parameter() > value.parameter()) {
+          value = product;
+        }
+      }
+      baseline[i] = value.parameter();
+    }
+  }
+  return baseline;
+}
+
+template <typename T>
+const std::vector<uint32_t> &
+BasicBatchedEvaluator<T>::VariableCone(uint32_t variable_index) {
+  std::vector<uint32_t> &cone = variable_cones_[variable_index];
+  if (variable_cone_built_[variable_index]) {
+    return cone;
+  }
+  const auto &parent_offsets = compiled_psdd_->parent_offsets();
+  const auto &parent_elements = compiled_psdd_->parent_elements();
+  const auto &element_owners = compiled_psdd_->element_owners();
+  const auto &variable_leaf_offsets = compiled_psdd_->variable_leaf_offsets();
+  const auto &variable_leaves = compiled_psdd_->variable_leaves();
+  cone_stamp_ += 1;
+  std::vector<uint32_t> frontier(
+      variable_leaves.begin() + variable_leaf_offsets[variable_index],
+      variable_leaves.begin() + variable_leaf_offsets[variable_index + 1]);
+  while (!frontier.empty()) {
+    uint32_t position = frontier.back();
+    frontier.pop_back();
+    for (uintmax_t k = parent_offsets[position];
+         k < parent_offsets[position + 1]; ++k) {
+      uint32_t parent = element_owners[parent_elements[k]];
+      if (cone_marks_[parent] != cone_stamp_) {
+        cone_marks_[parent] = cone_stamp_;
+        cone.push_back(parent);
+        frontier.push_back(parent);
+      }
+    }
+  }
+  std::sort(cone.begin(), cone.end());
+  variable_cone_built_[variable_index] = 1;
+  return cone;
+}
+
+template <typename T>
+bool BasicBatchedEvaluator<T>::EvaluateChunkCone(
+    const std::vector<std::vector<int32_t>> &evidence_rows, size_t row_begin,
+    uint32_t lane_size, Semiring semiring) {
+  const auto &variable_leaf_offsets = compiled_psdd_->variable_leaf_offsets();
+  const auto &variable_leaves = compiled_psdd_->variable_leaves();
+  uint32_t variable_size = compiled_psdd_->variable_size();
+  uint32_t node_size = compiled_psdd_->node_size();
+  auto max_cone_size = (size_t)(node_size * kMaxConeFraction);
+  // Cones are built first since building one moves cone_stamp_.
+  for (uint32_t lane = 0; lane < lane_size; ++lane) {
+    for (int32_t literal : evidence_rows[row_begin + lane]) {
+      auto variable_index = (uint32_t)std::abs(literal);
+      if (variable_index < variable_size &&
+          VariableCone(variable_index).size() > max_cone_size) {
+        return false;
+      }
+    }
+  }
+  cone_stamp_ += 1;
+  std::vector<uint32_t> observed_leaves;
+  std::vector<uint32_t> cone_positions;
+  for (uint32_t lane = 0; lane < lane_size; ++lane) {
+    for (int32_t literal : evidence_rows[row_begin + lane]) {
+      auto variable_index = (uint32_t)std::abs(literal);
+      if (variable_index >= variable_size ||
+          variable_leaf_offsets[variable_index] ==
+              variable_leaf_offsets[variable_index + 1] ||
+          cone_marks_[variable_leaves[variable_leaf_offsets[variable_index]]] ==
+              cone_stamp_) {
+        continue;
+      }
+      for (uint32_t j = variable_leaf_offsets[variable_index];
+           j < variable_leaf_offsets[variable_index + 1]; ++j) {
+        cone_marks_[variable_leaves[j]] = cone_stamp_;
+        observed_leaves.push_back(variable_leaves[j]);
+      }
+      for (uint32_t position : VariableCone(variable_index)) {
+        if (cone_marks_[position] != cone_stamp_) {
+          cone_marks_[position] = cone_stamp_;
+          cone_positions.push_back(position);
+        }
+      }
+      if (cone_positions.size() > max_cone_size) {
+        return false;
+      }
+    }
+  }
+  // Bring every lane back to the baseline, then overwrite the cone.
+  const std::vector<double> &baseline = BaselineValues(semiring);
+  if (baseline_semiring_ != semiring) {
+    ParallelFor(node_size, 256, [&](size_t begin, size_t end, uint32_t) {
+      for (size_t i = begin; i < end; ++i) {
+        std::fill(lanes((uint32_t)i), lanes((uint32_t)i) + lane_stride_,
+                  baseline[i]);
+      }
+    });
+    baseline_semiring_ = semiring;
+  } else {
+    for (uint32_t position : dirty_positions_) {
+      std::fill(lanes(position), lanes(position) + lane_stride_,
+                baseline[position]);
+    }
+  }
+  SetEvidenceLanes(evidence_rows, row_begin, lane_size, semiring);
+  std::sort(cone_positions.begin(), cone_positions.end(),
+            [this](uint32_t a, uint32_t b) {
+              return node_levels_[a] != node_levels_[b]
+                         ? node_levels_[a] < node_levels_[b]
+                         : a < b;
+            });
+  uint32_t active_size = RoundUpToLaneAlignment<T>(lane_size);
+  size_t level_begin = 0;
+  while (level_begin < cone_positions.size()) {
+    size_t level_end = level_begin;
+    while (level_end < cone_positions.size() &&
+           node_levels_[cone_positions[level_end]] ==
+               node_levels_[cone_positions[level_begin]]) {
+      ++level_end;
+    }
+    ParallelFor(level_end - level_begin, 4,
+                [&](size_t begin, size_t end, uint32_t worker_index) {
+                  T *product_buffer = product_buffers_.data() +
+                                           (size_t)worker_index * lane_stride_;
+                  for (size_t k = begin; k < end; ++k) {
+                    EvaluateDecisionNode(cone_positions[level_begin + k], 0,
+                                         active_size, semiring, false,
+                                         product_buffer);
+                  }
+                });
+    level_begin = level_end;
+  }
+  dirty_positions_ = std::move(observed_leaves);
+  dirty_positions_.insert(dirty_positions_.end(), cone_positions.begin(),
+                          cone_positions.end());
+  return true;
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::EvaluateDecisionNode(uint32_t position,
+                                                    uint32_t lane_begin,
+                                                    uint32_t lane_size,
+                                                    Semiring semiring,
+                                                    bool record_argmax,
+                                                    T *product_buffer) {
+  const log_space_kernels::KernelTable<T> &kernels =
+      log_space_kernels::GetKernelTable<T>(
+          static_cast<log_space_kernels::Isa>(simd_level_));
+  const auto &element_offsets = compiled_psdd_->element_offsets();
+  const auto &primes = compiled_psdd_->primes();
+  const auto &subs = compiled_psdd_->subs();
+  const auto &params = compiled_psdd_->parameters();
+  T *node_lanes = lanes(position) + lane_begin;
+  uint32_t *node_argmax =
+      record_argmax ? argmax_lanes(position) + lane_begin : nullptr;
+  uintmax_t j = element_offsets[position];
+  assert(j < element_offsets[position + 1]);
+  if (node_argmax) {
+    std::fill(node_argmax, node_argmax + lane_size, 0u);
+  }
+  for (; j < element_offsets[position + 1]; ++j) {
+    T weight = semiring == BOOLEAN_SEMIRING ? 0 : params[j].parameter();
+    bool first_element = j == element_offsets[position];
+    kernels.log_multiply(lanes(primes[j]) + lane_begin,
+                         lanes(subs[j]) + lane_begin, weight,
+                         first_element ? node_lanes : product_buffer,
+                         lane_size);
+    if (first_element) {
+      continue;
+    }
+    if (semiring == SUM_SEMIRING) {
+      kernels.log_add_exp(product_buffer, node_lanes, lane_size);
+    } else if (node_argmax) {
+      kernels.max_index(product_buffer, node_lanes, node_argmax,
+                        (uint32_t)(j - element_offsets[position]), lane_size);
+    } else {
+      kernels.max(product_buffer, node_lanes, lane_size);
+    }
+  }
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::EvaluateDecisionNodeLinear(uint32_t position,
+                                                          uint32_t lane_begin,
+                                                          uint32_t lane_size) {
+  const linear_space_kernels::KernelTable<T> &kernels =
+      linear_space_kernels::GetKernelTable<T>(
+          static_cast<log_space_kernels::Isa>(simd_level_));
+  const auto &element_offsets = compiled_psdd_->element_offsets();
+  const auto &primes = compiled_psdd_->primes();
+  const auto &subs = compiled_psdd_->subs();
+  T *node_mantissas = lanes(position) + lane_begin;
+  T *node_exponents = exponent_lanes(position) + lane_begin;
+  std::fill(node_mantissas, node_mantissas + lane_size, 0.0);
+  std::fill(node_exponents, node_exponents + lane_size,
+            -std::numeric_limits<double>::infinity());
+  for (uintmax_t j = element_offsets[position];
+       j < element_offsets[position + 1]; ++j) {
+    kernels.max_exponent(exponent_lanes(primes[j]) + lane_begin,
+                         exponent_lanes(subs[j]) + lane_begin,
+                         parameter_exponents_[j], node_exponents, lane_size);
+  }
+  for (uintmax_t j = element_offsets[position];
+       j < element_offsets[position + 1]; ++j) {
+    kernels.scaled_multiply_add(
+        lanes(primes[j]) + lane_begin, lanes(subs[j]) + lane_begin,
+        exponent_lanes(primes[j]) + lane_begin,
+        exponent_lanes(subs[j]) + lane_begin, parameter_mantissas_[j],
+        parameter_exponents_[j], node_exponents, node_mantissas, lane_size);
+  }
+  kernels.normalize(node_mantissas, node_exponents, lane_size);
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::DifferentiateNode(uint32_t position,
+                                                 uint32_t lane_begin,
+                                                 uint32_t lane_size,
+                                                 T *product_buffer) {
+  const log_space_kernels::KernelTable<T> &kernels =
+      log_space_kernels::GetKernelTable<T>(
+          static_cast<log_space_kernels::Isa>(simd_level_));
+  const auto &primes = compiled_psdd_->primes();
+  const auto &subs = compiled_psdd_->subs();
+  const auto &params = compiled_psdd_->parameters();
+  const auto &parent_offsets = compiled_psdd_->parent_offsets();
+  const auto &parent_elements = compiled_psdd_->parent_elements();
+  const auto &element_owners = compiled_psdd_->element_owners();
+  T *node_lanes = derivative_lanes(position) + lane_begin;
+  if (parent_offsets[position] == parent_offsets[position + 1]) {
+    std::fill(node_lanes, node_lanes + lane_size,
+              -std::numeric_limits<double>::infinity());
+    return;
+  }
+  for (uintmax_t k = parent_offsets[position];
+       k < parent_offsets[position + 1]; ++k) {
+    uintmax_t j = parent_elements[k];
+    // d(root)/d(node) gets d(root)/d(parent) * parameter * sibling value.
+    uint32_t sibling = primes[j] == position ? subs[j] : primes[j];
+    bool first_parent = k == parent_offsets[position];
+    kernels.log_multiply(derivative_lanes(element_owners[j]) + lane_begin,
+                         lanes(sibling) + lane_begin, params[j].parameter(),
+                         first_parent ? node_lanes : product_buffer,
+                         lane_size);
+    if (!first_parent) {
+      kernels.log_add_exp(product_buffer, node_lanes, lane_size);
+    }
+  }
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::DifferentiateNodeLinear(uint32_t position,
+                                                       uint32_t lane_begin,
+                                                       uint32_t lane_size) {
+  const linear_space_kernels::KernelTable<T> &kernels =
+      linear_space_kernels::GetKernelTable<T>(
+          static_cast<log_space_kernels::Isa>(simd_level_));
+  const auto &primes = compiled_psdd_->primes();
+  const auto &subs = compiled_psdd_->subs();
+  const auto &parent_offsets = compiled_psdd_->parent_offsets();
+  const auto &parent_elements = compiled_psdd_->parent_elements();
+  const auto &element_owners = compiled_psdd_->element_owners();
+  T *node_mantissas = derivative_lanes(position) + lane_begin;
+  T *node_exponents = derivative_exponent_lanes(position) + lane_begin;
+  std::fill(node_mantissas, node_mantissas + lane_size, 0.0);
+  std::fill(node_exponents, node_exponents + lane_size,
+            -std::numeric_limits<double>::infinity());
+  for (uintmax_t k = parent_offsets[position];
+       k < parent_offsets[position + 1]; ++k) {
+    uintmax_t j = parent_elements[k];
+    uint32_t sibling = primes[j] == position ? subs[j] : primes[j];
+    kernels.max_exponent(
+        derivative_exponent_lanes(element_owners[j]) + lane_begin,
+        exponent_lanes(sibling) + lane_begin, parameter_exponents_[j],
+        node_exponents, lane_size);
+  }
+  for (uintmax_t k = parent_offsets[position];
+       k < parent_offsets[position + 1]; ++k) {
+    uintmax_t j = parent_elements[k];
+    uint32_t sibling = primes[j] == position ? subs[j] : primes[j];
+    kernels.scaled_multiply_add(
+        derivative_lanes(element_owners[j]) + lane_begin,
+        lanes(sibling) + lane_begin,
+        derivative_exponent_lanes(element_owners[j]) + lane_begin,
+        exponent_lanes(sibling) + lane_begin, parameter_mantissas_[j],
+        parameter_exponents_[j], node_exponents, node_mantissas, lane_size);
+  }
+  kernels.normalize(node_mantissas, node_exponents, lane_size);
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::ForEachLevelNode(
+    uint32_t level, uint32_t active_size,
+    const std::function<void(uint32_t, uint32_t, uint32_t, T *)> &body) {
+  const auto &level_offsets = compiled_psdd_->level_offsets();
+  const auto &level_positions = compiled_psdd_->level_positions();
+  uint32_t thread_size = thread_pool_ ? thread_pool_->thread_size() : 1;
+  uint32_t level_begin = level_offsets[level];
+  uint32_t node_size = level_offsets[level + 1] - level_begin;
+  uint32_t target_task_size = thread_size * kTasksPerThread;
+  uint32_t lane_block_count = 1;
+  if (thread_size > 1 && node_size < target_task_size) {
+    lane_block_count = std::min((target_task_size + node_size - 1) / node_size,
+                                active_size / LaneAlignment<T>());
+  }
+  uint32_t lane_block_size = RoundUpToLaneAlignment<T>(
+      (active_size + lane_block_count - 1) / lane_block_count);
+  lane_block_count = (active_size + lane_block_size - 1) / lane_block_size;
+  ParallelFor((size_t)node_size * lane_block_count, 1,
+              [&](size_t begin, size_t end, uint32_t worker_index) {
+                T *product_buffer = product_buffers_.data() +
+                                         (size_t)worker_index * lane_stride_;
+                for (size_t task = begin; task < end; ++task) {
+                  uint32_t position =
+                      level_positions[level_begin + task / lane_block_count];
+                  auto lane_begin =
+                      (uint32_t)(task % lane_block_count) * lane_block_size;
+                  body(position, lane_begin,
+                       std::min(lane_block_size, active_size - lane_begin),
+                       product_buffer);
+                }
+              });
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::EvaluateChunk(
+    const std::vector<std::vector<int32_t>> &evidence_rows, size_t row_begin,
+    uint32_t lane_size, Semiring semiring, bool record_argmax) {
+  if (domain_ == LINEAR_DOMAIN && semiring == SUM_SEMIRING) {
+    EvaluateChunkLinear(evidence_rows, row_begin, lane_size);
+    return;
+  }
+  // The argmax of a node is only known if the node is recomputed for the
+  // chunk, so decoding always takes the full pass.
+  if (!record_argmax &&
+      EvaluateChunkCone(evidence_rows, row_begin, lane_size, semiring)) {
+    cone_chunk_count_ += 1;
+    return;
+  }
+  baseline_semiring_ = NO_SEMIRING;
+  dirty_positions_.clear();
+  const auto &element_offsets = compiled_psdd_->element_offsets();
+  const auto &params = compiled_psdd_->parameters();
+  ParallelFor(leaf_positions_.size(), 256,
+              [&](size_t begin, size_t end, uint32_t) {
+                for (size_t k = begin; k < end; ++k) {
+                  uint32_t position = leaf_positions_[k];
+                  double unobserved_value = 0;
+                  if (semiring == MAX_SEMIRING &&
+                      compiled_psdd_->node_type(position) == TOP_NODE_TYPE) {
+                    unobserved_value = std::max(
+                        params[element_offsets[position]].parameter(),
+                        params[element_offsets[position] + 1].parameter());
+                  }
+                  std::fill(lanes(position), lanes(position) + lane_stride_,
+                            unobserved_value);
+                }
+              });
+  SetEvidenceLanes(evidence_rows, row_begin, lane_size, semiring);
+  uint32_t active_size = RoundUpToLaneAlignment<T>(lane_size);
+  // Level 0 only holds leaves.
+  for (uint32_t level = 1; level < compiled_psdd_->level_size(); ++level) {
+    ForEachLevelNode(level, active_size,
+                     [&](uint32_t position, uint32_t lane_begin,
+                         uint32_t block_size, T *product_buffer) {
+                       EvaluateDecisionNode(position, lane_begin, block_size,
+                                            semiring, record_argmax,
+                                            product_buffer);
+                     });
+  }
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::EvaluateChunkLinear(
+    const std::vector<std::vector<int32_t>> &evidence_rows, size_t row_begin,
+    uint32_t lane_size) {
+  baseline_semiring_ = NO_SEMIRING;
+  dirty_positions_.clear();
+  // An unobserved leaf is 1 = 0.5 * 2^1, as in the log domain.
+  ParallelFor(leaf_positions_.size(), 256,
+              [&](size_t begin, size_t end, uint32_t) {
+                for (size_t k = begin; k < end; ++k) {
+                  uint32_t position = leaf_positions_[k];
+                  std::fill(lanes(position), lanes(position) + lane_stride_,
+                            0.5);
+                  std::fill(exponent_lanes(position),
+                            exponent_lanes(position) + lane_stride_, 1.0);
+                }
+              });
+  SetEvidenceLanes(evidence_rows, row_begin, lane_size, SUM_SEMIRING);
+  uint32_t active_size = RoundUpToLaneAlignment<T>(lane_size);
+  for (uint32_t level = 1; level < compiled_psdd_->level_size(); ++level) {
+    ForEachLevelNode(level, active_size,
+                     [&](uint32_t position, uint32_t lane_begin,
+                         uint32_t block_size, T *) {
+                       EvaluateDecisionNodeLinear(position, lane_begin,
+                                                  block_size);
+                     });
+  }
+  // Nothing reads the value of the root, so its lanes can hold the result.
+  uint32_t root_position = compiled_psdd_->root_position();
+  for (uint32_t lane = 0; lane < active_size; ++lane) {
+    lanes(root_position)[lane] = linear_space_kernels::JoinLog(
+        lanes(root_position)[lane], exponent_lanes(root_position)[lane]);
+  }
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::DifferentiateChunk(uint32_t lane_size) {
+  uint32_t active_size = RoundUpToLaneAlignment<T>(lane_size);
+  uint32_t root_position = compiled_psdd_->root_position();
+  if (domain_ == LINEAR_DOMAIN) {
+    // 1 = 0.5 * 2^1
+    std::fill(derivative_lanes(root_position),
+              derivative_lanes(root_position) + lane_stride_, 0.5);
+    std::fill(derivative_exponent_lanes(root_position),
+              derivative_exponent_lanes(root_position) + lane_stride_, 1.0);
+  } else {
+    std::fill(derivative_lanes(root_position),
+              derivative_lanes(root_position) + lane_stride_, 0.0);
+  }
+  // Parents are on higher levels, so walking the levels downwards makes
+  // every node's parents final before the node pulls from them.
+  for (int64_t level = (int64_t)compiled_psdd_->level_size() - 1; level >= 0;
+       --level) {
+    ForEachLevelNode((uint32_t)level, active_size,
+                     [&](uint32_t position, uint32_t lane_begin,
+                         uint32_t block_size, T *product_buffer) {
+                       if (position == root_position) {
+                         return;
+                       }
+                       if (domain_ == LINEAR_DOMAIN) {
+                         DifferentiateNodeLinear(position, lane_begin,
+                                                 block_size);
+                       } else {
+                         DifferentiateNode(position, lane_begin, block_size,
+                                           product_buffer);
+                       }
+                     });
+  }
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::EvaluateRows(
+    const std::vector<std::vector<int32_t>> &evidence_rows, Semiring semiring,
+    std::vector<double> *root_values) {
+  root_values->clear();
+  root_values->reserve(evidence_rows.size());
+  for (size_t row_begin = 0; row_begin < evidence_rows.size();
+       row_begin += batch_width_) {
+    auto lane_size = (uint32_t)std::min<size_t>(
+        batch_width_, evidence_rows.size() - row_begin);
+    EvaluateChunk(evidence_rows, row_begin, lane_size, semiring, false);
+    const T *root_lanes = lanes(compiled_psdd_->root_position());
+    root_values->insert(root_values->end(), root_lanes,
+                        root_lanes + lane_size);
+  }
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::LinearVariableJoints(uint32_t variable_index,
+                                                    uint32_t active_size,
+                                                    T *false_acc, T *true_acc,
+                                                    T *exponent_buffer) {
+  const linear_space_kernels::KernelTable<T> &kernels =
+      linear_space_kernels::GetKernelTable<T>(
+          static_cast<log_space_kernels::Isa>(simd_level_));
+  const auto &element_offsets = compiled_psdd_->element_offsets();
+  const auto &variable_leaf_offsets = compiled_psdd_->variable_leaf_offsets();
+  const auto &variable_leaves = compiled_psdd_->variable_leaves();
+  T *accs[2] = {false_acc, true_acc};
+  T *exponents[2] = {exponent_buffer, exponent_buffer + lane_stride_};
+  for (uint32_t value = 0; value < 2; ++value) {
+    std::fill(accs[value], accs[value] + active_size, 0.0);
+    std::fill(exponents[value], exponents[value] + active_size,
+              -std::numeric_limits<double>::infinity());
+  }
+  // The same terms as in the log domain: derivatives of the x-literals, and
+  // derivative * parameter of x for the top nodes. The first pass finds the
+  // exponent of each sum, the second adds the scaled terms.
+  for (int pass = 0; pass < 2; ++pass) {
+    for (uint32_t k = variable_leaf_offsets[variable_index];
+         k < variable_leaf_offsets[variable_index + 1]; ++k) {
+      uint32_t position = variable_leaves[k];
+      for (uint32_t value = 0; value < 2; ++value) {
+        T weight_mantissa = 1;
+        T weight_exponent = 0;
+        if (compiled_psdd_->node_type(position) == LITERAL_NODE_TYPE) {
+          if ((compiled_psdd_->literal(position) > 0) != (value == 1)) {
+            continue;
+          }
+        } else {
+          weight_mantissa = parameter_mantissas_[element_offsets[position] +
+                                                 value];
+          weight_exponent = parameter_exponents_[element_offsets[position] +
+                                                 value];
+        }
+        if (pass == 0) {
+          kernels.max_exponent(derivative_exponent_lanes(position),
+                               unit_exponents_.data(), weight_exponent,
+                               exponents[value], active_size);
+        } else {
+          kernels.scaled_multiply_add(
+              derivative_lanes(position), unit_mantissas_.data(),
+              derivative_exponent_lanes(position), unit_exponents_.data(),
+              weight_mantissa, weight_exponent, exponents[value], accs[value],
+              active_size);
+        }
+      }
+    }
+  }
+  for (uint32_t value = 0; value < 2; ++value) {
+    for (uint32_t lane = 0; lane < active_size; ++lane) {
+      accs[value][lane] = linear_space_kernels::JoinLog(
+          accs[value][lane], exponents[value][lane]);
+    }
+  }
+}
+
+template <typename T>
+std::vector<std::pair<Probability, Probability>>
+BasicBatchedEvaluator<T>::GetMarginals(
+    const std::vector<std::vector<int32_t>> &evidence_rows) {
+  const log_space_kernels::KernelTable<T> &kernels =
+      log_space_kernels::GetKernelTable<T>(
+          static_cast<log_space_kernels::Isa>(simd_level_));
+  const auto &element_offsets = compiled_psdd_->element_offsets();
+  const auto &params = compiled_psdd_->parameters();
+  const auto &variable_leaf_offsets = compiled_psdd_->variable_leaf_offsets();
+  const auto &variable_leaves = compiled_psdd_->variable_leaves();
+  uint32_t variable_size = compiled_psdd_->variable_size();
+  const auto zero_pair = std::make_pair(Probability::CreateFromDecimal(0),
+                                        Probability::CreateFromDecimal(0));
+  std::vector<std::pair<Probability, Probability>> marginals(
+      evidence_rows.size() * variable_size, zero_pair);
+  derivative_values_.resize(lane_values_.size());
+  if (domain_ == LINEAR_DOMAIN) {
+    derivative_exponents_.resize(lane_values_.size());
+  }
+  uint32_t thread_size = thread_pool_ ? thread_pool_->thread_size() : 1;
+  // Per worker: the false and true accumulators, and in the linear domain
+  // their exponents.
+  std::vector<T> accumulators((size_t)thread_size * 4 * lane_stride_);
+  for (size_t row_begin = 0; row_begin < evidence_rows.size();
+       row_begin += batch_width_) {
+    auto lane_size = (uint32_t)std::min<size_t>(
+        batch_width_, evidence_rows.size() - row_begin);
+    uint32_t active_size = RoundUpToLaneAlignment<T>(lane_size);
+    EvaluateChunk(evidence_rows, row_begin, lane_size, SUM_SEMIRING, false);
+    DifferentiateChunk(lane_size);
+    // For a variable X not in the evidence, Pr(X=x, e) is the sum of the
+    // derivatives of its x-literals, plus derivative * parameter of x over
+    // its top nodes.
+    ParallelFor(variable_size, 16, [&](size_t begin, size_t end,
+                                       uint32_t worker_index) {
+      T *false_acc =
+          accumulators.data() + (size_t)worker_index * 4 * lane_stride_;
+      T *true_acc = false_acc + lane_stride_;
+      T *product_buffer =
+          product_buffers_.data() + (size_t)worker_index * lane_stride_;
+      for (size_t v = begin; v < end; ++v) {
+        if (variable_leaf_offsets[v] == variable_leaf_offsets[v + 1]) {
+          continue;
+        }
+        if (domain_ == LINEAR_DOMAIN) {
+          LinearVariableJoints((uint32_t)v, active_size, false_acc, true_acc,
+                               true_acc + lane_stride_);
+        } else {
+          std::fill(false_acc, false_acc + active_size,
+                    -std::numeric_limits<double>::infinity());
+          std::fill(true_acc, true_acc + active_size,
+                    -std::numeric_limits<double>::infinity());
+          for (uint32_t k = variable_leaf_offsets[v];
+               k < variable_leaf_offsets[v + 1]; ++k) {
+            uint32_t position = variable_leaves[k];
+            const T *node_derivatives = derivative_lanes(position);
+            if (compiled_psdd_->node_type(position) == LITERAL_NODE_TYPE) {
+              kernels.log_add_exp(node_derivatives,
+                                  compiled_psdd_->literal(position) > 0
+                                      ? true_acc
+                                      : false_acc,
+                                  active_size);
+            } else {
+              for (uint32_t value = 0; value < 2; ++value) {
+                T weight =
+                    params[element_offsets[position] + value].parameter();
+                for (uint32_t lane = 0; lane < active_size; ++lane) {
+                  product_buffer[lane] = node_derivatives[lane] + weight;
+                }
+                kernels.log_add_exp(product_buffer,
+                                    value ? true_acc : false_acc, active_size);
+              }
+            }
+          }
+        }
+        for (uint32_t lane = 0; lane < lane_size; ++lane) {
+          Probability false_marginal =
+              Probability::CreateFromLog(false_acc[lane]);
+          Probability true_marginal =
+              Probability::CreateFromLog(true_acc[lane]);
+          Probability partition = false_marginal + true_marginal;
+          if (partition.parameter() ==
+              -std::numeric_limits<double>::infinity()) {
+            continue;
+          }
+          marginals[(row_begin + lane) * variable_size + v] =
+              std::make_pair(false_marginal / partition,
+                             true_marginal / partition);
+        }
+      }
+    });
+    // Rows with zero probability have no posterior; observed variables are
+    // certain.
+    const T *root_lanes = lanes(compiled_psdd_->root_position());
+    for (uint32_t lane = 0; lane < lane_size; ++lane) {
+      auto *row_marginals = &marginals[(row_begin + lane) * variable_size];
+      if (root_lanes[lane] == -std::numeric_limits<double>::infinity()) {
+        std::fill(row_marginals, row_marginals + variable_size, zero_pair);
+        continue;
+      }
+      for (int32_t literal : evidence_rows[row_begin + lane]) {
+        auto variable_index = (uint32_t)std::abs(literal);
+        if (variable_index >= variable_size ||
+            variable_leaf_offsets[variable_index] ==
+                variable_leaf_offsets[variable_index + 1]) {
+          continue;
+        }
+        row_marginals[variable_index] = std::make_pair(
+            Probability::CreateFromDecimal(literal > 0 ? 0 : 1),
+            Probability::CreateFromDecimal(literal > 0 ? 1 : 0));
+      }
+    }
+  }
+  return marginals;
+}
+
+template <typename T>
+void BasicBatchedEvaluator<T>::DecodeLane(
+    uint32_t lane, const std::vector<int32_t> &observations,
+    std::vector<uint32_t> *node_stack, std::vector<bool> *assignment) {
+  const auto &element_offsets = compiled_psdd_->element_offsets();
+  const auto &primes = compiled_psdd_->primes();
+  const auto &subs = compiled_psdd_->subs();
+  const auto &params = compiled_psdd_->parameters();
+  node_stack->clear();
+  node_stack->push_back(compiled_psdd_->root_position());
+  while (!node_stack->empty()) {
+    uint32_t position = node_stack->back();
+    node_stack->pop_back();
+    if (compiled_psdd_->node_type(position) == LITERAL_NODE_TYPE) {
+      int32_t literal = compiled_psdd_->literal(position);
+      (*assignment)[(uint32_t)std::abs(literal)] = literal > 0;
+    } else if (compiled_psdd_->node_type(position) == TOP_NODE_TYPE) {
+      uint32_t variable_index = compiled_psdd_->variable_index(position);
+      int32_t observation = observations[variable_index];
+      if (observation != 0) {
+        (*assignment)[variable_index] = observation > 0;
+      } else {
+        (*assignment)[variable_index] =
+            params[element_offsets[position] + 1].parameter() >
+            params[element_offsets[position]].parameter();
+      }
+    } else {
+      uintmax_t j = element_offsets[position] + argmax_lanes(position)[lane];
+      node_stack->push_back(primes[j]);
+      node_stack->push_back(subs[j]);
+    }
+  }
+}
+
+template <typename T>
+std::vector<std::pair<std::vector<bool>, Probability>>
+BasicBatchedEvaluator<T>::GetMPESolutions(
+    const std::vector<std::vector<int32_t>> &evidence_rows) {
+  uint32_t variable_size = compiled_psdd_->variable_size();
+  std::vector<std::pair<std::vector<bool>, Probability>> solutions;
+  solutions.reserve(evidence_rows.size());
+  argmax_values_.resize(lane_values_.size());
+  std::vector<int32_t> observations(variable_size, 0);
+  std::vector<uint32_t> node_stack;
+  for (size_t row_begin = 0; row_begin < evidence_rows.size();
+       row_begin += batch_width_) {
+    auto lane_size = (uint32_t)std::min<size_t>(
+        batch_width_, evidence_rows.size() - row_begin);
+    EvaluateChunk(evidence_rows, row_begin, lane_size, MAX_SEMIRING, true);
+    const T *root_lanes = lanes(compiled_psdd_->root_position());
+    for (uint32_t lane = 0; lane < lane_size; ++lane) {
+      solutions.emplace_back(std::vector<bool>(variable_size, false),
+                             Probability::CreateFromLog(root_lanes[lane]));
+      // A row with zero probability has no completion to decode.
+      if (root_lanes[lane] == -std::numeric_limits<double>::infinity()) {
+        continue;
+      }
+      const std::vector<int32_t> &row = evidence_rows[row_begin + lane];
+      for (int32_t literal : row) {
+        if ((uint32_t)std::abs(literal) < variable_size) {
+          observations[(uint32_t)std::abs(literal)] = literal;
+        }
+      }
+      DecodeLane(lane, observations, &node_stack, &solutions.back().first);
+      for (int32_t literal : row) {
+        if ((uint32_t)std::abs(literal) < variable_size) {
+          observations[(uint32_t)std::abs(literal)] = 0;
+        }
+      }
+    }
+  }
+  return solutions;
+}
+
+template class BasicBatchedEvaluator<float>;
+template class BasicBatchedEvaluator<double>;
@@ -0,0 +1,637 @@
+#include <psdd/compiled_psdd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+
+CompiledPsdd::CompiledPsdd(PsddNode *root_node) : variable_size_(0) {
+  std::vector<PsddNode *> serialized_nodes =
+      psdd_node_util::SerializePsddNodes(root_node);
+  // SerializePsddNodes lists parents before children, so its reverse is a
+  // bottom-up order.
+  std::reverse(serialized_nodes.begin(), serialized_nodes.end());
+  auto node_size = serialized_nodes.size();
+  node_types_.reserve(node_size);
+  literals_.reserve(node_size);
+  element_offsets_.reserve(node_size + 1);
+  // Positions are kept here rather than in user_data, which belongs to the
+  // caller.
+  std::unordered_map<const PsddNode *, uint32_t> node_positions;
+  node_positions.reserve(node_size);
+  for (PsddNode *cur_node : serialized_nodes) {
+    node_positions.emplace(cur_node, (uint32_t)node_positions.size());
+  }
+  element_offsets_.push_back(0);
+  for (PsddNode *cur_node : serialized_nodes) {
+    node_types_.push_back((uint8_t)cur_node->node_type());
+    if (cur_node->node_type() == LITERAL_NODE_TYPE) {
+      PsddLiteralNode *cur_literal = cur_node->psdd_literal_node();
+      literals_.push_back(cur_literal->literal());
+      variable_size_ =
+          std::max(variable_size_, cur_literal->variable_index() + 1);
+    } else if (cur_node->node_type() == TOP_NODE_TYPE) {
+      PsddTopNode *cur_top = cur_node->psdd_top_node();
+      literals_.push_back((int32_t)cur_top->variable_index());
+      variable_size_ = std::max(variable_size_, cur_top->variable_index() + 1);
+      primes_.push_back(0);
+      subs_.push_back(0);
+      parameters_.push_back(cur_top->false_parameter());
+      primes_.push_back(0);
+      subs_.push_back(0);
+      parameters_.push_back(cur_top->true_parameter());
+    } else {
+      assert(cur_node->node_type() == DECISION_NODE_TYPE);
+      PsddDecisionNode *cur_decn_node = cur_node->psdd_decision_node();
+      literals_.push_back(0);
+      for (const PsddElement &cur_element : cur_decn_node->elements()) {
+        primes_.push_back(node_positions.at(cur_element.prime));
+        subs_.push_back(node_positions.at(cur_element.sub));
+        parameters_.push_back(cur_element.parameter);
+      }
+    }
+    element_offsets_.push_back(parameters_.size());
+  }
+  BuildSchedules();
+}
+
+void CompiledPsdd::BuildSchedules() {
+  uint32_t node_size = this->node_size();
+  // Levels, by a counting sort of the nodes on their level.
+  std::vector<uint32_t> node_levels(node_size, 0);
+  uint32_t level_size = 1;
+  for (uint32_t i = 0; i < node_size; ++i) {
+    if (node_types_[i] != DECISION_NODE_TYPE) {
+      continue;
+    }
+    uint32_t child_level = 0;
+    for (uintmax_t j = element_offsets_[i]; j < element_offsets_[i + 1]; ++j) {
+      child_level = std::max(
+          child_level, std::max(node_levels[primes_[j]], node_levels[subs_[j]]));
+    }
+    node_levels[i] = child_level + 1;
+    level_size = std::max(level_size, node_levels[i] + 1);
+  }
+  level_offsets_.assign(level_size + 1, 0);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    level_offsets_[node_levels[i] + 1] += 1;
+  }
+  for (uint32_t level = 0; level < level_size; ++level) {
+    level_offsets_[level + 1] += level_offsets_[level];
+  }
+  level_positions_.resize(node_size);
+  std::vector<uint32_t> next_slots(level_offsets_.begin(),
+                                   level_offsets_.end() - 1);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    level_positions_[next_slots[node_levels[i]]++] = i;
+  }
+  // Parents and element owners.
+  element_owners_.resize(parameters_.size());
+  parent_offsets_.assign(node_size + 1, 0);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    for (uintmax_t j = element_offsets_[i]; j < element_offsets_[i + 1]; ++j) {
+      element_owners_[j] = i;
+      if (node_types_[i] == DECISION_NODE_TYPE) {
+        parent_offsets_[primes_[j] + 1] += 1;
+        parent_offsets_[subs_[j] + 1] += 1;
+      }
+    }
+  }
+  for (uint32_t i = 0; i < node_size; ++i) {
+    parent_offsets_[i + 1] += parent_offsets_[i];
+  }
+  parent_elements_.resize(parent_offsets_[node_size]);
+  std::vector<uintmax_t> next_parent_slots(parent_offsets_.begin(),
+                                           parent_offsets_.end() - 1);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    if (node_types_[i] != DECISION_NODE_TYPE) {
+      continue;
+    }
+    for (uintmax_t j = element_offsets_[i]; j < element_offsets_[i + 1]; ++j) {
+      parent_elements_[next_parent_slots[primes_[j]]++] = j;
+      parent_elements_[next_parent_slots[subs_[j]]++] = j;
+    }
+  }
+  // Variable leaves.
+  variable_leaf_offsets_.assign(variable_size_ + 1, 0);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    if (node_types_[i] != DECISION_NODE_TYPE) {
+      variable_leaf_offsets_[variable_index(i) + 1] += 1;
+    }
+  }
+  for (uint32_t v = 0; v < variable_size_; ++v) {
+    variable_leaf_offsets_[v + 1] += variable_leaf_offsets_[v];
+  }
+  variable_leaves_.resize(variable_leaf_offsets_[variable_size_]);
+  std::vector<uint32_t> next_leaf_slots(variable_leaf_offsets_.begin(),
+                                        variable_leaf_offsets_.end() - 1);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    if (node_types_[i] != DECISION_NODE_TYPE) {
+      variable_leaves_[next_leaf_slots[variable_index(i)]++] = i;
+    }
+  }
+}
+
+uint32_t CompiledPsdd::node_size() const {
+  return (uint32_t)node_types_.size();
+}
+
+uint32_t CompiledPsdd::root_position() const {
+  assert(!node_types_.empty());
+  return (uint32_t)node_types_.size() - 1;
+}
+
+uint32_t CompiledPsdd::variable_size() const { return variable_size_; }
+
+int CompiledPsdd::node_type(uint32_t position) const {
+  return node_types_[position];
+}
+
+int32_t CompiledPsdd::literal(uint32_t position) const {
+  return literals_[position];
+}
+
+uint32_t CompiledPsdd::variable_index(uint32_t position) const {
+  return literals_[position] > 0 ? static_cast<uint32_t>(literals_[position])
+                                 : static_cast<uint32_t>(-literals_[position]);
+}
+
+const std::vector<uint8_t> &CompiledPsdd::node_types() const {
+  return node_types_;
+}
+
+const std::vector<int32_t> &CompiledPsdd::literals() const {
+  return literals_;
+}
+
+const std::vector<uintmax_t> &CompiledPsdd::element_offsets() const {
+  return element_offsets_;
+}
+
+const std::vector<uint32_t> &CompiledPsdd::primes() const { return primes_; }
+
+const std::vector<uint32_t> &CompiledPsdd::subs() const { return subs_; }
+
+const std::vector<PsddParameter> &CompiledPsdd::parameters() const {
+  return parameters_;
+}
+
+uint32_t CompiledPsdd::level_size() const {
+  return (uint32_t)level_offsets_.size() - 1;
+}
+
+const std::vector<uint32_t> &CompiledPsdd::level_offsets() const {
+  return level_offsets_;
+}
+
+const std::vector<uint32_t> &CompiledPsdd::level_positions() const {
+  return level_positions_;
+}
+
+const std::vector<uintmax_t> &CompiledPsdd::parent_offsets() const {
+  return parent_offsets_;
+}
+
+const std::vector<uintmax_t> &CompiledPsdd::parent_elements() const {
+  return parent_elements_;
+}
+
+const std::vector<uint32_t> &CompiledPsdd::element_owners() const {
+  return element_owners_;
+}
+
+const std::vector<uint32_t> &CompiledPsdd::variable_leaf_offsets() const {
+  return variable_leaf_offsets_;
+}
+
+const std::vector<uint32_t> &CompiledPsdd::variable_leaves() const {
+  return variable_leaves_;
+}
+
+namespace {
+// The derivative of the root with respect to the node at position, summed
+// over the elements that use the node. Parents come later in the bottom-up
+// order, so their derivatives must already be set. The terms are gathered
+// into terms first so the two passes of SumParameters read them in order.
+Probability PullDerivative(const CompiledPsdd &compiled_psdd,
+                           const std::vector<Probability> &derivatives,
+                           uint32_t position, LogSumAccuracy accuracy,
+                           std::vector<Probability> *terms) {
+  if (position == compiled_psdd.root_position()) {
+    return Probability::CreateFromDecimal(1);
+  }
+  const auto &params = compiled_psdd.parameters();
+  const auto &parent_offsets = compiled_psdd.parent_offsets();
+  const auto &parent_elements = compiled_psdd.parent_elements();
+  const auto &element_owners = compiled_psdd.element_owners();
+  terms->clear();
+  for (uintmax_t k = parent_offsets[position];
+       k < parent_offsets[position + 1]; ++k) {
+    uintmax_t j = parent_elements[k];
+    terms->push_back(derivatives[element_owners[j]] * params[j]);
+  }
+  return SumParameters(
+      terms->size(), [terms](size_t i) { return (*terms)[i]; }, accuracy);
+}
+
+// The marginals of a variable with at least one leaf, first is false second
+// is true, from the derivatives of its leaves.
+std::pair<Probability, Probability>
+VariableMarginal(const CompiledPsdd &compiled_psdd,
+                 const std::vector<Probability> &derivatives,
+                 uint32_t variable_index, LogSumAccuracy accuracy,
+                 std::vector<Probability> *false_terms,
+                 std::vector<Probability> *true_terms) {
+  const auto &element_offsets = compiled_psdd.element_offsets();
+  const auto &params = compiled_psdd.parameters();
+  const auto &variable_leaf_offsets = compiled_psdd.variable_leaf_offsets();
+  const auto &variable_leaves = compiled_psdd.variable_leaves();
+  false_terms->clear();
+  true_terms->clear();
+  for (uint32_t k = variable_leaf_offsets[variable_index];
+       k < variable_leaf_offsets[variable_index + 1]; ++k) {
+    uint32_t position = variable_leaves[k];
+    if (compiled_psdd.node_type(position) == LITERAL_NODE_TYPE) {
+      if (compiled_psdd.literal(position) > 0) {
+        true_terms->push_back(derivatives[position]);
+      } else {
+        false_terms->push_back(derivatives[position]);
+      }
+    } else {
+      false_terms->push_back(derivatives[position] *
+                             params[element_offsets[position]]);
+      true_terms->push_back(derivatives[position] *
+                            params[element_offsets[position] + 1]);
+    }
+  }
+  Probability false_marginal = SumParameters(
+      false_terms->size(), [false_terms](size_t i) { return (*false_terms)[i]; },
+      accuracy);
+  Probability true_marginal = SumParameters(
+      true_terms->size(), [true_terms](size_t i) { return (*true_terms)[i]; },
+      accuracy);
+  Probability partition = false_marginal.Add(true_marginal, accuracy);
+  return std::make_pair(false_marginal / partition, true_marginal / partition);
+}
+
+// The marginals with every derivative pushed from its parents in turn,
+// folding with the FAST_LOG_SUM Add.
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+PushMarginals(const CompiledPsdd &compiled_psdd, QueryWorkspace *workspace) {
+  const auto &node_types = compiled_psdd.node_types();
+  const auto &element_offsets = compiled_psdd.element_offsets();
+  const auto &primes = compiled_psdd.primes();
+  const auto &subs = compiled_psdd.subs();
+  const auto &params = compiled_psdd.parameters();
+  uint32_t node_size = compiled_psdd.node_size();
+  // first is false second is true
+  std::vector<std::pair<Probability, Probability>> &variable_marginals =
+      *workspace->MutableVariableMarginals(compiled_psdd.variable_size());
+  std::vector<Probability> &derivatives =
+      *workspace->MutableDerivatives(node_size);
+  derivatives[compiled_psdd.root_position()] =
+      Probability::CreateFromDecimal(1);
+  for (int64_t i = (int64_t)node_size - 1; i >= 0; --i) {
+    const Probability cur_derivative = derivatives[i];
+    if (node_types[i] == LITERAL_NODE_TYPE) {
+      auto &cur_marginal =
+          variable_marginals[compiled_psdd.variable_index((uint32_t)i)];
+      if (compiled_psdd.literal((uint32_t)i) > 0) {
+        cur_marginal.second =
+            cur_marginal.second.Add(cur_derivative, FAST_LOG_SUM);
+      } else {
+        cur_marginal.first =
+            cur_marginal.first.Add(cur_derivative, FAST_LOG_SUM);
+      }
+    } else if (node_types[i] == TOP_NODE_TYPE) {
+      auto &cur_marginal =
+          variable_marginals[compiled_psdd.variable_index((uint32_t)i)];
+      cur_marginal.first = cur_marginal.first.Add(
+          cur_derivative * params[element_offsets[i]], FAST_LOG_SUM);
+      cur_marginal.second = cur_marginal.second.Add(
+          cur_derivative * params[element_offsets[i] + 1], FAST_LOG_SUM);
+    } else {
+      for (uintmax_t j = element_offsets[i]; j < element_offsets[i + 1]; ++j) {
+        Probability cur_term = cur_derivative * params[j];
+        derivatives[primes[j]] =
+            derivatives[primes[j]].Add(cur_term, FAST_LOG_SUM);
+        derivatives[subs[j]] = derivatives[subs[j]].Add(cur_term, FAST_LOG_SUM);
+      }
+    }
+  }
+  const auto &variable_leaf_offsets = compiled_psdd.variable_leaf_offsets();
+  std::unordered_map<uint32_t, std::pair<Probability, Probability>> marginals;
+  for (uint32_t v = 0; v < compiled_psdd.variable_size(); ++v) {
+    if (variable_leaf_offsets[v] == variable_leaf_offsets[v + 1]) {
+      continue;
+    }
+    const auto &cur_marginal = variable_marginals[v];
+    Probability partition =
+        cur_marginal.first.Add(cur_marginal.second, FAST_LOG_SUM);
+    marginals[v] = std::make_pair(cur_marginal.first / partition,
+                                  cur_marginal.second / partition);
+  }
+  return marginals;
+}
+} // namespace
+
+namespace psdd_node_util {
+std::pair<std::bitset<MAX_VAR>, Probability>
+GetMPESolution(const CompiledPsdd &compiled_psdd) {
+  QueryWorkspace workspace;
+  return GetMPESolution(compiled_psdd, &workspace);
+}
+
+std::pair<std::bitset<MAX_VAR>, Probability>
+GetMPESolution(const CompiledPsdd &compiled_psdd, QueryWorkspace *workspace) {
+  const auto &node_types = compiled_psdd.node_types();
+  const auto &element_offsets = compiled_psdd.element_offsets();
+  const auto &primes = compiled_psdd.primes();
+  const auto &subs = compiled_psdd.subs();
+  const auto &params = compiled_psdd.parameters();
+  uint32_t node_size = compiled_psdd.node_size();
+  std::vector<Probability> &max_values = *workspace->MutableValues(node_size);
+  // For a decision node, the element slot achieving the max. For a top node,
+  // 1 if the true parameter is chosen.
+  std::vector<uintmax_t> &max_choices = *workspace->MutableChoices(node_size);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    if (node_types[i] == LITERAL_NODE_TYPE) {
+      max_values[i] = Probability::CreateFromDecimal(1);
+      max_choices[i] = 0;
+    } else if (node_types[i] == TOP_NODE_TYPE) {
+      const auto &false_param = params[element_offsets[i]];
+      const auto &true_param = params[element_offsets[i] + 1];
+      if (true_param > false_param) {
+        max_values[i] = true_param;
+        max_choices[i] = 1;
+      } else {
+        max_values[i] = false_param;
+        max_choices[i] = 0;
+      }
+    } else {
+      Probability max_product = Probability::CreateFromDecimal(0);
+      uintmax_t max_index = element_offsets[i];
+      for (uintmax_t j = element_offsets[i]; j < element_offsets[i + 1]; ++j) {
+        Probability cur_product =
+            max_values[primes[j]] * max_values[subs[j]] * params[j];
+        if (cur_product > max_product) {
+          max_product = cur_product;
+          max_index = j;
+        }
+      }
+      max_values[i] = max_product;
+      max_choices[i] = max_index;
+    }
+  }
+  std::bitset<MAX_VAR> max_instantiation;
+  std::vector<uintmax_t> &node_stack = *workspace->MutableStack();
+  node_stack.push_back(compiled_psdd.root_position());
+  while (!node_stack.empty()) {
+    uintmax_t cur_position = node_stack.back();
+    node_stack.pop_back();
+    if (node_types[cur_position] == LITERAL_NODE_TYPE) {
+      if (compiled_psdd.literal(cur_position) > 0) {
+        max_instantiation.set(compiled_psdd.variable_index(cur_position));
+      }
+    } else if (node_types[cur_position] == TOP_NODE_TYPE) {
+      if (max_choices[cur_position]) {
+        max_instantiation.set(compiled_psdd.variable_index(cur_position));
+      }
+    } else {
+      node_stack.push_back(primes[max_choices[cur_position]]);
+      node_stack.push_back(subs[max_choices[cur_position]]);
+    }
+  }
+  return {max_instantiation, max_values[compiled_psdd.root_position()]};
+}
+
+mpz_class ModelCount(const CompiledPsdd &compiled_psdd) {
+  QueryWorkspace workspace;
+  return ModelCount(compiled_psdd, &workspace);
+}
+
+mpz_class ModelCount(const CompiledPsdd &compiled_psdd,
+                     QueryWorkspace *workspace) {
+  const auto &node_types = compiled_psdd.node_types();
+  const auto &element_offsets = compiled_psdd.element_offsets();
+  const auto &primes = compiled_psdd.primes();
+  const auto &subs = compiled_psdd.subs();
+  uint32_t node_size = compiled_psdd.node_size();
+  std::vector<mpz_class> &counts = *workspace->MutableCounts(node_size);
+  mpz_class product = 0;
+  for (uint32_t i = 0; i < node_size; ++i) {
+    if (node_types[i] == LITERAL_NODE_TYPE) {
+      counts[i] = 1;
+    } else if (node_types[i] == TOP_NODE_TYPE) {
+      counts[i] = 2;
+    } else {
+      mpz_class &total_count = counts[i];
+      total_count = 0;
+      for (uintmax_t j = element_offsets[i]; j < element_offsets[i + 1]; ++j) {
+        mpz_mul(product.get_mpz_t(), counts[primes[j]].get_mpz_t(),
+                counts[subs[j]].get_mpz_t());
+        mpz_add(total_count.get_mpz_t(), total_count.get_mpz_t(),
+                product.get_mpz_t());
+      }
+    }
+  }
+  return counts[compiled_psdd.root_position()];
+}
+
+Probability Evaluate(const std::bitset<MAX_VAR> &variables,
+                     const std::bitset<MAX_VAR> &instantiation,
+                     const CompiledPsdd &compiled_psdd) {
+  QueryWorkspace workspace;
+  return Evaluate(variables, instantiation, compiled_psdd, &workspace);
+}
+
+Probability Evaluate(const std::bitset<MAX_VAR> &variables,
+                     const std::bitset<MAX_VAR> &instantiation,
+                     const CompiledPsdd &compiled_psdd,
+                     QueryWorkspace *workspace) {
+  return Evaluate(variables, instantiation, compiled_psdd, workspace,
+                  EXACT_LOG_SUM);
+}
+
+Probability Evaluate(const std::bitset<MAX_VAR> &variables,
+                     const std::bitset<MAX_VAR> &instantiation,
+                     const CompiledPsdd &compiled_psdd,
+                     QueryWorkspace *workspace, LogSumAccuracy accuracy) {
+  const auto &node_types = compiled_psdd.node_types();
+  const auto &element_offsets = compiled_psdd.element_offsets();
+  const auto &primes = compiled_psdd.primes();
+  const auto &subs = compiled_psdd.subs();
+  const auto &params = compiled_psdd.parameters();
+  uint32_t node_size = compiled_psdd.node_size();
+  std::vector<Probability> &values = *workspace->MutableValues(node_size);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    if (node_types[i] == LITERAL_NODE_TYPE) {
+      uint32_t variable_index = compiled_psdd.variable_index(i);
+      if (variables[variable_index] &&
+          instantiation[variable_index] != (compiled_psdd.literal(i) > 0)) {
+        values[i] = Probability::CreateFromDecimal(0);
+      } else {
+        values[i] = Probability::CreateFromDecimal(1);
+      }
+    } else if (node_types[i] == TOP_NODE_TYPE) {
+      uint32_t variable_index = compiled_psdd.variable_index(i);
+      if (variables[variable_index]) {
+        values[i] = params[element_offsets[i] +
+                           (instantiation[variable_index] ? 1 : 0)];
+      } else {
+        values[i] = Probability::CreateFromDecimal(1);
+      }
+    } else {
+      uintmax_t element_begin = element_offsets[i];
+      values[i] = SumParameters(
+          element_offsets[i + 1] - element_begin,
+          [&](size_t k) {
+            uintmax_t j = element_begin + k;
+            return values[primes[j]] * values[subs[j]] * params[j];
+          },
+          accuracy);
+    }
+  }
+  return values[compiled_psdd.root_position()];
+}
+
+bool IsConsistent(const CompiledPsdd &compiled_psdd,
+                  const std::bitset<MAX_VAR> &variable_mask,
+                  const std::bitset<MAX_VAR> &partial_instantiation) {
+  QueryWorkspace workspace;
+  return IsConsistent(compiled_psdd, variable_mask, partial_instantiation,
+                      &workspace);
+}
+
+bool IsConsistent(const CompiledPsdd &compiled_psdd,
+                  const std::bitset<MAX_VAR> &variable_mask,
+                  const std::bitset<MAX_VAR> &partial_instantiation,
+                  QueryWorkspace *workspace) {
+  const auto &node_types = compiled_psdd.node_types();
+  const auto &element_offsets = compiled_psdd.element_offsets();
+  const auto &primes = compiled_psdd.primes();
+  const auto &subs = compiled_psdd.subs();
+  uint32_t node_size = compiled_psdd.node_size();
+  std::vector<uint8_t> &activation_flags = *workspace->MutableFlags(node_size);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    if (node_types[i] == LITERAL_NODE_TYPE) {
+      uint32_t variable_index = compiled_psdd.variable_index(i);
+      activation_flags[i] = !variable_mask[variable_index] ||
+                            partial_instantiation[variable_index] ==
+                                (compiled_psdd.literal(i) > 0);
+    } else if (node_types[i] == TOP_NODE_TYPE) {
+      activation_flags[i] = 1;
+    } else {
+      for (uintmax_t j = element_offsets[i]; j < element_offsets[i + 1]; ++j) {
+        if (activation_flags[primes[j]] && activation_flags[subs[j]]) {
+          activation_flags[i] = 1;
+          break;
+        }
+      }
+    }
+  }
+  return activation_flags[compiled_psdd.root_position()] != 0;
+}
+
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd) {
+  QueryWorkspace workspace;
+  return GetMarginals(compiled_psdd, &workspace);
+}
+
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd, QueryWorkspace *workspace) {
+  return GetMarginals(compiled_psdd, workspace, EXACT_LOG_SUM);
+}
+
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd, QueryWorkspace *workspace,
+             LogSumAccuracy accuracy) {
+  if (accuracy == FAST_LOG_SUM) {
+    // The table-driven Add is cheap enough that gathering the terms of each
+    // node for a pull costs more than it saves.
+    return PushMarginals(compiled_psdd, workspace);
+  }
+  const auto &variable_leaf_offsets = compiled_psdd.variable_leaf_offsets();
+  uint32_t node_size = compiled_psdd.node_size();
+  // Each derivative is pulled from the parents in one reduction rather than
+  // pushed from every parent in turn.
+  std::vector<Probability> &derivatives = *workspace->MutableValues(node_size);
+  std::vector<Probability> &terms = *workspace->MutableTerms();
+  for (int64_t i = (int64_t)node_size - 1; i >= 0; --i) {
+    derivatives[i] = PullDerivative(compiled_psdd, derivatives, (uint32_t)i,
+                                    accuracy, &terms);
+  }
+  std::vector<Probability> &true_terms = *workspace->MutableTrueTerms();
+  std::unordered_map<uint32_t, std::pair<Probability, Probability>> marginals;
+  for (uint32_t v = 0; v < compiled_psdd.variable_size(); ++v) {
+    if (variable_leaf_offsets[v] != variable_leaf_offsets[v + 1]) {
+      marginals[v] = VariableMarginal(compiled_psdd, derivatives, v, accuracy,
+                                      &terms, &true_terms);
+    }
+  }
+  return marginals;
+}
+
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd, ThreadPool *thread_pool) {
+  return GetMarginals(compiled_psdd, thread_pool, EXACT_LOG_SUM);
+}
+
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd, ThreadPool *thread_pool,
+             LogSumAccuracy accuracy) {
+  QueryWorkspace workspace;
+  return GetMarginals(compiled_psdd, thread_pool, &workspace, accuracy);
+}
+
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const CompiledPsdd &compiled_psdd, ThreadPool *thread_pool,
+             QueryWorkspace *workspace, LogSumAccuracy accuracy) {
+  const auto &level_offsets = compiled_psdd.level_offsets();
+  const auto &level_positions = compiled_psdd.level_positions();
+  const auto &variable_leaf_offsets = compiled_psdd.variable_leaf_offsets();
+  std::vector<Probability> &derivatives =
+      *workspace->MutableValues(compiled_psdd.node_size());
+  // Scratch term buffers, two per worker.
+  std::vector<std::vector<Probability>> &worker_terms =
+      *workspace->MutableWorkerTerms(2 * thread_pool->thread_size());
+  // Parents are always on a higher level, so each level only reads the
+  // derivatives written by the levels before it.
+  for (int64_t level = (int64_t)compiled_psdd.level_size() - 1; level >= 0;
+       --level) {
+    uint32_t level_begin = level_offsets[level];
+    thread_pool->ParallelFor(
+        level_offsets[level + 1] - level_begin, 64,
+        [&](size_t begin, size_t end, uint32_t worker_index) {
+          for (size_t k = begin; k < end; ++k) {
+            uint32_t position = level_positions[level_begin + k];
+            derivatives[position] =
+                PullDerivative(compiled_psdd, derivatives, position, accuracy,
+                               &worker_terms[2 * worker_index]);
+          }
+        });
+  }
+  // first is false second is true
+  std::vector<std::pair<Probability, Probability>> &variable_marginals =
+      *workspace->MutableVariableMarginals(compiled_psdd.variable_size());
+  thread_pool->ParallelFor(
+      compiled_psdd.variable_size(), 64,
+      [&](size_t begin, size_t end, uint32_t worker_index) {
+        for (size_t v = begin; v < end; ++v) {
+          if (variable_leaf_offsets[v] != variable_leaf_offsets[v + 1]) {
+            variable_marginals[v] = VariableMarginal(
+                compiled_psdd, derivatives, (uint32_t)v, accuracy,
+                &worker_terms[2 * worker_index],
+                &worker_terms[2 * worker_index + 1]);
+          }
+        }
+      });
+  std::unordered_map<uint32_t, std::pair<Probability, Probability>> marginals;
+  for (uint32_t v = 0; v < compiled_psdd.variable_size(); ++v) {
+    if (variable_leaf_offsets[v] != variable_leaf_offsets[v + 1]) {
+      marginals[v] = variable_marginals[v];
+    }
+  }
+  return marginals;
+}
+} // namespace psdd_node_util
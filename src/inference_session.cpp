@@ -0,0 +1,287 @@
+#include <psdd/inference_session.h>
+
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <queue>
+
+InferenceSession::InferenceSession(PsddNode *root_node)
+    : compiled_psdd_(root_node), last_recomputed_size_(0) {
+  uint32_t node_size = compiled_psdd_.node_size();
+  uint32_t variable_size = compiled_psdd_.variable_size();
+  observations_.resize(variable_size, 0);
+  values_.resize(node_size);
+  derivatives_.resize(node_size);
+  queued_.resize(node_size, 0);
+  dirty_variables_.resize(variable_size, 0);
+  for (uint32_t i = 0; i < node_size; ++i) {
+    if (compiled_psdd_.node_type(i) == DECISION_NODE_TYPE) {
+      values_[i] = DecisionValue(i);
+    } else {
+      values_[i] = LeafValue(i);
+    }
+  }
+  for (int64_t i = (int64_t)node_size - 1; i >= 0; --i) {
+    derivatives_[i] = Derivative((uint32_t)i);
+  }
+  variable_marginals_.resize(variable_size);
+  for (uint32_t v = 0; v < variable_size; ++v) {
+    variable_marginals_[v] = VariableMarginal(v);
+  }
+  last_recomputed_size_ = 2 * (uintmax_t)node_size;
+}
+
+const CompiledPsdd &InferenceSession::compiled_psdd() const {
+  return compiled_psdd_;
+}
+
+void InferenceSession::Observe(int32_t literal) {
+  auto variable_index = (uint32_t)std::abs(literal);
+  last_recomputed_size_ = 0;
+  if (variable_index >= observations_.size() ||
+      observations_[variable_index] == literal) {
+    return;
+  }
+  observations_[variable_index] = literal;
+  PropagateValues(variable_index);
+}
+
+void InferenceSession::Retract(uint32_t variable_index) {
+  last_recomputed_size_ = 0;
+  if (variable_index >= observations_.size() ||
+      observations_[variable_index] == 0) {
+    return;
+  }
+  observations_[variable_index] = 0;
+  PropagateValues(variable_index);
+}
+
+int32_t InferenceSession::observation(uint32_t variable_index) const {
+  return variable_index < observations_.size() ? observations_[variable_index]
+                                               : 0;
+}
+
+Probability InferenceSession::EvidenceProbability() const {
+  return Probability::CreateFromLog(values_[compiled_psdd_.root_position()]);
+}
+
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+InferenceSession::Marginals() {
+  last_recomputed_size_ = 0;
+  PropagateDerivatives();
+  for (uint32_t variable_index : dirty_variable_list_) {
+    variable_marginals_[variable_index] = VariableMarginal(variable_index);
+    dirty_variables_[variable_index] = 0;
+  }
+  dirty_variable_list_.clear();
+  bool zero_evidence = values_[compiled_psdd_.root_position()] ==
+                       -std::numeric_limits<double>::infinity();
+  const auto &variable_leaf_offsets = compiled_psdd_.variable_leaf_offsets();
+  std::unordered_map<uint32_t, std::pair<Probability, Probability>> marginals;
+  for (uint32_t v = 0; v < compiled_psdd_.variable_size(); ++v) {
+    if (variable_leaf_offsets[v] == variable_leaf_offsets[v + 1]) {
+      continue;
+    }
+    if (zero_evidence) {
+      marginals[v] = std::make_pair(Probability::CreateFromDecimal(0),
+                                    Probability::CreateFromDecimal(0));
+    } else if (observations_[v] != 0) {
+      marginals[v] = std::make_pair(
+          Probability::CreateFromDecimal(observations_[v] > 0 ? 0 : 1),
+          Probability::CreateFromDecimal(observations_[v] > 0 ? 1 : 0));
+    } else {
+      marginals[v] = variable_marginals_[v];
+    }
+  }
+  return marginals;
+}
+
+uintmax_t InferenceSession::last_recomputed_size() const {
+  return last_recomputed_size_;
+}
+
+double InferenceSession::LeafValue(uint32_t position) const {
+  int32_t cur_observation =
+      observations_[compiled_psdd_.variable_index(position)];
+  if (cur_observation == 0) {
+    return 0;
+  }
+  if (compiled_psdd_.node_type(position) == LITERAL_NODE_TYPE) {
+    return compiled_psdd_.literal(position) == cur_observation
+               ? 0
+               : -std::numeric_limits<double>::infinity();
+  }
+  return compiled_psdd_
+      .parameters()[compiled_psdd_.element_offsets()[position] +
+                    (cur_observation > 0 ? 1 : 0)]
+      .parameter();
+}
+
+double InferenceSession::DecisionValue(uint32_t position) const {
+  const auto &element_offsets = compiled_psdd_.element_offsets();
+  const auto &primes = compiled_psdd_.primes();
+  const auto &subs = compiled_psdd_.subs();
+  const auto &params = compiled_psdd_.parameters();
+  uintmax_t element_begin = element_offsets[position];
+  return SumParameters(element_offsets[position + 1] - element_begin,
+                       [&](size_t k) {
+                         uintmax_t j = element_begin + k;
+                         return Probability::CreateFromLog(values_[primes[j]] +
+                                                           values_[subs[j]]) *
+                                params[j];
+                       })
+      .parameter();
+}
+
+double InferenceSession::Derivative(uint32_t position) const {
+  if (position == compiled_psdd_.root_position()) {
+    return 0;
+  }
+  const auto &primes = compiled_psdd_.primes();
+  const auto &subs = compiled_psdd_.subs();
+  const auto &params = compiled_psdd_.parameters();
+  const auto &parent_offsets = compiled_psdd_.parent_offsets();
+  const auto &parent_elements = compiled_psdd_.parent_elements();
+  const auto &element_owners = compiled_psdd_.element_owners();
+  uintmax_t parent_begin = parent_offsets[position];
+  return SumParameters(parent_offsets[position + 1] - parent_begin,
+                       [&](size_t k) {
+                         uintmax_t j = parent_elements[parent_begin + k];
+                         uint32_t sibling =
+                             primes[j] == position ? subs[j] : primes[j];
+                         return Probability::CreateFromLog(
+                                    derivatives_[element_owners[j]] +
+                                    values_[sibling]) *
+                                params[j];
+                       })
+      .parameter();
+}
+
+std::pair<Probability, Probability>
+InferenceSession::VariableMarginal(uint32_t variable_index) const {
+  const auto &element_offsets = compiled_psdd_.element_offsets();
+  const auto &params = compiled_psdd_.parameters();
+  const auto &variable_leaf_offsets = compiled_psdd_.variable_leaf_offsets();
+  const auto &variable_leaves = compiled_psdd_.variable_leaves();
+  // Pr(X=x, e) for an unobserved X is the derivative with respect to its
+  // x-indicator.
+  Probability false_marginal = Probability::CreateFromDecimal(0);
+  Probability true_marginal = Probability::CreateFromDecimal(0);
+  for (uint32_t k = variable_leaf_offsets[variable_index];
+       k < variable_leaf_offsets[variable_index + 1]; ++k) {
+    uint32_t position = variable_leaves[k];
+    Probability derivative = Probability::CreateFromLog(derivatives_[position]);
+    if (compiled_psdd_.node_type(position) == LITERAL_NODE_TYPE) {
+      if (compiled_psdd_.literal(position) > 0) {
+        true_marginal = true_marginal + derivative;
+      } else {
+        false_marginal = false_marginal + derivative;
+      }
+    } else {
+      false_marginal =
+          false_marginal + derivative * params[element_offsets[position]];
+      true_marginal =
+          true_marginal + derivative * params[element_offsets[position] + 1];
+    }
+  }
+  Probability partition = false_marginal + true_marginal;
+  if (partition.parameter() == -std::numeric_limits<double>::infinity()) {
+    return std::make_pair(Probability::CreateFromDecimal(0),
+                          Probability::CreateFromDecimal(0));
+  }
+  return std::make_pair(false_marginal / partition, true_marginal / partition);
+}
+
+void InferenceSession::PropagateValues(uint32_t variable_index) {
+  const auto &parent_offsets = compiled_psdd_.parent_offsets();
+  const auto &parent_elements = compiled_psdd_.parent_elements();
+  const auto &element_owners = compiled_psdd_.element_owners();
+  const auto &variable_leaf_offsets = compiled_psdd_.variable_leaf_offsets();
+  const auto &variable_leaves = compiled_psdd_.variable_leaves();
+  if (!dirty_variables_[variable_index]) {
+    dirty_variables_[variable_index] = 1;
+    dirty_variable_list_.push_back(variable_index);
+  }
+  // Children have smaller positions than their parents, so popping the
+  // smallest position first recomputes a node after all its changed
+  // children.
+  std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>>
+      node_queue;
+  for (uint32_t k = variable_leaf_offsets[variable_index];
+       k < variable_leaf_offsets[variable_index + 1]; ++k) {
+    node_queue.push(variable_leaves[k]);
+    queued_[variable_leaves[k]] = 1;
+  }
+  while (!node_queue.empty()) {
+    uint32_t position = node_queue.top();
+    node_queue.pop();
+    queued_[position] = 0;
+    last_recomputed_size_ += 1;
+    double value = compiled_psdd_.node_type(position) == DECISION_NODE_TYPE
+                       ? DecisionValue(position)
+                       : LeafValue(position);
+    if (value == values_[position]) {
+      continue;
+    }
+    values_[position] = value;
+    changed_value_positions_.push_back(position);
+    for (uintmax_t k = parent_offsets[position];
+         k < parent_offsets[position + 1]; ++k) {
+      uint32_t parent = element_owners[parent_elements[k]];
+      if (!queued_[parent]) {
+        queued_[parent] = 1;
+        node_queue.push(parent);
+      }
+    }
+  }
+}
+
+void InferenceSession::PropagateDerivatives() {
+  const auto &element_offsets = compiled_psdd_.element_offsets();
+  const auto &primes = compiled_psdd_.primes();
+  const auto &subs = compiled_psdd_.subs();
+  const auto &parent_offsets = compiled_psdd_.parent_offsets();
+  const auto &parent_elements = compiled_psdd_.parent_elements();
+  // Parents have larger positions, so popping the largest position first
+  // recomputes a node after all its changed parents.
+  std::priority_queue<uint32_t> node_queue;
+  auto enqueue = [&](uint32_t position) {
+    if (!queued_[position]) {
+      queued_[position] = 1;
+      node_queue.push(position);
+    }
+  };
+  // A changed value only enters the derivatives of its siblings.
+  for (uint32_t position : changed_value_positions_) {
+    for (uintmax_t k = parent_offsets[position];
+         k < parent_offsets[position + 1]; ++k) {
+      uintmax_t j = parent_elements[k];
+      enqueue(primes[j] == position ? subs[j] : primes[j]);
+    }
+  }
+  changed_value_positions_.clear();
+  while (!node_queue.empty()) {
+    uint32_t position = node_queue.top();
+    node_queue.pop();
+    queued_[position] = 0;
+    last_recomputed_size_ += 1;
+    double derivative = Derivative(position);
+    if (derivative == derivatives_[position]) {
+      continue;
+    }
+    derivatives_[position] = derivative;
+    if (compiled_psdd_.node_type(position) != DECISION_NODE_TYPE) {
+      uint32_t variable_index = compiled_psdd_.variable_index(position);
+      if (!dirty_variables_[variable_index]) {
+        dirty_variables_[variable_index] = 1;
+        dirty_variable_list_.push_back(variable_index);
+      }
+      continue;
+    }
+    for (uintmax_t j = element_offsets[position];
+         j < element_offsets[position + 1]; ++j) {
+      enqueue(primes[j]);
+      enqueue(subs[j]);
+    }
+  }
+}
@@ -0,0 +1,45 @@
+#include <psdd/learning_workspace.h>
+
+#include <algorithm>
+
+namespace {
+void ResizeBuffers(size_t node_size, size_t data_size,
+                   std::vector<BatchedPsddValue> *buffers) {
+  if (buffers->size() < node_size) {
+    buffers->resize(node_size);
+  }
+  for (size_t i = 0; i < node_size; ++i) {
+    (*buffers)[i].resize(data_size);
+  }
+}
+} // namespace
+
+std::vector<BatchedPsddValue> *
+LearningWorkspace::MutableValues(size_t node_size, size_t data_size) {
+  ResizeBuffers(node_size, data_size, &values_);
+  return &values_;
+}
+
+std::vector<BatchedPsddValue> *
+LearningWorkspace::MutableContextValues(size_t node_size, size_t data_size) {
+  ResizeBuffers(node_size, data_size, &context_values_);
+  for (size_t i = 0; i < node_size; ++i) {
+    std::fill(context_values_[i].begin(), context_values_[i].end(), false);
+  }
+  return &context_values_;
+}
+
+std::vector<size_t> *LearningWorkspace::MutableCountOffsets(size_t size) {
+  if (count_offsets_.size() < size) {
+    count_offsets_.resize(size);
+  }
+  return &count_offsets_;
+}
+
+std::vector<uintmax_t> *LearningWorkspace::MutableDataCounts(size_t size) {
+  if (data_counts_.size() < size) {
+    data_counts_.resize(size);
+  }
+  std::fill(data_counts_.begin(), data_counts_.begin() + size, 0);
+  return &data_counts_;
+}
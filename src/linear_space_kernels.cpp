@@ -0,0 +1,291 @@
+#include "linear_space_kernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PSDD_HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace linear_space_kernels {
+namespace {
+// ln(2) split so that k * kLn2Hi is exact for |k| < 2^20.
+const double kLn2Hi = 6.93147180369123816490e-01;
+const double kLn2Lo = 1.90821492927058770002e-10;
+// Below this, exp underflows to a subnormal or zero.
+const double kSmallestDirectLog = -700;
+
+// 2^k for integral k down to the smallest normal exponent of T, and 0 for
+// smaller k, -inf or NaN.
+template <typename T> T ScaleFromExponent(T k) {
+  return k >= std::numeric_limits<T>::min_exponent - 1
+             ? std::ldexp((T)1, (int)k)
+             : 0;
+}
+
+template <typename T>
+void ScalarMaxExponent(const T *ea, const T *eb, T weight_exponent,
+                       T *exponent, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    exponent[i] = std::max(exponent[i], ea[i] + eb[i] + weight_exponent);
+  }
+}
+
+// Scaling by a power of two is exact, so this matches the fused
+// multiply-add of the vector kernels.
+template <typename T>
+void ScalarScaledMultiplyAdd(const T *ma, const T *mb, const T *ea,
+                             const T *eb, T weight_mantissa, T weight_exponent,
+                             const T *exponent, T *acc, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    T scale =
+        ScaleFromExponent(ea[i] + eb[i] + weight_exponent - exponent[i]);
+    acc[i] += ma[i] * mb[i] * weight_mantissa * scale;
+  }
+}
+
+template <typename T>
+void ScalarNormalize(T *mantissa, T *exponent, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    if (mantissa[i] == 0) {
+      exponent[i] = -std::numeric_limits<T>::infinity();
+      continue;
+    }
+    int shift;
+    mantissa[i] = std::frexp(mantissa[i], &shift);
+    exponent[i] += shift;
+  }
+}
+
+#ifdef PSDD_HAVE_X86_KERNELS
+// Adding 1.5 * 2^52 to an integral double leaves the integer in the low
+// mantissa bits.
+const double kRoundingMagic = 6755399441055744.0;
+const long long kExponentMask = 0x7ff0000000000000LL;
+// The exponent bits of 0.5.
+const long long kHalfExponentBits = 0x3fe0000000000000LL;
+// The bits of 2^52, whose low mantissa bits take a small integer exactly.
+const long long kTwoTo52Bits = 0x4330000000000000LL;
+const double kTwoTo52 = 4503599627370496.0;
+// The smallest normal exponent of a double.
+const double kMinScaleExponent = -1022;
+
+#define PSDD_AVX2_TARGET __attribute__((target("avx2,fma")))
+#define PSDD_AVX512_TARGET __attribute__((target("avx512f")))
+
+// 2^k for integral k in [-1022, 0], and 0 for smaller k, -inf or NaN.
+PSDD_AVX2_TARGET inline __m256d Scale256(__m256d k) {
+  __m256d in_range =
+      _mm256_cmp_pd(k, _mm256_set1_pd(kMinScaleExponent), _CMP_GE_OQ);
+  __m256i bits = _mm256_castpd_si256(
+      _mm256_add_pd(k, _mm256_set1_pd(kRoundingMagic)));
+  bits = _mm256_slli_epi64(_mm256_add_epi64(bits, _mm256_set1_epi64x(1023)),
+                           52);
+  return _mm256_and_pd(_mm256_castsi256_pd(bits), in_range);
+}
+
+PSDD_AVX2_TARGET void Avx2MaxExponent(const double *ea, const double *eb,
+                                      double weight_exponent,
+                                      double *exponent, size_t size) {
+  __m256d weights = _mm256_set1_pd(weight_exponent);
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m256d sum = _mm256_add_pd(
+        _mm256_add_pd(_mm256_loadu_pd(ea + i), _mm256_loadu_pd(eb + i)),
+        weights);
+    _mm256_storeu_pd(exponent + i,
+                     _mm256_max_pd(_mm256_loadu_pd(exponent + i), sum));
+  }
+  ScalarMaxExponent(ea + i, eb + i, weight_exponent, exponent + i, size - i);
+}
+
+PSDD_AVX2_TARGET void
+Avx2ScaledMultiplyAdd(const double *ma, const double *mb, const double *ea,
+                      const double *eb, double weight_mantissa,
+                      double weight_exponent, const double *exponent,
+                      double *acc, size_t size) {
+  __m256d weight_mantissas = _mm256_set1_pd(weight_mantissa);
+  __m256d weight_exponents = _mm256_set1_pd(weight_exponent);
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m256d k = _mm256_sub_pd(
+        _mm256_add_pd(
+            _mm256_add_pd(_mm256_loadu_pd(ea + i), _mm256_loadu_pd(eb + i)),
+            weight_exponents),
+        _mm256_loadu_pd(exponent + i));
+    __m256d product = _mm256_mul_pd(
+        _mm256_mul_pd(_mm256_loadu_pd(ma + i), _mm256_loadu_pd(mb + i)),
+        weight_mantissas);
+    _mm256_storeu_pd(acc + i, _mm256_fmadd_pd(product, Scale256(k),
+                                              _mm256_loadu_pd(acc + i)));
+  }
+  ScalarScaledMultiplyAdd(ma + i, mb + i, ea + i, eb + i, weight_mantissa,
+                          weight_exponent, exponent + i, acc + i, size - i);
+}
+
+PSDD_AVX2_TARGET void Avx2Normalize(double *mantissa, double *exponent,
+                                    size_t size) {
+  const __m256i exponent_mask = _mm256_set1_epi64x(kExponentMask);
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m256d m = _mm256_loadu_pd(mantissa + i);
+    __m256d is_zero = _mm256_cmp_pd(m, _mm256_setzero_pd(), _CMP_EQ_OQ);
+    __m256i bits = _mm256_castpd_si256(m);
+    // The biased exponent of m, converted through the low bits of 2^52.
+    __m256i biased = _mm256_srli_epi64(_mm256_and_si256(bits, exponent_mask),
+                                       52);
+    __m256d shift = _mm256_sub_pd(
+        _mm256_castsi256_pd(
+            _mm256_or_si256(biased, _mm256_set1_epi64x(kTwoTo52Bits))),
+        _mm256_set1_pd(kTwoTo52 + 1022));
+    __m256d normalized = _mm256_castsi256_pd(
+        _mm256_or_si256(_mm256_andnot_si256(exponent_mask, bits),
+                        _mm256_set1_epi64x(kHalfExponentBits)));
+    __m256d e = _mm256_add_pd(_mm256_loadu_pd(exponent + i), shift);
+    _mm256_storeu_pd(
+        mantissa + i,
+        _mm256_blendv_pd(normalized, _mm256_setzero_pd(), is_zero));
+    _mm256_storeu_pd(
+        exponent + i,
+        _mm256_blendv_pd(
+            e, _mm256_set1_pd(-std::numeric_limits<double>::infinity()),
+            is_zero));
+  }
+  ScalarNormalize(mantissa + i, exponent + i, size - i);
+}
+
+PSDD_AVX512_TARGET inline __m512d Scale512(__m512d k) {
+  __mmask8 in_range =
+      _mm512_cmp_pd_mask(k, _mm512_set1_pd(kMinScaleExponent), _CMP_GE_OQ);
+  __m512i bits = _mm512_castpd_si512(
+      _mm512_add_pd(k, _mm512_set1_pd(kRoundingMagic)));
+  bits = _mm512_slli_epi64(_mm512_add_epi64(bits, _mm512_set1_epi64(1023)),
+                           52);
+  return _mm512_maskz_mov_pd(in_range, _mm512_castsi512_pd(bits));
+}
+
+PSDD_AVX512_TARGET void Avx512MaxExponent(const double *ea, const double *eb,
+                                          double weight_exponent,
+                                          double *exponent, size_t size) {
+  __m512d weights = _mm512_set1_pd(weight_exponent);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m512d sum = _mm512_add_pd(
+        _mm512_add_pd(_mm512_loadu_pd(ea + i), _mm512_loadu_pd(eb + i)),
+        weights);
+    _mm512_storeu_pd(exponent + i,
+                     _mm512_max_pd(_mm512_loadu_pd(exponent + i), sum));
+  }
+  ScalarMaxExponent(ea + i, eb + i, weight_exponent, exponent + i, size - i);
+}
+
+PSDD_AVX512_TARGET void
+Avx512ScaledMultiplyAdd(const double *ma, const double *mb, const double *ea,
+                        const double *eb, double weight_mantissa,
+                        double weight_exponent, const double *exponent,
+                        double *acc, size_t size) {
+  __m512d weight_mantissas = _mm512_set1_pd(weight_mantissa);
+  __m512d weight_exponents = _mm512_set1_pd(weight_exponent);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m512d k = _mm512_sub_pd(
+        _mm512_add_pd(
+            _mm512_add_pd(_mm512_loadu_pd(ea + i), _mm512_loadu_pd(eb + i)),
+            weight_exponents),
+        _mm512_loadu_pd(exponent + i));
+    __m512d product = _mm512_mul_pd(
+        _mm512_mul_pd(_mm512_loadu_pd(ma + i), _mm512_loadu_pd(mb + i)),
+        weight_mantissas);
+    _mm512_storeu_pd(acc + i, _mm512_fmadd_pd(product, Scale512(k),
+                                              _mm512_loadu_pd(acc + i)));
+  }
+  ScalarScaledMultiplyAdd(ma + i, mb + i, ea + i, eb + i, weight_mantissa,
+                          weight_exponent, exponent + i, acc + i, size - i);
+}
+
+PSDD_AVX512_TARGET void Avx512Normalize(double *mantissa, double *exponent,
+                                        size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m512d m = _mm512_loadu_pd(mantissa + i);
+    __mmask8 non_zero =
+        _mm512_cmp_pd_mask(m, _mm512_setzero_pd(), _CMP_NEQ_UQ);
+    // getexp is floor(log2(m)), one less than the frexp exponent.
+    __m512d shift = _mm512_add_pd(_mm512_getexp_pd(m), _mm512_set1_pd(1.0));
+    __m512d normalized =
+        _mm512_getmant_pd(m, _MM_MANT_NORM_p5_1, _MM_MANT_SIGN_zero);
+    __m512d e = _mm512_add_pd(_mm512_loadu_pd(exponent + i), shift);
+    _mm512_storeu_pd(mantissa + i, _mm512_maskz_mov_pd(non_zero, normalized));
+    _mm512_storeu_pd(
+        exponent + i,
+        _mm512_mask_blend_pd(
+            non_zero, _mm512_set1_pd(-std::numeric_limits<double>::infinity()),
+            e));
+  }
+  ScalarNormalize(mantissa + i, exponent + i, size - i);
+}
+#endif // PSDD_HAVE_X86_KERNELS
+} // namespace
+
+template <>
+const KernelTable<double> &
+GetKernelTable<double>(log_space_kernels::Isa isa) {
+  static const KernelTable<double> scalar_table = {
+      ScalarMaxExponent<double>, ScalarScaledMultiplyAdd<double>,
+      ScalarNormalize<double>};
+#ifdef PSDD_HAVE_X86_KERNELS
+  static const KernelTable<double> avx2_table = {
+      Avx2MaxExponent, Avx2ScaledMultiplyAdd, Avx2Normalize};
+  static const KernelTable<double> avx512_table = {
+      Avx512MaxExponent, Avx512ScaledMultiplyAdd, Avx512Normalize};
+  assert(isa <= log_space_kernels::DetectIsa());
+  if (isa == log_space_kernels::AVX512_ISA) {
+    return avx512_table;
+  } else if (isa == log_space_kernels::AVX2_ISA) {
+    return avx2_table;
+  }
+#endif
+  return scalar_table;
+}
+
+template <>
+const KernelTable<float> &GetKernelTable<float>(log_space_kernels::Isa) {
+  static const KernelTable<float> scalar_table = {
+      ScalarMaxExponent<float>, ScalarScaledMultiplyAdd<float>,
+      ScalarNormalize<float>};
+  return scalar_table;
+}
+
+template <typename T>
+void SplitLog(double log_value, T *mantissa, T *exponent) {
+  if (log_value == -std::numeric_limits<double>::infinity()) {
+    *mantissa = 0;
+    *exponent = -std::numeric_limits<T>::infinity();
+    return;
+  }
+  double k = 0;
+  if (log_value < kSmallestDirectLog) {
+    // exp(log_value) = 2^k * exp(r) with r in [0, ln2).
+    k = std::floor(log_value / (kLn2Hi + kLn2Lo));
+    log_value = (log_value - k * kLn2Hi) - k * kLn2Lo;
+  }
+  int shift;
+  *mantissa = (T)std::frexp(std::exp(log_value), &shift);
+  *exponent = (T)(k + shift);
+}
+
+template <typename T> double JoinLog(T mantissa, T exponent) {
+  if (mantissa == 0) {
+    return -std::numeric_limits<double>::infinity();
+  }
+  return std::log((double)mantissa) + exponent * kLn2Hi + exponent * kLn2Lo;
+}
+
+template void SplitLog<float>(double, float *, float *);
+template void SplitLog<double>(double, double *, double *);
+template double JoinLog<float>(float, float);
+template double JoinLog<double>(double, double);
+} // namespace linear_space_kernels
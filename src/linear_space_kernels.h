@@ -0,0 +1,45 @@
+#ifndef PSDD_LINEAR_SPACE_KERNELS_H
+#define PSDD_LINEAR_SPACE_KERNELS_H
+
+#include <cstddef>
+
+#include "log_space_kernels.h"
+
+// Element-wise kernels for values kept in linear space as
+// mantissa * 2^exponent, with the mantissa in [0.5, 1) and an integral
+// exponent stored as a double. Zero probability is a zero mantissa with a
+// -inf exponent. A sum of products is computed in two passes: the largest
+// exponent of the terms becomes the exponent of the sum, and each term is
+// scaled to it by an exact power of two before it is added, so nothing
+// transcendental is evaluated. Instruction sets are the ones of
+// log_space_kernels.
+namespace linear_space_kernels {
+template <typename T> struct KernelTable {
+  // exponent[i] = max(exponent[i], ea[i] + eb[i] + weight_exponent)
+  void (*max_exponent)(const T *ea, const T *eb, T weight_exponent,
+                       T *exponent, size_t size);
+  // acc[i] += ma[i] * mb[i] * weight_mantissa *
+  //           2^(ea[i] + eb[i] + weight_exponent - exponent[i]).
+  // Terms scaled below the smallest normal number are dropped.
+  void (*scaled_multiply_add)(const T *ma, const T *mb, const T *ea,
+                              const T *eb, T weight_mantissa,
+                              T weight_exponent, const T *exponent, T *acc,
+                              size_t size);
+  // Moves the power of two of each mantissa into its exponent. Mantissas
+  // must be zero or normal.
+  void (*normalize)(T *mantissa, T *exponent, size_t size);
+};
+
+// Kernels for isa, which must not exceed log_space_kernels::DetectIsa().
+// Defined for float and double; only the double kernels have vector
+// versions.
+template <typename T>
+const KernelTable<T> &GetKernelTable(log_space_kernels::Isa isa);
+// Splits exp(log_value) into a mantissa in [0.5, 1) and an exponent, without
+// underflowing for very small probabilities.
+template <typename T> void SplitLog(double log_value, T *mantissa, T *exponent);
+// The inverse of SplitLog.
+template <typename T> double JoinLog(T mantissa, T exponent);
+} // namespace linear_space_kernels
+
+#endif // PSDD_LINEAR_SPACE_KERNELS_H
@@ -0,0 +1,574 @@
+#include "log_space_kernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PSDD_HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace log_space_kernels {
+namespace {
+// The scalar kernels follow PsddParameter::operator+ exactly.
+template <typename T> T ScalarLogAddExp(T a, T b) {
+  if (a == -std::numeric_limits<T>::infinity()) {
+    return b;
+  } else if (b == -std::numeric_limits<T>::infinity()) {
+    return a;
+  } else if (a > b) {
+    return a + std::log1p(std::exp(b - a));
+  } else {
+    return b + std::log1p(std::exp(a - b));
+  }
+}
+
+template <typename T>
+void ScalarLogMultiply(const T *a, const T *b, T weight, T *out, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    out[i] = a[i] + b[i] + weight;
+  }
+}
+
+template <typename T> void ScalarLogAddExp(const T *a, T *acc, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    acc[i] = ScalarLogAddExp(acc[i], a[i]);
+  }
+}
+
+template <typename T> void ScalarMax(const T *a, T *acc, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    acc[i] = std::max(acc[i], a[i]);
+  }
+}
+
+template <typename T>
+void ScalarMaxIndex(const T *a, T *acc, uint32_t *acc_index, uint32_t index,
+                    size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    if (a[i] > acc[i]) {
+      acc[i] = a[i];
+      acc_index[i] = index;
+    }
+  }
+}
+
+#ifdef PSDD_HAVE_X86_KERNELS
+// exp(x) for x in [kExpLowerBound, 0]: x = k * ln2 + r with |r| <= ln2 / 2,
+// exp(r) by its degree 13 Taylor polynomial (truncation error below 1e-17)
+// and 2^k assembled directly in the exponent bits.
+const double kLog2e = 1.4426950408889634;
+const double kLn2Hi = 6.93147180369123816490e-01;
+const double kLn2Lo = 1.90821492927058770002e-10;
+const double kExpLowerBound = -708.39;
+// Adding 1.5 * 2^52 to an integral double leaves the integer in the low
+// mantissa bits.
+const double kRoundingMagic = 6755399441055744.0;
+const double kExpCoefficients[14] = {1.0,
+                                     1.0,
+                                     1.0 / 2,
+                                     1.0 / 6,
+                                     1.0 / 24,
+                                     1.0 / 120,
+                                     1.0 / 720,
+                                     1.0 / 5040,
+                                     1.0 / 40320,
+                                     1.0 / 362880,
+                                     1.0 / 3628800,
+                                     1.0 / 39916800,
+                                     1.0 / 479001600,
+                                     1.0 / 6227020800};
+// log1p(y) for y in [0, 1], following fdlibm's log: 1 + y = 2^k * (1 + f)
+// with f in [sqrt(2) / 2 - 1, sqrt(2) - 1] and log(1 + f) from a minimax
+// polynomial in s = f / (2 + f).
+const double kLn2 = 6.93147180559945286227e-01;
+const double kSqrt2Minus1 = 0.41421356237309503;
+const double kLg1 = 6.666666666666735130e-01;
+const double kLg2 = 3.999999999940941908e-01;
+const double kLg3 = 2.857142874366239149e-01;
+const double kLg4 = 2.222219843214978396e-01;
+const double kLg5 = 1.818357216161805012e-01;
+const double kLg6 = 1.531383769920937332e-01;
+const double kLg7 = 1.479819860511658591e-01;
+
+#define PSDD_AVX2_TARGET __attribute__((target("avx2,fma")))
+#define PSDD_AVX512_TARGET __attribute__((target("avx512f")))
+
+PSDD_AVX2_TARGET inline __m256d Exp256(__m256d x) {
+  __m256d k =
+      _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(kLog2e)),
+                      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(kLn2Hi), x);
+  r = _mm256_fnmadd_pd(k, _mm256_set1_pd(kLn2Lo), r);
+  __m256d p = _mm256_set1_pd(kExpCoefficients[13]);
+  for (int i = 12; i >= 0; --i) {
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(kExpCoefficients[i]));
+  }
+  __m256i bits = _mm256_castpd_si256(
+      _mm256_add_pd(k, _mm256_set1_pd(kRoundingMagic)));
+  bits = _mm256_slli_epi64(_mm256_add_epi64(bits, _mm256_set1_epi64x(1023)),
+                           52);
+  return _mm256_mul_pd(p, _mm256_castsi256_pd(bits));
+}
+
+PSDD_AVX2_TARGET inline __m256d Log1p256(__m256d y) {
+  __m256d big = _mm256_cmp_pd(y, _mm256_set1_pd(kSqrt2Minus1), _CMP_GT_OQ);
+  __m256d f = _mm256_blendv_pd(
+      y,
+      _mm256_mul_pd(_mm256_sub_pd(y, _mm256_set1_pd(1.0)),
+                    _mm256_set1_pd(0.5)),
+      big);
+  __m256d k_ln2 = _mm256_and_pd(big, _mm256_set1_pd(kLn2));
+  __m256d s = _mm256_div_pd(f, _mm256_add_pd(_mm256_set1_pd(2.0), f));
+  __m256d z = _mm256_mul_pd(s, s);
+  __m256d w = _mm256_mul_pd(z, z);
+  __m256d t1 = _mm256_fmadd_pd(w, _mm256_set1_pd(kLg6), _mm256_set1_pd(kLg4));
+  t1 = _mm256_fmadd_pd(w, t1, _mm256_set1_pd(kLg2));
+  t1 = _mm256_mul_pd(w, t1);
+  __m256d t2 = _mm256_fmadd_pd(w, _mm256_set1_pd(kLg7), _mm256_set1_pd(kLg5));
+  t2 = _mm256_fmadd_pd(w, t2, _mm256_set1_pd(kLg3));
+  t2 = _mm256_fmadd_pd(w, t2, _mm256_set1_pd(kLg1));
+  t2 = _mm256_mul_pd(z, t2);
+  __m256d r = _mm256_add_pd(t1, t2);
+  __m256d hfsq = _mm256_mul_pd(_mm256_set1_pd(0.5), _mm256_mul_pd(f, f));
+  // log(1 + f) = f - hfsq + s * (hfsq + R)
+  __m256d log_f = _mm256_sub_pd(
+      f, _mm256_fnmadd_pd(s, _mm256_add_pd(hfsq, r), hfsq));
+  return _mm256_add_pd(k_ln2, log_f);
+}
+
+PSDD_AVX2_TARGET void Avx2LogMultiply(const double *a, const double *b,
+                                      double weight, double *out,
+                                      size_t size) {
+  __m256d weights = _mm256_set1_pd(weight);
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m256d sum = _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+    _mm256_storeu_pd(out + i, _mm256_add_pd(sum, weights));
+  }
+  ScalarLogMultiply(a + i, b + i, weight, out + i, size - i);
+}
+
+PSDD_AVX2_TARGET void Avx2LogAddExp(const double *a, double *acc,
+                                    size_t size) {
+  const __m256d negative_infinity =
+      _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m256d x = _mm256_loadu_pd(a + i);
+    __m256d y = _mm256_loadu_pd(acc + i);
+    __m256d hi = _mm256_max_pd(x, y);
+    __m256d lo = _mm256_min_pd(x, y);
+    // If lo is zero probability, the sum is hi (this also covers hi being
+    // zero probability, where lo - hi would be NaN).
+    __m256d lo_is_zero = _mm256_cmp_pd(lo, negative_infinity, _CMP_EQ_OQ);
+    __m256d diff =
+        _mm256_max_pd(_mm256_sub_pd(lo, hi), _mm256_set1_pd(kExpLowerBound));
+    __m256d sum = _mm256_add_pd(hi, Log1p256(Exp256(diff)));
+    _mm256_storeu_pd(acc + i, _mm256_blendv_pd(sum, hi, lo_is_zero));
+  }
+  ScalarLogAddExp(a + i, acc + i, size - i);
+}
+
+PSDD_AVX2_TARGET void Avx2Max(const double *a, double *acc, size_t size) {
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    _mm256_storeu_pd(acc + i, _mm256_max_pd(_mm256_loadu_pd(acc + i),
+                                            _mm256_loadu_pd(a + i)));
+  }
+  ScalarMax(a + i, acc + i, size - i);
+}
+
+PSDD_AVX2_TARGET void Avx2MaxIndex(const double *a, double *acc,
+                                   uint32_t *acc_index, uint32_t index,
+                                   size_t size) {
+  const __m128i indices = _mm_set1_epi32((int)index);
+  // Picks the low 32 bits of each 64-bit comparison mask.
+  const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m256d x = _mm256_loadu_pd(a + i);
+    __m256d y = _mm256_loadu_pd(acc + i);
+    __m256d greater = _mm256_cmp_pd(x, y, _CMP_GT_OQ);
+    _mm256_storeu_pd(acc + i, _mm256_blendv_pd(y, x, greater));
+    __m128i index_mask = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(
+        _mm256_castpd_si256(greater), low_halves));
+    __m128i old_indices = _mm_loadu_si128((const __m128i *)(acc_index + i));
+    _mm_storeu_si128((__m128i *)(acc_index + i),
+                     _mm_blendv_epi8(old_indices, indices, index_mask));
+  }
+  ScalarMaxIndex(a + i, acc + i, acc_index + i, index, size - i);
+}
+
+PSDD_AVX512_TARGET inline __m512d Exp512(__m512d x) {
+  __m512d k =
+      _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(kLog2e)),
+                           _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m512d r = _mm512_fnmadd_pd(k, _mm512_set1_pd(kLn2Hi), x);
+  r = _mm512_fnmadd_pd(k, _mm512_set1_pd(kLn2Lo), r);
+  __m512d p = _mm512_set1_pd(kExpCoefficients[13]);
+  for (int i = 12; i >= 0; --i) {
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(kExpCoefficients[i]));
+  }
+  __m512i bits = _mm512_castpd_si512(
+      _mm512_add_pd(k, _mm512_set1_pd(kRoundingMagic)));
+  bits = _mm512_slli_epi64(_mm512_add_epi64(bits, _mm512_set1_epi64(1023)),
+                           52);
+  return _mm512_mul_pd(p, _mm512_castsi512_pd(bits));
+}
+
+PSDD_AVX512_TARGET inline __m512d Log1p512(__m512d y) {
+  __mmask8 big =
+      _mm512_cmp_pd_mask(y, _mm512_set1_pd(kSqrt2Minus1), _CMP_GT_OQ);
+  __m512d f = _mm512_mask_blend_pd(
+      big, y,
+      _mm512_mul_pd(_mm512_sub_pd(y, _mm512_set1_pd(1.0)),
+                    _mm512_set1_pd(0.5)));
+  __m512d k_ln2 = _mm512_maskz_mov_pd(big, _mm512_set1_pd(kLn2));
+  __m512d s = _mm512_div_pd(f, _mm512_add_pd(_mm512_set1_pd(2.0), f));
+  __m512d z = _mm512_mul_pd(s, s);
+  __m512d w = _mm512_mul_pd(z, z);
+  __m512d t1 = _mm512_fmadd_pd(w, _mm512_set1_pd(kLg6), _mm512_set1_pd(kLg4));
+  t1 = _mm512_fmadd_pd(w, t1, _mm512_set1_pd(kLg2));
+  t1 = _mm512_mul_pd(w, t1);
+  __m512d t2 = _mm512_fmadd_pd(w, _mm512_set1_pd(kLg7), _mm512_set1_pd(kLg5));
+  t2 = _mm512_fmadd_pd(w, t2, _mm512_set1_pd(kLg3));
+  t2 = _mm512_fmadd_pd(w, t2, _mm512_set1_pd(kLg1));
+  t2 = _mm512_mul_pd(z, t2);
+  __m512d r = _mm512_add_pd(t1, t2);
+  __m512d hfsq = _mm512_mul_pd(_mm512_set1_pd(0.5), _mm512_mul_pd(f, f));
+  __m512d log_f = _mm512_sub_pd(
+      f, _mm512_fnmadd_pd(s, _mm512_add_pd(hfsq, r), hfsq));
+  return _mm512_add_pd(k_ln2, log_f);
+}
+
+PSDD_AVX512_TARGET void Avx512LogMultiply(const double *a, const double *b,
+                                          double weight, double *out,
+                                          size_t size) {
+  __m512d weights = _mm512_set1_pd(weight);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m512d sum = _mm512_add_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+    _mm512_storeu_pd(out + i, _mm512_add_pd(sum, weights));
+  }
+  ScalarLogMultiply(a + i, b + i, weight, out + i, size - i);
+}
+
+PSDD_AVX512_TARGET void Avx512LogAddExp(const double *a, double *acc,
+                                        size_t size) {
+  const __m512d negative_infinity =
+      _mm512_set1_pd(-std::numeric_limits<double>::infinity());
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m512d x = _mm512_loadu_pd(a + i);
+    __m512d y = _mm512_loadu_pd(acc + i);
+    __m512d hi = _mm512_max_pd(x, y);
+    __m512d lo = _mm512_min_pd(x, y);
+    __mmask8 lo_is_zero =
+        _mm512_cmp_pd_mask(lo, negative_infinity, _CMP_EQ_OQ);
+    __m512d diff =
+        _mm512_max_pd(_mm512_sub_pd(lo, hi), _mm512_set1_pd(kExpLowerBound));
+    __m512d sum = _mm512_add_pd(hi, Log1p512(Exp512(diff)));
+    _mm512_storeu_pd(acc + i, _mm512_mask_blend_pd(lo_is_zero, sum, hi));
+  }
+  ScalarLogAddExp(a + i, acc + i, size - i);
+}
+
+PSDD_AVX512_TARGET void Avx512Max(const double *a, double *acc,
+                                  size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    _mm512_storeu_pd(acc + i, _mm512_max_pd(_mm512_loadu_pd(acc + i),
+                                            _mm512_loadu_pd(a + i)));
+  }
+  ScalarMax(a + i, acc + i, size - i);
+}
+PSDD_AVX512_TARGET void Avx512MaxIndex(const double *a, double *acc,
+                                       uint32_t *acc_index, uint32_t index,
+                                       size_t size) {
+  const __m512i indices = _mm512_set1_epi32((int)index);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m512d x = _mm512_loadu_pd(a + i);
+    __m512d y = _mm512_loadu_pd(acc + i);
+    __mmask8 greater = _mm512_cmp_pd_mask(x, y, _CMP_GT_OQ);
+    _mm512_storeu_pd(acc + i, _mm512_mask_blend_pd(greater, y, x));
+    // Without AVX512VL the 8 indices are handled in the low half of a
+    // 16-lane register.
+    __m512i old_indices = _mm512_castsi256_si512(
+        _mm256_loadu_si256((const __m256i *)(acc_index + i)));
+    __m512i new_indices =
+        _mm512_mask_mov_epi32(old_indices, (__mmask16)greater, indices);
+    _mm256_storeu_si256((__m256i *)(acc_index + i),
+                        _mm512_castsi512_si256(new_indices));
+  }
+  ScalarMaxIndex(a + i, acc + i, acc_index + i, index, size - i);
+}
+
+// Single precision: the same reductions with cephes' expf polynomial and
+// fdlibm's logf coefficients, accurate to a few float ulps.
+const float kLog2eFloat = 1.44269504088896341f;
+const float kLn2HiFloat = 0.693359375f;
+const float kLn2LoFloat = -2.12194440e-4f;
+const float kExpLowerBoundFloat = -87.3f;
+const float kExpCoefficientsFloat[6] = {
+    5.0000001201e-1f, 1.6666665459e-1f, 4.1665795894e-2f,
+    8.3334519073e-3f, 1.3981999507e-3f, 1.9875691500e-4f};
+const float kLn2Float = 6.9314718246e-01f;
+const float kSqrt2Minus1Float = 0.41421356f;
+const float kLg1Float = 0.66666662693f;
+const float kLg2Float = 0.40000972152f;
+const float kLg3Float = 0.28498786688f;
+const float kLg4Float = 0.24279078841f;
+
+PSDD_AVX2_TARGET inline __m256 Exp256(__m256 x) {
+  __m256 k = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(kLog2eFloat)),
+                             _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256 r = _mm256_fnmadd_ps(k, _mm256_set1_ps(kLn2HiFloat), x);
+  r = _mm256_fnmadd_ps(k, _mm256_set1_ps(kLn2LoFloat), r);
+  __m256 p = _mm256_set1_ps(kExpCoefficientsFloat[5]);
+  for (int i = 4; i >= 0; --i) {
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kExpCoefficientsFloat[i]));
+  }
+  // exp(r) = 1 + r + r^2 * p
+  p = _mm256_fmadd_ps(_mm256_mul_ps(r, r), p,
+                      _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+  __m256i bits = _mm256_slli_epi32(
+      _mm256_add_epi32(_mm256_cvtps_epi32(k), _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+}
+
+PSDD_AVX2_TARGET inline __m256 Log1p256(__m256 y) {
+  __m256 big = _mm256_cmp_ps(y, _mm256_set1_ps(kSqrt2Minus1Float), _CMP_GT_OQ);
+  __m256 f = _mm256_blendv_ps(
+      y,
+      _mm256_mul_ps(_mm256_sub_ps(y, _mm256_set1_ps(1.0f)),
+                    _mm256_set1_ps(0.5f)),
+      big);
+  __m256 k_ln2 = _mm256_and_ps(big, _mm256_set1_ps(kLn2Float));
+  __m256 s = _mm256_div_ps(f, _mm256_add_ps(_mm256_set1_ps(2.0f), f));
+  __m256 z = _mm256_mul_ps(s, s);
+  __m256 w = _mm256_mul_ps(z, z);
+  __m256 t1 = _mm256_mul_ps(
+      w, _mm256_fmadd_ps(w, _mm256_set1_ps(kLg4Float),
+                         _mm256_set1_ps(kLg2Float)));
+  __m256 t2 = _mm256_mul_ps(
+      z, _mm256_fmadd_ps(w, _mm256_set1_ps(kLg3Float),
+                         _mm256_set1_ps(kLg1Float)));
+  __m256 r = _mm256_add_ps(t1, t2);
+  __m256 hfsq = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(f, f));
+  __m256 log_f =
+      _mm256_sub_ps(f, _mm256_fnmadd_ps(s, _mm256_add_ps(hfsq, r), hfsq));
+  return _mm256_add_ps(k_ln2, log_f);
+}
+
+PSDD_AVX2_TARGET void Avx2LogMultiply(const float *a, const float *b,
+                                      float weight, float *out, size_t size) {
+  __m256 weights = _mm256_set1_ps(weight);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m256 sum = _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    _mm256_storeu_ps(out + i, _mm256_add_ps(sum, weights));
+  }
+  ScalarLogMultiply(a + i, b + i, weight, out + i, size - i);
+}
+
+PSDD_AVX2_TARGET void Avx2LogAddExp(const float *a, float *acc, size_t size) {
+  const __m256 negative_infinity =
+      _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m256 x = _mm256_loadu_ps(a + i);
+    __m256 y = _mm256_loadu_ps(acc + i);
+    __m256 hi = _mm256_max_ps(x, y);
+    __m256 lo = _mm256_min_ps(x, y);
+    __m256 lo_is_zero = _mm256_cmp_ps(lo, negative_infinity, _CMP_EQ_OQ);
+    __m256 diff = _mm256_max_ps(_mm256_sub_ps(lo, hi),
+                                _mm256_set1_ps(kExpLowerBoundFloat));
+    __m256 sum = _mm256_add_ps(hi, Log1p256(Exp256(diff)));
+    _mm256_storeu_ps(acc + i, _mm256_blendv_ps(sum, hi, lo_is_zero));
+  }
+  ScalarLogAddExp(a + i, acc + i, size - i);
+}
+
+PSDD_AVX2_TARGET void Avx2Max(const float *a, float *acc, size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    _mm256_storeu_ps(acc + i, _mm256_max_ps(_mm256_loadu_ps(acc + i),
+                                            _mm256_loadu_ps(a + i)));
+  }
+  ScalarMax(a + i, acc + i, size - i);
+}
+
+PSDD_AVX2_TARGET void Avx2MaxIndex(const float *a, float *acc,
+                                   uint32_t *acc_index, uint32_t index,
+                                   size_t size) {
+  const __m256i indices = _mm256_set1_epi32((int)index);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m256 x = _mm256_loadu_ps(a + i);
+    __m256 y = _mm256_loadu_ps(acc + i);
+    __m256 greater = _mm256_cmp_ps(x, y, _CMP_GT_OQ);
+    _mm256_storeu_ps(acc + i, _mm256_blendv_ps(y, x, greater));
+    __m256i old_indices = _mm256_loadu_si256((const __m256i *)(acc_index + i));
+    _mm256_storeu_si256((__m256i *)(acc_index + i),
+                        _mm256_blendv_epi8(old_indices, indices,
+                                           _mm256_castps_si256(greater)));
+  }
+  ScalarMaxIndex(a + i, acc + i, acc_index + i, index, size - i);
+}
+
+PSDD_AVX512_TARGET inline __m512 Exp512(__m512 x) {
+  __m512 k =
+      _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(kLog2eFloat)),
+                           _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m512 r = _mm512_fnmadd_ps(k, _mm512_set1_ps(kLn2HiFloat), x);
+  r = _mm512_fnmadd_ps(k, _mm512_set1_ps(kLn2LoFloat), r);
+  __m512 p = _mm512_set1_ps(kExpCoefficientsFloat[5]);
+  for (int i = 4; i >= 0; --i) {
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kExpCoefficientsFloat[i]));
+  }
+  p = _mm512_fmadd_ps(_mm512_mul_ps(r, r), p,
+                      _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+  __m512i bits = _mm512_slli_epi32(
+      _mm512_add_epi32(_mm512_cvtps_epi32(k), _mm512_set1_epi32(127)), 23);
+  return _mm512_mul_ps(p, _mm512_castsi512_ps(bits));
+}
+
+PSDD_AVX512_TARGET inline __m512 Log1p512(__m512 y) {
+  __mmask16 big =
+      _mm512_cmp_ps_mask(y, _mm512_set1_ps(kSqrt2Minus1Float), _CMP_GT_OQ);
+  __m512 f = _mm512_mask_blend_ps(
+      big, y,
+      _mm512_mul_ps(_mm512_sub_ps(y, _mm512_set1_ps(1.0f)),
+                    _mm512_set1_ps(0.5f)));
+  __m512 k_ln2 = _mm512_maskz_mov_ps(big, _mm512_set1_ps(kLn2Float));
+  __m512 s = _mm512_div_ps(f, _mm512_add_ps(_mm512_set1_ps(2.0f), f));
+  __m512 z = _mm512_mul_ps(s, s);
+  __m512 w = _mm512_mul_ps(z, z);
+  __m512 t1 = _mm512_mul_ps(
+      w, _mm512_fmadd_ps(w, _mm512_set1_ps(kLg4Float),
+                         _mm512_set1_ps(kLg2Float)));
+  __m512 t2 = _mm512_mul_ps(
+      z, _mm512_fmadd_ps(w, _mm512_set1_ps(kLg3Float),
+                         _mm512_set1_ps(kLg1Float)));
+  __m512 r = _mm512_add_ps(t1, t2);
+  __m512 hfsq = _mm512_mul_ps(_mm512_set1_ps(0.5f), _mm512_mul_ps(f, f));
+  __m512 log_f =
+      _mm512_sub_ps(f, _mm512_fnmadd_ps(s, _mm512_add_ps(hfsq, r), hfsq));
+  return _mm512_add_ps(k_ln2, log_f);
+}
+
+PSDD_AVX512_TARGET void Avx512LogMultiply(const float *a, const float *b,
+                                          float weight, float *out,
+                                          size_t size) {
+  __m512 weights = _mm512_set1_ps(weight);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m512 sum = _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    _mm512_storeu_ps(out + i, _mm512_add_ps(sum, weights));
+  }
+  ScalarLogMultiply(a + i, b + i, weight, out + i, size - i);
+}
+
+PSDD_AVX512_TARGET void Avx512LogAddExp(const float *a, float *acc,
+                                        size_t size) {
+  const __m512 negative_infinity =
+      _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m512 x = _mm512_loadu_ps(a + i);
+    __m512 y = _mm512_loadu_ps(acc + i);
+    __m512 hi = _mm512_max_ps(x, y);
+    __m512 lo = _mm512_min_ps(x, y);
+    __mmask16 lo_is_zero =
+        _mm512_cmp_ps_mask(lo, negative_infinity, _CMP_EQ_OQ);
+    __m512 diff = _mm512_max_ps(_mm512_sub_ps(lo, hi),
+                                _mm512_set1_ps(kExpLowerBoundFloat));
+    __m512 sum = _mm512_add_ps(hi, Log1p512(Exp512(diff)));
+    _mm512_storeu_ps(acc + i, _mm512_mask_blend_ps(lo_is_zero, sum, hi));
+  }
+  ScalarLogAddExp(a + i, acc + i, size - i);
+}
+
+PSDD_AVX512_TARGET void Avx512Max(const float *a, float *acc, size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    _mm512_storeu_ps(acc + i, _mm512_max_ps(_mm512_loadu_ps(acc + i),
+                                            _mm512_loadu_ps(a + i)));
+  }
+  ScalarMax(a + i, acc + i, size - i);
+}
+
+PSDD_AVX512_TARGET void Avx512MaxIndex(const float *a, float *acc,
+                                       uint32_t *acc_index, uint32_t index,
+                                       size_t size) {
+  const __m512i indices = _mm512_set1_epi32((int)index);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m512 x = _mm512_loadu_ps(a + i);
+    __m512 y = _mm512_loadu_ps(acc + i);
+    __mmask16 greater = _mm512_cmp_ps_mask(x, y, _CMP_GT_OQ);
+    _mm512_storeu_ps(acc + i, _mm512_mask_blend_ps(greater, y, x));
+    __m512i old_indices = _mm512_loadu_si512(acc_index + i);
+    _mm512_storeu_si512(acc_index + i,
+                        _mm512_mask_mov_epi32(old_indices, greater, indices));
+  }
+  ScalarMaxIndex(a + i, acc + i, acc_index + i, index, size - i);
+}
+#endif // PSDD_HAVE_X86_KERNELS
+} // namespace
+
+Isa DetectIsa() {
+#ifdef PSDD_HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return AVX512_ISA;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return AVX2_ISA;
+  }
+#endif
+  return SCALAR_ISA;
+}
+
+template <> const KernelTable<double> &GetKernelTable<double>(Isa isa) {
+  static const KernelTable<double> scalar_table = {
+      ScalarLogMultiply<double>, ScalarLogAddExp<double>, ScalarMax<double>,
+      ScalarMaxIndex<double>};
+#ifdef PSDD_HAVE_X86_KERNELS
+  static const KernelTable<double> avx2_table = {Avx2LogMultiply, Avx2LogAddExp,
+                                                 Avx2Max, Avx2MaxIndex};
+  static const KernelTable<double> avx512_table = {
+      Avx512LogMultiply, Avx512LogAddExp, Avx512Max, Avx512MaxIndex};
+  assert(isa <= DetectIsa());
+  if (isa == AVX512_ISA) {
+    return avx512_table;
+  } else if (isa == AVX2_ISA) {
+    return avx2_table;
+  }
+#endif
+  return scalar_table;
+}
+
+template <> const KernelTable<float> &GetKernelTable<float>(Isa isa) {
+  static const KernelTable<float> scalar_table = {
+      ScalarLogMultiply<float>, ScalarLogAddExp<float>, ScalarMax<float>,
+      ScalarMaxIndex<float>};
+#ifdef PSDD_HAVE_X86_KERNELS
+  static const KernelTable<float> avx2_table = {Avx2LogMultiply, Avx2LogAddExp,
+                                                Avx2Max, Avx2MaxIndex};
+  static const KernelTable<float> avx512_table = {
+      Avx512LogMultiply, Avx512LogAddExp, Avx512Max, Avx512MaxIndex};
+  assert(isa <= DetectIsa());
+  if (isa == AVX512_ISA) {
+    return avx512_table;
+  } else if (isa == AVX2_ISA) {
+    return avx2_table;
+  }
+#endif
+  return scalar_table;
+}
+} // namespace log_space_kernels
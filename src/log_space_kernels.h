@@ -0,0 +1,35 @@
+#ifndef PSDD_LOG_SPACE_KERNELS_H
+#define PSDD_LOG_SPACE_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Element-wise kernels over contiguous arrays of log-space floats or doubles.
+// Every kernel has a scalar, an AVX2 and an AVX-512 implementation; the
+// vector versions are compiled with function-level target attributes so the
+// library itself does not need to be built with -mavx2. Zero probability is
+// -inf, as in PsddParameter.
+namespace log_space_kernels {
+enum Isa { SCALAR_ISA = 0, AVX2_ISA = 1, AVX512_ISA = 2 };
+
+template <typename T> struct KernelTable {
+  // out[i] = a[i] + b[i] + weight
+  void (*log_multiply)(const T *a, const T *b, T weight, T *out, size_t size);
+  // acc[i] = log(exp(acc[i]) + exp(a[i]))
+  void (*log_add_exp)(const T *a, T *acc, size_t size);
+  // acc[i] = max(acc[i], a[i])
+  void (*max)(const T *a, T *acc, size_t size);
+  // Where a[i] > acc[i]: acc[i] = a[i] and acc_index[i] = index. Ties keep
+  // the earlier index.
+  void (*max_index)(const T *a, T *acc, uint32_t *acc_index, uint32_t index,
+                    size_t size);
+};
+
+// The best instruction set supported by both the compiler and the running CPU.
+Isa DetectIsa();
+// Kernels for isa, which must not exceed DetectIsa(). Defined for float and
+// double.
+template <typename T> const KernelTable<T> &GetKernelTable(Isa isa);
+} // namespace log_space_kernels
+
+#endif // PSDD_LOG_SPACE_KERNELS_H
@@ -16,6 +16,7 @@
 #include <string>
 #include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "htd/PostOrderTreeTraversal.hpp"
@@ -32,7 +33,10 @@ extern "C" {
 };
 
 PgmCompiler::PgmCompiler(std::string working_dir)
-    : m_network(nullptr), m_pm(nullptr), working_dir_(std::move(working_dir)) {}
+    : m_network(nullptr),
+      m_pm(nullptr),
+      m_thread_pool(nullptr),
+      working_dir_(std::move(working_dir)) {}
 
 std::pair<PsddNode*, PsddParameter> PgmCompiler::compile_factor(
     size_t factor_index) {
@@ -269,8 +273,9 @@ std::pair<PsddNode*, PsddParameter> PgmCompiler::compile_network_with_vtree(
       std::cout << "Start to GC" << std::endl;
       std::vector<PsddNode*> used_nodes(output_buffer.begin(),
                                         output_buffer.end());
-      m_pm->DeleteUnusedPsddNodes(used_nodes);
-      std::cout << "Finish GC" << std::endl;
+      size_t reclaimed_bytes = m_pm->DeleteUnusedPsddNodes(used_nodes);
+      std::cout << "Finish GC, reclaimed " << reclaimed_bytes << " bytes"
+                << std::endl;
     }
   }
   return {output_buffer.front(), z};
@@ -337,8 +342,7 @@ std::pair<PsddNode*, PsddParameter> PgmCompiler::compile_network(
   return {final_result, z};
 }
 
-std::pair<PsddNode*, PsddParameter> PgmCompiler::compile_network_dc(
-    size_t gc_freq) {
+std::pair<PsddRef, PsddParameter> PgmCompiler::compile_network_dc() {
   std::unordered_map<SddLiteral, Vtree*> var_to_vtree;
   std::vector<Vtree*> serialized_vtree =
       vtree_util::SerializeVtree(m_pm->vtree());
@@ -350,6 +354,8 @@ std::pair<PsddNode*, PsddParameter> PgmCompiler::compile_network_dc(
   std::vector<SddLiteral> factor_orders;
   std::vector<PsddNode*> nodes;
   PsddParameter z = PsddParameter::CreateFromDecimal(1);
+  // Nodes from here on are created by this call, and nothing else holds them.
+  uintmax_t first_node_index = m_pm->next_node_index();
   std::cout << "Start Loading factors" << std::endl;
   auto factor_size = m_network->factor_size();
   for (auto i = 0; i < factor_size; i++) {
@@ -373,12 +379,15 @@ std::pair<PsddNode*, PsddParameter> PgmCompiler::compile_network_dc(
             [&](const size_t& a, const size_t& b) {
               return factor_orders[a] > factor_orders[b];
             });
-  PsddNode* final_result = nullptr;
   int proc_nodes = 0;
-  std::deque<PsddNode*> nodes_to_mult;
+  // Each intermediate result is freed as soon as it has been multiplied.
+  std::deque<PsddRef> nodes_to_mult;
   for (auto n_id : compilation_order) {
-    nodes_to_mult.push_back(nodes[n_id]);
+    nodes_to_mult.emplace_back(m_pm, nodes[n_id]);
   }
+  // Drops what compiling the factors left behind.
+  size_t reclaimed_bytes = m_pm->DeleteUnreferencedPsddNodes(first_node_index);
+  std::cout << "Reclaimed " << reclaimed_bytes << " bytes" << std::endl;
   std::cout.width(30);
   std::cout << std::left << "Arg1 size:";
   std::cout.width(30);
@@ -388,33 +397,31 @@ std::pair<PsddNode*, PsddParameter> PgmCompiler::compile_network_dc(
   std::cout.width(15);
   std::cout << std::left << "Remaining" << std::endl;
   while (nodes_to_mult.size() > 1) {
-    PsddNode* a = nodes_to_mult.front();
+    PsddRef a = std::move(nodes_to_mult.front());
     nodes_to_mult.pop_front();
-    PsddNode* b = nodes_to_mult.front();
+    PsddRef b = std::move(nodes_to_mult.front());
     nodes_to_mult.pop_front();
     std::cout << "\r";
     std::cout.width(30);
-    std::cout << std::left << psdd_node_util::SerializePsddNodes(a).size();
+    std::cout << std::left
+              << psdd_node_util::SerializePsddNodes(a.get()).size();
     std::cout.width(30);
-    std::cout << std::left << psdd_node_util::SerializePsddNodes(b).size();
+    std::cout << std::left
+              << psdd_node_util::SerializePsddNodes(b.get()).size();
     proc_nodes += 1;
     std::cout.width(15);
     std::cout << std::left << proc_nodes;
     std::cout.width(15);
     std::cout << std::left << nodes.size() - proc_nodes << std::flush;
-    auto mult_result = m_pm->Multiply(a, b, /*flag_index*/ 0);
+    auto mult_result =
+        m_thread_pool == nullptr
+            ? m_pm->Multiply(a, b, /*flag_index*/ 0)
+            : m_pm->ParallelMultiply(a, b, /*flag_index*/ 0, m_thread_pool);
     z *= mult_result.second;
-    nodes_to_mult.push_back(mult_result.first);
-    if ((proc_nodes % gc_freq) == 0) {
-      std::cout << "\rStart to GC ";
-      std::vector<PsddNode*> used_nodes(nodes_to_mult.begin(),
-                                        nodes_to_mult.end());
-      m_pm->DeleteUnusedPsddNodes(used_nodes);
-      std::cout << "Finish GC" << std::flush;
-    }
+    nodes_to_mult.push_back(std::move(mult_result.first));
   }
   std::cout << std::endl;
-  return {nodes_to_mult.front(), z};
+  return {std::move(nodes_to_mult.front()), z};
 }
 
 void PgmCompiler::init_psdd_manager_from_vtree(const char* vtree_fname) {
@@ -490,3 +497,7 @@ void PgmCompiler::read_uai_file(const char* uai_file) {
 }
 
 PsddManager* PgmCompiler::psdd_manager() const { return m_pm; }
+
+void PgmCompiler::set_thread_pool(ThreadPool* thread_pool) {
+  m_thread_pool = thread_pool;
+}
@@ -0,0 +1,122 @@
+#include <psdd/psdd_computed_table.h>
+#include <psdd/psdd_node_arena.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+// Spreads the combined operand keys over the low bits that pick an entry.
+std::size_t MixHash(std::size_t hash_value) {
+  uint64_t mixed = hash_value;
+  mixed ^= mixed >> 33;
+  mixed *= 0xff51afd7ed558ccdULL;
+  mixed ^= mixed >> 33;
+  mixed *= 0xc4ceb9fe1a85ec53ULL;
+  mixed ^= mixed >> 33;
+  return (std::size_t)mixed;
+}
+} // namespace
+
+double PsddComputedTableStats::hit_rate() const {
+  return lookup_size == 0 ? 0 : (double)hit_size / lookup_size;
+}
+
+PsddComputedTable::PsddComputedTable(const PsddNodeArena *node_arena,
+                                     size_t entry_size)
+    : node_arena_(node_arena), entry_size_(entry_size), allocate_flag_(),
+      generation_(0), entries_(), stripes_(new Stripe[kStripeSize]) {
+  assert(entry_size_ >= kStripeSize &&
+         (entry_size_ & (entry_size_ - 1)) == 0);
+}
+
+bool PsddComputedTable::FindProduct(const PsddNode *first,
+                                    const PsddNode *second,
+                                    uintmax_t flag_index,
+                                    LogSumAccuracy accuracy,
+                                    PsddDecisionNode **product,
+                                    PsddParameter *partition) {
+  std::call_once(allocate_flag_, &PsddComputedTable::AllocateEntries, this);
+  size_t entry_index = EntryIndex(first, second, flag_index, accuracy);
+  Stripe &stripe = stripes_[entry_index % kStripeSize];
+  std::lock_guard<std::mutex> lock(stripe.mutex);
+  ++stripe.lookup_size;
+  Entry &entry = entries_[entry_index];
+  if (entry.first != first || entry.second != second ||
+      entry.first_index != first->node_index() ||
+      entry.second_index != second->node_index() ||
+      entry.flag_index != flag_index || entry.accuracy != accuracy) {
+    return false;
+  }
+  // The product is read only once the arena says it is still there.
+  if (entry.product != nullptr &&
+      (!node_arena_->HoldsDecisionNode(entry.product, entry.product_index) ||
+       (entry.generation != generation_.load() &&
+        entry.product->ref_count() == 0))) {
+    ++stripe.stale_size;
+    entry = Entry();
+    return false;
+  }
+  ++stripe.hit_size;
+  *product = entry.product;
+  *partition = entry.partition;
+  return true;
+}
+
+void PsddComputedTable::InsertProduct(const PsddNode *first,
+                                      const PsddNode *second,
+                                      uintmax_t flag_index,
+                                      LogSumAccuracy accuracy,
+                                      PsddDecisionNode *product,
+                                      PsddParameter partition) {
+  std::call_once(allocate_flag_, &PsddComputedTable::AllocateEntries, this);
+  size_t entry_index = EntryIndex(first, second, flag_index, accuracy);
+  Stripe &stripe = stripes_[entry_index % kStripeSize];
+  std::lock_guard<std::mutex> lock(stripe.mutex);
+  Entry &entry = entries_[entry_index];
+  entry.first = first;
+  entry.second = second;
+  entry.first_index = first->node_index();
+  entry.second_index = second->node_index();
+  entry.flag_index = flag_index;
+  entry.accuracy = accuracy;
+  entry.product = product;
+  entry.product_index = product == nullptr ? 0 : product->node_index();
+  entry.generation = generation_.load();
+  entry.partition = partition;
+}
+
+PsddComputedTableStats PsddComputedTable::stats() const {
+  PsddComputedTableStats result;
+  result.entry_size = entry_size_;
+  for (size_t i = 0; i < kStripeSize; ++i) {
+    Stripe &stripe = stripes_[i];
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    result.lookup_size += stripe.lookup_size;
+    result.hit_size += stripe.hit_size;
+    result.stale_size += stripe.stale_size;
+  }
+  return result;
+}
+
+void PsddComputedTable::Clear() {
+  // Entries that were never allocated are empty already.
+  if (entries_ != nullptr) {
+    std::fill(entries_.get(), entries_.get() + entry_size_, Entry());
+  }
+}
+
+void PsddComputedTable::AdvanceGeneration() { generation_.fetch_add(1); }
+
+size_t PsddComputedTable::EntryIndex(const PsddNode *first,
+                                     const PsddNode *second,
+                                     uintmax_t flag_index,
+                                     LogSumAccuracy accuracy) const {
+  std::size_t hash_value = MixHash(first->node_index());
+  hash_value = MixHash(hash_value ^ second->node_index());
+  hash_value = MixHash(hash_value ^ (flag_index << 1 | accuracy));
+  return hash_value & (entry_size_ - 1);
+}
+
+void PsddComputedTable::AllocateEntries() {
+  entries_.reset(new Entry[entry_size_]);
+}
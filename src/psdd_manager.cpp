@@ -4,15 +4,25 @@
 
 #include <psdd/psdd_manager.h>
 #include <psdd/psdd_unique_table.h>
+#include <psdd/thread_pool.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <sstream>
 #include <stack>
+#include <unordered_map>
 #include <unordered_set>
+#include <utility>
 namespace {
 using std::unordered_set;
 
@@ -27,55 +37,206 @@ void TagSddVtreeWithPsddVtree(
   }
 }
 
-struct MultiplyFunctional {
-  std::size_t operator()(const std::pair<PsddNode *, PsddNode *> &arg) const {
-    return (std::hash<uintmax_t>{}(arg.first->node_index()) << 1) ^
-           (std::hash<uintmax_t>{}(arg.second->node_index()));
-  }
-  bool operator()(const std::pair<PsddNode *, PsddNode *> &arg1,
-                  const std::pair<PsddNode *, PsddNode *> &arg2) const {
-    return (arg1.second == arg2.second) && (arg1.first == arg2.first);
+// Entries of the computed table of Multiply. At 1 << 16 entries of 72 bytes
+// it takes 4.5MB once the manager first multiplies.
+const size_t kComputedTableSize = 1 << 16;
+
+// Default bound on the entries of the cache of one Multiply call. Entries
+// take 32 bytes, so the cache stays under 32MB.
+const size_t kMultiplyCacheSize = 1 << 20;
+
+// The elements of the decision node being looked up. Kept per thread, so a
+// lookup that finds its node allocates nothing.
+std::vector<PsddElement> &ScratchElements() {
+  thread_local std::vector<PsddElement> elements;
+  return elements;
+}
+
+std::size_t HashNodePair(const PsddNode *first, const PsddNode *second) {
+  uint64_t hash_value =
+      first->node_index() * 0x9e3779b97f4a7c15ULL ^ second->node_index();
+  hash_value ^= hash_value >> 33;
+  hash_value *= 0xff51afd7ed558ccdULL;
+  hash_value ^= hash_value >> 33;
+  return (std::size_t)hash_value;
+}
+
+// Returns the nodes with an index of at least first_node_index that products
+// reach, which are the nodes a computation starting at first_node_index has
+// created if products are the new ones it returned.
+template <typename Products>
+std::vector<PsddNode *> CreatedNodes(const Products &products,
+                                     uintmax_t first_node_index) {
+  std::vector<PsddNode *> created_nodes;
+  std::unordered_set<PsddNode *> visited_nodes;
+  std::vector<PsddNode *> node_stack(products.begin(), products.end());
+  while (!node_stack.empty()) {
+    PsddNode *cur_node = node_stack.back();
+    node_stack.pop_back();
+    if (cur_node->node_index() < first_node_index ||
+        !visited_nodes.insert(cur_node).second) {
+      continue;
+    }
+    created_nodes.push_back(cur_node);
+    if (cur_node->node_type() == DECISION_NODE_TYPE) {
+      for (const PsddElement &cur_element :
+           cur_node->psdd_decision_node()->elements()) {
+        node_stack.push_back(cur_element.prime);
+        node_stack.push_back(cur_element.sub);
+      }
+    }
   }
-};
+  return created_nodes;
+}
 
+// The products computed during one Multiply, in an open-addressing table
+// that starts small and doubles while it is more than half full, up to
+// max_entry_size entries. Past that a new product overwrites the one in its
+// slot, and a product that was overwritten is computed again if it is
+// needed, so the table of a large multiplication cannot outgrow its bound.
+// The products the computation creates are also listed apart from the table,
+// one pointer each, and so are the true nodes it uses, at most one per vtree
+// node. Neither is bounded, but both count towards memory_size.
 class ComputationCache {
  public:
-  explicit ComputationCache(uint32_t variable_size)
-      : cache_(2 * variable_size - 1) {}
+  // Products with a node index of at least first_node_index are recorded as
+  // created by the computation.
+  ComputationCache(size_t max_entry_size, uintmax_t first_node_index)
+      : entries_(std::min(kMinEntrySize, max_entry_size)),
+        max_entry_size_(max_entry_size), live_size_(0),
+        first_node_index_(first_node_index), created_products_(),
+        true_nodes_() {
+    assert(max_entry_size_ > 0 &&
+           (max_entry_size_ & (max_entry_size_ - 1)) == 0);
+  }
   std::pair<PsddNode *, Probability> Lookup(PsddNode *first_node,
                                             PsddNode *second_node,
                                             bool *found) const {
-    auto vtree_index = sdd_vtree_position(first_node->vtree_node());
-    assert(cache_.size() > static_cast<size_t>(vtree_index));
-    const auto &cache_at_vtree = cache_[vtree_index];
-    auto node_pair = std::pair<PsddNode *, PsddNode *>(first_node, second_node);
-    auto lookup_it = cache_at_vtree.find(node_pair);
-    if (lookup_it == cache_at_vtree.end()) {
-      *found = false;
-      return std::make_pair(nullptr, Probability::CreateFromDecimal(0));
-    } else {
+    const Entry &entry = entries_[EntryIndex(first_node, second_node)];
+    if (entry.first == first_node && entry.second == second_node) {
       *found = true;
-      return lookup_it->second;
+      return {entry.result, entry.partition};
     }
+    *found = false;
+    return std::make_pair(nullptr, Probability::CreateFromDecimal(0));
   }
   void Update(PsddNode *first, PsddNode *second,
               const std::pair<PsddNode *, Probability> &result) {
-    auto vtree_index = sdd_vtree_position(first->vtree_node());
-    assert(cache_.size() > static_cast<size_t>(vtree_index));
-    std::pair<PsddNode *, PsddNode *> node_pair(first, second);
-    cache_[vtree_index][node_pair] = result;
+    if (result.first != nullptr &&
+        result.first->node_index() >= first_node_index_) {
+      created_products_.push_back(result.first);
+    }
+    Entry &entry = entries_[EntryIndex(first, second)];
+    if (entry.first == nullptr) {
+      ++live_size_;
+    }
+    entry = {first, second, result.first, result.second};
+    if (2 * live_size_ > entries_.size() && entries_.size() < max_entry_size_) {
+      Grow();
+    }
+  }
+  // Bytes held by the entries, the list of created products and the true
+  // nodes. The hash map is estimated as a bucket array and one list node per
+  // true node.
+  size_t memory_size() const {
+    return entries_.size() * sizeof(Entry) +
+           created_products_.capacity() * sizeof(PsddNode *) +
+           true_nodes_.bucket_count() * sizeof(void *) +
+           true_nodes_.size() *
+               (sizeof(void *) + sizeof(std::pair<SddLiteral, PsddNode *>));
+  }
+  // The true nodes that conform products to the vtree, keyed by vtree
+  // position. They are shared by the products of the computation, so each
+  // is looked up once.
+  std::unordered_map<SddLiteral, PsddNode *> *true_nodes() {
+    return &true_nodes_;
+  }
+  // The products and true nodes with an index of at least first_node_index,
+  // possibly with repeats. Every node the computation has created is
+  // reachable from them.
+  std::vector<PsddNode *> CreatedRoots() const {
+    std::vector<PsddNode *> created_roots(created_products_.begin(),
+                                          created_products_.end());
+    for (const auto &true_node : true_nodes_) {
+      if (true_node.second->node_index() >= first_node_index_) {
+        created_roots.push_back(true_node.second);
+      }
+    }
+    return created_roots;
   }
 
  private:
-  std::vector<std::unordered_map<std::pair<PsddNode *, PsddNode *>,
-                                 std::pair<PsddNode *, Probability>,
-                                 MultiplyFunctional, MultiplyFunctional>>
-      cache_;
+  struct Entry {
+    PsddNode *first = nullptr;
+    PsddNode *second = nullptr;
+    PsddNode *result = nullptr;
+    Probability partition;
+  };
+  static const size_t kMinEntrySize = 1 << 10;
+  size_t EntryIndex(const PsddNode *first, const PsddNode *second) const {
+    return HashNodePair(first, second) & (entries_.size() - 1);
+  }
+  void Grow() {
+    std::vector<Entry> old_entries(2 * entries_.size());
+    old_entries.swap(entries_);
+    live_size_ = 0;
+    for (const Entry &old_entry : old_entries) {
+      if (old_entry.first != nullptr) {
+        Entry &entry = entries_[EntryIndex(old_entry.first, old_entry.second)];
+        if (entry.first == nullptr) {
+          ++live_size_;
+        }
+        entry = old_entry;
+      }
+    }
+  }
+  std::vector<Entry> entries_;
+  size_t max_entry_size_;
+  size_t live_size_;
+  uintmax_t first_node_index_;
+  // Kept apart from the entries, which may lose them. A product computed for
+  // several pairs of operands is listed once for each.
+  std::vector<PsddNode *> created_products_;
+  std::unordered_map<SddLiteral, PsddNode *> true_nodes_;
 };
 
+// Returns the decision node with the given elements, whose parameters are
+// normalized in place, and the partition they are divided by. Without
+// elements the product is false, which is nullptr with partition 0. The
+// true nodes used to conform the elements are kept in cache.
+std::pair<PsddDecisionNode *, PsddParameter>
+NormalizedProduct(const std::vector<PsddNode *> &primes,
+                  const std::vector<PsddNode *> &subs,
+                  std::vector<PsddParameter> *parameters,
+                  PsddManager *manager, uintmax_t flag_index,
+                  LogSumAccuracy accuracy, ComputationCache *cache) {
+  if (primes.empty()) {
+    return {nullptr, PsddParameter::CreateFromDecimal(0)};
+  }
+  PsddParameter partition = SumParameters(
+      parameters->size(), [&](size_t i) { return (*parameters)[i]; },
+      accuracy);
+  for (auto &single_parameter : *parameters) {
+    single_parameter = single_parameter / partition;
+    assert(single_parameter != PsddParameter::CreateFromDecimal(0));
+  }
+  return {manager->GetConformedPsddDecisionNode(primes, subs, *parameters,
+                                                flag_index,
+                                                cache->true_nodes()),
+          partition};
+}
+
+// Products of decision nodes missing from cache are looked up in
+// computed_table, which keeps them across calls, before being computed. The
+// operands are ordered by node index first, so a product and its commuted
+// one share their entries and are computed the same way.
 std::pair<PsddNode *, PsddParameter> MultiplyWithCache(
     PsddNode *first, PsddNode *second, PsddManager *manager,
-    uintmax_t flag_index, ComputationCache *cache) {
+    uintmax_t flag_index, LogSumAccuracy accuracy, ComputationCache *cache,
+    PsddComputedTable *computed_table) {
+  if (first->node_index() > second->node_index()) {
+    std::swap(first, second);
+  }
   bool found = false;
   auto result = cache->Lookup(first, second, &found);
   if (found) return result;
@@ -83,60 +244,50 @@ std::pair<PsddNode *, PsddParameter> MultiplyWithCache(
          sdd_vtree_position(second->vtree_node()));
   if (first->node_type() == DECISION_NODE_TYPE) {
     assert(second->node_type() == DECISION_NODE_TYPE);
+    PsddDecisionNode *computed_product = nullptr;
+    PsddParameter computed_partition;
+    if (computed_table->FindProduct(first, second, flag_index, accuracy,
+                                    &computed_product, &computed_partition)) {
+      std::pair<PsddNode *, Probability> comp_result = {computed_product,
+                                                        computed_partition};
+      cache->Update(first, second, comp_result);
+      return comp_result;
+    }
     PsddDecisionNode *first_decision_node = first->psdd_decision_node();
     PsddDecisionNode *second_decision_node = second->psdd_decision_node();
-    const auto &first_primes = first_decision_node->primes();
-    const auto &first_subs = first_decision_node->subs();
-    const auto &first_parameters = first_decision_node->parameters();
-    const auto &second_primes = second_decision_node->primes();
-    const auto &second_subs = second_decision_node->subs();
-    const auto &second_parameters = second_decision_node->parameters();
-    auto first_element_size = first_primes.size();
-    auto second_element_size = second_primes.size();
     std::vector<PsddNode *> next_primes;
     std::vector<PsddNode *> next_subs;
     std::vector<PsddParameter> next_parameters;
-    PsddParameter partition = PsddParameter::CreateFromDecimal(0);
-    for (size_t i = 0; i < first_element_size; ++i) {
-      PsddNode *cur_first_prime = first_primes[i];
-      PsddNode *cur_first_sub = first_subs[i];
-      PsddParameter cur_first_param = first_parameters[i];
-      for (size_t j = 0; j < second_element_size; ++j) {
-        PsddNode *cur_second_prime = second_primes[j];
-        auto cur_prime_result = MultiplyWithCache(
-            cur_first_prime, cur_second_prime, manager, flag_index, cache);
+    for (const PsddElement &first_element : first_decision_node->elements()) {
+      for (const PsddElement &second_element :
+           second_decision_node->elements()) {
+        auto cur_prime_result =
+            MultiplyWithCache(first_element.prime, second_element.prime,
+                              manager, flag_index, accuracy, cache,
+                              computed_table);
         if (cur_prime_result.first == nullptr) {
           continue;
         }
-        PsddNode *cur_second_sub = second_subs[j];
-        auto cur_sub_result = MultiplyWithCache(cur_first_sub, cur_second_sub,
-                                                manager, flag_index, cache);
+        auto cur_sub_result =
+            MultiplyWithCache(first_element.sub, second_element.sub, manager,
+                              flag_index, accuracy, cache, computed_table);
         if (cur_sub_result.first == nullptr) {
           continue;
         }
         next_primes.push_back(cur_prime_result.first);
         next_subs.push_back(cur_sub_result.first);
-        PsddParameter cur_second_param = second_parameters[j];
-        next_parameters.push_back(cur_second_param * cur_first_param *
-                                  cur_prime_result.second *
-                                  cur_sub_result.second);
-        partition = partition + next_parameters.back();
+        next_parameters.push_back(
+            second_element.parameter * first_element.parameter *
+            cur_prime_result.second * cur_sub_result.second);
       }
     }
-    if (next_primes.empty()) {
-      std::pair<PsddNode *, Probability> comp_result = {
-          nullptr, PsddParameter::CreateFromDecimal(0)};
-      cache->Update(first, second, comp_result);
-      return comp_result;
-    }
-    for (auto &single_parameter : next_parameters) {
-      single_parameter = single_parameter / partition;
-      assert(single_parameter != PsddParameter::CreateFromDecimal(0));
-    }
-    auto new_node = manager->GetConformedPsddDecisionNode(
-        next_primes, next_subs, next_parameters, flag_index);
-    std::pair<PsddNode *, Probability> comp_result = {new_node, partition};
+    auto product = NormalizedProduct(next_primes, next_subs, &next_parameters,
+                                     manager, flag_index, accuracy, cache);
+    std::pair<PsddNode *, Probability> comp_result = {product.first,
+                                                      product.second};
     cache->Update(first, second, comp_result);
+    computed_table->InsertProduct(first, second, flag_index, accuracy,
+                                  product.first, product.second);
     return comp_result;
   } else if (first->node_type() == LITERAL_NODE_TYPE) {
     PsddLiteralNode *first_literal_node = first->psdd_literal_node();
@@ -209,7 +360,7 @@ std::pair<PsddNode *, PsddParameter> MultiplyWithCache(
           first_top_node->true_parameter() * second_top_node->true_parameter();
       PsddParameter neg_weight = first_top_node->false_parameter() *
                                  second_top_node->false_parameter();
-      PsddParameter partition = pos_weight + neg_weight;
+      PsddParameter partition = pos_weight.Add(neg_weight, accuracy);
       PsddNode *new_node = manager->GetPsddTopNode(
           first_top_node->variable_index(), flag_index, pos_weight / partition,
           neg_weight / partition);
@@ -223,6 +374,339 @@ std::pair<PsddNode *, PsddParameter> MultiplyWithCache(
     }
   }
 }
+
+// Products become tasks only if their vtree node has more than this many
+// variables, and only while the deque of the worker that needs them holds
+// fewer than kReadyTaskSize tasks. Other products are computed serially by
+// that worker, since a task costs several times as much as a product that
+// is mostly found in the caches.
+const SddLiteral kMinTaskVariableSize = 8;
+const size_t kReadyTaskSize = 4;
+
+// A product of two decision nodes that ParallelProduct computes as a task.
+// The task first waits for the products of the primes of its element pairs,
+// then for the products of the subs under consistent primes, and then builds
+// its node. Only the worker running a stage touches the stage and the
+// element products; mutex guards the rest.
+struct ProductTask {
+  ProductTask(PsddNode *first_node, PsddNode *second_node)
+      : first(first_node), second(second_node), stage(0), pending_size(0),
+        prime_products(), sub_products(), mutex(), done(false), result(),
+        dependents() {}
+  PsddNode *first;
+  PsddNode *second;
+  int stage;
+  // Products still to come before the next stage can run.
+  std::atomic<size_t> pending_size;
+  // Indexed by element pair, in the order Multiply visits them.
+  std::vector<std::pair<PsddNode *, PsddParameter>> prime_products;
+  std::vector<std::pair<PsddNode *, PsddParameter>> sub_products;
+  std::mutex mutex;
+  bool done;
+  std::pair<PsddNode *, PsddParameter> result;
+  // Tasks waiting for this one, and where each wants the result written.
+  using Dependent =
+      std::pair<ProductTask *, std::pair<PsddNode *, PsddParameter> *>;
+  std::vector<Dependent> dependents;
+};
+
+// Multiplies two PSDDs on the workers of a ThreadPool. Each worker keeps a
+// deque of ready tasks, runs the newest task of its own deque, and steals
+// the oldest task of another deque when its own is empty. A task never
+// blocks: it registers with the tasks it needs and is made ready again by
+// the last of them to finish. Workers that find no task sleep until one is
+// pushed or the whole product is done. Every product task is created once, so workers that need
+// a product in flight wait for it instead of computing it again. Other
+// products go through MultiplyWithCache with a cache per worker and the
+// computed table of the manager, and come out the same as from Multiply.
+class ParallelProduct {
+ public:
+  ParallelProduct(PsddManager *manager, PsddComputedTable *computed_table,
+                  uintmax_t flag_index, LogSumAccuracy accuracy,
+                  size_t cache_size, uintmax_t first_node_index,
+                  uint32_t worker_size)
+      : manager_(manager), computed_table_(computed_table),
+        flag_index_(flag_index), accuracy_(accuracy),
+        first_node_index_(first_node_index), worker_size_(worker_size),
+        caches_(), queues_(new WorkerQueue[worker_size]),
+        shards_(new TaskShard[kTaskShardSize]), root_(nullptr),
+        finished_(false), ready_size_(0), idle_size_(0), idle_mutex_(),
+        idle_condition_() {
+    for (uint32_t i = 0; i < worker_size_; ++i) {
+      caches_.emplace_back(new ComputationCache(cache_size, first_node_index));
+    }
+  }
+  std::pair<PsddNode *, PsddParameter> Run(PsddNode *first, PsddNode *second,
+                                           ThreadPool *thread_pool) {
+    std::pair<PsddNode *, PsddParameter> result;
+    if (!Request(first, second, nullptr, &result, 0)) {
+      return result;
+    }
+    thread_pool->Run(worker_size_, [this](size_t, uint32_t worker_index) {
+      WorkLoop(worker_index);
+    });
+    return root_->result;
+  }
+  // Bytes held by the caches of the workers.
+  size_t memory_size() const {
+    size_t memory_size = 0;
+    for (const auto &cache : caches_) {
+      memory_size += cache->memory_size();
+    }
+    return memory_size;
+  }
+  // The nodes the multiplication has created.
+  std::vector<PsddNode *> CreatedNodes() const {
+    std::vector<PsddNode *> products;
+    for (const auto &cache : caches_) {
+      std::vector<PsddNode *> created_roots = cache->CreatedRoots();
+      products.insert(products.end(), created_roots.begin(),
+                      created_roots.end());
+    }
+    for (size_t i = 0; i < kTaskShardSize; ++i) {
+      for (const auto &task_entry : shards_[i].tasks) {
+        PsddNode *product = task_entry.second->result.first;
+        if (product != nullptr && product->node_index() >= first_node_index_) {
+          products.push_back(product);
+        }
+      }
+    }
+    return ::CreatedNodes(products, first_node_index_);
+  }
+
+ private:
+  struct NodePairHash {
+    std::size_t
+    operator()(const std::pair<PsddNode *, PsddNode *> &node_pair) const {
+      return HashNodePair(node_pair.first, node_pair.second);
+    }
+  };
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<ProductTask *> tasks;
+  };
+  struct TaskShard {
+    std::mutex mutex;
+    std::unordered_map<std::pair<PsddNode *, PsddNode *>,
+                       std::unique_ptr<ProductTask>, NodePairHash>
+        tasks;
+  };
+  static const size_t kTaskShardSize = 64;
+  // Writes the product of first and second to *result if it can be had
+  // without waiting, and returns false. Otherwise adds it to the pending
+  // products of parent, arranges for it to be written before parent runs
+  // again, and returns true. The root product has no parent.
+  bool Request(PsddNode *first, PsddNode *second, ProductTask *parent,
+               std::pair<PsddNode *, PsddParameter> *result,
+               uint32_t worker_index) {
+    if (first->node_index() > second->node_index()) {
+      std::swap(first, second);
+    }
+    if (first->node_type() != DECISION_NODE_TYPE ||
+        sdd_vtree_var_count(first->vtree_node()) <= kMinTaskVariableSize ||
+        (parent != nullptr && !WantsTasks(worker_index))) {
+      *result = MultiplyWithCache(first, second, manager_, flag_index_,
+                                  accuracy_, caches_[worker_index].get(),
+                                  computed_table_);
+      return false;
+    }
+    std::pair<PsddNode *, PsddNode *> node_pair(first, second);
+    TaskShard &shard = shards_[HashNodePair(first, second) % kTaskShardSize];
+    ProductTask *task = nullptr;
+    bool is_new = false;
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto &task_entry = shard.tasks[node_pair];
+      if (task_entry == nullptr) {
+        task_entry.reset(new ProductTask(first, second));
+        is_new = true;
+      }
+      task = task_entry.get();
+    }
+    if (parent == nullptr) {
+      root_ = task;
+    }
+    {
+      std::lock_guard<std::mutex> lock(task->mutex);
+      if (task->done) {
+        *result = task->result;
+        return false;
+      }
+      if (parent != nullptr) {
+        parent->pending_size.fetch_add(1);
+        task->dependents.emplace_back(parent, result);
+      }
+    }
+    if (is_new) {
+      Push(task, worker_index);
+    }
+    return true;
+  }
+  void Step(ProductTask *task, uint32_t worker_index) {
+    PsddDecisionNode *first_node = task->first->psdd_decision_node();
+    PsddDecisionNode *second_node = task->second->psdd_decision_node();
+    size_t second_size = second_node->elements().size();
+    size_t pair_size = first_node->elements().size() * second_size;
+    if (task->stage == 0) {
+      PsddDecisionNode *computed_product = nullptr;
+      PsddParameter computed_partition;
+      if (computed_table_->FindProduct(task->first, task->second,
+                                       flag_index_, accuracy_,
+                                       &computed_product,
+                                       &computed_partition)) {
+        Complete(task, {computed_product, computed_partition}, worker_index);
+        return;
+      }
+      task->prime_products.resize(pair_size);
+    } else if (task->stage == 1) {
+      task->sub_products.resize(pair_size);
+    } else {
+      std::vector<PsddNode *> next_primes;
+      std::vector<PsddNode *> next_subs;
+      std::vector<PsddParameter> next_parameters;
+      for (size_t i = 0; i < pair_size; ++i) {
+        const auto &prime_product = task->prime_products[i];
+        const auto &sub_product = task->sub_products[i];
+        if (prime_product.first == nullptr || sub_product.first == nullptr) {
+          continue;
+        }
+        const PsddElement &first_element =
+            first_node->elements()[i / second_size];
+        const PsddElement &second_element =
+            second_node->elements()[i % second_size];
+        next_primes.push_back(prime_product.first);
+        next_subs.push_back(sub_product.first);
+        next_parameters.push_back(second_element.parameter *
+                                  first_element.parameter *
+                                  prime_product.second * sub_product.second);
+      }
+      auto product = NormalizedProduct(
+          next_primes, next_subs, &next_parameters, manager_, flag_index_,
+          accuracy_, caches_[worker_index].get());
+      computed_table_->InsertProduct(task->first, task->second, flag_index_,
+                                     accuracy_, product.first,
+                                     product.second);
+      Complete(task, {product.first, product.second}, worker_index);
+      return;
+    }
+    // One pending product for this loop, so that the task cannot be made
+    // ready before all of its requests are out.
+    task->pending_size.store(1);
+    for (size_t i = 0; i < pair_size; ++i) {
+      const PsddElement &first_element =
+          first_node->elements()[i / second_size];
+      const PsddElement &second_element =
+          second_node->elements()[i % second_size];
+      if (task->stage == 0) {
+        Request(first_element.prime, second_element.prime, task,
+                &task->prime_products[i], worker_index);
+      } else if (task->prime_products[i].first != nullptr) {
+        Request(first_element.sub, second_element.sub, task,
+                &task->sub_products[i], worker_index);
+      }
+    }
+    task->stage += 1;
+    Release(task, worker_index);
+  }
+  void Complete(ProductTask *task,
+                const std::pair<PsddNode *, PsddParameter> &result,
+                uint32_t worker_index) {
+    std::vector<ProductTask::Dependent> dependents;
+    {
+      std::lock_guard<std::mutex> lock(task->mutex);
+      task->result = result;
+      task->done = true;
+      dependents.swap(task->dependents);
+    }
+    for (const auto &dependent : dependents) {
+      *dependent.second = result;
+      Release(dependent.first, worker_index);
+    }
+    if (task == root_) {
+      finished_.store(true);
+      std::lock_guard<std::mutex> lock(idle_mutex_);
+      idle_condition_.notify_all();
+    }
+  }
+  // Counts off one pending product of task, and makes it ready if that was
+  // the last.
+  void Release(ProductTask *task, uint32_t worker_index) {
+    if (task->pending_size.fetch_sub(1) == 1) {
+      Push(task, worker_index);
+    }
+  }
+  bool WantsTasks(uint32_t worker_index) {
+    WorkerQueue &queue = queues_[worker_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    return queue.tasks.size() < kReadyTaskSize;
+  }
+  void Push(ProductTask *task, uint32_t worker_index) {
+    {
+      WorkerQueue &queue = queues_[worker_index];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(task);
+    }
+    // A worker counts itself idle before it checks ready_size_, so either
+    // it sees this task or it is counted here and gets woken.
+    ready_size_.fetch_add(1);
+    if (idle_size_.load() > 0) {
+      std::lock_guard<std::mutex> lock(idle_mutex_);
+      idle_condition_.notify_one();
+    }
+  }
+  ProductTask *Pop(uint32_t worker_index) {
+    for (uint32_t i = 0; i < worker_size_; ++i) {
+      WorkerQueue &queue = queues_[(worker_index + i) % worker_size_];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      ProductTask *task = nullptr;
+      if (i == 0) {
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+      } else {
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+      }
+      ready_size_.fetch_sub(1);
+      return task;
+    }
+    return nullptr;
+  }
+  void WorkLoop(uint32_t worker_index) {
+    while (!finished_.load()) {
+      ProductTask *task = Pop(worker_index);
+      if (task == nullptr) {
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        idle_size_.fetch_add(1);
+        idle_condition_.wait(lock, [this]() {
+          return ready_size_.load() > 0 || finished_.load();
+        });
+        idle_size_.fetch_sub(1);
+        continue;
+      }
+      Step(task, worker_index);
+    }
+  }
+  PsddManager *manager_;
+  PsddComputedTable *computed_table_;
+  uintmax_t flag_index_;
+  LogSumAccuracy accuracy_;
+  uintmax_t first_node_index_;
+  uint32_t worker_size_;
+  std::vector<std::unique_ptr<ComputationCache>> caches_;
+  std::unique_ptr<WorkerQueue[]> queues_;
+  std::unique_ptr<TaskShard[]> shards_;
+  ProductTask *root_;
+  std::atomic<bool> finished_;
+  // Tasks in the deques, and workers asleep or about to sleep on
+  // idle_condition_.
+  std::atomic<size_t> ready_size_;
+  std::atomic<size_t> idle_size_;
+  std::mutex idle_mutex_;
+  std::condition_variable idle_condition_;
+};
 }  // namespace
 
 PsddManager *PsddManager::GetPsddManagerFromSddVtree(
@@ -257,13 +741,17 @@ PsddManager *PsddManager::GetPsddManagerFromSddVtree(
   for (Vtree *sdd_vtree_node : serialized_sdd_vtree) {
     sdd_vtree_set_data(nullptr, sdd_vtree_node);
   }
-  auto unique_table = PsddUniqueTable::GetPsddUniqueTable();
-  return new PsddManager(psdd_vtree, unique_table);
+  return new PsddManager(psdd_vtree);
 }
-PsddManager::PsddManager(Vtree *vtree, PsddUniqueTable *unique_table)
+PsddManager::PsddManager(Vtree *vtree)
     : vtree_(vtree),
-      unique_table_(unique_table),
+      node_arena_(),
+      unique_table_(
+          PsddUniqueTable::GetPsddUniqueTable(&node_arena_, vtree)),
+      computed_table_(&node_arena_, kComputedTableSize),
       node_index_(0),
+      multiply_cache_size_(kMultiplyCacheSize),
+      multiply_cache_memory_size_(0),
       leaf_vtree_map_() {
   std::vector<Vtree *> serialized_vtrees = vtree_util::SerializeVtree(vtree_);
   for (Vtree *cur_v : serialized_vtrees) {
@@ -272,14 +760,117 @@ PsddManager::PsddManager(Vtree *vtree, PsddUniqueTable *unique_table)
     }
   }
 }
+PsddLiteralNode *PsddManager::GetUniqueLiteralNode(Vtree *vtree_node,
+                                                   uintmax_t flag_index,
+                                                   int32_t literal) {
+  PsddNode *unique_node = unique_table_->FindUniqueNode(
+      PsddNodeKey::LiteralNodeKey(vtree_node, flag_index, literal));
+  if (unique_node == nullptr) {
+    // Another thread may have added the node since the lookup, in which case
+    // GetUniqueNode returns that one.
+    unique_node = unique_table_->GetUniqueNode(node_arena_.NewLiteralNode(
+        NewNodeIndex(), vtree_node, flag_index, literal));
+  }
+  return unique_node->psdd_literal_node();
+}
+
+PsddDecisionNode *PsddManager::GetUniqueDecisionNode(
+    Vtree *vtree_node, uintmax_t flag_index,
+    const std::vector<PsddNode *> &primes, const std::vector<PsddNode *> &subs,
+    const std::vector<PsddParameter> &parameters) {
+  std::vector<PsddElement> &elements = ScratchElements();
+  elements.clear();
+  for (size_t i = 0; i < primes.size(); ++i) {
+    elements.push_back({primes[i], subs[i],
+                        parameters.empty() ? PsddParameter() : parameters[i]});
+  }
+  std::sort(elements.begin(), elements.end(),
+            [](const PsddElement &lhs, const PsddElement &rhs) {
+              return lhs.prime->node_index() < rhs.prime->node_index();
+            });
+  PsddNode *unique_node =
+      unique_table_->FindUniqueNode(PsddNodeKey::DecisionNodeKey(
+          vtree_node, flag_index, elements.data(), elements.size()));
+  if (unique_node == nullptr) {
+    unique_node = unique_table_->GetUniqueNode(node_arena_.NewDecisionNode(
+        NewNodeIndex(), vtree_node, flag_index, elements));
+  }
+  return unique_node->psdd_decision_node();
+}
+
+void PsddManager::RecordMultiplyCacheMemory(size_t memory_size) {
+  size_t max_memory_size = multiply_cache_memory_size_.load();
+  while (memory_size > max_memory_size &&
+         !multiply_cache_memory_size_.compare_exchange_weak(max_memory_size,
+                                                            memory_size)) {
+  }
+}
+
+uintmax_t PsddManager::NewNodeIndex() {
+  // Only uniqueness matters, so no ordering with other memory is needed.
+  return node_index_.fetch_add(1, std::memory_order_relaxed);
+}
+
 PsddManager::~PsddManager() {
-  unique_table_->DeleteUnusedPsddNodes({});
+  // The nodes are released with node_arena_.
   delete (unique_table_);
   sdd_vtree_free(vtree_);
 }
-void PsddManager::DeleteUnusedPsddNodes(
+size_t PsddManager::DeleteUnusedPsddNodes(
     const std::vector<PsddNode *> &used_nodes) {
-  unique_table_->DeleteUnusedPsddNodes(used_nodes);
+  // Clearing costs far less than the sweep, and the table could otherwise
+  // keep a product some of whose descendants were freed.
+  computed_table_.Clear();
+  return unique_table_->DeleteUnusedPsddNodes(used_nodes);
+}
+size_t PsddManager::DeleteUnreferencedPsddNodes(uintmax_t first_node_index) {
+  computed_table_.Clear();
+  return unique_table_->DeleteUnreferencedPsddNodes(first_node_index);
+}
+uintmax_t PsddManager::next_node_index() const { return node_index_.load(); }
+
+void PsddManager::RefPsddNode(PsddNode *node) {
+  std::vector<PsddNode *> node_stack = {node};
+  while (!node_stack.empty()) {
+    PsddNode *cur_node = node_stack.back();
+    node_stack.pop_back();
+    cur_node->IncreaseRefCount();
+    // A node that becomes live holds its children.
+    if (cur_node->ref_count() == 1 &&
+        cur_node->node_type() == DECISION_NODE_TYPE) {
+      for (const PsddElement &cur_element :
+           cur_node->psdd_decision_node()->elements()) {
+        node_stack.push_back(cur_element.prime);
+        node_stack.push_back(cur_element.sub);
+      }
+    }
+  }
+}
+
+size_t PsddManager::DerefPsddNode(PsddNode *node) {
+  size_t reclaimed_bytes = 0;
+  std::vector<PsddNode *> node_stack = {node};
+  while (!node_stack.empty()) {
+    PsddNode *cur_node = node_stack.back();
+    node_stack.pop_back();
+    cur_node->DecreaseRefCount();
+    if (cur_node->ref_count() > 0) {
+      continue;
+    }
+    if (cur_node->node_type() == DECISION_NODE_TYPE) {
+      for (const PsddElement &cur_element :
+           cur_node->psdd_decision_node()->elements()) {
+        node_stack.push_back(cur_element.prime);
+        node_stack.push_back(cur_element.sub);
+      }
+    }
+    reclaimed_bytes += unique_table_->DeletePsddNode(cur_node);
+  }
+  if (reclaimed_bytes > 0) {
+    // Products that were never live may have lost descendants.
+    computed_table_.AdvanceGeneration();
+  }
+  return reclaimed_bytes;
 }
 
 PsddNode *PsddManager::ConvertSddToPsdd(SddNode *root_node, Vtree *sdd_vtree,
@@ -343,9 +934,8 @@ PsddNode *PsddManager::ConvertSddToPsdd(SddNode *root_node, Vtree *sdd_vtree,
         }
       }
       assert(!primes.empty());
-      PsddNode *new_decn_node = new PsddDecisionNode(
-          node_index_, new_vtree_node, flag_index, primes, subs, parameters);
-      new_decn_node = unique_table_->GetUniqueNode(new_decn_node, &node_index_);
+      PsddNode *new_decn_node = GetUniqueDecisionNode(
+          new_vtree_node, flag_index, primes, subs, parameters);
       node_map[sdd_id(cur_node)] = new_decn_node;
     } else if (sdd_node_is_literal(cur_node)) {
       Vtree *old_vtree_node = sdd_vtree_of(cur_node);
@@ -358,10 +948,8 @@ PsddNode *PsddManager::ConvertSddToPsdd(SddNode *root_node, Vtree *sdd_vtree,
       } else {
         new_literal = -static_cast<int32_t>(sdd_vtree_var(new_vtree_node));
       }
-      PsddNode *new_literal_node = new PsddLiteralNode(
-          node_index_, new_vtree_node, flag_index, new_literal);
-      new_literal_node =
-          unique_table_->GetUniqueNode(new_literal_node, &node_index_);
+      PsddNode *new_literal_node =
+          GetUniqueLiteralNode(new_vtree_node, flag_index, new_literal);
       node_map[sdd_id(cur_node)] = new_literal_node;
     } else {
       // True false node
@@ -438,59 +1026,76 @@ PsddNode *PsddManager::NormalizePsddNode(
     if (sdd_vtree_left(cur_vtree_parent_node) == cur_vtree_node) {
       auto true_node = GetTrueNode(sdd_vtree_right(cur_vtree_parent_node),
                                    flag_index, true_node_map);
-      PsddNode *next_node = new PsddDecisionNode(
-          node_index_, cur_vtree_parent_node, flag_index, {cur_node},
-          {true_node}, {PsddParameter::CreateFromDecimal(1)});
-      next_node = unique_table_->GetUniqueNode(next_node, &node_index_);
+      PsddNode *next_node = GetUniqueDecisionNode(
+          cur_vtree_parent_node, flag_index, {cur_node}, {true_node},
+          {PsddParameter::CreateFromDecimal(1)});
       cur_node = next_node;
     } else {
       assert(sdd_vtree_right(cur_vtree_parent_node) == cur_vtree_node);
       auto true_node = GetTrueNode(sdd_vtree_left(cur_vtree_parent_node),
                                    flag_index, true_node_map);
-      PsddNode *next_node = new PsddDecisionNode(
-          node_index_, cur_vtree_parent_node, flag_index, {true_node},
-          {cur_node}, {PsddParameter::CreateFromDecimal(1)});
-      next_node = unique_table_->GetUniqueNode(next_node, &node_index_);
+      PsddNode *next_node = GetUniqueDecisionNode(
+          cur_vtree_parent_node, flag_index, {true_node}, {cur_node},
+          {PsddParameter::CreateFromDecimal(1)});
       cur_node = next_node;
     }
   }
   return cur_node;
 }
 Vtree *PsddManager::vtree() const { return vtree_; }
+
+PsddUniqueTableStats PsddManager::unique_table_stats() const {
+  return unique_table_->stats();
+}
+PsddComputedTableStats PsddManager::computed_table_stats() const {
+  return computed_table_.stats();
+}
+void PsddManager::set_multiply_cache_size(size_t entry_size) {
+  assert(entry_size > 0 && (entry_size & (entry_size - 1)) == 0);
+  multiply_cache_size_ = entry_size;
+}
+size_t PsddManager::multiply_cache_memory_size() const {
+  return multiply_cache_memory_size_.load();
+}
 PsddManager *PsddManager::GetPsddManagerFromVtree(Vtree *psdd_vtree) {
   Vtree *copy_vtree = vtree_util::CopyVtree(psdd_vtree);
-  auto *unique_table = PsddUniqueTable::GetPsddUniqueTable();
-  return new PsddManager(copy_vtree, unique_table);
+  return new PsddManager(copy_vtree);
 }
 PsddTopNode *PsddManager::GetPsddTopNode(
     uint32_t variable_index, uintmax_t flag_index,
     const PsddParameter &positive_parameter,
     const PsddParameter &negative_parameter) {
   assert(leaf_vtree_map_.find(variable_index) != leaf_vtree_map_.end());
-  Vtree *target_vtree_node = leaf_vtree_map_[variable_index];
+  Vtree *target_vtree_node = leaf_vtree_map_.at(variable_index);
   assert(sdd_vtree_is_leaf(target_vtree_node));
-  auto next_node = new PsddTopNode(node_index_, target_vtree_node, flag_index,
-                                   (uint32_t)sdd_vtree_var(target_vtree_node),
-                                   positive_parameter, negative_parameter);
-  next_node =
-      (PsddTopNode *)unique_table_->GetUniqueNode(next_node, &node_index_);
-  return next_node;
+  auto variable = (uint32_t)sdd_vtree_var(target_vtree_node);
+  PsddNode *unique_node = unique_table_->FindUniqueNode(PsddNodeKey::TopNodeKey(
+      target_vtree_node, flag_index, variable, positive_parameter));
+  if (unique_node == nullptr) {
+    unique_node = unique_table_->GetUniqueNode(node_arena_.NewTopNode(
+        NewNodeIndex(), target_vtree_node, flag_index, variable,
+        positive_parameter, negative_parameter));
+  }
+  return unique_node->psdd_top_node();
 }
 PsddLiteralNode *PsddManager::GetPsddLiteralNode(int32_t literal,
                                                  uintmax_t flag_index) {
   assert(leaf_vtree_map_.find(abs(literal)) != leaf_vtree_map_.end());
-  Vtree *target_vtree_node = leaf_vtree_map_[abs(literal)];
+  Vtree *target_vtree_node = leaf_vtree_map_.at(abs(literal));
   assert(sdd_vtree_is_leaf(target_vtree_node));
-  auto next_node =
-      new PsddLiteralNode(node_index_, target_vtree_node, flag_index, literal);
-  next_node =
-      (PsddLiteralNode *)unique_table_->GetUniqueNode(next_node, &node_index_);
-  return next_node;
+  return GetUniqueLiteralNode(target_vtree_node, flag_index, literal);
 }
 PsddDecisionNode *PsddManager::GetConformedPsddDecisionNode(
     const std::vector<PsddNode *> &primes, const std::vector<PsddNode *> &subs,
     const std::vector<PsddParameter> &params, uintmax_t flag_index) {
   std::unordered_map<SddLiteral, PsddNode *> true_node_map;
+  return GetConformedPsddDecisionNode(primes, subs, params, flag_index,
+                                      &true_node_map);
+}
+PsddDecisionNode *PsddManager::GetConformedPsddDecisionNode(
+    const std::vector<PsddNode *> &primes, const std::vector<PsddNode *> &subs,
+    const std::vector<PsddParameter> &params, uintmax_t flag_index,
+    std::unordered_map<SddLiteral, PsddNode *> *true_node_map) {
   Vtree *lca =
       sdd_vtree_lca(primes[0]->vtree_node(), subs[0]->vtree_node(), vtree_);
   assert(lca != nullptr);
@@ -503,17 +1108,14 @@ PsddDecisionNode *PsddManager::GetConformedPsddDecisionNode(
     PsddNode *cur_prime = primes[i];
     PsddNode *cur_sub = subs[i];
     PsddNode *cur_conformed_prime =
-        NormalizePsddNode(left_child, cur_prime, flag_index, &true_node_map);
+        NormalizePsddNode(left_child, cur_prime, flag_index, true_node_map);
     PsddNode *cur_conformed_sub =
-        NormalizePsddNode(right_child, cur_sub, flag_index, &true_node_map);
+        NormalizePsddNode(right_child, cur_sub, flag_index, true_node_map);
     conformed_primes.push_back(cur_conformed_prime);
     conformed_subs.push_back(cur_conformed_sub);
   }
-  auto next_decn_node = new PsddDecisionNode(
-      node_index_, lca, flag_index, conformed_primes, conformed_subs, params);
-  next_decn_node = (PsddDecisionNode *)unique_table_->GetUniqueNode(
-      next_decn_node, &node_index_);
-  return next_decn_node;
+  return GetUniqueDecisionNode(lca, flag_index, conformed_primes,
+                               conformed_subs, params);
 }
 
 // TODO: Use the flag index from the input
@@ -541,7 +1143,9 @@ PsddNode *PsddManager::LoadPsddNode(Vtree *target_vtree,
       PsddDecisionNode *cur_decision_node = cur_node->psdd_decision_node();
       const auto &cur_primes = cur_decision_node->primes();
       const auto &cur_subs = cur_decision_node->subs();
-      const auto &cur_parameters = cur_decision_node->parameters();
+      std::vector<PsddParameter> cur_parameters(
+          cur_decision_node->parameters().begin(),
+          cur_decision_node->parameters().end());
       std::vector<PsddNode *> new_primes(cur_primes.size(), nullptr);
       std::vector<PsddNode *> new_subs(cur_subs.size(), nullptr);
       for (size_t i = 0; i < cur_primes.size(); ++i) {
@@ -572,8 +1176,89 @@ PsddNode *PsddManager::NormalizePsddNode(Vtree *target_vtree_node,
 
 std::pair<PsddNode *, PsddParameter> PsddManager::Multiply(
     PsddNode *arg1, PsddNode *arg2, uintmax_t flag_index) {
-  ComputationCache cache((uint32_t)leaf_vtree_map_.size());
-  return MultiplyWithCache(arg1, arg2, this, flag_index, &cache);
+  return Multiply(arg1, arg2, flag_index, EXACT_LOG_SUM);
+}
+
+std::pair<PsddNode *, PsddParameter>
+PsddManager::Multiply(PsddNode *arg1, PsddNode *arg2, uintmax_t flag_index,
+                      LogSumAccuracy accuracy) {
+  // Nothing the product creates needs to be tracked.
+  ComputationCache cache(multiply_cache_size_,
+                         std::numeric_limits<uintmax_t>::max());
+  auto result = MultiplyWithCache(arg1, arg2, this, flag_index, accuracy,
+                                  &cache, &computed_table_);
+  RecordMultiplyCacheMemory(cache.memory_size());
+  return result;
+}
+
+std::pair<PsddRef, PsddParameter> PsddManager::Multiply(const PsddRef &arg1,
+                                                        const PsddRef &arg2,
+                                                        uintmax_t flag_index) {
+  return Multiply(arg1, arg2, flag_index, EXACT_LOG_SUM);
+}
+
+std::pair<PsddRef, PsddParameter>
+PsddManager::Multiply(const PsddRef &arg1, const PsddRef &arg2,
+                      uintmax_t flag_index, LogSumAccuracy accuracy) {
+  uintmax_t first_node_index = node_index_.load();
+  ComputationCache cache(multiply_cache_size_, first_node_index);
+  auto result = MultiplyWithCache(arg1.get(), arg2.get(), this, flag_index,
+                                  accuracy, &cache, &computed_table_);
+  RecordMultiplyCacheMemory(cache.memory_size());
+  PsddRef result_ref(this, result.first);
+  // Nodes created by this call are referenced by nothing outside it, so the
+  // ones the result does not keep live are garbage.
+  for (PsddNode *cur_node :
+       CreatedNodes(cache.CreatedRoots(), first_node_index)) {
+    if (cur_node->ref_count() == 0) {
+      unique_table_->DeletePsddNode(cur_node);
+    }
+  }
+  return {std::move(result_ref), result.second};
+}
+
+std::pair<PsddNode *, PsddParameter>
+PsddManager::ParallelMultiply(PsddNode *arg1, PsddNode *arg2,
+                              uintmax_t flag_index, ThreadPool *thread_pool) {
+  return ParallelMultiply(arg1, arg2, flag_index, EXACT_LOG_SUM, thread_pool);
+}
+
+std::pair<PsddNode *, PsddParameter>
+PsddManager::ParallelMultiply(PsddNode *arg1, PsddNode *arg2,
+                              uintmax_t flag_index, LogSumAccuracy accuracy,
+                              ThreadPool *thread_pool) {
+  ParallelProduct product(this, &computed_table_, flag_index, accuracy,
+                          multiply_cache_size_,
+                          std::numeric_limits<uintmax_t>::max(),
+                          thread_pool->thread_size());
+  auto result = product.Run(arg1, arg2, thread_pool);
+  RecordMultiplyCacheMemory(product.memory_size());
+  return result;
+}
+
+std::pair<PsddRef, PsddParameter>
+PsddManager::ParallelMultiply(const PsddRef &arg1, const PsddRef &arg2,
+                              uintmax_t flag_index, ThreadPool *thread_pool) {
+  return ParallelMultiply(arg1, arg2, flag_index, EXACT_LOG_SUM, thread_pool);
+}
+
+std::pair<PsddRef, PsddParameter>
+PsddManager::ParallelMultiply(const PsddRef &arg1, const PsddRef &arg2,
+                              uintmax_t flag_index, LogSumAccuracy accuracy,
+                              ThreadPool *thread_pool) {
+  uintmax_t first_node_index = node_index_.load();
+  ParallelProduct product(this, &computed_table_, flag_index, accuracy,
+                          multiply_cache_size_, first_node_index,
+                          thread_pool->thread_size());
+  auto result = product.Run(arg1.get(), arg2.get(), thread_pool);
+  RecordMultiplyCacheMemory(product.memory_size());
+  PsddRef result_ref(this, result.first);
+  for (PsddNode *cur_node : product.CreatedNodes()) {
+    if (cur_node->ref_count() == 0) {
+      unique_table_->DeletePsddNode(cur_node);
+    }
+  }
+  return {std::move(result_ref), result.second};
 }
 
 PsddNode *PsddManager::ReadPsddFile(const char *psdd_filename,
@@ -647,10 +1332,8 @@ PsddNode *PsddManager::ReadPsddFile(const char *psdd_filename,
       assert(sdd_vtree_parent(primes[0]->vtree_node()) ==
              sdd_vtree_parent(subs[0]->vtree_node()));
       Vtree *next_vtree = sdd_vtree_parent(primes[0]->vtree_node());
-      auto cur_node = new PsddDecisionNode(node_index_, next_vtree, flag_index,
-                                           primes, subs, params);
-      cur_node = (PsddDecisionNode *)unique_table_->GetUniqueNode(cur_node,
-                                                                  &node_index_);
+      PsddDecisionNode *cur_node =
+          GetUniqueDecisionNode(next_vtree, flag_index, primes, subs, params);
       construct_cache[node_index] = cur_node;
       root_node = cur_node;
     }
@@ -798,9 +1481,8 @@ PsddNode *PsddManager::FromSdd(SddNode *root_node, Vtree *sdd_vtree,
         }
       }
       assert(!primes.empty());
-      PsddNode *new_decn_node = new PsddDecisionNode(
-          node_index_, new_vtree_node, flag_index, primes, subs, parameters);
-      new_decn_node = unique_table_->GetUniqueNode(new_decn_node, &node_index_);
+      PsddNode *new_decn_node = GetUniqueDecisionNode(
+          new_vtree_node, flag_index, primes, subs, parameters);
       node_map[sdd_id(cur_node)] = new_decn_node;
     } else if (sdd_node_is_literal(cur_node)) {
       Vtree *old_vtree_node = sdd_vtree_of(cur_node);
@@ -813,10 +1495,8 @@ PsddNode *PsddManager::FromSdd(SddNode *root_node, Vtree *sdd_vtree,
       } else {
         new_literal = -static_cast<int32_t>(sdd_vtree_var(new_vtree_node));
       }
-      PsddNode *new_literal_node = new PsddLiteralNode(
-          node_index_, new_vtree_node, flag_index, new_literal);
-      new_literal_node =
-          unique_table_->GetUniqueNode(new_literal_node, &node_index_);
+      PsddNode *new_literal_node =
+          GetUniqueLiteralNode(new_vtree_node, flag_index, new_literal);
       node_map[sdd_id(cur_node)] = new_literal_node;
     } else {
       // True false node
@@ -838,45 +1518,64 @@ PsddNode *PsddManager::LearnPsddParameters(
     PsddNode *target_structure,
     const std::unordered_map<int32_t, BatchedPsddValue> &examples,
     size_t data_size, PsddParameter alpha, uintmax_t flag_index) {
+  LearningWorkspace workspace;
+  return LearnPsddParameters(target_structure, examples, data_size, alpha,
+                             flag_index, &workspace);
+}
+
+PsddNode *PsddManager::LearnPsddParameters(
+    PsddNode *target_structure,
+    const std::unordered_map<int32_t, BatchedPsddValue> &examples,
+    size_t data_size, PsddParameter alpha, uintmax_t flag_index,
+    LearningWorkspace *workspace) {
   std::vector<PsddNode *> serialized_psdd_nodes =
       psdd_node_util::SerializePsddNodes(target_structure);
   assert(serialized_psdd_nodes[0] == target_structure);
+  size_t node_size = serialized_psdd_nodes.size();
+  // The data counts of the node at position i start at count_offsets[i]: one
+  // per element of a decision node, and the true and false counts of a top
+  // node.
+  auto &count_offsets = *workspace->MutableCountOffsets(node_size);
+  size_t count_size = 0;
+  for (size_t i = 0; i < node_size; ++i) {
+    PsddNode *cur_node = serialized_psdd_nodes[i];
+    cur_node->SetUserData(i);
+    count_offsets[i] = count_size;
+    if (cur_node->node_type() == DECISION_NODE_TYPE) {
+      count_size += cur_node->psdd_decision_node()->elements().size();
+    } else if (cur_node->node_type() == TOP_NODE_TYPE) {
+      count_size += 2;
+    }
+  }
+  auto &data_counts = *workspace->MutableDataCounts(count_size);
   if (data_size != 0) {
-    for (auto node_it = serialized_psdd_nodes.rbegin();
-         node_it != serialized_psdd_nodes.rend(); ++node_it) {
-      PsddNode *cur_node = *node_it;
-      // Initialize the context value
-      BatchedPsddValue initial_context_values(data_size, false);
-      cur_node->SetBatchedPsddContextValue(std::move(initial_context_values));
+    auto &values = *workspace->MutableValues(node_size, data_size);
+    auto &context_values =
+        *workspace->MutableContextValues(node_size, data_size);
+    for (size_t position = node_size; position-- > 0;) {
+      PsddNode *cur_node = serialized_psdd_nodes[position];
+      BatchedPsddValue &cur_batched_value = values[position];
       if (cur_node->node_type() == LITERAL_NODE_TYPE) {
         PsddLiteralNode *cur_literal_node = cur_node->psdd_literal_node();
         auto example_it = examples.find(cur_literal_node->variable_index());
         assert(example_it != examples.end());
-        BatchedPsddValue cur_batched_value = example_it->second;
-        assert(cur_batched_value.size() == data_size);
+        assert(example_it->second.size() == data_size);
+        cur_batched_value = example_it->second;
         if (!cur_literal_node->sign()) {
-          auto data_size = cur_batched_value.size();
-          for (size_t i = 0; i < data_size; ++i) {
-            cur_batched_value[i] = !cur_batched_value[i];
-          }
+          cur_batched_value.flip();
         }
-        cur_literal_node->SetBatchedPsddValue(std::move(cur_batched_value));
         continue;
       }
       if (cur_node->node_type() == TOP_NODE_TYPE) {
-        BatchedPsddValue cur_batched_value(data_size, true);
-        cur_node->SetBatchedPsddValue(std::move(cur_batched_value));
+        std::fill(cur_batched_value.begin(), cur_batched_value.end(), true);
         continue;
       }
       if (cur_node->node_type() == DECISION_NODE_TYPE) {
         PsddDecisionNode *cur_decn_node = cur_node->psdd_decision_node();
-        const auto &cur_primes = cur_decn_node->primes();
-        const auto &cur_subs = cur_decn_node->subs();
-        size_t element_size = cur_primes.size();
-        BatchedPsddValue cur_batched_value(data_size, false);
-        for (size_t i = 0; i < element_size; ++i) {
-          const auto &cur_prime_value = cur_primes[i]->batched_psdd_value();
-          const auto &cur_sub_value = cur_subs[i]->batched_psdd_value();
+        std::fill(cur_batched_value.begin(), cur_batched_value.end(), false);
+        for (const PsddElement &cur_element : cur_decn_node->elements()) {
+          const auto &cur_prime_value = values[cur_element.prime->user_data()];
+          const auto &cur_sub_value = values[cur_element.sub->user_data()];
           for (size_t cur_data_index = 0; cur_data_index < data_size;
                ++cur_data_index) {
             if (cur_prime_value[cur_data_index] &&
@@ -885,111 +1584,101 @@ PsddNode *PsddManager::LearnPsddParameters(
             }
           }
         }
-        cur_decn_node->SetBatchedPsddValue(std::move(cur_batched_value));
         continue;
       }
     }
     // Initialize the context value for the root node.
-    target_structure->MutableBatchedPsddContextValue()->flip();
-    for (PsddNode *cur_node : serialized_psdd_nodes) {
-      const auto &cur_contexts = cur_node->batched_psdd_context_value();
+    context_values[0].flip();
+    for (size_t position = 0; position < node_size; ++position) {
+      PsddNode *cur_node = serialized_psdd_nodes[position];
+      const auto &cur_contexts = context_values[position];
+      uintmax_t *cur_data_counts = &data_counts[count_offsets[position]];
       if (cur_node->node_type() == TOP_NODE_TYPE) {
         PsddTopNode *cur_top_node = cur_node->psdd_top_node();
         int32_t variable_index = cur_top_node->variable_index();
         auto example_it = examples.find(variable_index);
         assert(example_it != examples.end());
-        uintmax_t pos_data_count = 0;
-        uintmax_t neg_data_count = 0;
         for (size_t i = 0; i < data_size; ++i) {
           if (cur_contexts[i]) {
             if (example_it->second[i]) {
-              ++pos_data_count;
+              ++cur_data_counts[0];
             } else {
-              ++neg_data_count;
+              ++cur_data_counts[1];
             }
           }
         }
-        cur_top_node->IncrementTrueDataCount(pos_data_count);
-        cur_top_node->IncrementFalseDataCount(neg_data_count);
       } else if (cur_node->node_type() == DECISION_NODE_TYPE) {
         PsddDecisionNode *cur_decn_node = cur_node->psdd_decision_node();
-        const auto &primes = cur_decn_node->primes();
-        const auto &subs = cur_decn_node->subs();
-        size_t element_size = primes.size();
+        const auto &elements = cur_decn_node->elements();
+        size_t element_size = elements.size();
         for (size_t i = 0; i < element_size; ++i) {
-          const auto &cur_prime_value = primes[i]->batched_psdd_value();
-          const auto &cur_sub_value = subs[i]->batched_psdd_value();
+          auto prime_position = elements[i].prime->user_data();
+          auto sub_position = elements[i].sub->user_data();
+          const auto &cur_prime_value = values[prime_position];
+          const auto &cur_sub_value = values[sub_position];
           for (size_t j = 0; j < data_size; ++j) {
             if (cur_contexts[j] && cur_prime_value[j] && cur_sub_value[j]) {
-              cur_decn_node->IncrementDataCount(i, 1);
-              primes[i]->MutableBatchedPsddContextValue()->at(j) = true;
-              subs[i]->MutableBatchedPsddContextValue()->at(j) = true;
+              ++cur_data_counts[i];
+              context_values[prime_position][j] = true;
+              context_values[sub_position][j] = true;
             }
           }
         }
       }
-      cur_node->MutableBatchedPsddContextValue()->clear();
-      cur_node->MutableBatchedPsddValue()->clear();
     }
   }
-  // Calculate local probability
-  for (auto it = serialized_psdd_nodes.rbegin();
-       it != serialized_psdd_nodes.rend(); ++it) {
-    PsddNode *cur_node = *it;
+  // Calculate local probability. Children come later in the serialization,
+  // so they are mapped to their new nodes first.
+  std::vector<PsddNode *> new_nodes(node_size, nullptr);
+  for (size_t position = node_size; position-- > 0;) {
+    PsddNode *cur_node = serialized_psdd_nodes[position];
+    const uintmax_t *cur_data_counts = &data_counts[count_offsets[position]];
     if (cur_node->node_type() == LITERAL_NODE_TYPE) {
       PsddLiteralNode *cur_lit_node = cur_node->psdd_literal_node();
-      PsddLiteralNode *new_node =
+      new_nodes[position] =
           GetPsddLiteralNode(cur_lit_node->literal(), flag_index);
-      cur_lit_node->SetUserData((uintmax_t)new_node);
     } else if (cur_node->node_type() == TOP_NODE_TYPE) {
       PsddTopNode *cur_top_node = cur_node->psdd_top_node();
       // Calculates laplacian smoothed data counts
       const auto true_data_count =
           PsddParameter::CreateFromDecimal(
-              static_cast<double>(cur_top_node->true_data_count())) +
+              static_cast<double>(cur_data_counts[0])) +
           alpha;
       const auto false_data_count =
           PsddParameter::CreateFromDecimal(
-              static_cast<double>(cur_top_node->false_data_count())) +
+              static_cast<double>(cur_data_counts[1])) +
           alpha;
       const auto total_data_count = true_data_count + false_data_count;
-      PsddTopNode *new_top_node =
+      new_nodes[position] =
           GetPsddTopNode(cur_top_node->variable_index(), flag_index,
                          true_data_count / total_data_count,
                          false_data_count / total_data_count);
-      cur_top_node->SetUserData((uintmax_t)new_top_node);
     } else {
       assert(cur_node->node_type() == DECISION_NODE_TYPE);
       PsddDecisionNode *cur_decision_node = cur_node->psdd_decision_node();
       std::vector<PsddParameter> parameters;
-      const auto &primes = cur_decision_node->primes();
-      const auto &subs = cur_decision_node->subs();
-      size_t element_size = primes.size();
-      PsddParameter total_data_counts = PsddParameter::CreateFromDecimal(0);
-      const auto &data_counts = cur_decision_node->data_counts();
+      const auto &elements = cur_decision_node->elements();
+      size_t element_size = elements.size();
       std::vector<PsddNode *> new_primes;
       std::vector<PsddNode *> new_subs;
       for (size_t i = 0; i < element_size; ++i) {
         parameters.push_back(PsddParameter::CreateFromDecimal(
-                                 static_cast<double>(data_counts[i])) +
+                                 static_cast<double>(cur_data_counts[i])) +
                              alpha);
-        total_data_counts = total_data_counts + parameters.back();
-        new_primes.push_back((PsddNode *)primes[i]->user_data());
-        new_subs.push_back((PsddNode *)subs[i]->user_data());
+        new_primes.push_back(new_nodes[elements[i].prime->user_data()]);
+        new_subs.push_back(new_nodes[elements[i].sub->user_data()]);
       }
+      PsddParameter total_data_counts = SumParameters(
+          element_size, [&](size_t i) { return parameters[i]; });
       for (size_t i = 0; i < element_size; ++i) {
         parameters[i] = parameters[i] / total_data_counts;
       }
-      PsddNode *new_decn_node = GetConformedPsddDecisionNode(
+      new_nodes[position] = GetConformedPsddDecisionNode(
           new_primes, new_subs, parameters, flag_index);
-      cur_decision_node->SetUserData((uintmax_t)new_decn_node);
     }
   }
-  PsddNode *result_node = (PsddNode *)target_structure->user_data();
-  // Clear learning states
   for (PsddNode *cur_node : serialized_psdd_nodes) {
-    cur_node->ResetDataCount();
     cur_node->SetUserData(0);
   }
-  return result_node;
+  return new_nodes[0];
 }
@@ -201,6 +201,36 @@ std::vector<SddLiteral> LeftToRightLeafTraverse(Vtree *root) {
 }
 } // namespace vtree_util
 namespace psdd_node_util {
+bool IsConsistent(
+    const PsddNode *node,
+    const std::unordered_map<uint32_t, bool> &partial_instantiation) {
+  if (node->node_type() == LITERAL_NODE_TYPE) {
+    return static_cast<const PsddLiteralNode *>(node)->IsConsistent(
+        partial_instantiation);
+  } else if (node->node_type() == DECISION_NODE_TYPE) {
+    return static_cast<const PsddDecisionNode *>(node)->IsConsistent(
+        partial_instantiation);
+  } else {
+    assert(node->node_type() == TOP_NODE_TYPE);
+    return static_cast<const PsddTopNode *>(node)->IsConsistent(
+        partial_instantiation);
+  }
+}
+
+void DirectSample(PsddNode *node, std::bitset<MAX_VAR> *instantiation,
+                  RandomDoubleFromUniformGenerator *generator) {
+  if (node->node_type() == LITERAL_NODE_TYPE) {
+    static_cast<PsddLiteralNode *>(node)->DirectSample(instantiation,
+                                                       generator);
+  } else if (node->node_type() == DECISION_NODE_TYPE) {
+    static_cast<PsddDecisionNode *>(node)->DirectSample(instantiation,
+                                                        generator);
+  } else {
+    assert(node->node_type() == TOP_NODE_TYPE);
+    static_cast<PsddTopNode *>(node)->DirectSample(instantiation, generator);
+  }
+}
+
 
 SddNode *ConvertPsddNodeToSddNode(
     const std::vector<PsddNode *> &serialized_psdd_nodes,
@@ -270,8 +300,8 @@ SerializePsddNodes(const std::vector<PsddNode *> &root_nodes) {
     PsddNode *cur_psdd_node = result[explore_index];
     if (cur_psdd_node->node_type() == 2) {
       auto cur_decn_node = static_cast<PsddDecisionNode *>(cur_psdd_node);
-      const std::vector<PsddNode *> &primes = cur_decn_node->primes();
-      const std::vector<PsddNode *> &subs = cur_decn_node->subs();
+      const auto &primes = cur_decn_node->primes();
+      const auto &subs = cur_decn_node->subs();
       for (const auto cur_prime : primes) {
         if (node_explored.find(cur_prime->node_index()) ==
             node_explored.end()) {
@@ -307,8 +337,8 @@ GetCoveredPsddNodes(const std::vector<PsddNode *> &root_nodes) {
     front_nodes.pop();
     if (cur_psdd_node->node_type() == 2) {
       auto cur_decn_node = static_cast<PsddDecisionNode *>(cur_psdd_node);
-      const std::vector<PsddNode *> &primes = cur_decn_node->primes();
-      const std::vector<PsddNode *> &subs = cur_decn_node->subs();
+      const auto &primes = cur_decn_node->primes();
+      const auto &subs = cur_decn_node->subs();
       for (const auto cur_prime : primes) {
         if (covered_nodes.find(cur_prime->node_index()) ==
             covered_nodes.end()) {
@@ -360,91 +390,81 @@ void SetActivationFlag(const std::bitset<MAX_VAR> &evidence,
 
 std::pair<std::bitset<MAX_VAR>, Probability>
 GetMPESolution(const std::vector<PsddNode *> &serialized_psdd_nodes) {
-  for (auto it = serialized_psdd_nodes.rbegin();
-       it != serialized_psdd_nodes.rend(); ++it) {
-    PsddNode *cur_node = *it;
+  QueryWorkspace workspace;
+  return GetMPESolution(serialized_psdd_nodes, &workspace);
+}
+
+std::pair<std::bitset<MAX_VAR>, Probability>
+GetMPESolution(const std::vector<PsddNode *> &serialized_psdd_nodes,
+               QueryWorkspace *workspace) {
+  auto node_size = serialized_psdd_nodes.size();
+  std::vector<Probability> &max_values = *workspace->MutableValues(node_size);
+  // For a decision node, the index of the element achieving the max. For a
+  // top node, 1 if the true parameter is chosen.
+  std::vector<uintmax_t> &max_choices = *workspace->MutableChoices(node_size);
+  workspace->IndexNodes(serialized_psdd_nodes);
+  for (int64_t i = (int64_t)node_size - 1; i >= 0; --i) {
+    PsddNode *cur_node = serialized_psdd_nodes[i];
     if (cur_node->node_type() == LITERAL_NODE_TYPE) {
-      auto *cache_pair = new std::pair<PsddParameter, uintmax_t>(
-          PsddParameter::CreateFromDecimal(1.0), 0);
-      cur_node->SetUserData((uintmax_t)cache_pair);
+      max_values[i] = PsddParameter::CreateFromDecimal(1.0);
+      max_choices[i] = 0;
     } else if (cur_node->node_type() == TOP_NODE_TYPE) {
       PsddTopNode *cur_top_node = cur_node->psdd_top_node();
-      Probability cur_value;
-      std::pair<PsddParameter, uintmax_t> *cache_pair;
       if (cur_top_node->true_parameter() > cur_top_node->false_parameter()) {
-        cache_pair = new std::pair<PsddParameter, uintmax_t>(
-            cur_top_node->true_parameter(), 1);
+        max_values[i] = cur_top_node->true_parameter();
+        max_choices[i] = 1;
       } else {
-        cache_pair = new std::pair<PsddParameter, uintmax_t>(
-            cur_top_node->false_parameter(), 0);
+        max_values[i] = cur_top_node->false_parameter();
+        max_choices[i] = 0;
       }
-      cur_node->SetUserData((uintmax_t)cache_pair);
     } else {
       assert(cur_node->node_type() == DECISION_NODE_TYPE);
       PsddDecisionNode *cur_decn_node = cur_node->psdd_decision_node();
       Probability max_product = Probability::CreateFromDecimal(0);
       uintmax_t max_index = 0;
-      const auto &cur_primes = cur_decn_node->primes();
-      const auto &cur_subs = cur_decn_node->subs();
-      const auto &cur_params = cur_decn_node->parameters();
-      uintmax_t element_size = cur_decn_node->primes().size();
-      for (uintmax_t i = 0; i < element_size; ++i) {
-        PsddNode *cur_prime_node = cur_primes[i];
-        PsddNode *cur_sub_node = cur_subs[i];
-        PsddParameter cur_parameter = cur_params[i];
-        auto cur_prime_comp_cache =
-            (std::pair<PsddParameter, uintmax_t> *)cur_prime_node->user_data();
-        auto cur_sub_comp_cache =
-            (std::pair<PsddParameter, uintmax_t> *)cur_sub_node->user_data();
-        Probability cur_product = cur_prime_comp_cache->first *
-                                  cur_sub_comp_cache->first * cur_parameter;
+      const auto &cur_elements = cur_decn_node->elements();
+      const uintmax_t *element_positions = workspace->ElementPositions(i);
+      uintmax_t element_size = cur_elements.size();
+      for (uintmax_t j = 0; j < element_size; ++j) {
+        Probability cur_product = max_values[element_positions[2 * j]] *
+                                  max_values[element_positions[2 * j + 1]] *
+                                  cur_elements[j].parameter;
         if (cur_product > max_product) {
           max_product = cur_product;
-          max_index = i;
+          max_index = j;
         }
       }
-      auto *cache_pair =
-          new std::pair<PsddParameter, uintmax_t>(max_product, max_index);
-      cur_node->SetUserData((uintmax_t)cache_pair);
+      max_values[i] = max_product;
+      max_choices[i] = max_index;
     }
   }
   // Extract solution;
-  std::queue<PsddNode *> node_queue;
-  node_queue.push(serialized_psdd_nodes[0]);
+  std::vector<uintmax_t> &node_stack = *workspace->MutableStack();
+  node_stack.push_back(0);
   std::bitset<MAX_VAR> max_instantiation;
-  auto *cache_pair =
-      (std::pair<PsddParameter, uintmax_t> *)serialized_psdd_nodes[0]
-          ->user_data();
-  auto max_prob = cache_pair->first;
-  while (!node_queue.empty()) {
-    PsddNode *cur_node = node_queue.front();
-    node_queue.pop();
+  while (!node_stack.empty()) {
+    uintmax_t cur_position = node_stack.back();
+    node_stack.pop_back();
+    PsddNode *cur_node = serialized_psdd_nodes[cur_position];
     if (cur_node->node_type() == LITERAL_NODE_TYPE) {
       PsddLiteralNode *cur_literal_node = cur_node->psdd_literal_node();
       if (cur_literal_node->sign()) {
         max_instantiation.set(cur_literal_node->variable_index());
       }
     } else if (cur_node->node_type() == DECISION_NODE_TYPE) {
-      PsddDecisionNode *cur_decn_node = cur_node->psdd_decision_node();
-      cache_pair = (std::pair<PsddParameter, uintmax_t> *)cur_node->user_data();
-      node_queue.push(cur_decn_node->primes()[cache_pair->second]);
-      node_queue.push(cur_decn_node->subs()[cache_pair->second]);
+      const uintmax_t *element_positions =
+          workspace->ElementPositions(cur_position);
+      uintmax_t max_index = max_choices[cur_position];
+      node_stack.push_back(element_positions[2 * max_index]);
+      node_stack.push_back(element_positions[2 * max_index + 1]);
     } else {
       assert(cur_node->node_type() == TOP_NODE_TYPE);
-      PsddTopNode *cur_top_node = cur_node->psdd_top_node();
-      cache_pair =
-          (std::pair<PsddParameter, uintmax_t> *)cur_top_node->user_data();
-      if (cache_pair->second) {
-        max_instantiation.set(cur_top_node->variable_index());
+      if (max_choices[cur_position]) {
+        max_instantiation.set(cur_node->psdd_top_node()->variable_index());
       }
     }
   }
-  for (PsddNode *cur_node : serialized_psdd_nodes) {
-    cache_pair = (std::pair<PsddParameter, uintmax_t> *)cur_node->user_data();
-    delete (cache_pair);
-    cur_node->SetUserData(0);
-  }
-  return {max_instantiation, max_prob};
+  return {max_instantiation, max_values[0]};
 }
 
 std::pair<std::bitset<MAX_VAR>, Probability>
@@ -453,84 +473,87 @@ GetMPESolution(PsddNode *psdd_node) {
   return GetMPESolution(serialized_psdd_nodes);
 }
 mpz_class ModelCount(const std::vector<PsddNode *> &serialized_nodes) {
-  std::unordered_map<uintmax_t, mpz_class> count_cache;
-  for (auto node_it = serialized_nodes.rbegin();
-       node_it != serialized_nodes.rend(); ++node_it) {
-    PsddNode *cur_node = *node_it;
+  QueryWorkspace workspace;
+  return ModelCount(serialized_nodes, &workspace);
+}
+mpz_class ModelCount(const std::vector<PsddNode *> &serialized_nodes,
+                     QueryWorkspace *workspace) {
+  auto node_size = serialized_nodes.size();
+  std::vector<mpz_class> &counts = *workspace->MutableCounts(node_size);
+  workspace->IndexNodes(serialized_nodes);
+  mpz_class product = 0;
+  for (int64_t i = (int64_t)node_size - 1; i >= 0; --i) {
+    PsddNode *cur_node = serialized_nodes[i];
     if (cur_node->node_type() == LITERAL_NODE_TYPE) {
-      count_cache[cur_node->node_index()] = 1;
+      counts[i] = 1;
     } else if (cur_node->node_type() == TOP_NODE_TYPE) {
-      count_cache[cur_node->node_index()] = 2;
+      counts[i] = 2;
     } else {
       assert(cur_node->node_type() == DECISION_NODE_TYPE);
       PsddDecisionNode *cur_decn_node = cur_node->psdd_decision_node();
-      const auto &primes = cur_decn_node->primes();
-      const auto &subs = cur_decn_node->subs();
-      auto element_size = primes.size();
-      mpz_class total_count = 0;
-      for (size_t i = 0; i < element_size; ++i) {
-        PsddNode *cur_prime = primes[i];
-        PsddNode *cur_sub = subs[i];
-        const mpz_class &a = count_cache[cur_prime->node_index()];
-        const mpz_class &b = count_cache[cur_sub->node_index()];
-        mpz_class product = 0;
+      const uintmax_t *element_positions = workspace->ElementPositions(i);
+      auto element_size = cur_decn_node->elements().size();
+      mpz_class &total_count = counts[i];
+      total_count = 0;
+      for (size_t j = 0; j < element_size; ++j) {
+        const mpz_class &a = counts[element_positions[2 * j]];
+        const mpz_class &b = counts[element_positions[2 * j + 1]];
         mpz_mul(product.get_mpz_t(), a.get_mpz_t(), b.get_mpz_t());
         mpz_add(total_count.get_mpz_t(), total_count.get_mpz_t(),
                 product.get_mpz_t());
       }
-      count_cache[cur_node->node_index()] = total_count;
     }
   }
-  return count_cache[serialized_nodes[0]->node_index()];
+  return counts[0];
 }
 Probability Evaluate(const std::bitset<MAX_VAR> &variables,
                      const std::bitset<MAX_VAR> &instantiation,
                      const std::vector<PsddNode *> &serialized_nodes) {
-  std::unordered_map<uintmax_t, Probability> evaluation_cache;
-  for (auto node_it = serialized_nodes.rbegin();
-       node_it != serialized_nodes.rend(); ++node_it) {
-    PsddNode *cur_node = *node_it;
+  QueryWorkspace workspace;
+  return Evaluate(variables, instantiation, serialized_nodes, &workspace);
+}
+Probability Evaluate(const std::bitset<MAX_VAR> &variables,
+                     const std::bitset<MAX_VAR> &instantiation,
+                     const std::vector<PsddNode *> &serialized_nodes,
+                     QueryWorkspace *workspace) {
+  auto node_size = serialized_nodes.size();
+  std::vector<Probability> &values = *workspace->MutableValues(node_size);
+  workspace->IndexNodes(serialized_nodes);
+  for (int64_t i = (int64_t)node_size - 1; i >= 0; --i) {
+    PsddNode *cur_node = serialized_nodes[i];
     if (cur_node->node_type() == LITERAL_NODE_TYPE) {
       PsddLiteralNode *cur_lit = cur_node->psdd_literal_node();
       if (variables[cur_lit->variable_index()]) {
         if (instantiation[cur_lit->variable_index()] == cur_lit->sign()) {
-          evaluation_cache[cur_node->node_index()] =
-              Probability::CreateFromDecimal(1);
+          values[i] = Probability::CreateFromDecimal(1);
         } else {
-          evaluation_cache[cur_node->node_index()] =
-              Probability::CreateFromDecimal(0);
+          values[i] = Probability::CreateFromDecimal(0);
         }
       } else {
-        evaluation_cache[cur_node->node_index()] =
-            Probability::CreateFromDecimal(1);
+        values[i] = Probability::CreateFromDecimal(1);
       }
     } else if (cur_node->node_type() == TOP_NODE_TYPE) {
       PsddTopNode *cur_top = cur_node->psdd_top_node();
       if (variables[cur_top->variable_index()]) {
         if (instantiation[cur_top->variable_index()]) {
-          evaluation_cache[cur_node->node_index()] = cur_top->true_parameter();
+          values[i] = cur_top->true_parameter();
         } else {
-          evaluation_cache[cur_node->node_index()] = cur_top->false_parameter();
+          values[i] = cur_top->false_parameter();
         }
       } else {
-        evaluation_cache[cur_node->node_index()] =
-            Probability::CreateFromDecimal(1);
+        values[i] = Probability::CreateFromDecimal(1);
       }
     } else {
       PsddDecisionNode *cur_decn_node = cur_node->psdd_decision_node();
-      auto element_size = cur_decn_node->primes().size();
-      Probability cur_prob = Probability::CreateFromDecimal(0);
-      for (size_t i = 0; i < element_size; ++i) {
-        PsddNode *cur_prime = cur_decn_node->primes()[i];
-        PsddNode *cur_sub = cur_decn_node->subs()[i];
-        cur_prob = cur_prob + evaluation_cache[cur_prime->node_index()] *
-                                  evaluation_cache[cur_sub->node_index()] *
-                                  cur_decn_node->parameters()[i];
-      }
-      evaluation_cache[cur_node->node_index()] = cur_prob;
+      const auto &elements = cur_decn_node->elements();
+      const uintmax_t *element_positions = workspace->ElementPositions(i);
+      values[i] = SumParameters(elements.size(), [&](size_t j) {
+        return values[element_positions[2 * j]] *
+               values[element_positions[2 * j + 1]] * elements[j].parameter;
+      });
     }
   }
-  return evaluation_cache[serialized_nodes[0]->node_index()];
+  return values[0];
 }
 bool IsConsistent(PsddNode *node, const std::bitset<MAX_VAR> &variable_mask,
                   const std::bitset<MAX_VAR> &partial_instantiation) {
@@ -637,71 +660,74 @@ void WritePsddToFile(PsddNode *root_node, const char *output_filename) {
 }
 std::unordered_map<uint32_t, std::pair<Probability, Probability>>
 GetMarginals(const std::vector<PsddNode *> &serialized_nodes) {
+  QueryWorkspace workspace;
+  return GetMarginals(serialized_nodes, &workspace);
+}
+std::unordered_map<uint32_t, std::pair<Probability, Probability>>
+GetMarginals(const std::vector<PsddNode *> &serialized_nodes,
+             QueryWorkspace *workspace) {
+  auto node_size = serialized_nodes.size();
+  workspace->IndexNodes(serialized_nodes);
+  workspace->IndexParents(serialized_nodes);
+  std::vector<Probability> &derivatives = *workspace->MutableValues(node_size);
+  std::vector<Probability> &terms = *workspace->MutableTerms();
+  // Parents come first, so each derivative is pulled from the parents in one
+  // reduction rather than pushed from every parent in turn.
+  for (size_t i = 0; i < node_size; ++i) {
+    if (i == 0) {
+      derivatives[i] = Probability::CreateFromDecimal(1);
+      continue;
+    }
+    const std::pair<uintmax_t, uintmax_t> *parent_elements =
+        workspace->ParentElements(i);
+    auto parent_size = workspace->ParentElementSize(i);
+    terms.clear();
+    for (size_t k = 0; k < parent_size; ++k) {
+      auto parent_position = parent_elements[k].first;
+      const PsddElement &cur_element =
+          serialized_nodes[parent_position]
+              ->psdd_decision_node()
+              ->elements()[parent_elements[k].second];
+      terms.push_back(derivatives[parent_position] * cur_element.parameter);
+    }
+    derivatives[i] =
+        SumParameters(terms.size(), [&terms](size_t k) { return terms[k]; });
+  }
   // first is false second is true
   std::unordered_map<uint32_t, std::pair<Probability, Probability>> marginals;
-  std::vector<Probability> derivatives(serialized_nodes.size(),
-                                       Probability::CreateFromDecimal(0));
-  auto index = 0;
-  for (PsddNode *cur_node : serialized_nodes) {
-    cur_node->SetUserData((uintmax_t)index);
-    index++;
-  }
-  derivatives[0] = Probability::CreateFromDecimal(1);
-  for (PsddNode *cur_node : serialized_nodes) {
-    if (cur_node->node_type() == LITERAL_NODE_TYPE) {
-      auto cur_lit = cur_node->psdd_literal_node();
-      auto marginal_it = marginals.find(cur_lit->variable_index());
-      if (marginal_it == marginals.end()) {
-        marginals[cur_lit->variable_index()] =
-            std::make_pair(PsddParameter::CreateFromDecimal(0),
-                           PsddParameter::CreateFromDecimal(0));
-        marginal_it = marginals.find(cur_lit->variable_index());
-      }
-      if (cur_lit->sign()) {
-        marginal_it->second.second =
-            marginal_it->second.second + derivatives[cur_lit->user_data()];
+  std::vector<Probability> &true_terms = *workspace->MutableTrueTerms();
+  for (uint32_t v = 0; v < workspace->variable_size(); ++v) {
+    auto leaf_size = workspace->VariableLeafSize(v);
+    if (leaf_size == 0) {
+      continue;
+    }
+    const uintmax_t *leaves = workspace->VariableLeaves(v);
+    std::vector<Probability> &false_terms = terms;
+    false_terms.clear();
+    true_terms.clear();
+    for (size_t k = 0; k < leaf_size; ++k) {
+      PsddNode *cur_node = serialized_nodes[leaves[k]];
+      if (cur_node->node_type() == LITERAL_NODE_TYPE) {
+        if (cur_node->psdd_literal_node()->sign()) {
+          true_terms.push_back(derivatives[leaves[k]]);
+        } else {
+          false_terms.push_back(derivatives[leaves[k]]);
+        }
       } else {
-        marginal_it->second.first =
-            marginal_it->second.first + derivatives[cur_lit->user_data()];
-      }
-    } else if (cur_node->node_type() == TOP_NODE_TYPE) {
-      auto cur_top = cur_node->psdd_top_node();
-      auto marginal_it = marginals.find(cur_top->variable_index());
-      if (marginal_it == marginals.end()) {
-        marginals[cur_top->variable_index()] =
-            std::make_pair(PsddParameter::CreateFromDecimal(0),
-                           PsddParameter::CreateFromDecimal(0));
-        marginal_it = marginals.find(cur_top->variable_index());
-      }
-      marginal_it->second.first =
-          marginal_it->second.first +
-          derivatives[cur_top->user_data()] * cur_top->false_parameter();
-      marginal_it->second.second =
-          marginal_it->second.second +
-          derivatives[cur_top->user_data()] * cur_top->true_parameter();
-    } else {
-      auto cur_decn_node = cur_node->psdd_decision_node();
-      const auto &primes = cur_decn_node->primes();
-      const auto &subs = cur_decn_node->subs();
-      const auto &params = cur_decn_node->parameters();
-      Probability cur_derivative = derivatives[cur_decn_node->user_data()];
-      auto element_size = primes.size();
-      for (size_t i = 0; i < element_size; ++i) {
-        derivatives[primes[i]->user_data()] =
-            derivatives[primes[i]->user_data()] + cur_derivative * params[i];
-        derivatives[subs[i]->user_data()] =
-            derivatives[subs[i]->user_data()] + cur_derivative * params[i];
+        auto cur_top = cur_node->psdd_top_node();
+        false_terms.push_back(derivatives[leaves[k]] *
+                              cur_top->false_parameter());
+        true_terms.push_back(derivatives[leaves[k]] *
+                             cur_top->true_parameter());
       }
     }
-  }
-  for (PsddNode *cur_node : serialized_nodes) {
-    cur_node->SetUserData(0);
-  }
-  for (auto &cur_marginal : marginals) {
-    Probability partition =
-        cur_marginal.second.first + cur_marginal.second.second;
-    cur_marginal.second.first = cur_marginal.second.first / partition;
-    cur_marginal.second.second = cur_marginal.second.second / partition;
+    Probability false_marginal = SumParameters(
+        false_terms.size(), [&false_terms](size_t k) { return false_terms[k]; });
+    Probability true_marginal = SumParameters(
+        true_terms.size(), [&true_terms](size_t k) { return true_terms[k]; });
+    Probability partition = false_marginal + true_marginal;
+    marginals[v] = std::make_pair(false_marginal / partition,
+                                  true_marginal / partition);
   }
   return marginals;
 }
@@ -720,13 +746,11 @@ uintmax_t GetPsddSize(PsddNode *root_node) {
 }
 } // namespace psdd_node_util
 
-PsddNode::PsddNode(uintmax_t node_index, Vtree *vtree_node)
-    : PsddNode(node_index, vtree_node, 0) {}
-
-PsddNode::PsddNode(uintmax_t node_index, Vtree *vtree_node,
+PsddNode::PsddNode(int node_type, uintmax_t node_index, Vtree *vtree_node,
                    uintmax_t flag_index)
     : node_index_(node_index), vtree_node_(vtree_node), user_data_(0),
-      flag_index_(flag_index), activation_flag_(false) {}
+      flag_index_(flag_index), ref_count_(0), node_type_((uint8_t)node_type),
+      activation_flag_(false) {}
 
 uintmax_t PsddNode::node_index() const { return node_index_; }
 
@@ -745,6 +769,15 @@ void PsddNode::SetActivationFlag() { activation_flag_ = true; }
 
 void PsddNode::ResetActivationFlag() { activation_flag_ = false; }
 
+uint32_t PsddNode::ref_count() const { return ref_count_; }
+
+void PsddNode::IncreaseRefCount() { ++ref_count_; }
+
+void PsddNode::DecreaseRefCount() {
+  assert(ref_count_ > 0);
+  --ref_count_;
+}
+
 bool PsddNode::IsConsistent(const std::bitset<MAX_VAR> &instantiation,
                             uint32_t variable_size) {
   std::unordered_map<uint32_t, bool> evid;
@@ -753,12 +786,23 @@ bool PsddNode::IsConsistent(const std::bitset<MAX_VAR> &instantiation,
   }
   return IsConsistent(evid);
 }
+bool PsddNode::IsConsistent(
+    const std::unordered_map<uint32_t, bool> &partial_instantiation) const {
+  return psdd_node_util::IsConsistent(this, partial_instantiation);
+}
+
+void PsddNode::DirectSample(std::bitset<MAX_VAR> *instantiation,
+                            RandomDoubleFromUniformGenerator *generator) {
+  psdd_node_util::DirectSample(this, instantiation, generator);
+}
+
 uintmax_t PsddNode::user_data() const { return user_data_; }
 void PsddNode::SetUserData(uintmax_t user_data) { user_data_ = user_data; }
 
 PsddLiteralNode::PsddLiteralNode(uintmax_t node_index, Vtree *vtree_node,
                                  uintmax_t flag_index, int32_t literal)
-    : PsddNode(node_index, vtree_node, flag_index), literal_(literal) {
+    : PsddNode(LITERAL_NODE_TYPE, node_index, vtree_node, flag_index),
+      literal_(literal) {
   CalculateHashValue();
 }
 
@@ -776,8 +820,6 @@ bool PsddLiteralNode::operator==(const PsddLiteralNode &other) const {
   return literal_ == other.literal() && flag_index() == other.flag_index();
 }
 
-int PsddLiteralNode::node_type() const { return 1; }
-
 bool PsddLiteralNode::IsConsistent(
     const std::unordered_map<uint32_t, bool> &partial_instantiation) const {
   uint32_t var_index = variable_index();
@@ -797,13 +839,16 @@ uint32_t PsddLiteralNode::variable_index() const {
 
 int32_t PsddLiteralNode::literal() const { return literal_; }
 
-void PsddLiteralNode::CalculateHashValue() {
-  std::size_t hash_value = std::hash<int32_t>{}(literal_);
-  hash_value ^= (std::hash<uintmax_t>{}(flag_index()) << 1);
-  set_hash_value(hash_value);
+std::size_t PsddLiteralNode::HashValue(uintmax_t flag_index,
+                                       int32_t literal) {
+  std::size_t hash_value = std::hash<int32_t>{}(literal);
+  hash_value ^= (std::hash<uintmax_t>{}(flag_index) << 1);
+  return hash_value;
 }
 
-void PsddLiteralNode::ResetDataCount() {}
+void PsddLiteralNode::CalculateHashValue() {
+  set_hash_value(HashValue(flag_index(), literal_));
+}
 
 void PsddLiteralNode::DirectSample(
     std::bitset<MAX_VAR> *instantiation,
@@ -818,28 +863,43 @@ PsddDecisionNode::PsddDecisionNode(uintmax_t node_index, Vtree *vtree_node,
                                    const std::vector<PsddNode *> &primes,
                                    const std::vector<PsddNode *> &subs,
                                    const std::vector<PsddParameter> &parameters)
-    : PsddNode(node_index, vtree_node, flag_index),
-      data_counts_(primes.size(), 0) {
-  std::vector<std::pair<uintmax_t, uintmax_t>> indexes;
-  for (const auto &cur_prime : primes) {
-    indexes.emplace_back(
-        std::make_pair(indexes.size(), cur_prime->node_index()));
-  }
-  std::sort(
-      indexes.begin(), indexes.end(),
-      [](const auto &lhs, const auto &rhs) { return lhs.second < rhs.second; });
+    : PsddDecisionNode(node_index, vtree_node, flag_index, primes, subs,
+                       parameters, std::pmr::get_default_resource()) {}
+
+PsddDecisionNode::PsddDecisionNode(uintmax_t node_index, Vtree *vtree_node,
+                                   uintmax_t flag_index,
+                                   const std::vector<PsddNode *> &primes,
+                                   const std::vector<PsddNode *> &subs,
+                                   const std::vector<PsddParameter> &parameters,
+                                   std::pmr::memory_resource *element_resource)
+    : PsddNode(DECISION_NODE_TYPE, node_index, vtree_node, flag_index),
+      elements_(element_resource) {
   auto partition_size = primes.size();
   assert(partition_size == subs.size());
-  primes_.resize(partition_size, nullptr);
-  subs_.resize(partition_size, nullptr);
-  parameters_.resize(partition_size);
+  elements_.reserve(partition_size);
   for (size_t i = 0; i < partition_size; i++) {
-    primes_[i] = primes[indexes[i].first];
-    subs_[i] = subs[indexes[i].first];
-    if (!parameters.empty()) {
-      parameters_[i] = parameters[indexes[i].first];
-    }
+    elements_.push_back({primes[i], subs[i],
+                         parameters.empty() ? PsddParameter()
+                                            : parameters[i]});
   }
+  std::sort(elements_.begin(), elements_.end(),
+            [](const PsddElement &lhs, const PsddElement &rhs) {
+              return lhs.prime->node_index() < rhs.prime->node_index();
+            });
+  CalculateHashValue();
+}
+
+PsddDecisionNode::PsddDecisionNode(uintmax_t node_index, Vtree *vtree_node,
+                                   uintmax_t flag_index,
+                                   const std::vector<PsddElement> &elements,
+                                   std::pmr::memory_resource *element_resource)
+    : PsddNode(DECISION_NODE_TYPE, node_index, vtree_node, flag_index),
+      elements_(elements.begin(), elements.end(), element_resource) {
+  assert(std::is_sorted(elements_.begin(), elements_.end(),
+                        [](const PsddElement &lhs, const PsddElement &rhs) {
+                          return lhs.prime->node_index() <
+                                 rhs.prime->node_index();
+                        }));
   CalculateHashValue();
 }
 
@@ -865,73 +925,72 @@ PsddDecisionNode::PsddDecisionNode(uintmax_t *node_index, Vtree *vtree_node,
     : PsddDecisionNode(node_index, vtree_node, 0, primes, subs) {}
 
 bool PsddDecisionNode::operator==(const PsddDecisionNode &other) const {
-  if (primes_.size() != other.primes_.size()) {
+  if (elements_.size() != other.elements_.size()) {
     return false;
   }
   if (flag_index() != other.flag_index()) {
     return false;
   }
-  auto element_size = primes_.size();
+  auto element_size = elements_.size();
   for (size_t i = 0; i < element_size; i++) {
-    if (primes_[i]->node_index() != other.primes_[i]->node_index()) {
+    const PsddElement &cur_element = elements_[i];
+    const PsddElement &other_element = other.elements_[i];
+    if (cur_element.prime->node_index() != other_element.prime->node_index()) {
       return false;
     }
-    if (subs_[i]->node_index() != other.subs_[i]->node_index()) {
+    if (cur_element.sub->node_index() != other_element.sub->node_index()) {
       return false;
     }
-    if (parameters_[i] != other.parameters_[i]) {
+    if (cur_element.parameter != other_element.parameter) {
       return false;
     }
   }
   return true;
 }
 
-int PsddDecisionNode::node_type() const { return 2; }
-
 bool PsddDecisionNode::IsConsistent(
     const std::unordered_map<uint32_t, bool> &partial_instantiation) const {
-  auto element_size = primes_.size();
-  for (size_t i = 0; i < element_size; i++) {
-    PsddNode *cur_prime = primes_[i];
-    PsddNode *cur_sub = subs_[i];
-    if (cur_prime->IsConsistent(partial_instantiation) &&
-        cur_sub->IsConsistent(partial_instantiation)) {
+  for (const PsddElement &cur_element : elements_) {
+    if (cur_element.prime->IsConsistent(partial_instantiation) &&
+        cur_element.sub->IsConsistent(partial_instantiation)) {
       return true;
     }
   }
   return false;
 }
 
-const std::vector<PsddNode *> &PsddDecisionNode::primes() const {
-  return primes_;
+const std::pmr::vector<PsddElement> &PsddDecisionNode::elements() const {
+  return elements_;
 }
 
-const std::vector<PsddNode *> &PsddDecisionNode::subs() const { return subs_; }
+PsddPrimeView PsddDecisionNode::primes() const {
+  return PsddPrimeView(elements_.data(), elements_.size());
+}
 
-const std::vector<PsddParameter> &PsddDecisionNode::parameters() const {
-  return parameters_;
+PsddSubView PsddDecisionNode::subs() const {
+  return PsddSubView(elements_.data(), elements_.size());
 }
 
-void PsddDecisionNode::CalculateHashValue() {
-  std::size_t hash_value = std::hash<uintmax_t>{}(flag_index());
-  auto element_size = primes_.size();
+PsddParameterView PsddDecisionNode::parameters() const {
+  return PsddParameterView(elements_.data(), elements_.size());
+}
+
+std::size_t PsddDecisionNode::HashValue(uintmax_t flag_index,
+                                        const PsddElement *elements,
+                                        size_t element_size) {
+  std::size_t hash_value = std::hash<uintmax_t>{}(flag_index);
   for (size_t i = 0; i < element_size; i++) {
-    hash_value ^= (std::hash<uintmax_t>{}(primes_[i]->node_index()) << i);
-    hash_value ^= (std::hash<uintmax_t>{}(subs_[i]->node_index()) << i);
-    hash_value ^= (parameters_[i].hash_value() << i);
+    const PsddElement &cur_element = elements[i];
+    hash_value ^=
+        (std::hash<uintmax_t>{}(cur_element.prime->node_index()) << i);
+    hash_value ^= (std::hash<uintmax_t>{}(cur_element.sub->node_index()) << i);
+    hash_value ^= (cur_element.parameter.hash_value() << i);
   }
-  set_hash_value(hash_value);
-}
-void PsddDecisionNode::IncrementDataCount(uintmax_t index,
-                                          uintmax_t increment_size) {
-  data_counts_[index] += increment_size;
+  return hash_value;
 }
 
-void PsddDecisionNode::ResetDataCount() {
-  auto element_size = primes_.size();
-  for (size_t i = 0; i < element_size; ++i) {
-    data_counts_[i] = 0;
-  }
+void PsddDecisionNode::CalculateHashValue() {
+  set_hash_value(HashValue(flag_index(), elements_.data(), elements_.size()));
 }
 
 void PsddDecisionNode::DirectSample(
@@ -941,31 +1000,25 @@ void PsddDecisionNode::DirectSample(
       (generator->generate() - generator->min()) /
       (generator->max() - generator->min()));
   PsddParameter acc = PsddParameter::CreateFromDecimal(0);
-  auto element_size = primes_.size();
-  for (size_t i = 0; i < element_size; ++i) {
-    PsddParameter cur_parameter = parameters_[i];
-    acc = acc + cur_parameter;
+  for (const PsddElement &cur_element : elements_) {
+    acc = acc + cur_element.parameter;
     if (uniform_rand < acc) {
       // Use this partition
-      primes_[i]->DirectSample(instantiation, generator);
-      subs_[i]->DirectSample(instantiation, generator);
+      cur_element.prime->DirectSample(instantiation, generator);
+      cur_element.sub->DirectSample(instantiation, generator);
       return;
     }
   }
   assert(false);
 }
-const std::vector<uintmax_t> &PsddDecisionNode::data_counts() const {
-  return data_counts_;
-}
 
 PsddTopNode::PsddTopNode(uintmax_t node_index, Vtree *vtree_node,
                          uintmax_t flag_index, uint32_t variable_index,
                          PsddParameter true_parameter,
                          PsddParameter false_parameter)
-    : PsddNode(node_index, vtree_node, flag_index),
+    : PsddNode(TOP_NODE_TYPE, node_index, vtree_node, flag_index),
       variable_index_(variable_index), true_parameter_(true_parameter),
-      false_parameter_(false_parameter), true_data_count_(0),
-      false_data_count_(0) {
+      false_parameter_(false_parameter) {
   CalculateHashValue();
 }
 
@@ -986,8 +1039,6 @@ bool PsddTopNode::operator==(const PsddTopNode &other) const {
          true_parameter_ == other.true_parameter_;
 }
 
-int PsddTopNode::node_type() const { return 3; }
-
 bool PsddTopNode::IsConsistent(
     const std::unordered_map<uint32_t, bool> &partial_instantiation) const {
   return true;
@@ -995,25 +1046,19 @@ bool PsddTopNode::IsConsistent(
 
 uint32_t PsddTopNode::variable_index() const { return variable_index_; }
 
-void PsddTopNode::CalculateHashValue() {
-  std::size_t hash_value = std::hash<uint32_t>{}(variable_index_);
-  hash_value ^= true_parameter_.hash_value() << 1;
-  hash_value ^= std::hash<uintmax_t>{}(flag_index()) << 2;
-  set_hash_value(hash_value);
-}
-
-void PsddTopNode::IncrementTrueDataCount(uintmax_t increment_size) {
-  true_data_count_ += increment_size;
+std::size_t PsddTopNode::HashValue(uintmax_t flag_index,
+                                   uint32_t variable_index,
+                                   PsddParameter true_parameter) {
+  std::size_t hash_value = std::hash<uint32_t>{}(variable_index);
+  hash_value ^= true_parameter.hash_value() << 1;
+  hash_value ^= std::hash<uintmax_t>{}(flag_index) << 2;
+  return hash_value;
 }
 
-void PsddTopNode::IncrementFalseDataCount(uintmax_t increment_size) {
-  false_data_count_ += increment_size;
+void PsddTopNode::CalculateHashValue() {
+  set_hash_value(HashValue(flag_index(), variable_index_, true_parameter_));
 }
 
-void PsddTopNode::ResetDataCount() {
-  true_data_count_ = 0;
-  false_data_count_ = 0;
-}
 PsddParameter PsddTopNode::true_parameter() const { return true_parameter_; }
 PsddParameter PsddTopNode::false_parameter() const { return false_parameter_; }
 
@@ -1026,5 +1071,3 @@ void PsddTopNode::DirectSample(std::bitset<MAX_VAR> *instantiation,
     instantiation->set(variable_index_);
   }
 }
-uintmax_t PsddTopNode::true_data_count() const { return true_data_count_; }
-uintmax_t PsddTopNode::false_data_count() const { return false_data_count_; }
@@ -0,0 +1,98 @@
+#include <atomic>
+#include <cassert>
+
+#include <psdd/psdd_node_arena.h>
+
+PsddNodeArena::PsddNodeArena() : shards_() {
+  for (uint32_t i = 0; i < kShardSize; ++i) {
+    shards_.emplace_back(new Shard(i));
+  }
+}
+
+PsddLiteralNode *PsddNodeArena::NewLiteralNode(uintmax_t node_index,
+                                               Vtree *vtree_node,
+                                               uintmax_t flag_index,
+                                               int32_t literal) {
+  Shard &shard = LocalShard();
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.literal_nodes.New(node_index, vtree_node, flag_index, literal);
+}
+
+PsddTopNode *PsddNodeArena::NewTopNode(uintmax_t node_index, Vtree *vtree_node,
+                                       uintmax_t flag_index,
+                                       uint32_t variable_index,
+                                       PsddParameter true_parameter,
+                                       PsddParameter false_parameter) {
+  Shard &shard = LocalShard();
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.top_nodes.New(node_index, vtree_node, flag_index,
+                             variable_index, true_parameter, false_parameter);
+}
+
+PsddDecisionNode *PsddNodeArena::NewDecisionNode(
+    uintmax_t node_index, Vtree *vtree_node, uintmax_t flag_index,
+    const std::vector<PsddNode *> &primes, const std::vector<PsddNode *> &subs,
+    const std::vector<PsddParameter> &params) {
+  Shard &shard = LocalShard();
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.decision_nodes.New(node_index, vtree_node, flag_index, primes,
+                                  subs, params, &shard.element_resource);
+}
+
+PsddDecisionNode *
+PsddNodeArena::NewDecisionNode(uintmax_t node_index, Vtree *vtree_node,
+                               uintmax_t flag_index,
+                               const std::vector<PsddElement> &elements) {
+  Shard &shard = LocalShard();
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.decision_nodes.New(node_index, vtree_node, flag_index, elements,
+                                  &shard.element_resource);
+}
+
+size_t PsddNodeArena::DeleteNode(PsddNode *node) {
+  if (node->node_type() == LITERAL_NODE_TYPE) {
+    auto literal_node = static_cast<PsddLiteralNode *>(node);
+    Shard &shard =
+        *shards_[PsddNodeSlab<PsddLiteralNode>::ShardIndex(literal_node)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.literal_nodes.Delete(literal_node);
+  } else if (node->node_type() == TOP_NODE_TYPE) {
+    auto top_node = static_cast<PsddTopNode *>(node);
+    Shard &shard = *shards_[PsddNodeSlab<PsddTopNode>::ShardIndex(top_node)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.top_nodes.Delete(top_node);
+  } else {
+    assert(node->node_type() == DECISION_NODE_TYPE);
+    auto decision_node = static_cast<PsddDecisionNode *>(node);
+    Shard &shard =
+        *shards_[PsddNodeSlab<PsddDecisionNode>::ShardIndex(decision_node)];
+    size_t element_bytes =
+        decision_node->elements().capacity() * sizeof(PsddElement);
+    // The element array goes back to the pool of the same shard.
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return element_bytes + shard.decision_nodes.Delete(decision_node);
+  }
+}
+
+bool PsddNodeArena::HoldsDecisionNode(const PsddDecisionNode *node,
+                                      uintmax_t node_index) const {
+  return PsddNodeSlab<PsddDecisionNode>::Holds(node, node_index);
+}
+
+size_t PsddNodeArena::node_size() const {
+  size_t result = 0;
+  for (const auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    result += shard->literal_nodes.live_size() + shard->top_nodes.live_size() +
+              shard->decision_nodes.live_size();
+  }
+  return result;
+}
+
+PsddNodeArena::Shard &PsddNodeArena::LocalShard() {
+  // Threads are numbered in the order they first create a node, so up to
+  // kShardSize of them never share a shard.
+  static std::atomic<uint32_t> next_thread_number(0);
+  thread_local uint32_t thread_number = next_thread_number.fetch_add(1);
+  return *shards_[thread_number % kShardSize];
+}
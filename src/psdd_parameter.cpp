@@ -2,17 +2,59 @@
 // Created by Jason Shen on 4/1/17.
 //
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <vector>
+
 #include <psdd/psdd_parameter.h>
 
 #define APPX_LEVEL 7
 
 PsddParameter::PsddParameter() : PsddParameter(std::log(0)) {}
 
-PsddParameter::PsddParameter(double parameter)
-    : parameter_(parameter), hash_value_(static_cast<uintmax_t>(
-                                 parameter * std::pow(10, APPX_LEVEL))) {}
+namespace {
+const double kQuantizationScale = 1e7;
+static_assert(APPX_LEVEL == 7, "kQuantizationScale must be 10^APPX_LEVEL");
+
+// FastLog1pExpNegative expands f(x) = log1p(exp(-x)) around the nearest table
+// point, at most half a step away. With s = exp(-x) / (1 + exp(-x)),
+// f' = -s, f'' = s(1 - s) and |f'''| = s(1 - s)|1 - 2s| <= 0.0963, so the
+// remainder is below (1/64)^3 / 6 * 0.0963 < 6.2e-8. Arguments are clamped to
+// the cutoff, whose point is all zeros, and f(x) < 4.2e-8 for the arguments
+// that round to it, so neither step branches on the argument.
+const double kFastLogSumStepsPerUnit = 32;
+const double kFastLogSumCutoff = 17;
+
+struct TaylorCoefficients {
+  double value;
+  double slope;
+  double half_curvature;
+};
+
+std::vector<TaylorCoefficients> MakeFastLogSumTable() {
+  auto point_size = (size_t)(kFastLogSumCutoff * kFastLogSumStepsPerUnit) + 1;
+  std::vector<TaylorCoefficients> table(point_size, {0, 0, 0});
+  for (size_t i = 0; i + 1 < point_size; ++i) {
+    double x = (double)i / kFastLogSumStepsPerUnit;
+    double s = 1 / (1 + std::exp(x));
+    table[i] = {std::log1p(std::exp(-x)), -s, s * (1 - s) / 2};
+  }
+  return table;
+}
+
+const std::vector<TaylorCoefficients> kFastLogSumTable = MakeFastLogSumTable();
+} // namespace
+
+double FastLog1pExpNegative(double x) {
+  x = x < kFastLogSumCutoff ? x : kFastLogSumCutoff;
+  auto index = (int32_t)(x * kFastLogSumStepsPerUnit + 0.5);
+  double offset = x - index * (1 / kFastLogSumStepsPerUnit);
+  const TaylorCoefficients &point = kFastLogSumTable[index];
+  return point.value + offset * (point.slope + offset * point.half_curvature);
+}
+
+PsddParameter::PsddParameter(double parameter) : parameter_(parameter) {}
 
 PsddParameter PsddParameter::CreateFromDecimal(double num) {
   return PsddParameter(std::log(num));
@@ -39,6 +81,19 @@ PsddParameter PsddParameter::operator+(const PsddParameter &other) const {
   }
 }
 
+PsddParameter PsddParameter::Add(const PsddParameter &other,
+                                 LogSumAccuracy accuracy) const {
+  if (accuracy == EXACT_LOG_SUM) {
+    return *this + other;
+  }
+  // Which side is larger is unpredictable in a sum of products, so pick it
+  // without branching. Zeros need no branch either: the difference is then
+  // inf or NaN, which FastLog1pExpNegative clamps to its cutoff.
+  return PsddParameter(
+      std::max(parameter_, other.parameter_) +
+      FastLog1pExpNegative(std::abs(parameter_ - other.parameter_)));
+}
+
 PsddParameter PsddParameter::operator/(const PsddParameter &other) const {
   return PsddParameter(parameter_ - other.parameter_);
 }
@@ -49,16 +104,29 @@ PsddParameter PsddParameter::operator*(const PsddParameter &other) const {
 
 double PsddParameter::parameter() const { return parameter_; }
 
+// Saturates instead of overflowing, so zero (a -inf logarithm) has a key of
+// its own.
+intmax_t PsddParameter::quantized_parameter() const {
+  double scaled = parameter_ * kQuantizationScale;
+  if (!(scaled > (double)std::numeric_limits<intmax_t>::min())) {
+    return std::numeric_limits<intmax_t>::min();
+  }
+  if (!(scaled < (double)std::numeric_limits<intmax_t>::max())) {
+    return std::numeric_limits<intmax_t>::max();
+  }
+  return static_cast<intmax_t>(scaled);
+}
+
 std::size_t PsddParameter::hash_value() const {
-  return static_cast<std::size_t>(hash_value_);
+  return static_cast<std::size_t>(quantized_parameter());
 }
 
 bool PsddParameter::operator==(const PsddParameter &other) const {
-  return hash_value_ == other.hash_value_;
+  return quantized_parameter() == other.quantized_parameter();
 }
 
 bool PsddParameter::operator!=(const PsddParameter &other) const {
-  return hash_value_ != other.hash_value_;
+  return quantized_parameter() != other.quantized_parameter();
 }
 bool PsddParameter::operator<(const PsddParameter &other) const {
   if (*this == other) {
@@ -0,0 +1,35 @@
+#include <psdd/psdd_manager.h>
+#include <psdd/psdd_ref.h>
+
+#include <utility>
+
+PsddRef::PsddRef() : manager_(nullptr), node_(nullptr) {}
+
+PsddRef::PsddRef(PsddManager *manager, PsddNode *node)
+    : manager_(manager), node_(node) {
+  if (node_ != nullptr) {
+    manager_->RefPsddNode(node_);
+  }
+}
+
+PsddRef::PsddRef(const PsddRef &other) : PsddRef(other.manager_, other.node_) {}
+
+PsddRef::PsddRef(PsddRef &&other) noexcept
+    : manager_(other.manager_), node_(other.node_) {
+  other.node_ = nullptr;
+}
+
+PsddRef &PsddRef::operator=(PsddRef other) noexcept {
+  std::swap(manager_, other.manager_);
+  std::swap(node_, other.node_);
+  return *this;
+}
+
+PsddRef::~PsddRef() { Reset(); }
+
+void PsddRef::Reset() {
+  if (node_ != nullptr) {
+    manager_->DerefPsddNode(node_);
+    node_ = nullptr;
+  }
+}
@@ -3,347 +3,379 @@
 //
 
 #include <psdd/psdd_node.h>
+#include <psdd/psdd_node_arena.h>
 #include <psdd/psdd_unique_table.h>
 
-#include <set>
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace {
-struct PsddUniqueTableSetFunctional {
-  bool operator()(PsddNode *node_a, PsddNode *node_b) const {
-    if (node_a->flag_index() != node_b->flag_index()) {
-      return node_a->flag_index() < node_b->flag_index();
-    }
-    if (node_a->node_type() == LITERAL_NODE_TYPE) {
-      if (node_b->node_type() != LITERAL_NODE_TYPE) {
-        return true;
-      }
-      return node_a->psdd_literal_node()->literal() <
-             node_b->psdd_literal_node()->literal();
-    } else if (node_a->node_type() == TOP_NODE_TYPE) {
-      if (node_b->node_type() == LITERAL_NODE_TYPE) {
-        return false;
-      }
-      if (node_b->node_type() == DECISION_NODE_TYPE) {
-        return true;
-      }
-      if (node_a->psdd_top_node()->variable_index() !=
-          node_b->psdd_top_node()->variable_index()) {
-        return node_a->psdd_top_node()->variable_index() <
-               node_b->psdd_top_node()->variable_index();
-      } else {
-        return node_a->psdd_top_node()->true_parameter() <
-               node_b->psdd_top_node()->true_parameter();
-      }
-    } else {
-      if (node_b->node_type() != DECISION_NODE_TYPE) {
-        return false;
-      }
-      auto a_size = node_a->psdd_decision_node()->primes().size();
-      for (auto i = 0; i < a_size; ++i) {
-        if (i >= node_b->psdd_decision_node()->primes().size()) {
-          return false;
-        }
-        if (node_a->psdd_decision_node()->primes()[i]->node_index() !=
-            node_b->psdd_decision_node()->primes()[i]->node_index()) {
-          return node_a->psdd_decision_node()->primes()[i]->node_index() <
-                 node_b->psdd_decision_node()->primes()[i]->node_index();
-        } else if (node_a->psdd_decision_node()->subs()[i]->node_index() !=
-                   node_b->psdd_decision_node()->subs()[i]->node_index()) {
-          return node_a->psdd_decision_node()->subs()[i]->node_index() <
-                 node_b->psdd_decision_node()->subs()[i]->node_index();
-        } else if (node_a->psdd_decision_node()->parameters()[i] !=
-                   node_b->psdd_decision_node()->parameters()[i]) {
-          return node_a->psdd_decision_node()->parameters()[i] <
-                 node_b->psdd_decision_node()->parameters()[i];
-        }
-      }
-      if (node_b->psdd_decision_node()->primes().size() >
-          node_a->psdd_decision_node()->primes().size()) {
-        return true;
-      } else {
-        return false;
+// The node hashes combine identity hashes of indexes with xor and shifts, so
+// their low bits are too regular to index a power-of-two table directly.
+std::size_t MixHash(std::size_t hash_value) {
+  uint64_t mixed = hash_value;
+  mixed ^= mixed >> 33;
+  mixed *= 0xff51afd7ed558ccdULL;
+  mixed ^= mixed >> 33;
+  mixed *= 0xc4ceb9fe1a85ec53ULL;
+  mixed ^= mixed >> 33;
+  return (std::size_t)mixed;
+}
+
+bool IsSameNode(const PsddNode *node_a, const PsddNode *node_b) {
+  if (node_a->node_type() != node_b->node_type()) {
+    return false;
+  }
+  if (node_a->node_type() == LITERAL_NODE_TYPE) {
+    return *((const PsddLiteralNode *)node_a) ==
+           *((const PsddLiteralNode *)node_b);
+  } else if (node_a->node_type() == DECISION_NODE_TYPE) {
+    return *((const PsddDecisionNode *)node_a) ==
+           *((const PsddDecisionNode *)node_b);
+  } else {
+    return *((const PsddTopNode *)node_a) == *((const PsddTopNode *)node_b);
+  }
+}
+
+// The nodes normalized for one vtree node, in an open-addressing table with
+// linear probing. Each slot keeps the mixed hash of its node, so most
+// mismatches are rejected without touching the node and growing does not
+// rehash.
+class PsddNodeHashTable {
+ public:
+  PsddNodeHashTable() : slots_(kMinSlotSize), node_size_(0) {}
+  // Returns the node key matches, or nullptr. *probe_length is set to the
+  // number of slots inspected.
+  PsddNode *Find(const PsddNodeKey &key, size_t *probe_length) const {
+    std::size_t hash_value = MixHash(key.hash_value);
+    size_t mask = slots_.size() - 1;
+    size_t index = hash_value & mask;
+    *probe_length = 1;
+    while (slots_[index].node != nullptr) {
+      if (slots_[index].hash_value == hash_value &&
+          key.Matches(slots_[index].node)) {
+        return slots_[index].node;
       }
+      index = (index + 1) & mask;
+      ++*probe_length;
     }
+    return nullptr;
   }
-};
-struct UniqueTableFunctional {
-  std::size_t operator()(const PsddNode *node) const {
-    return node->hash_value();
+  // Returns the node equal to node, inserting node if there is none.
+  // *probe_length is set to the number of slots inspected.
+  PsddNode *FindOrInsert(PsddNode *node, size_t *probe_length) {
+    if ((node_size_ + 1) * kMaxLoadDenominator >
+        slots_.size() * kMaxLoadNumerator) {
+      Rehash(2 * slots_.size());
+    }
+    std::size_t hash_value = MixHash(node->hash_value());
+    size_t mask = slots_.size() - 1;
+    size_t index = hash_value & mask;
+    *probe_length = 1;
+    while (slots_[index].node != nullptr) {
+      if (slots_[index].hash_value == hash_value &&
+          IsSameNode(slots_[index].node, node)) {
+        return slots_[index].node;
+      }
+      index = (index + 1) & mask;
+      ++*probe_length;
+    }
+    slots_[index] = {hash_value, node};
+    ++node_size_;
+    return node;
   }
-  std::size_t operator()(const PsddLiteralNode *node) const {
-    return node->hash_value();
+  // node must be in the table.
+  void Remove(PsddNode *node) {
+    size_t mask = slots_.size() - 1;
+    size_t hole = MixHash(node->hash_value()) & mask;
+    while (slots_[hole].node != node) {
+      assert(slots_[hole].node != nullptr);
+      hole = (hole + 1) & mask;
+    }
+    // Shifts later slots of the run back into the hole when their home slot
+    // allows it, so no probe sequence crosses an empty slot.
+    for (size_t next = (hole + 1) & mask; slots_[next].node != nullptr;
+         next = (next + 1) & mask) {
+      size_t home = slots_[next].hash_value & mask;
+      if (((next - home) & mask) >= ((next - hole) & mask)) {
+        slots_[hole] = slots_[next];
+        hole = next;
+      }
+    }
+    slots_[hole] = Slot();
+    --node_size_;
   }
-  std::size_t operator()(const PsddDecisionNode *node) const {
-    return node->hash_value();
+  template <typename Visit> void ForEach(Visit visit) const {
+    for (const Slot &cur_slot : slots_) {
+      if (cur_slot.node != nullptr) {
+        visit(cur_slot.node);
+      }
+    }
   }
-  std::size_t operator()(const PsddTopNode *node) { return node->hash_value(); }
-  bool operator()(const PsddNode *node_a, const PsddNode *node_b) const {
-    if (node_a->node_type() != node_b->node_type()) {
-      return false;
+  // Drops the nodes for which remove(node) is true. remove may destroy the
+  // node it is given.
+  template <typename Remove> void RemoveIf(Remove remove) {
+    std::vector<Slot> kept_slots;
+    for (const Slot &cur_slot : slots_) {
+      if (cur_slot.node != nullptr && !remove(cur_slot.node)) {
+        kept_slots.push_back(cur_slot);
+      }
     }
-    if (node_a->node_type() == 1) {
-      return *((PsddLiteralNode *)node_a) == *((PsddLiteralNode *)node_b);
-    } else if (node_a->node_type() == 2) {
-      return *((PsddDecisionNode *)node_a) == *((PsddDecisionNode *)node_b);
-    } else {
-      return *((PsddTopNode *)node_a) == *((PsddTopNode *)node_b);
+    node_size_ = 0;
+    size_t slot_size = kMinSlotSize;
+    while (kept_slots.size() * kMaxLoadDenominator >
+           slot_size * kMaxLoadNumerator) {
+      slot_size *= 2;
+    }
+    slots_.assign(slot_size, Slot());
+    for (const Slot &cur_slot : kept_slots) {
+      Insert(cur_slot);
     }
   }
-  bool operator()(const PsddLiteralNode *node_a,
-                  const PsddLiteralNode *node_b) const {
-    return *node_a == *node_b;
-  }
-  bool operator()(const PsddDecisionNode *node_a,
-                  const PsddDecisionNode *node_b) const {
-    return *node_a == *node_b;
+  size_t node_size() const { return node_size_; }
+  size_t slot_size() const { return slots_.size(); }
+
+ private:
+  struct Slot {
+    std::size_t hash_value = 0;
+    PsddNode *node = nullptr;
+  };
+  static const size_t kMinSlotSize = 8;
+  // Grows past a load factor of 7/10.
+  static const size_t kMaxLoadNumerator = 7;
+  static const size_t kMaxLoadDenominator = 10;
+  void Rehash(size_t slot_size) {
+    std::vector<Slot> old_slots(slot_size);
+    old_slots.swap(slots_);
+    node_size_ = 0;
+    for (const Slot &cur_slot : old_slots) {
+      if (cur_slot.node != nullptr) {
+        Insert(cur_slot);
+      }
+    }
   }
-  bool operator()(const PsddTopNode *node_a, const PsddTopNode *node_b) {
-    return *node_a == *node_b;
+  // Inserts a node known to be absent.
+  void Insert(const Slot &slot) {
+    size_t mask = slots_.size() - 1;
+    size_t index = slot.hash_value & mask;
+    while (slots_[index].node != nullptr) {
+      index = (index + 1) & mask;
+    }
+    slots_[index] = slot;
+    ++node_size_;
   }
+  std::vector<Slot> slots_;
+  size_t node_size_;
 };
+
+// The table of one vtree position, with the lock that guards it and the
+// counts of the lookups made in it.
+struct PsddUniqueTableShard {
+  std::mutex mutex;
+  PsddNodeHashTable table;
+  size_t lookup_size = 0;
+  size_t probe_size = 0;
+  size_t max_probe_length = 0;
+};
+
+// Lookups at different vtree positions take different locks, so threads
+// building different parts of a PSDD seldom wait on each other.
 class PsddUniqueTableImp : public PsddUniqueTable {
  public:
-  PsddUniqueTableImp() : PsddUniqueTable() {}
+  PsddUniqueTableImp(PsddNodeArena *node_arena, size_t shard_size)
+      : PsddUniqueTable(),
+        node_arena_(node_arena),
+        shards_(new PsddUniqueTableShard[shard_size]),
+        shard_size_(shard_size) {}
   ~PsddUniqueTableImp() override = default;
-  PsddNode *GetUniqueNode(PsddNode *node, uintmax_t *node_index) override {
-    if (node->node_type() == 1) {
-      auto cur_literal_node = (PsddLiteralNode *)node;
-      SddLiteral cur_node_vtree_position =
-          sdd_vtree_position(cur_literal_node->vtree_node());
-      auto literal_node_map_at_vtree =
-          literal_node_table_.find(cur_node_vtree_position);
-      if (literal_node_map_at_vtree != literal_node_table_.end()) {
-        auto found_node =
-            literal_node_map_at_vtree->second.find(cur_literal_node);
-        if (found_node == literal_node_map_at_vtree->second.end()) {
-          literal_node_map_at_vtree->second.insert(cur_literal_node);
-          if (node_index != nullptr) {
-            *node_index += 1;
-          }
-          return node;
-        } else {
-          PsddNode *found_node_ptr = *found_node;
-          delete (node);
-          return found_node_ptr;
-        }
-      } else {
-        literal_node_table_[cur_node_vtree_position] =
-            std::set<PsddNode *, PsddUniqueTableSetFunctional>(
-                {cur_literal_node});
-        // std::unordered_set<PsddLiteralNode *, UniqueTableFunctional,
-        //                     UniqueTableFunctional>({cur_literal_node});
-        if (node_index != nullptr) {
-          *node_index += 1;
-        }
-        return node;
-      }
-    } else if (node->node_type() == 2) {
-      auto cur_decision_node = (PsddDecisionNode *)node;
-      SddLiteral cur_node_vtree_position =
-          sdd_vtree_position(cur_decision_node->vtree_node());
-      auto decision_node_map_at_vtree =
-          decision_node_table_.find(cur_node_vtree_position);
-      if (decision_node_map_at_vtree != decision_node_table_.end()) {
-        auto found_node =
-            decision_node_map_at_vtree->second.find(cur_decision_node);
-        if (found_node == decision_node_map_at_vtree->second.end()) {
-          decision_node_map_at_vtree->second.insert(cur_decision_node);
-          if (node_index != nullptr) {
-            *node_index += 1;
-          }
-          return node;
-        } else {
-          PsddNode *found_node_ptr = *found_node;
-          delete (node);
-          return found_node_ptr;
-        }
-      } else {
-        decision_node_table_[cur_node_vtree_position] =
-            std::set<PsddNode *, PsddUniqueTableSetFunctional>(
-                {cur_decision_node});
-        // std::unordered_set<PsddDecisionNode *, UniqueTableFunctional,
-        //                     UniqueTableFunctional>({cur_decision_node});
-        if (node_index != nullptr) {
-          *node_index += 1;
-        }
-        return node;
-      }
-    } else {
-      // node_type == 3
-      auto cur_top_node = (PsddTopNode *)node;
-      SddLiteral cur_node_vtree_position =
-          sdd_vtree_position(cur_top_node->vtree_node());
-      auto top_node_map_at_vtree =
-          top_node_table_.find(cur_node_vtree_position);
-      if (top_node_map_at_vtree != top_node_table_.end()) {
-        auto found_node = top_node_map_at_vtree->second.find(cur_top_node);
-        if (found_node == top_node_map_at_vtree->second.end()) {
-          top_node_map_at_vtree->second.insert(cur_top_node);
-          if (node_index != nullptr) {
-            *node_index += 1;
-          }
-          return node;
-        } else {
-          PsddNode *found_node_ptr = *found_node;
-          delete (node);
-          return found_node_ptr;
-        }
-      } else {
-        top_node_table_[cur_node_vtree_position] =
-            std::set<PsddNode *, PsddUniqueTableSetFunctional>({cur_top_node});
-        // std::unordered_set<PsddTopNode *, UniqueTableFunctional,
-        //                     UniqueTableFunctional>({cur_top_node});
-        if (node_index != nullptr) {
-          *node_index += 1;
-        }
-        return node;
-      }
+  PsddNode *GetUniqueNode(PsddNode *node) override {
+    PsddUniqueTableShard &shard = Shard(node);
+    PsddNode *unique_node = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      size_t probe_length = 0;
+      unique_node = shard.table.FindOrInsert(node, &probe_length);
+      ++shard.lookup_size;
+      shard.probe_size += probe_length;
+      shard.max_probe_length = std::max(shard.max_probe_length, probe_length);
     }
+    if (unique_node != node) {
+      node_arena_->DeleteNode(node);
+    }
+    return unique_node;
+  }
+  PsddNode *FindUniqueNode(const PsddNodeKey &key) override {
+    PsddUniqueTableShard &shard = Shard(key.vtree_node);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size_t probe_length = 0;
+    PsddNode *unique_node = shard.table.Find(key, &probe_length);
+    ++shard.lookup_size;
+    shard.probe_size += probe_length;
+    shard.max_probe_length = std::max(shard.max_probe_length, probe_length);
+    return unique_node;
   }
-  void DeletePsddNodesWithoutFlagIndexes(
+  size_t DeletePsddNode(PsddNode *node) override {
+    Shard(node).table.Remove(node);
+    return node_arena_->DeleteNode(node);
+  }
+
+  size_t DeletePsddNodesWithoutFlagIndexes(
       const std::unordered_set<uintmax_t> &flag_index) override {
-    // check decision map
-    auto decision_table_it = decision_node_table_.begin();
-    while (decision_table_it != decision_node_table_.end()) {
-      auto node_it = decision_table_it->second.begin();
-      while (node_it != decision_table_it->second.end()) {
-        if (flag_index.find((*node_it)->flag_index()) == flag_index.end()) {
-          node_it = decision_table_it->second.erase(node_it);
-        } else {
-          ++node_it;
+    std::vector<PsddNode *> kept_nodes;
+    for (size_t i = 0; i < shard_size_; ++i) {
+      shards_[i].table.ForEach([&](PsddNode *node) {
+        if (flag_index.find(node->flag_index()) != flag_index.end()) {
+          kept_nodes.push_back(node);
         }
-      }
-      if (decision_table_it->second.empty()) {
-        decision_table_it = decision_node_table_.erase(decision_table_it);
-      } else {
-        ++decision_table_it;
-      }
-    }
-    // check literal map
-    auto literal_table_it = literal_node_table_.begin();
-    while (literal_table_it != literal_node_table_.end()) {
-      auto node_it = literal_table_it->second.begin();
-      while (node_it != literal_table_it->second.end()) {
-        if (flag_index.find((*node_it)->flag_index()) == flag_index.end()) {
-          node_it = literal_table_it->second.erase(node_it);
-        } else {
-          ++node_it;
-        }
-      }
-      if (literal_table_it->second.empty()) {
-        literal_table_it = literal_node_table_.erase(literal_table_it);
-      } else {
-        ++literal_table_it;
-      }
-    }
-    // check top map
-    auto top_table_it = top_node_table_.begin();
-    while (top_table_it != top_node_table_.end()) {
-      auto node_it = top_table_it->second.begin();
-      while (node_it != top_table_it->second.end()) {
-        if (flag_index.find((*node_it)->flag_index()) == flag_index.end()) {
-          node_it = top_table_it->second.erase(node_it);
-        } else {
-          ++node_it;
-        }
-      }
-      if (top_table_it->second.empty()) {
-        top_table_it = top_node_table_.erase(top_table_it);
-      } else {
-        ++top_table_it;
-      }
+      });
     }
+    return DeleteUnusedPsddNodes(kept_nodes);
   }
 
-  // TODO:testing this function
-  void DeleteUnusedPsddNodes(
+  size_t DeleteUnusedPsddNodes(
       const std::vector<PsddNode *> &used_psdd_nodes) override {
     auto covered_nodes = psdd_node_util::GetCoveredPsddNodes(used_psdd_nodes);
-    // check decision map
-    auto decision_table_it = decision_node_table_.begin();
-    while (decision_table_it != decision_node_table_.end()) {
-      auto node_it = decision_table_it->second.begin();
-      while (node_it != decision_table_it->second.end()) {
-        if (covered_nodes.find((*node_it)->node_index()) ==
-            covered_nodes.end()) {
-          node_it = decision_table_it->second.erase(node_it);
-        } else {
-          ++node_it;
+    size_t reclaimed_bytes = 0;
+    for (size_t i = 0; i < shard_size_; ++i) {
+      shards_[i].table.RemoveIf([&](PsddNode *node) {
+        if (node->ref_count() > 0 ||
+            covered_nodes.find(node->node_index()) != covered_nodes.end()) {
+          return false;
         }
-      }
-      if (decision_table_it->second.empty()) {
-        decision_table_it = decision_node_table_.erase(decision_table_it);
-      } else {
-        ++decision_table_it;
-      }
+        reclaimed_bytes += node_arena_->DeleteNode(node);
+        return true;
+      });
     }
-    // check literal map
-    auto literal_table_it = literal_node_table_.begin();
-    while (literal_table_it != literal_node_table_.end()) {
-      auto node_it = literal_table_it->second.begin();
-      while (node_it != literal_table_it->second.end()) {
-        if (covered_nodes.find((*node_it)->node_index()) ==
-            covered_nodes.end()) {
-          node_it = literal_table_it->second.erase(node_it);
-        } else {
-          ++node_it;
+    return reclaimed_bytes;
+  }
+
+  size_t DeleteUnreferencedPsddNodes(uintmax_t first_node_index) override {
+    size_t reclaimed_bytes = 0;
+    for (size_t i = 0; i < shard_size_; ++i) {
+      shards_[i].table.RemoveIf([&](PsddNode *node) {
+        if (node->node_index() < first_node_index || node->ref_count() > 0) {
+          return false;
         }
-      }
-      if (literal_table_it->second.empty()) {
-        literal_table_it = literal_node_table_.erase(literal_table_it);
-      } else {
-        ++literal_table_it;
-      }
+        reclaimed_bytes += node_arena_->DeleteNode(node);
+        return true;
+      });
     }
-    // check top map
-    auto top_table_it = top_node_table_.begin();
-    while (top_table_it != top_node_table_.end()) {
-      auto node_it = top_table_it->second.begin();
-      while (node_it != top_table_it->second.end()) {
-        if (covered_nodes.find((*node_it)->node_index()) ==
-            covered_nodes.end()) {
-          node_it = top_table_it->second.erase(node_it);
-        } else {
-          ++node_it;
-        }
-      }
-      if (top_table_it->second.empty()) {
-        top_table_it = top_node_table_.erase(top_table_it);
-      } else {
-        ++top_table_it;
-      }
+    return reclaimed_bytes;
+  }
+
+  PsddUniqueTableStats stats() const override {
+    PsddUniqueTableStats result;
+    for (size_t i = 0; i < shard_size_; ++i) {
+      PsddUniqueTableShard &shard = shards_[i];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      result.node_size += shard.table.node_size();
+      result.slot_size += shard.table.slot_size();
+      result.lookup_size += shard.lookup_size;
+      result.probe_size += shard.probe_size;
+      result.max_probe_length =
+          std::max(result.max_probe_length, shard.max_probe_length);
     }
+    return result;
   }
 
  private:
-  std::unordered_map<SddLiteral,
-                     std::set<PsddNode *, PsddUniqueTableSetFunctional>>
-      decision_node_table_;
-  std::unordered_map<SddLiteral,
-                     std::set<PsddNode *, PsddUniqueTableSetFunctional>>
-      literal_node_table_;
-  std::unordered_map<SddLiteral,
-                     std::set<PsddNode *, PsddUniqueTableSetFunctional>>
-      top_node_table_;
-
-  // std::unordered_map<
-  //     SddLiteral, std::unordered_set<PsddDecisionNode *,
-  //     UniqueTableFunctional,
-  //                                    UniqueTableFunctional>>
-  //     decision_node_table_;
-  // std::unordered_map<
-  //     SddLiteral, std::unordered_set<PsddLiteralNode *,
-  //     UniqueTableFunctional,
-  //                                    UniqueTableFunctional>>
-  //     literal_node_table_;
-  // std::unordered_map<SddLiteral,
-  //                    std::unordered_set<PsddTopNode *, UniqueTableFunctional,
-  //                                       UniqueTableFunctional>>
-  //     top_node_table_;
+  PsddUniqueTableShard &Shard(const PsddNode *node) const {
+    return Shard(node->vtree_node());
+  }
+  PsddUniqueTableShard &Shard(Vtree *vtree_node) const {
+    auto vtree_position = (size_t)sdd_vtree_position(vtree_node);
+    assert(vtree_position < shard_size_);
+    return shards_[vtree_position];
+  }
+  PsddNodeArena *node_arena_;
+  // Indexed by vtree position.
+  std::unique_ptr<PsddUniqueTableShard[]> shards_;
+  size_t shard_size_;
 };
 }  // namespace
 
-PsddUniqueTable *PsddUniqueTable::GetPsddUniqueTable() {
-  return new PsddUniqueTableImp();
+PsddNodeKey PsddNodeKey::LiteralNodeKey(Vtree *vtree_node,
+                                        uintmax_t flag_index,
+                                        int32_t literal) {
+  PsddNodeKey key = {};
+  key.node_type = LITERAL_NODE_TYPE;
+  key.vtree_node = vtree_node;
+  key.flag_index = flag_index;
+  key.hash_value = PsddLiteralNode::HashValue(flag_index, literal);
+  key.literal = literal;
+  return key;
+}
+
+PsddNodeKey PsddNodeKey::TopNodeKey(Vtree *vtree_node, uintmax_t flag_index,
+                                    uint32_t variable_index,
+                                    PsddParameter true_parameter) {
+  PsddNodeKey key = {};
+  key.node_type = TOP_NODE_TYPE;
+  key.vtree_node = vtree_node;
+  key.flag_index = flag_index;
+  key.hash_value =
+      PsddTopNode::HashValue(flag_index, variable_index, true_parameter);
+  key.variable_index = variable_index;
+  key.true_parameter = true_parameter;
+  return key;
+}
+
+PsddNodeKey PsddNodeKey::DecisionNodeKey(Vtree *vtree_node,
+                                         uintmax_t flag_index,
+                                         const PsddElement *elements,
+                                         size_t element_size) {
+  PsddNodeKey key = {};
+  key.node_type = DECISION_NODE_TYPE;
+  key.vtree_node = vtree_node;
+  key.flag_index = flag_index;
+  key.hash_value =
+      PsddDecisionNode::HashValue(flag_index, elements, element_size);
+  key.elements = elements;
+  key.element_size = element_size;
+  return key;
+}
+
+bool PsddNodeKey::Matches(const PsddNode *node) const {
+  if (node->node_type() != node_type || node->flag_index() != flag_index) {
+    return false;
+  }
+  if (node_type == LITERAL_NODE_TYPE) {
+    return ((const PsddLiteralNode *)node)->literal() == literal;
+  } else if (node_type == TOP_NODE_TYPE) {
+    auto top_node = (const PsddTopNode *)node;
+    return top_node->variable_index() == variable_index &&
+           top_node->true_parameter() == true_parameter;
+  }
+  const auto &node_elements = ((const PsddDecisionNode *)node)->elements();
+  if (node_elements.size() != element_size) {
+    return false;
+  }
+  for (size_t i = 0; i < element_size; ++i) {
+    if (node_elements[i].prime->node_index() !=
+            elements[i].prime->node_index() ||
+        node_elements[i].sub->node_index() != elements[i].sub->node_index() ||
+        node_elements[i].parameter != elements[i].parameter) {
+      return false;
+    }
+  }
+  return true;
+}
+
+double PsddUniqueTableStats::load_factor() const {
+  return slot_size == 0 ? 0 : (double)node_size / slot_size;
+}
+
+double PsddUniqueTableStats::average_probe_length() const {
+  return lookup_size == 0 ? 0 : (double)probe_size / lookup_size;
+}
+
+PsddUniqueTable *PsddUniqueTable::GetPsddUniqueTable(PsddNodeArena *node_arena,
+                                                     Vtree *vtree) {
+  // A vtree over n variables has 2n-1 nodes, at positions 0 to 2n-2.
+  auto vtree_size = (size_t)(2 * sdd_vtree_var_count(vtree) - 1);
+  return new PsddUniqueTableImp(node_arena, vtree_size);
 }
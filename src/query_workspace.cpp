@@ -0,0 +1,187 @@
+#include <psdd/query_workspace.h>
+
+#include <algorithm>
+#include <psdd/psdd_node.h>
+
+namespace {
+// Whether node is a leaf, setting *variable_index to its variable if so.
+bool LeafVariable(PsddNode *node, uint32_t *variable_index) {
+  if (node->node_type() == LITERAL_NODE_TYPE) {
+    *variable_index = node->psdd_literal_node()->variable_index();
+    return true;
+  }
+  if (node->node_type() == TOP_NODE_TYPE) {
+    *variable_index = node->psdd_top_node()->variable_index();
+    return true;
+  }
+  return false;
+}
+} // namespace
+
+void QueryWorkspace::IndexNodes(
+    const std::vector<PsddNode *> &serialized_nodes) {
+  if (IsIndexed(serialized_nodes)) {
+    return;
+  }
+  auto node_size = serialized_nodes.size();
+  node_positions_.clear();
+  node_positions_.reserve(node_size);
+  for (size_t i = 0; i < node_size; ++i) {
+    node_positions_.emplace(serialized_nodes[i], i);
+  }
+  element_offsets_.resize(node_size + 1);
+  element_positions_.clear();
+  for (size_t i = 0; i < node_size; ++i) {
+    element_offsets_[i] = element_positions_.size();
+    PsddNode *cur_node = serialized_nodes[i];
+    if (cur_node->node_type() != DECISION_NODE_TYPE) {
+      continue;
+    }
+    for (const PsddElement &cur_element :
+         cur_node->psdd_decision_node()->elements()) {
+      element_positions_.push_back(node_positions_.at(cur_element.prime));
+      element_positions_.push_back(node_positions_.at(cur_element.sub));
+    }
+  }
+  element_offsets_[node_size] = element_positions_.size();
+  indexed_data_ = serialized_nodes.data();
+  indexed_size_ = node_size;
+  indexed_root_ = node_size == 0 ? nullptr : serialized_nodes[0];
+  indexed_root_index_ = node_size == 0 ? 0 : serialized_nodes[0]->node_index();
+  parents_indexed_ = false;
+}
+
+void QueryWorkspace::IndexParents(
+    const std::vector<PsddNode *> &serialized_nodes) {
+  if (parents_indexed_) {
+    return;
+  }
+  auto node_size = serialized_nodes.size();
+  parent_offsets_.assign(node_size + 1, 0);
+  variable_size_ = 0;
+  for (size_t i = 0; i < node_size; ++i) {
+    uint32_t variable_index = 0;
+    if (LeafVariable(serialized_nodes[i], &variable_index)) {
+      variable_size_ = std::max(variable_size_, variable_index + 1);
+    }
+    for (size_t k = element_offsets_[i]; k < element_offsets_[i + 1]; ++k) {
+      parent_offsets_[element_positions_[k] + 1] += 1;
+    }
+  }
+  for (size_t i = 0; i < node_size; ++i) {
+    parent_offsets_[i + 1] += parent_offsets_[i];
+  }
+  parent_elements_.resize(parent_offsets_[node_size]);
+  variable_leaf_offsets_.assign(variable_size_ + 1, 0);
+  std::vector<size_t> next_parent_slots(parent_offsets_.begin(),
+                                        parent_offsets_.end() - 1);
+  for (size_t i = 0; i < node_size; ++i) {
+    uint32_t variable_index = 0;
+    if (LeafVariable(serialized_nodes[i], &variable_index)) {
+      variable_leaf_offsets_[variable_index + 1] += 1;
+    }
+    for (size_t k = element_offsets_[i]; k < element_offsets_[i + 1]; ++k) {
+      parent_elements_[next_parent_slots[element_positions_[k]]++] =
+          std::make_pair(i, (k - element_offsets_[i]) / 2);
+    }
+  }
+  for (uint32_t v = 0; v < variable_size_; ++v) {
+    variable_leaf_offsets_[v + 1] += variable_leaf_offsets_[v];
+  }
+  variable_leaves_.resize(variable_leaf_offsets_[variable_size_]);
+  std::vector<size_t> next_leaf_slots(variable_leaf_offsets_.begin(),
+                                      variable_leaf_offsets_.end() - 1);
+  for (size_t i = 0; i < node_size; ++i) {
+    uint32_t variable_index = 0;
+    if (LeafVariable(serialized_nodes[i], &variable_index)) {
+      variable_leaves_[next_leaf_slots[variable_index]++] = i;
+    }
+  }
+  parents_indexed_ = true;
+}
+
+bool QueryWorkspace::IsIndexed(
+    const std::vector<PsddNode *> &serialized_nodes) const {
+  // The root fixes every node below it, and a node freed since the last call
+  // cannot come back with the same node index.
+  return !serialized_nodes.empty() &&
+         serialized_nodes.data() == indexed_data_ &&
+         serialized_nodes.size() == indexed_size_ &&
+         serialized_nodes[0] == indexed_root_ &&
+         serialized_nodes[0]->node_index() == indexed_root_index_;
+}
+
+std::vector<Probability> *QueryWorkspace::MutableValues(size_t size) {
+  if (values_.size() < size) {
+    values_.resize(size);
+  }
+  return &values_;
+}
+
+std::vector<Probability> *QueryWorkspace::MutableDerivatives(size_t size) {
+  if (derivatives_.size() < size) {
+    derivatives_.resize(size);
+  }
+  std::fill(derivatives_.begin(), derivatives_.begin() + size,
+            Probability::CreateFromDecimal(0));
+  return &derivatives_;
+}
+
+std::vector<mpz_class> *QueryWorkspace::MutableCounts(size_t size) {
+  if (counts_.size() < size) {
+    counts_.resize(size);
+  }
+  return &counts_;
+}
+
+std::vector<uint8_t> *QueryWorkspace::MutableFlags(size_t size) {
+  if (flags_.size() < size) {
+    flags_.resize(size);
+  }
+  std::fill(flags_.begin(), flags_.begin() + size, 0);
+  return &flags_;
+}
+
+std::vector<uintmax_t> *QueryWorkspace::MutableChoices(size_t size) {
+  if (choices_.size() < size) {
+    choices_.resize(size);
+  }
+  return &choices_;
+}
+
+std::vector<std::pair<Probability, Probability>> *
+QueryWorkspace::MutableVariableMarginals(size_t size) {
+  if (variable_marginals_.size() < size) {
+    variable_marginals_.resize(size);
+  }
+  std::fill(variable_marginals_.begin(), variable_marginals_.begin() + size,
+            std::make_pair(Probability::CreateFromDecimal(0),
+                           Probability::CreateFromDecimal(0)));
+  return &variable_marginals_;
+}
+
+std::vector<uintmax_t> *QueryWorkspace::MutableStack() {
+  stack_.clear();
+  return &stack_;
+}
+
+std::vector<Probability> *QueryWorkspace::MutableTerms() {
+  terms_.clear();
+  return &terms_;
+}
+
+std::vector<Probability> *QueryWorkspace::MutableTrueTerms() {
+  true_terms_.clear();
+  return &true_terms_;
+}
+
+std::vector<std::vector<Probability>> *
+QueryWorkspace::MutableWorkerTerms(size_t size) {
+  if (worker_terms_.size() < size) {
+    worker_terms_.resize(size);
+  }
+  for (auto &cur_terms : worker_terms_) {
+    cur_terms.clear();
+  }
+  return &worker_terms_;
+}
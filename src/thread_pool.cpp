@@ -0,0 +1,104 @@
+#include <psdd/thread_pool.h>
+
+#include <algorithm>
+
+namespace {
+// ParallelFor creates this many chunks per thread so uneven chunks balance
+// out.
+const size_t kChunksPerThread = 4;
+} // namespace
+
+ThreadPool::ThreadPool(uint32_t thread_size)
+    : task_(nullptr), task_size_(0), next_task_(0), busy_workers_(0),
+      generation_(0), stop_(false) {
+  for (uint32_t i = 1; i < std::max(thread_size, 1u); ++i) {
+    threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_ready_.notify_all();
+  for (std::thread &cur_thread : threads_) {
+    cur_thread.join();
+  }
+}
+
+uint32_t ThreadPool::thread_size() const {
+  return (uint32_t)threads_.size() + 1;
+}
+
+void ThreadPool::Run(size_t task_size,
+                     const std::function<void(size_t, uint32_t)> &task) {
+  if (threads_.empty() || task_size <= 1) {
+    for (size_t i = 0; i < task_size; ++i) {
+      task(i, 0);
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    task_size_ = task_size;
+    next_task_.store(0);
+    busy_workers_ = (uint32_t)threads_.size();
+    generation_ += 1;
+  }
+  work_ready_.notify_all();
+  RunTasks(0);
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_done_.wait(lock, [this] { return busy_workers_ == 0; });
+  task_ = nullptr;
+}
+
+void ThreadPool::ParallelFor(
+    size_t size, size_t min_chunk_size,
+    const std::function<void(size_t, size_t, uint32_t)> &body) {
+  if (size == 0) {
+    return;
+  }
+  size_t chunk_size = std::max<size_t>(
+      std::max<size_t>(min_chunk_size, 1),
+      (size + thread_size() * kChunksPerThread - 1) /
+          (thread_size() * kChunksPerThread));
+  size_t chunk_count = (size + chunk_size - 1) / chunk_size;
+  Run(chunk_count, [&](size_t chunk_index, uint32_t worker_index) {
+    size_t begin = chunk_index * chunk_size;
+    body(begin, std::min(size, begin + chunk_size), worker_index);
+  });
+}
+
+void ThreadPool::WorkerLoop(uint32_t worker_index) {
+  uint64_t seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_ready_.wait(lock, [this, seen_generation] {
+        return stop_ || generation_ != seen_generation;
+      });
+      if (stop_) {
+        return;
+      }
+      seen_generation = generation_;
+    }
+    RunTasks(worker_index);
+    std::lock_guard<std::mutex> lock(mutex_);
+    busy_workers_ -= 1;
+    if (busy_workers_ == 0) {
+      work_done_.notify_one();
+    }
+  }
+}
+
+void ThreadPool::RunTasks(uint32_t worker_index) {
+  while (true) {
+    size_t task_index = next_task_.fetch_add(1);
+    if (task_index >= task_size_) {
+      return;
+    }
+    (*task_)(task_index, worker_index);
+  }
+}
@@ -0,0 +1,426 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <psdd/batched_evaluator.h>
+#include <psdd/psdd_manager.h>
+#include <memory>
+#include <random>
+#include <unordered_map>
+extern "C" {
+#include <sdd/sddapi.h>
+}
+
+#include "test_util.h"
+
+namespace {
+class BatchedEvaluatorTest : public testing::Test {
+protected:
+  void SetUp() override {
+    RandomDoubleFromGammaGenerator generator(1, 1, 0);
+    Vtree *vtree = sdd_vtree_new(8, "balanced");
+    sdd_manager_ = sdd_manager_new(vtree);
+    sdd_manager_auto_gc_and_minimize_off(sdd_manager_);
+    psdd_manager_ = PsddManager::GetPsddManagerFromVtree(vtree);
+    sdd_vtree_free(vtree);
+    std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
+    SddNode *card_node = test_util::CardinalityK(8, 3, sdd_manager_, &cache);
+    PsddNode *structure = psdd_manager_->ConvertSddToPsdd(
+        card_node, sdd_manager_vtree(sdd_manager_), 0);
+    root_ = psdd_manager_->SampleParameters(&generator, structure, 0);
+    std::mt19937 engine(0);
+    std::uniform_int_distribution<> sign_sampler(0, 1);
+    std::uniform_int_distribution<> count_sampler(0, 4);
+    // 100 rows exercise both a full and a partial chunk of 64 lanes.
+    for (auto i = 0; i < 100; ++i) {
+      std::vector<int32_t> row;
+      std::bitset<MAX_VAR> mask;
+      std::bitset<MAX_VAR> instantiation;
+      auto evidence_size = count_sampler(engine);
+      for (int32_t variable_index = 1; variable_index <= 8; ++variable_index) {
+        if ((int)row.size() < evidence_size && sign_sampler(engine)) {
+          bool sign = sign_sampler(engine) == 1;
+          row.push_back(sign ? variable_index : -variable_index);
+          mask.set(variable_index);
+          instantiation.set(variable_index, sign);
+        }
+      }
+      evidence_rows_.push_back(row);
+      masks_.push_back(mask);
+      instantiations_.push_back(instantiation);
+    }
+  }
+  void TearDown() override {
+    delete (psdd_manager_);
+    sdd_manager_free(sdd_manager_);
+  }
+  SddManager *sdd_manager_ = nullptr;
+  PsddManager *psdd_manager_ = nullptr;
+  PsddNode *root_ = nullptr;
+  std::vector<std::vector<int32_t>> evidence_rows_;
+  std::vector<std::bitset<MAX_VAR>> masks_;
+  std::vector<std::bitset<MAX_VAR>> instantiations_;
+};
+
+void ExpectLogNear(double actual, double expected, double tolerance = 1e-12) {
+  if (expected == -std::numeric_limits<double>::infinity()) {
+    EXPECT_EQ(actual, expected);
+  } else {
+    EXPECT_NEAR(actual, expected, tolerance);
+  }
+}
+
+std::vector<SimdLevel> SupportedSimdLevels() {
+  std::vector<SimdLevel> levels;
+  for (int level = SCALAR_SIMD_LEVEL;
+       level <= BatchedEvaluator::DetectSimdLevel(); ++level) {
+    levels.push_back((SimdLevel)level);
+  }
+  return levels;
+}
+} // namespace
+
+TEST_F(BatchedEvaluatorTest, EVALUATE_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  for (SimdLevel simd_level : SupportedSimdLevels()) {
+    BatchedEvaluator evaluator(&compiled_psdd, 64, simd_level);
+    EXPECT_EQ(evaluator.simd_level(), simd_level);
+    auto results = evaluator.Evaluate(evidence_rows_);
+    ASSERT_EQ(results.size(), evidence_rows_.size());
+    for (size_t i = 0; i < evidence_rows_.size(); ++i) {
+      ExpectLogNear(
+          results[i].parameter(),
+          psdd_node_util::Evaluate(masks_[i], instantiations_[i], root_)
+              .parameter());
+    }
+  }
+}
+
+TEST_F(BatchedEvaluatorTest, EVALUATE_MAX_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  std::bitset<MAX_VAR> all_variables = (1 << 9) - 2;
+  for (SimdLevel simd_level : SupportedSimdLevels()) {
+    BatchedEvaluator evaluator(&compiled_psdd, 64, simd_level);
+    auto results = evaluator.EvaluateMax(evidence_rows_);
+    ASSERT_EQ(results.size(), evidence_rows_.size());
+    for (size_t i = 0; i < evidence_rows_.size(); ++i) {
+      // Brute force over the completions of the evidence.
+      double expected = -std::numeric_limits<double>::infinity();
+      for (auto j = 0; j < (1 << 8); ++j) {
+        std::bitset<MAX_VAR> cur_instantiation = j << 1;
+        if (((cur_instantiation ^ instantiations_[i]) & masks_[i]).any()) {
+          continue;
+        }
+        expected = std::max(
+            expected,
+            psdd_node_util::Evaluate(all_variables, cur_instantiation, root_)
+                .parameter());
+      }
+      ExpectLogNear(results[i].parameter(), expected);
+    }
+  }
+}
+
+TEST_F(BatchedEvaluatorTest, IS_CONSISTENT_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  BatchedEvaluator evaluator(&compiled_psdd);
+  auto results = evaluator.IsConsistent(evidence_rows_);
+  ASSERT_EQ(results.size(), evidence_rows_.size());
+  for (size_t i = 0; i < evidence_rows_.size(); ++i) {
+    EXPECT_EQ(results[i], psdd_node_util::IsConsistent(root_, masks_[i],
+                                                       instantiations_[i]));
+  }
+}
+
+TEST_F(BatchedEvaluatorTest, THREADED_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  BatchedEvaluator serial_evaluator(&compiled_psdd);
+  auto expected_sums = serial_evaluator.Evaluate(evidence_rows_);
+  auto expected_maxes = serial_evaluator.EvaluateMax(evidence_rows_);
+  auto expected_consistency = serial_evaluator.IsConsistent(evidence_rows_);
+  ThreadPool thread_pool(4);
+  // A narrow batch keeps every level split along the nodes; a wide one
+  // splits the lanes as well.
+  for (uint32_t batch_width : {8u, 100u}) {
+    BatchedEvaluator evaluator(&compiled_psdd, batch_width,
+                               BatchedEvaluator::DetectSimdLevel(),
+                               &thread_pool);
+    auto sums = evaluator.Evaluate(evidence_rows_);
+    auto maxes = evaluator.EvaluateMax(evidence_rows_);
+    EXPECT_EQ(evaluator.IsConsistent(evidence_rows_), expected_consistency);
+    for (size_t i = 0; i < evidence_rows_.size(); ++i) {
+      ExpectLogNear(sums[i].parameter(), expected_sums[i].parameter());
+      ExpectLogNear(maxes[i].parameter(), expected_maxes[i].parameter());
+    }
+  }
+}
+
+TEST_F(BatchedEvaluatorTest, MPE_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  std::bitset<MAX_VAR> all_variables = (1 << 9) - 2;
+  ThreadPool thread_pool(4);
+  std::vector<std::unique_ptr<BatchedEvaluator>> evaluators;
+  for (SimdLevel simd_level : SupportedSimdLevels()) {
+    evaluators.emplace_back(
+        new BatchedEvaluator(&compiled_psdd, 64, simd_level));
+  }
+  evaluators.emplace_back(new BatchedEvaluator(
+      &compiled_psdd, 16, BatchedEvaluator::DetectSimdLevel(), &thread_pool));
+  for (const auto &evaluator : evaluators) {
+    auto maxes = evaluator->EvaluateMax(evidence_rows_);
+    auto solutions = evaluator->GetMPESolutions(evidence_rows_);
+    ASSERT_EQ(solutions.size(), evidence_rows_.size());
+    for (size_t i = 0; i < evidence_rows_.size(); ++i) {
+      const auto &assignment = solutions[i].first;
+      ASSERT_EQ(assignment.size(), compiled_psdd.variable_size());
+      ExpectLogNear(solutions[i].second.parameter(), maxes[i].parameter());
+      if (maxes[i].parameter() == -std::numeric_limits<double>::infinity()) {
+        continue;
+      }
+      // The decoded assignment completes the evidence and achieves the max.
+      std::bitset<MAX_VAR> instantiation;
+      for (uint32_t v = 1; v < assignment.size(); ++v) {
+        instantiation.set(v, assignment[v]);
+      }
+      EXPECT_FALSE(((instantiation ^ instantiations_[i]) & masks_[i]).any());
+      ExpectLogNear(
+          psdd_node_util::Evaluate(all_variables, instantiation, root_)
+              .parameter(),
+          maxes[i].parameter());
+    }
+  }
+}
+
+TEST_F(BatchedEvaluatorTest, MARGINALS_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  ThreadPool thread_pool(4);
+  BatchedEvaluator serial_evaluator(&compiled_psdd);
+  BatchedEvaluator threaded_evaluator(&compiled_psdd, 64,
+                                      BatchedEvaluator::DetectSimdLevel(),
+                                      &thread_pool);
+  uint32_t variable_size = compiled_psdd.variable_size();
+  for (BatchedEvaluator *evaluator : {&serial_evaluator, &threaded_evaluator}) {
+    auto marginals = evaluator->GetMarginals(evidence_rows_);
+    ASSERT_EQ(marginals.size(), evidence_rows_.size() * variable_size);
+    for (size_t i = 0; i < evidence_rows_.size(); ++i) {
+      Probability evidence_probability =
+          psdd_node_util::Evaluate(masks_[i], instantiations_[i], root_);
+      for (uint32_t v = 1; v < variable_size; ++v) {
+        const auto &marginal = marginals[i * variable_size + v];
+        if (evidence_probability.parameter() ==
+            -std::numeric_limits<double>::infinity()) {
+          EXPECT_EQ(marginal.first.parameter(),
+                    -std::numeric_limits<double>::infinity());
+          EXPECT_EQ(marginal.second.parameter(),
+                    -std::numeric_limits<double>::infinity());
+          continue;
+        }
+        std::bitset<MAX_VAR> mask = masks_[i];
+        std::bitset<MAX_VAR> instantiation = instantiations_[i];
+        mask.set(v);
+        instantiation.set(v);
+        double expected_true =
+            (psdd_node_util::Evaluate(mask, instantiation, root_) /
+             evidence_probability)
+                .parameter();
+        if (masks_[i][v]) {
+          // Observed variables are certain.
+          expected_true = instantiations_[i][v]
+                              ? 0
+                              : -std::numeric_limits<double>::infinity();
+        }
+        ExpectLogNear(marginal.second.parameter(), expected_true);
+      }
+    }
+  }
+}
+
+TEST_F(BatchedEvaluatorTest, LINEAR_DOMAIN_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  BatchedEvaluator log_evaluator(&compiled_psdd);
+  auto expected_sums = log_evaluator.Evaluate(evidence_rows_);
+  auto expected_marginals = log_evaluator.GetMarginals(evidence_rows_);
+  ThreadPool thread_pool(4);
+  std::vector<std::unique_ptr<BatchedEvaluator>> evaluators;
+  for (SimdLevel simd_level : SupportedSimdLevels()) {
+    evaluators.emplace_back(
+        new BatchedEvaluator(&compiled_psdd, 64, simd_level));
+  }
+  evaluators.emplace_back(new BatchedEvaluator(
+      &compiled_psdd, 16, BatchedEvaluator::DetectSimdLevel(), &thread_pool));
+  for (const auto &evaluator : evaluators) {
+    evaluator->set_domain(LINEAR_DOMAIN);
+    EXPECT_EQ(evaluator->domain(), LINEAR_DOMAIN);
+    auto sums = evaluator->Evaluate(evidence_rows_);
+    auto marginals = evaluator->GetMarginals(evidence_rows_);
+    ASSERT_EQ(marginals.size(), expected_marginals.size());
+    for (size_t i = 0; i < evidence_rows_.size(); ++i) {
+      ExpectLogNear(sums[i].parameter(), expected_sums[i].parameter());
+    }
+    for (size_t i = 0; i < marginals.size(); ++i) {
+      ExpectLogNear(marginals[i].first.parameter(),
+                    expected_marginals[i].first.parameter());
+      ExpectLogNear(marginals[i].second.parameter(),
+                    expected_marginals[i].second.parameter());
+    }
+    // The max semiring is unaffected by the domain.
+    auto maxes = evaluator->EvaluateMax(evidence_rows_);
+    auto expected_maxes = log_evaluator.EvaluateMax(evidence_rows_);
+    for (size_t i = 0; i < evidence_rows_.size(); ++i) {
+      ExpectLogNear(maxes[i].parameter(), expected_maxes[i].parameter());
+    }
+  }
+}
+
+TEST_F(BatchedEvaluatorTest, FLOAT_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  std::bitset<MAX_VAR> all_variables = (1 << 9) - 2;
+  BatchedEvaluator double_evaluator(&compiled_psdd);
+  auto expected_sums = double_evaluator.Evaluate(evidence_rows_);
+  auto expected_maxes = double_evaluator.EvaluateMax(evidence_rows_);
+  auto expected_marginals = double_evaluator.GetMarginals(evidence_rows_);
+  const double tolerance = 1e-4;
+  for (SimdLevel simd_level : SupportedSimdLevels()) {
+    for (EvaluationDomain domain : {LOG_DOMAIN, LINEAR_DOMAIN}) {
+      FloatBatchedEvaluator evaluator(&compiled_psdd, 64, simd_level);
+      evaluator.set_domain(domain);
+      auto sums = evaluator.Evaluate(evidence_rows_);
+      auto maxes = evaluator.EvaluateMax(evidence_rows_);
+      auto marginals = evaluator.GetMarginals(evidence_rows_);
+      auto solutions = evaluator.GetMPESolutions(evidence_rows_);
+      EXPECT_EQ(evaluator.IsConsistent(evidence_rows_),
+                double_evaluator.IsConsistent(evidence_rows_));
+      for (size_t i = 0; i < evidence_rows_.size(); ++i) {
+        ExpectLogNear(sums[i].parameter(), expected_sums[i].parameter(),
+                      tolerance);
+        ExpectLogNear(maxes[i].parameter(), expected_maxes[i].parameter(),
+                      tolerance);
+        if (expected_maxes[i].parameter() ==
+            -std::numeric_limits<double>::infinity()) {
+          continue;
+        }
+        // Near ties may decode differently, but not to a worse assignment.
+        std::bitset<MAX_VAR> instantiation;
+        for (uint32_t v = 1; v < solutions[i].first.size(); ++v) {
+          instantiation.set(v, solutions[i].first[v]);
+        }
+        ExpectLogNear(
+            psdd_node_util::Evaluate(all_variables, instantiation, root_)
+                .parameter(),
+            expected_maxes[i].parameter(), tolerance);
+      }
+      for (size_t i = 0; i < marginals.size(); ++i) {
+        ExpectLogNear(marginals[i].second.parameter(),
+                      expected_marginals[i].second.parameter(), tolerance);
+      }
+    }
+  }
+}
+
+TEST(BATCHED_EVALUATOR_TEST, LINEAR_DOMAIN_UNDERFLOW_TEST) {
+  // Observing all of 1200 independent variables gives probabilities far
+  // below the smallest double.
+  const uint32_t variable_size = 1200;
+  RandomDoubleFromGammaGenerator generator(1, 1, 0);
+  Vtree *vtree = sdd_vtree_new(variable_size, "right");
+  PsddManager *psdd_manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  sdd_vtree_free(vtree);
+  PsddNode *root = psdd_manager->SampleParameters(
+      &generator, psdd_manager->GetTrueNode(psdd_manager->vtree(), 0), 0);
+  CompiledPsdd compiled_psdd(root);
+  std::mt19937 engine(0);
+  std::uniform_int_distribution<> sign_sampler(0, 1);
+  std::vector<std::vector<int32_t>> evidence_rows(10);
+  for (auto &row : evidence_rows) {
+    for (int32_t variable_index = 1; variable_index <= (int32_t)variable_size;
+         ++variable_index) {
+      row.push_back(sign_sampler(engine) ? variable_index : -variable_index);
+    }
+  }
+  // The last row leaves one variable unobserved.
+  evidence_rows.back().pop_back();
+  BatchedEvaluator log_evaluator(&compiled_psdd);
+  auto expected_sums = log_evaluator.Evaluate(evidence_rows);
+  auto expected_marginals = log_evaluator.GetMarginals(evidence_rows);
+  for (SimdLevel simd_level : SupportedSimdLevels()) {
+    BatchedEvaluator evaluator(&compiled_psdd, 64, simd_level);
+    evaluator.set_domain(LINEAR_DOMAIN);
+    auto sums = evaluator.Evaluate(evidence_rows);
+    auto marginals = evaluator.GetMarginals(evidence_rows);
+    for (size_t i = 0; i < evidence_rows.size(); ++i) {
+      EXPECT_LT(expected_sums[i].parameter(), -745);
+      ExpectLogNear(sums[i].parameter(), expected_sums[i].parameter(), 1e-9);
+    }
+    for (size_t i = 0; i < marginals.size(); ++i) {
+      ExpectLogNear(marginals[i].second.parameter(),
+                    expected_marginals[i].second.parameter(), 1e-9);
+    }
+  }
+  delete psdd_manager;
+}
+
+TEST_F(BatchedEvaluatorTest, EVIDENCE_CONE_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  BatchedEvaluator evaluator(&compiled_psdd, 8);
+  // Single-literal rows, as in the benchmark, keep the evidence cones small.
+  std::vector<std::vector<int32_t>> sparse_rows;
+  for (int32_t variable_index = 1; variable_index <= 8; ++variable_index) {
+    sparse_rows.push_back({});
+    for (auto i = 0; i < 7; ++i) {
+      sparse_rows.push_back({i % 2 ? variable_index : -variable_index});
+    }
+  }
+  // Interleave semirings and full passes so that cached lanes get restored.
+  for (auto round = 0; round < 2; ++round) {
+    auto sums = evaluator.Evaluate(sparse_rows);
+    auto maxes = evaluator.EvaluateMax(sparse_rows);
+    auto dense_sums = evaluator.Evaluate(evidence_rows_);
+    auto marginals = evaluator.GetMarginals(sparse_rows);
+    for (size_t i = 0; i < sparse_rows.size(); ++i) {
+      std::bitset<MAX_VAR> mask;
+      std::bitset<MAX_VAR> instantiation;
+      for (int32_t literal : sparse_rows[i]) {
+        mask.set(std::abs(literal));
+        instantiation.set(std::abs(literal), literal > 0);
+      }
+      ExpectLogNear(
+          sums[i].parameter(),
+          psdd_node_util::Evaluate(mask, instantiation, root_).parameter());
+      for (int32_t literal : sparse_rows[i]) {
+        const auto &marginal =
+            marginals[i * compiled_psdd.variable_size() + std::abs(literal)];
+        Probability expected = Probability::CreateFromDecimal(
+            sums[i].parameter() == -std::numeric_limits<double>::infinity()
+                ? 0
+                : 1);
+        ExpectLogNear((literal > 0 ? marginal.second : marginal.first)
+                          .parameter(),
+                      expected.parameter());
+      }
+    }
+    std::bitset<MAX_VAR> all_variables = (1 << 9) - 2;
+    for (size_t i = 0; i < sparse_rows.size(); ++i) {
+      double expected = -std::numeric_limits<double>::infinity();
+      for (auto j = 0; j < (1 << 8); ++j) {
+        std::bitset<MAX_VAR> cur_instantiation = j << 1;
+        bool consistent = true;
+        for (int32_t literal : sparse_rows[i]) {
+          consistent &= cur_instantiation[std::abs(literal)] == (literal > 0);
+        }
+        if (consistent) {
+          expected = std::max(
+              expected,
+              psdd_node_util::Evaluate(all_variables, cur_instantiation, root_)
+                  .parameter());
+        }
+      }
+      ExpectLogNear(maxes[i].parameter(), expected);
+    }
+    for (size_t i = 0; i < evidence_rows_.size(); ++i) {
+      ExpectLogNear(
+          dense_sums[i].parameter(),
+          psdd_node_util::Evaluate(masks_[i], instantiations_[i], root_)
+              .parameter());
+    }
+  }
+  EXPECT_GT(evaluator.cone_chunk_count(), 0);
+}
@@ -0,0 +1,259 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <psdd/compiled_psdd.h>
+#include <psdd/psdd_manager.h>
+#include <thread>
+#include <unordered_map>
+extern "C" {
+#include <sdd/sddapi.h>
+}
+
+#include "test_util.h"
+
+namespace {
+class CompiledPsddTest : public testing::Test {
+protected:
+  void SetUp() override {
+    RandomDoubleFromGammaGenerator generator(1, 1, 0);
+    Vtree *vtree = sdd_vtree_new(8, "balanced");
+    sdd_manager_ = sdd_manager_new(vtree);
+    sdd_manager_auto_gc_and_minimize_off(sdd_manager_);
+    psdd_manager_ = PsddManager::GetPsddManagerFromVtree(vtree);
+    sdd_vtree_free(vtree);
+    std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
+    SddNode *card_node = test_util::CardinalityK(8, 3, sdd_manager_, &cache);
+    PsddNode *structure = psdd_manager_->ConvertSddToPsdd(
+        card_node, sdd_manager_vtree(sdd_manager_), 0);
+    root_ = psdd_manager_->SampleParameters(&generator, structure, 0);
+  }
+  void TearDown() override {
+    delete (psdd_manager_);
+    sdd_manager_free(sdd_manager_);
+  }
+  SddManager *sdd_manager_ = nullptr;
+  PsddManager *psdd_manager_ = nullptr;
+  PsddNode *root_ = nullptr;
+};
+} // namespace
+
+TEST_F(CompiledPsddTest, LAYOUT_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  auto serialized_nodes = psdd_node_util::SerializePsddNodes(root_);
+  EXPECT_EQ(compiled_psdd.node_size(), serialized_nodes.size());
+  EXPECT_EQ(compiled_psdd.variable_size(), 9);
+  EXPECT_EQ(compiled_psdd.node_type(compiled_psdd.root_position()),
+            DECISION_NODE_TYPE);
+  for (uint32_t i = 0; i < compiled_psdd.node_size(); ++i) {
+    const auto &offsets = compiled_psdd.element_offsets();
+    for (uintmax_t j = offsets[i]; j < offsets[i + 1]; ++j) {
+      if (compiled_psdd.node_type(i) == DECISION_NODE_TYPE) {
+        EXPECT_LT(compiled_psdd.primes()[j], i);
+        EXPECT_LT(compiled_psdd.subs()[j], i);
+      }
+    }
+  }
+  // Every decision node is on a higher level than its children, and is
+  // listed as a parent of each of them.
+  std::vector<uint32_t> node_levels(compiled_psdd.node_size());
+  for (uint32_t level = 0; level < compiled_psdd.level_size(); ++level) {
+    for (uint32_t k = compiled_psdd.level_offsets()[level];
+         k < compiled_psdd.level_offsets()[level + 1]; ++k) {
+      node_levels[compiled_psdd.level_positions()[k]] = level;
+    }
+  }
+  EXPECT_EQ(node_levels[compiled_psdd.root_position()],
+            compiled_psdd.level_size() - 1);
+  const auto &parent_offsets = compiled_psdd.parent_offsets();
+  const auto &parent_elements = compiled_psdd.parent_elements();
+  for (uint32_t i = 0; i < compiled_psdd.node_size(); ++i) {
+    for (uintmax_t k = parent_offsets[i]; k < parent_offsets[i + 1]; ++k) {
+      uintmax_t element_index = parent_elements[k];
+      uint32_t owner = compiled_psdd.element_owners()[element_index];
+      EXPECT_GT(node_levels[owner], node_levels[i]);
+      EXPECT_TRUE(compiled_psdd.primes()[element_index] == i ||
+                  compiled_psdd.subs()[element_index] == i);
+    }
+  }
+}
+
+TEST_F(CompiledPsddTest, QUERY_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  auto serialized_nodes = psdd_node_util::SerializePsddNodes(root_);
+  EXPECT_EQ(psdd_node_util::ModelCount(compiled_psdd),
+            psdd_node_util::ModelCount(serialized_nodes));
+  auto mpe = psdd_node_util::GetMPESolution(compiled_psdd);
+  auto expected_mpe = psdd_node_util::GetMPESolution(serialized_nodes);
+  EXPECT_EQ(mpe.first, expected_mpe.first);
+  EXPECT_DOUBLE_EQ(mpe.second.parameter(), expected_mpe.second.parameter());
+  auto marginals = psdd_node_util::GetMarginals(compiled_psdd);
+  auto expected_marginals = psdd_node_util::GetMarginals(serialized_nodes);
+  EXPECT_EQ(marginals.size(), expected_marginals.size());
+  for (const auto &expected_marginal : expected_marginals) {
+    auto marginal_it = marginals.find(expected_marginal.first);
+    ASSERT_NE(marginal_it, marginals.end());
+    EXPECT_NEAR(marginal_it->second.first.parameter(),
+                expected_marginal.second.first.parameter(), 1e-9);
+    EXPECT_NEAR(marginal_it->second.second.parameter(),
+                expected_marginal.second.second.parameter(), 1e-9);
+  }
+  auto cap = 1 << 9;
+  for (auto i = 0; i < cap; ++i) {
+    std::bitset<MAX_VAR> cur_instantiation = i;
+    // Alternate between full and partial instantiations.
+    std::bitset<MAX_VAR> mask = (i % 3 == 0) ? (1 << 5) - 1 : cap - 1;
+    EXPECT_DOUBLE_EQ(
+        psdd_node_util::Evaluate(mask, cur_instantiation, compiled_psdd)
+            .parameter(),
+        psdd_node_util::Evaluate(mask, cur_instantiation, serialized_nodes)
+            .parameter());
+    EXPECT_EQ(
+        psdd_node_util::IsConsistent(compiled_psdd, mask, cur_instantiation),
+        psdd_node_util::IsConsistent(serialized_nodes, mask,
+                                     cur_instantiation));
+  }
+}
+
+TEST_F(CompiledPsddTest, WORKSPACE_REUSE_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  auto serialized_nodes = psdd_node_util::SerializePsddNodes(root_);
+  QueryWorkspace workspace;
+  for (auto round = 0; round < 2; ++round) {
+    EXPECT_EQ(psdd_node_util::ModelCount(compiled_psdd, &workspace),
+              psdd_node_util::ModelCount(serialized_nodes));
+    EXPECT_EQ(psdd_node_util::ModelCount(serialized_nodes, &workspace),
+              psdd_node_util::ModelCount(serialized_nodes));
+    auto expected_mpe = psdd_node_util::GetMPESolution(serialized_nodes);
+    EXPECT_EQ(psdd_node_util::GetMPESolution(compiled_psdd, &workspace).first,
+              expected_mpe.first);
+    EXPECT_EQ(
+        psdd_node_util::GetMPESolution(serialized_nodes, &workspace).first,
+        expected_mpe.first);
+    auto expected_marginals = psdd_node_util::GetMarginals(serialized_nodes);
+    auto marginals = psdd_node_util::GetMarginals(compiled_psdd, &workspace);
+    for (const auto &expected_marginal : expected_marginals) {
+      EXPECT_NEAR(marginals[expected_marginal.first].second.parameter(),
+                  expected_marginal.second.second.parameter(), 1e-9);
+    }
+    for (auto i = 0; i < (1 << 8); ++i) {
+      std::bitset<MAX_VAR> cur_instantiation = i << 1;
+      std::bitset<MAX_VAR> mask = (1 << 9) - 2;
+      Probability expected =
+          psdd_node_util::Evaluate(mask, cur_instantiation, root_);
+      EXPECT_DOUBLE_EQ(psdd_node_util::Evaluate(mask, cur_instantiation,
+                                                compiled_psdd, &workspace)
+                           .parameter(),
+                       expected.parameter());
+      EXPECT_DOUBLE_EQ(psdd_node_util::Evaluate(mask, cur_instantiation,
+                                                serialized_nodes, &workspace)
+                           .parameter(),
+                       expected.parameter());
+    }
+  }
+  // The same vector holding the nodes under another root is indexed again.
+  PsddNode *sub_root = root_->psdd_decision_node()->elements()[0].sub;
+  serialized_nodes = psdd_node_util::SerializePsddNodes(sub_root);
+  EXPECT_EQ(psdd_node_util::ModelCount(serialized_nodes, &workspace),
+            psdd_node_util::ModelCount(serialized_nodes));
+  auto expected_marginals = psdd_node_util::GetMarginals(serialized_nodes);
+  auto marginals = psdd_node_util::GetMarginals(serialized_nodes, &workspace);
+  EXPECT_EQ(marginals.size(), expected_marginals.size());
+  for (const auto &expected_marginal : expected_marginals) {
+    EXPECT_EQ(marginals[expected_marginal.first], expected_marginal.second);
+  }
+}
+
+TEST_F(CompiledPsddTest, SHARED_NODES_TEST) {
+  auto serialized_nodes = psdd_node_util::SerializePsddNodes(root_);
+  for (PsddNode *cur_node : serialized_nodes) {
+    cur_node->SetUserData(cur_node->node_index() + 7);
+  }
+  CompiledPsdd compiled_psdd(root_);
+  EXPECT_EQ(compiled_psdd.node_size(), serialized_nodes.size());
+  std::bitset<MAX_VAR> mask = (1 << 9) - 2;
+  std::vector<Probability> expected;
+  for (auto i = 0; i < (1 << 8); ++i) {
+    expected.push_back(psdd_node_util::Evaluate(mask, i << 1, root_));
+  }
+  // Queries with workspaces of their own may run on the same nodes at once.
+  std::vector<std::vector<Probability>> results(2);
+  std::vector<std::thread> threads;
+  for (auto &cur_results : results) {
+    threads.emplace_back([&]() {
+      QueryWorkspace workspace;
+      for (auto i = 0; i < (1 << 8); ++i) {
+        cur_results.push_back(psdd_node_util::Evaluate(
+            mask, i << 1, serialized_nodes, &workspace));
+      }
+      psdd_node_util::ModelCount(serialized_nodes, &workspace);
+      psdd_node_util::GetMPESolution(serialized_nodes, &workspace);
+      psdd_node_util::GetMarginals(serialized_nodes, &workspace);
+    });
+  }
+  for (auto &cur_thread : threads) {
+    cur_thread.join();
+  }
+  for (const auto &cur_results : results) {
+    EXPECT_EQ(cur_results, expected);
+  }
+  for (PsddNode *cur_node : serialized_nodes) {
+    EXPECT_EQ(cur_node->user_data(), cur_node->node_index() + 7);
+  }
+}
+
+TEST_F(CompiledPsddTest, PARALLEL_MARGINALS_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  auto expected_marginals = psdd_node_util::GetMarginals(compiled_psdd);
+  // One workspace serves pools of every size.
+  QueryWorkspace workspace;
+  for (uint32_t thread_size : {1u, 4u, 2u}) {
+    ThreadPool thread_pool(thread_size);
+    auto marginals = psdd_node_util::GetMarginals(compiled_psdd, &thread_pool,
+                                                  &workspace, EXACT_LOG_SUM);
+    EXPECT_EQ(marginals.size(), expected_marginals.size());
+    for (const auto &expected_marginal : expected_marginals) {
+      auto marginal_it = marginals.find(expected_marginal.first);
+      ASSERT_NE(marginal_it, marginals.end());
+      EXPECT_NEAR(marginal_it->second.first.parameter(),
+                  expected_marginal.second.first.parameter(), 1e-9);
+      EXPECT_NEAR(marginal_it->second.second.parameter(),
+                  expected_marginal.second.second.parameter(), 1e-9);
+    }
+  }
+}
+
+TEST_F(CompiledPsddTest, FAST_LOG_SUM_TEST) {
+  CompiledPsdd compiled_psdd(root_);
+  QueryWorkspace workspace;
+  ThreadPool thread_pool(2);
+  auto expected_marginals = psdd_node_util::GetMarginals(compiled_psdd);
+  auto marginals = psdd_node_util::GetMarginals(compiled_psdd, &workspace,
+                                                FAST_LOG_SUM);
+  auto parallel_marginals = psdd_node_util::GetMarginals(
+      compiled_psdd, &thread_pool, FAST_LOG_SUM);
+  for (const auto &expected_marginal : expected_marginals) {
+    EXPECT_NEAR(marginals[expected_marginal.first].first.parameter(),
+                expected_marginal.second.first.parameter(), 1e-5);
+    EXPECT_NEAR(marginals[expected_marginal.first].second.parameter(),
+                expected_marginal.second.second.parameter(), 1e-5);
+    EXPECT_NEAR(parallel_marginals[expected_marginal.first].second.parameter(),
+                expected_marginal.second.second.parameter(), 1e-5);
+  }
+  for (auto i = 0; i < (1 << 8); i += 7) {
+    std::bitset<MAX_VAR> cur_instantiation = i << 1;
+    std::bitset<MAX_VAR> mask = 0x0f << 1;
+    double expected =
+        psdd_node_util::Evaluate(mask, cur_instantiation, compiled_psdd)
+            .parameter();
+    double actual = psdd_node_util::Evaluate(mask, cur_instantiation,
+                                             compiled_psdd, &workspace,
+                                             FAST_LOG_SUM)
+                        .parameter();
+    if (expected == -std::numeric_limits<double>::infinity()) {
+      EXPECT_EQ(actual, expected);
+    } else {
+      EXPECT_NEAR(actual, expected, 1e-5);
+    }
+  }
+}
@@ -0,0 +1,76 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <psdd/inference_session.h>
+#include <psdd/psdd_manager.h>
+#include <random>
+#include <unordered_map>
+extern "C" {
+#include <sdd/sddapi.h>
+}
+
+#include "test_util.h"
+
+TEST(INFERENCE_SESSION_TEST, INCREMENTAL_TEST) {
+  RandomDoubleFromGammaGenerator generator(1, 1, 0);
+  Vtree *vtree = sdd_vtree_new(10, "balanced");
+  SddManager *sdd_manager = sdd_manager_new(vtree);
+  sdd_manager_auto_gc_and_minimize_off(sdd_manager);
+  PsddManager *psdd_manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  sdd_vtree_free(vtree);
+  std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
+  SddNode *card_node = test_util::CardinalityK(10, 4, sdd_manager, &cache);
+  PsddNode *structure = psdd_manager->ConvertSddToPsdd(
+      card_node, sdd_manager_vtree(sdd_manager), 0);
+  PsddNode *root = psdd_manager->SampleParameters(&generator, structure, 0);
+  InferenceSession session(root);
+  std::mt19937 engine(0);
+  std::uniform_int_distribution<int32_t> variable_sampler(1, 10);
+  std::uniform_int_distribution<> action_sampler(0, 2);
+  std::bitset<MAX_VAR> mask;
+  std::bitset<MAX_VAR> instantiation;
+  uintmax_t node_size = session.compiled_psdd().node_size();
+  for (auto step = 0; step < 60; ++step) {
+    int32_t variable_index = variable_sampler(engine);
+    int action = action_sampler(engine);
+    if (action == 0) {
+      session.Retract((uint32_t)variable_index);
+      mask.reset(variable_index);
+      instantiation.reset(variable_index);
+    } else {
+      session.Observe(action == 1 ? variable_index : -variable_index);
+      mask.set(variable_index);
+      instantiation.set(variable_index, action == 1);
+    }
+    EXPECT_LE(session.last_recomputed_size(), node_size);
+    EXPECT_EQ(session.observation(variable_index),
+              mask[variable_index]
+                  ? (instantiation[variable_index] ? variable_index
+                                                   : -variable_index)
+                  : 0);
+    // Incremental results match a session built from scratch bit for bit.
+    InferenceSession fresh_session(root);
+    for (int32_t v = 1; v <= 10; ++v) {
+      if (mask[v]) {
+        fresh_session.Observe(instantiation[v] ? v : -v);
+      }
+    }
+    EXPECT_EQ(session.EvidenceProbability().parameter(),
+              fresh_session.EvidenceProbability().parameter());
+    EXPECT_DOUBLE_EQ(
+        session.EvidenceProbability().parameter(),
+        psdd_node_util::Evaluate(mask, instantiation, root).parameter());
+    auto marginals = session.Marginals();
+    auto expected_marginals = fresh_session.Marginals();
+    ASSERT_EQ(marginals.size(), expected_marginals.size());
+    for (const auto &expected_marginal : expected_marginals) {
+      const auto &marginal = marginals[expected_marginal.first];
+      EXPECT_EQ(marginal.first.parameter(),
+                expected_marginal.second.first.parameter());
+      EXPECT_EQ(marginal.second.parameter(),
+                expected_marginal.second.second.parameter());
+    }
+  }
+  delete (psdd_manager);
+  sdd_manager_free(sdd_manager);
+}
@@ -202,3 +202,39 @@ TEST(PsddLearningTest, ParityLearningExample) {
   delete (psdd_manager);
   sdd_manager_free(sdd_manager);
 }
+
+TEST(PsddLearningTest, LearningWithReusedWorkspace) {
+  Vtree *vtree = sdd_vtree_new(4, "right");
+  SddManager *sdd_manager = sdd_manager_new(vtree);
+  sdd_manager_auto_gc_and_minimize_off(sdd_manager);
+  SddNode *parity_node = GenerateParitySDD(sdd_manager);
+  PsddManager *psdd_manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  sdd_vtree_free(vtree);
+  PsddNode *parity_psdd = psdd_manager->FromSdd(
+      parity_node, sdd_manager_vtree(sdd_manager), 1, psdd_manager->vtree());
+  std::unordered_map<int32_t, BatchedPsddValue> large_examples;
+  std::unordered_map<int32_t, BatchedPsddValue> small_examples;
+  for (int32_t i = 1; i <= 4; ++i) {
+    large_examples[i] = BatchedPsddValue({true, false, i % 2 == 0, true});
+    small_examples[i] = BatchedPsddValue(2, i > 2);
+  }
+  LearningWorkspace workspace;
+  psdd_manager->LearnPsddParameters(parity_psdd, large_examples, 4,
+                                    PsddParameter::CreateFromDecimal(1), 2,
+                                    &workspace);
+  // A smaller job on the same workspace must not see the larger one.
+  PsddNode *reused_psdd = psdd_manager->LearnPsddParameters(
+      parity_psdd, small_examples, 2, PsddParameter::CreateFromDecimal(1), 3,
+      &workspace);
+  PsddNode *fresh_psdd = psdd_manager->LearnPsddParameters(
+      parity_psdd, small_examples, 2, PsddParameter::CreateFromDecimal(1), 4);
+  std::bitset<MAX_VAR> variables;
+  variables.set();
+  for (size_t i = 0; i < 16; ++i) {
+    std::bitset<MAX_VAR> instantiation = i << 1;
+    EXPECT_EQ(psdd_node_util::Evaluate(variables, instantiation, reused_psdd),
+              psdd_node_util::Evaluate(variables, instantiation, fresh_psdd));
+  }
+  delete (psdd_manager);
+  sdd_manager_free(sdd_manager);
+}
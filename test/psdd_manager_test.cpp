@@ -4,71 +4,14 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <psdd/psdd_manager.h>
+#include <psdd/thread_pool.h>
+#include <random>
 #include <unordered_map>
 extern "C" {
 #include <sdd/sddapi.h>
 }
 
-namespace {
-SddNode *CardinalityK(
-    uint32_t variable_size_usign, uint32_t k, SddManager *manager,
-    std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>>
-        *cache) {
-  auto variable_size = (SddLiteral)variable_size_usign;
-  auto cache_it = cache->find(variable_size_usign);
-  if (cache_it != cache->end()) {
-    auto second_cache_it = cache_it->second.find(k);
-    if (second_cache_it != cache_it->second.end()) {
-      return second_cache_it->second;
-    }
-  } else {
-    cache->insert({variable_size, {}});
-    cache_it = cache->find(variable_size_usign);
-  }
-  if (variable_size == 1) {
-    if (k == 0) {
-      SddNode *result = sdd_manager_literal(-1, manager);
-      cache_it->second.insert({0, result});
-      return result;
-    } else {
-      SddNode *result = sdd_manager_literal(1, manager);
-      cache_it->second.insert({1, result});
-      return result;
-    }
-  } else {
-    if (k == 0) {
-      SddNode *remaining =
-          CardinalityK(variable_size_usign - 1, 0, manager, cache);
-      SddNode *result = sdd_conjoin(
-          sdd_manager_literal(-variable_size, manager), remaining, manager);
-      cache_it->second.insert({0, result});
-      return result;
-    } else if (k == variable_size) {
-      SddNode *remaining =
-          CardinalityK(variable_size_usign - 1, k - 1, manager, cache);
-      SddNode *result = sdd_conjoin(sdd_manager_literal(variable_size, manager),
-                                    remaining, manager);
-      cache_it->second.insert({k, result});
-      return result;
-    } else {
-      SddNode *remaining_positive =
-          CardinalityK(variable_size_usign - 1, k - 1, manager, cache);
-      SddNode *remaining_negative =
-          CardinalityK(variable_size_usign - 1, k, manager, cache);
-      SddNode *positive_case =
-          sdd_conjoin(sdd_manager_literal(variable_size, manager),
-                      remaining_positive, manager);
-      SddNode *negative_case =
-          sdd_conjoin(sdd_manager_literal(-variable_size, manager),
-                      remaining_negative, manager);
-      SddNode *result = sdd_disjoin(positive_case, negative_case, manager);
-      cache_it->second.insert({k, result});
-      return result;
-    }
-  }
-}
-
-} // namespace
+#include "test_util.h"
 
 TEST(SDD_TO_PSDD_TEST, MODEL_COUNT_TEST) {
   Vtree *vtree = sdd_vtree_new(10, "right");
@@ -76,7 +19,7 @@ TEST(SDD_TO_PSDD_TEST, MODEL_COUNT_TEST) {
   sdd_vtree_free(vtree);
   sdd_manager_auto_gc_and_minimize_off(sdd_manager);
   std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
-  SddNode *cardinality_node = CardinalityK(10, 5, sdd_manager, &cache);
+  SddNode *cardinality_node = test_util::CardinalityK(10, 5, sdd_manager, &cache);
   std::unordered_map<uint32_t, uint32_t> variable_mapping;
   for (auto i = 0; i < 10; ++i) {
     variable_mapping[(uint32_t)i + 1] = (uint32_t)i + 1;
@@ -163,6 +106,45 @@ TEST(PSDD_MANAGER_TEST, GET_TOP_NODE) {
   delete (psdd_manager);
 }
 
+TEST(PSDD_MANAGER_TEST, UNIQUE_TABLE_STATS_TEST) {
+  Vtree *vtree = sdd_vtree_new(10, "right");
+  PsddManager *psdd_manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  sdd_vtree_free(vtree);
+  PsddUniqueTableStats initial_stats = psdd_manager->unique_table_stats();
+  std::vector<PsddNode *> top_nodes;
+  for (uint32_t i = 1; i <= 10; ++i) {
+    for (uintmax_t flag_index = 0; flag_index < 20; ++flag_index) {
+      top_nodes.push_back(psdd_manager->GetPsddTopNode(
+          i, flag_index, PsddParameter::CreateFromDecimal(0.5),
+          PsddParameter::CreateFromDecimal(0.5)));
+    }
+  }
+  // Looking the same nodes up again finds them instead of adding new ones.
+  for (uint32_t i = 1; i <= 10; ++i) {
+    for (uintmax_t flag_index = 0; flag_index < 20; ++flag_index) {
+      EXPECT_EQ(psdd_manager->GetPsddTopNode(
+                    i, flag_index, PsddParameter::CreateFromDecimal(0.5),
+                    PsddParameter::CreateFromDecimal(0.5)),
+                top_nodes[(i - 1) * 20 + flag_index]);
+    }
+  }
+  PsddUniqueTableStats stats = psdd_manager->unique_table_stats();
+  EXPECT_EQ(stats.node_size, initial_stats.node_size + 200);
+  // A new node takes a lookup before it is created and one to add it.
+  EXPECT_EQ(stats.lookup_size, initial_stats.lookup_size + 600);
+  EXPECT_GE(stats.probe_size, stats.lookup_size);
+  EXPECT_GE(stats.max_probe_length, 1);
+  EXPECT_GT(stats.load_factor(), 0);
+  EXPECT_LE(stats.load_factor(), 0.7);
+  EXPECT_GE(stats.average_probe_length(), 1);
+  // Finding an existing node does not create one, so it uses no node index.
+  PsddNode *next_top_node =
+      psdd_manager->GetPsddTopNode(1, 20, PsddParameter::CreateFromDecimal(0.5),
+                                   PsddParameter::CreateFromDecimal(0.5));
+  EXPECT_EQ(next_top_node->node_index(), top_nodes.back()->node_index() + 1);
+  delete (psdd_manager);
+}
+
 TEST(PSDD_MANAGER_TEST, GET_LIERAL_NODE) {
   Vtree *vtree = sdd_vtree_new(10, "right");
   PsddManager *psdd_manager = PsddManager::GetPsddManagerFromVtree(vtree);
@@ -250,7 +232,7 @@ TEST(PSDD_MANAGER_TEST, FROM_SDD_TEST) {
   SddManager *manager = sdd_manager_new(v);
   sdd_vtree_free(v);
   std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
-  SddNode *card_node = CardinalityK(8, 4, manager, &cache);
+  SddNode *card_node = test_util::CardinalityK(8, 4, manager, &cache);
   Vtree *psdd_vtree = sdd_vtree_new(16, "balanced");
   PsddManager *psdd_manager = PsddManager::GetPsddManagerFromVtree(psdd_vtree);
   sdd_vtree_free(psdd_vtree);
@@ -294,7 +276,7 @@ TEST(PSDD_MANAGER_TEST, LOAD_PSDD_TEST) {
       PsddManager::GetPsddManagerFromSddVtree(v, variable_identical_map);
   sdd_vtree_free(v);
   std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
-  SddNode *card_node = CardinalityK(8, 4, test_sdd_manager, &cache);
+  SddNode *card_node = test_util::CardinalityK(8, 4, test_sdd_manager, &cache);
   PsddNode *card_psdd = test_psdd_manager->ConvertSddToPsdd(
       card_node, sdd_manager_vtree(test_sdd_manager), 0);
   PsddNode *second_card_psdd =
@@ -385,7 +367,7 @@ TEST(PSDD_MANAGER_TEST, MULTIPLY_TEST2) {
   SddManager *sdd_manager = sdd_manager_new(vtree);
   sdd_vtree_free(vtree);
   std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
-  SddNode *card_k1 = CardinalityK(8, 4, sdd_manager, &cache);
+  SddNode *card_k1 = test_util::CardinalityK(8, 4, sdd_manager, &cache);
   std::unordered_map<uint32_t, uint32_t> variable_mapping;
   for (auto i = 1; i <= 8; ++i) {
     variable_mapping[(uint32_t)i] = (uint32_t)i;
@@ -410,6 +392,312 @@ TEST(PSDD_MANAGER_TEST, MULTIPLY_TEST2) {
         result.second;
     EXPECT_DOUBLE_EQ(cur_num.parameter(), result_num.parameter());
   }
+  auto fast_result = manager->Multiply(node_1, node_2, 4, FAST_LOG_SUM);
+  EXPECT_NEAR(fast_result.second.parameter(), result.second.parameter(), 1e-5);
+}
+
+TEST(PSDD_MANAGER_TEST, GARBAGE_COLLECTION_TEST) {
+  Vtree *vtree = sdd_vtree_new(8, "right");
+  PsddManager *manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  SddManager *sdd_manager = sdd_manager_new(vtree);
+  sdd_vtree_free(vtree);
+  std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
+  SddNode *card_k1 = test_util::CardinalityK(8, 4, sdd_manager, &cache);
+  PsddNode *node_1 =
+      manager->ConvertSddToPsdd(card_k1, sdd_manager_vtree(sdd_manager), 0);
+  PsddNode *node_2 =
+      manager->ConvertSddToPsdd(card_k1, sdd_manager_vtree(sdd_manager), 1);
+  auto model_count =
+      psdd_node_util::ModelCount(psdd_node_util::SerializePsddNodes(node_1));
+  auto result = manager->Multiply(node_1, node_2, 3);
+  auto result_s_psdd = psdd_node_util::SerializePsddNodes(result.first);
+  std::bitset<MAX_VAR> mask = (1 << 9) - 1;
+  std::vector<PsddParameter> expected_values;
+  auto cap = 1 << 9;
+  for (auto i = 0; i < cap; ++i) {
+    std::bitset<MAX_VAR> cur_instantiation = i;
+    expected_values.push_back(
+        psdd_node_util::Evaluate(mask, cur_instantiation, result_s_psdd));
+  }
+  size_t node_size = manager->unique_table_stats().node_size;
+  EXPECT_GT(node_size, result_s_psdd.size());
+  // Only the product survives; the operands are freed.
+  size_t reclaimed_bytes = manager->DeleteUnusedPsddNodes({result.first});
+  EXPECT_GT(reclaimed_bytes, 0);
+  EXPECT_EQ(manager->unique_table_stats().node_size, result_s_psdd.size());
+  EXPECT_EQ(result_s_psdd, psdd_node_util::SerializePsddNodes(result.first));
+  for (auto i = 0; i < cap; ++i) {
+    std::bitset<MAX_VAR> cur_instantiation = i;
+    EXPECT_EQ(psdd_node_util::Evaluate(mask, cur_instantiation, result_s_psdd),
+              expected_values[i]);
+  }
+  // Nothing else to free, and the freed storage can be used again.
+  EXPECT_EQ(manager->DeleteUnusedPsddNodes({result.first}), 0);
+  node_1 =
+      manager->ConvertSddToPsdd(card_k1, sdd_manager_vtree(sdd_manager), 0);
+  EXPECT_EQ(
+      psdd_node_util::ModelCount(psdd_node_util::SerializePsddNodes(node_1)),
+      model_count);
+  EXPECT_GT(manager->DeleteUnusedPsddNodes({}), 0);
+  EXPECT_EQ(manager->unique_table_stats().node_size, 0);
+  delete (manager);
+  sdd_manager_free(sdd_manager);
+}
+
+TEST(PSDD_MANAGER_TEST, COMPUTED_TABLE_TEST) {
+  Vtree *vtree = sdd_vtree_new(8, "right");
+  PsddManager *manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  SddManager *sdd_manager = sdd_manager_new(vtree);
+  sdd_vtree_free(vtree);
+  std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
+  SddNode *card_k1 = test_util::CardinalityK(8, 4, sdd_manager, &cache);
+  PsddNode *node_1 =
+      manager->ConvertSddToPsdd(card_k1, sdd_manager_vtree(sdd_manager), 0);
+  PsddNode *node_2 =
+      manager->ConvertSddToPsdd(card_k1, sdd_manager_vtree(sdd_manager), 1);
+  auto node_1_s_psdd = psdd_node_util::SerializePsddNodes(node_1);
+  auto node_2_s_psdd = psdd_node_util::SerializePsddNodes(node_2);
+  auto result = manager->Multiply(node_1, node_2, 2);
+  PsddComputedTableStats stats = manager->computed_table_stats();
+  EXPECT_GT(stats.lookup_size, 0);
+  // The root product is found, so nothing under it is looked up again.
+  auto repeated_result = manager->Multiply(node_1, node_2, 2);
+  EXPECT_EQ(repeated_result.first, result.first);
+  EXPECT_EQ(repeated_result.second, result.second);
+  PsddComputedTableStats repeated_stats = manager->computed_table_stats();
+  EXPECT_EQ(repeated_stats.lookup_size, stats.lookup_size + 1);
+  EXPECT_EQ(repeated_stats.hit_size, stats.hit_size + 1);
+  EXPECT_GT(repeated_stats.hit_rate(), 0);
+  // Products under another flag index are different entries.
+  EXPECT_NE(manager->Multiply(node_1, node_2, 3).first, result.first);
+  // Freeing the product in bulk drops every entry, and multiplying again
+  // builds an equal one.
+  auto result_s_psdd = psdd_node_util::SerializePsddNodes(result.first);
+  EXPECT_GT(manager->DeleteUnusedPsddNodes({node_1, node_2}), 0);
+  auto rebuilt_result = manager->Multiply(node_1, node_2, 2);
+  EXPECT_EQ(manager->computed_table_stats().stale_size, 0);
+  EXPECT_EQ(rebuilt_result.second, result.second);
+  std::bitset<MAX_VAR> mask = (1 << 9) - 1;
+  auto rebuilt_s_psdd =
+      psdd_node_util::SerializePsddNodes(rebuilt_result.first);
+  EXPECT_EQ(rebuilt_s_psdd.size(), result_s_psdd.size());
+  for (auto i = 0; i < (1 << 9); ++i) {
+    std::bitset<MAX_VAR> cur_instantiation = i;
+    PsddParameter expected =
+        psdd_node_util::Evaluate(mask, cur_instantiation, node_1_s_psdd) *
+        psdd_node_util::Evaluate(mask, cur_instantiation, node_2_s_psdd);
+    EXPECT_DOUBLE_EQ(
+        (psdd_node_util::Evaluate(mask, cur_instantiation, rebuilt_s_psdd) *
+         rebuilt_result.second)
+            .parameter(),
+        expected.parameter());
+  }
+  // A product freed by reference counting stays until a lookup finds it
+  // stale.
+  PsddRef ref_1(manager, node_1);
+  PsddRef ref_2(manager, node_2);
+  auto ref_result = manager->Multiply(ref_1, ref_2, 4);
+  ref_result.first.Reset();
+  auto rebuilt_ref_result = manager->Multiply(ref_1, ref_2, 4);
+  EXPECT_GT(manager->computed_table_stats().stale_size, 0);
+  EXPECT_EQ(rebuilt_ref_result.second, ref_result.second);
+  // A product that was never live is not found again once a live node under
+  // it has been freed.
+  auto raw_result = manager->Multiply(node_1, node_2, 5);
+  PsddNode *created_child = nullptr;
+  for (const PsddElement &cur_element :
+       raw_result.first->psdd_decision_node()->elements()) {
+    if (cur_element.sub->flag_index() == 5 &&
+        cur_element.sub->ref_count() == 0) {
+      created_child = cur_element.sub;
+    }
+  }
+  ASSERT_NE(created_child, nullptr);
+  PsddRef(manager, created_child).Reset();
+  size_t stale_size = manager->computed_table_stats().stale_size;
+  auto rebuilt_raw_result = manager->Multiply(node_1, node_2, 5);
+  EXPECT_GT(manager->computed_table_stats().stale_size, stale_size);
+  EXPECT_EQ(rebuilt_raw_result.second, raw_result.second);
+  auto rebuilt_raw_s_psdd =
+      psdd_node_util::SerializePsddNodes(rebuilt_raw_result.first);
+  for (auto i = 0; i < (1 << 9); i += 5) {
+    std::bitset<MAX_VAR> cur_instantiation = i;
+    PsddParameter expected =
+        psdd_node_util::Evaluate(mask, cur_instantiation, node_1_s_psdd) *
+        psdd_node_util::Evaluate(mask, cur_instantiation, node_2_s_psdd);
+    EXPECT_DOUBLE_EQ(
+        (psdd_node_util::Evaluate(mask, cur_instantiation, rebuilt_raw_s_psdd) *
+         rebuilt_raw_result.second)
+            .parameter(),
+        expected.parameter());
+  }
+  rebuilt_ref_result.first.Reset();
+  ref_1.Reset();
+  ref_2.Reset();
+  delete (manager);
+  sdd_manager_free(sdd_manager);
+}
+
+TEST(PSDD_MANAGER_TEST, MULTIPLY_CACHE_SIZE_TEST) {
+  Vtree *vtree = sdd_vtree_new(8, "right");
+  PsddManager *manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  PsddManager *small_cache_manager =
+      PsddManager::GetPsddManagerFromVtree(vtree);
+  SddManager *sdd_manager = sdd_manager_new(vtree);
+  sdd_vtree_free(vtree);
+  std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
+  SddNode *card_k1 = test_util::CardinalityK(8, 4, sdd_manager, &cache);
+  PsddNode *node_1 =
+      manager->ConvertSddToPsdd(card_k1, sdd_manager_vtree(sdd_manager), 0);
+  PsddNode *node_2 =
+      manager->ConvertSddToPsdd(card_k1, sdd_manager_vtree(sdd_manager), 1);
+  auto result = manager->Multiply(node_1, node_2, 2);
+  EXPECT_GT(manager->multiply_cache_memory_size(), 0);
+  // The commuted product is the same one.
+  auto commuted_result = manager->Multiply(node_2, node_1, 3);
+  EXPECT_EQ(commuted_result.second, result.second);
+  EXPECT_EQ(psdd_node_util::SerializePsddNodes(commuted_result.first).size(),
+            psdd_node_util::SerializePsddNodes(result.first).size());
+  // A cache too small to hold the products loses some of them, which only
+  // costs time.
+  small_cache_manager->set_multiply_cache_size(4);
+  PsddNode *small_node_1 = small_cache_manager->ConvertSddToPsdd(
+      card_k1, sdd_manager_vtree(sdd_manager), 0);
+  PsddNode *small_node_2 = small_cache_manager->ConvertSddToPsdd(
+      card_k1, sdd_manager_vtree(sdd_manager), 1);
+  auto small_result = small_cache_manager->Multiply(small_node_1,
+                                                    small_node_2, 2);
+  EXPECT_LE(small_cache_manager->multiply_cache_memory_size(),
+            manager->multiply_cache_memory_size());
+  EXPECT_EQ(small_result.second, result.second);
+  auto result_s_psdd = psdd_node_util::SerializePsddNodes(result.first);
+  auto small_s_psdd = psdd_node_util::SerializePsddNodes(small_result.first);
+  ASSERT_EQ(small_s_psdd.size(), result_s_psdd.size());
+  std::bitset<MAX_VAR> mask = (1 << 9) - 1;
+  for (auto i = 0; i < (1 << 9); ++i) {
+    std::bitset<MAX_VAR> cur_instantiation = i;
+    EXPECT_EQ(psdd_node_util::Evaluate(mask, cur_instantiation, small_s_psdd),
+              psdd_node_util::Evaluate(mask, cur_instantiation, result_s_psdd));
+  }
+  // Multiply on PsddRefs also lists the products it creates, which the table
+  // size does not bound but the memory size counts.
+  PsddManager *ref_manager =
+      PsddManager::GetPsddManagerFromVtree(small_cache_manager->vtree());
+  ref_manager->set_multiply_cache_size(4);
+  PsddRef ref_1(ref_manager, ref_manager->ConvertSddToPsdd(
+                                 card_k1, sdd_manager_vtree(sdd_manager), 0));
+  PsddRef ref_2(ref_manager, ref_manager->ConvertSddToPsdd(
+                                 card_k1, sdd_manager_vtree(sdd_manager), 1));
+  auto ref_result = ref_manager->Multiply(ref_1, ref_2, 2);
+  EXPECT_EQ(ref_result.second, result.second);
+  EXPECT_GT(ref_manager->multiply_cache_memory_size(),
+            small_cache_manager->multiply_cache_memory_size());
+  ref_result.first.Reset();
+  ref_1.Reset();
+  ref_2.Reset();
+  delete (ref_manager);
+  delete (manager);
+  delete (small_cache_manager);
+  sdd_manager_free(sdd_manager);
+}
+
+TEST(PSDD_MANAGER_TEST, CONCURRENT_MULTIPLY_TEST) {
+  Vtree *vtree = sdd_vtree_new(8, "right");
+  PsddManager *manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  SddManager *sdd_manager = sdd_manager_new(vtree);
+  sdd_vtree_free(vtree);
+  std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
+  SddNode *card_k1 = test_util::CardinalityK(8, 4, sdd_manager, &cache);
+  PsddNode *node_1 =
+      manager->ConvertSddToPsdd(card_k1, sdd_manager_vtree(sdd_manager), 0);
+  PsddNode *node_2 =
+      manager->ConvertSddToPsdd(card_k1, sdd_manager_vtree(sdd_manager), 1);
+  // Threads multiplying under the same flag index race to create the same
+  // nodes, and must all end up with the same product.
+  const size_t flag_size = 4;
+  const size_t task_size = 32;
+  std::vector<std::pair<PsddNode *, PsddParameter>> results(task_size);
+  ThreadPool thread_pool(8);
+  thread_pool.Run(task_size, [&](size_t task_index, uint32_t) {
+    results[task_index] =
+        manager->Multiply(node_1, node_2, 2 + task_index % flag_size);
+  });
+  size_t node_size = manager->unique_table_stats().node_size;
+  for (size_t i = 0; i < flag_size; ++i) {
+    auto serial_result = manager->Multiply(node_1, node_2, 2 + i);
+    for (size_t j = i; j < task_size; j += flag_size) {
+      EXPECT_EQ(results[j].first, serial_result.first);
+      EXPECT_EQ(results[j].second, serial_result.second);
+    }
+  }
+  EXPECT_EQ(manager->unique_table_stats().node_size, node_size);
+  delete (manager);
+  sdd_manager_free(sdd_manager);
+}
+
+TEST(PSDD_MANAGER_TEST, PARALLEL_MULTIPLY_TEST) {
+  // Deep enough that the products near the root are split into tasks.
+  Vtree *vtree = sdd_vtree_new(24, "right");
+  PsddManager *manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  PsddManager *serial_manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  SddManager *sdd_manager = sdd_manager_new(vtree);
+  sdd_vtree_free(vtree);
+  std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
+  SddNode *card_k1 = test_util::CardinalityK(24, 12, sdd_manager, &cache);
+  RandomDoubleFromGammaGenerator generator(1, 1, 0);
+  PsddNode *node_1 = manager->SampleParameters(
+      &generator,
+      manager->ConvertSddToPsdd(card_k1, sdd_manager_vtree(sdd_manager), 0),
+      0);
+  PsddNode *node_2 = manager->SampleParameters(
+      &generator,
+      manager->ConvertSddToPsdd(card_k1, sdd_manager_vtree(sdd_manager), 1),
+      1);
+  PsddNode *serial_node_1 =
+      serial_manager->LoadPsddNode(serial_manager->vtree(), node_1, 0);
+  PsddNode *serial_node_2 =
+      serial_manager->LoadPsddNode(serial_manager->vtree(), node_2, 1);
+  auto serial_result =
+      serial_manager->Multiply(serial_node_1, serial_node_2, 2);
+  auto serial_s_psdd = psdd_node_util::SerializePsddNodes(serial_result.first);
+  ThreadPool thread_pool(4);
+  std::bitset<MAX_VAR> mask = (1 << 25) - 1;
+  std::mt19937 random_generator(0);
+  for (uintmax_t flag_index = 2; flag_index < 6; ++flag_index) {
+    auto result =
+        manager->ParallelMultiply(node_1, node_2, flag_index, &thread_pool);
+    EXPECT_EQ(result.second, serial_result.second);
+    auto result_s_psdd = psdd_node_util::SerializePsddNodes(result.first);
+    EXPECT_EQ(result_s_psdd.size(), serial_s_psdd.size());
+    for (auto i = 0; i < 100; ++i) {
+      std::bitset<MAX_VAR> cur_instantiation = random_generator() << 1;
+      EXPECT_EQ(
+          psdd_node_util::Evaluate(mask, cur_instantiation, result_s_psdd),
+          psdd_node_util::Evaluate(mask, cur_instantiation, serial_s_psdd));
+    }
+  }
+  auto serial_fast_result =
+      serial_manager->Multiply(serial_node_1, serial_node_2, 3, FAST_LOG_SUM);
+  auto fast_result = manager->ParallelMultiply(node_1, node_2, 7, FAST_LOG_SUM,
+                                               &thread_pool);
+  EXPECT_EQ(fast_result.second, serial_fast_result.second);
+  EXPECT_EQ(psdd_node_util::SerializePsddNodes(fast_result.first).size(),
+            psdd_node_util::SerializePsddNodes(serial_fast_result.first).size());
+  // Referenced operands keep only the product.
+  PsddRef ref_1(manager, node_1);
+  PsddRef ref_2(manager, node_2);
+  manager->DeleteUnusedPsddNodes({});
+  size_t node_size = manager->unique_table_stats().node_size;
+  auto product = manager->ParallelMultiply(ref_1, ref_2, 6, &thread_pool);
+  EXPECT_EQ(product.second, serial_result.second);
+  EXPECT_EQ(manager->unique_table_stats().node_size,
+            node_size + serial_s_psdd.size());
+  product.first.Reset();
+  ref_1.Reset();
+  ref_2.Reset();
+  delete (manager);
+  delete (serial_manager);
+  sdd_manager_free(sdd_manager);
 }
 
 TEST(PSDD_MANAGER_TEST, MULTIPLY_TEST3) {
@@ -419,7 +707,7 @@ TEST(PSDD_MANAGER_TEST, MULTIPLY_TEST3) {
   SddManager *sdd_manager = sdd_manager_new(vtree);
   sdd_vtree_free(vtree);
   std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
-  SddNode *card_k1 = CardinalityK(8, 4, sdd_manager, &cache);
+  SddNode *card_k1 = test_util::CardinalityK(8, 4, sdd_manager, &cache);
   std::unordered_map<uint32_t, uint32_t> variable_mapping;
   for (auto i = 1; i <= 8; ++i) {
     variable_mapping[(uint32_t)i] = (uint32_t)i;
@@ -457,7 +745,7 @@ TEST(PSDD_MANAGER_TEST, MULTIPLY_TEST4) {
   std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
   std::vector<SddNode *> cards;
   for (auto i = 0; i <= 8; ++i) {
-    cards.push_back(CardinalityK(8, i, sdd_manager, &cache));
+    cards.push_back(test_util::CardinalityK(8, i, sdd_manager, &cache));
   }
   SddNode *less6 = sdd_manager_false(sdd_manager);
   for (auto i = 0; i < 6; ++i) {
@@ -0,0 +1,101 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include <psdd/psdd_node_arena.h>
+extern "C" {
+#include <sdd/sddapi.h>
+}
+
+TEST(PSDD_NODE_ARENA_TEST, SLOT_REUSE_TEST) {
+  Vtree *vtree = sdd_vtree_new(2, "balanced");
+  Vtree *left = sdd_vtree_left(vtree);
+  Vtree *right = sdd_vtree_right(vtree);
+  PsddNodeArena arena;
+  PsddLiteralNode *positive = arena.NewLiteralNode(0, left, 0, 1);
+  PsddLiteralNode *negative = arena.NewLiteralNode(1, left, 0, -1);
+  PsddTopNode *top = arena.NewTopNode(2, right, 0, 2,
+                                      PsddParameter::CreateFromDecimal(0.5),
+                                      PsddParameter::CreateFromDecimal(0.5));
+  PsddDecisionNode *decision = arena.NewDecisionNode(
+      3, vtree, 0, {positive, negative}, {top, top},
+      {PsddParameter::CreateFromDecimal(0.25),
+       PsddParameter::CreateFromDecimal(0.75)});
+  EXPECT_EQ(arena.node_size(), 4);
+  EXPECT_EQ(decision->primes().size(), 2);
+  EXPECT_EQ(decision->elements()[0].sub, top);
+  // A deleted slot is the next one handed out for its type.
+  arena.DeleteNode(negative);
+  EXPECT_EQ(arena.node_size(), 3);
+  EXPECT_EQ(arena.NewLiteralNode(4, left, 0, -1), negative);
+  arena.DeleteNode(decision);
+  PsddDecisionNode *second_decision = arena.NewDecisionNode(
+      5, vtree, 0, {positive}, {top}, {PsddParameter::CreateFromDecimal(1)});
+  EXPECT_EQ(second_decision, decision);
+  EXPECT_EQ(second_decision->node_index(), 5);
+  EXPECT_EQ(arena.node_size(), 4);
+  // Enough nodes to need more than one slab.
+  std::vector<PsddLiteralNode *> literal_nodes;
+  for (uintmax_t i = 0; i < 1000; ++i) {
+    literal_nodes.push_back(arena.NewLiteralNode(6 + i, left, i, 1));
+  }
+  for (uintmax_t i = 0; i < 1000; ++i) {
+    EXPECT_EQ(literal_nodes[i]->flag_index(), i);
+  }
+  EXPECT_EQ(arena.node_size(), 1004);
+  sdd_vtree_free(vtree);
+}
+
+TEST(PSDD_NODE_ARENA_TEST, THREADS_TEST) {
+  Vtree *vtree = sdd_vtree_new(2, "balanced");
+  Vtree *left = sdd_vtree_left(vtree);
+  PsddNodeArena arena;
+  PsddLiteralNode *positive = arena.NewLiteralNode(0, left, 0, 1);
+  PsddLiteralNode *negative = arena.NewLiteralNode(1, left, 0, -1);
+  const uintmax_t thread_size = 4;
+  const uintmax_t node_size = 500;
+  std::vector<std::vector<PsddDecisionNode *>> decision_nodes(thread_size);
+  std::vector<std::thread> threads;
+  for (uintmax_t i = 0; i < thread_size; ++i) {
+    threads.emplace_back([&, i]() {
+      for (uintmax_t j = 0; j < node_size; ++j) {
+        decision_nodes[i].push_back(arena.NewDecisionNode(
+            2 + i * node_size + j, vtree, 0, {positive, negative},
+            {positive, negative},
+            {PsddParameter::CreateFromDecimal(0.5),
+             PsddParameter::CreateFromDecimal(0.5)}));
+      }
+    });
+  }
+  for (auto &cur_thread : threads) {
+    cur_thread.join();
+  }
+  threads.clear();
+  EXPECT_EQ(arena.node_size(), 2 + thread_size * node_size);
+  // Each thread deletes the nodes another one created.
+  for (uintmax_t i = 0; i < thread_size; ++i) {
+    threads.emplace_back([&, i]() {
+      for (PsddDecisionNode *cur_node :
+           decision_nodes[(i + 1) % thread_size]) {
+        arena.DeleteNode(cur_node);
+      }
+    });
+  }
+  for (auto &cur_thread : threads) {
+    cur_thread.join();
+  }
+  EXPECT_EQ(arena.node_size(), 2);
+  for (uintmax_t i = 0; i < thread_size; ++i) {
+    for (uintmax_t j = 0; j < node_size; ++j) {
+      EXPECT_FALSE(arena.HoldsDecisionNode(decision_nodes[i][j],
+                                           2 + i * node_size + j));
+    }
+  }
+  PsddDecisionNode *decision = arena.NewDecisionNode(
+      2 + thread_size * node_size, vtree, 0, {positive}, {positive},
+      {PsddParameter::CreateFromDecimal(1)});
+  EXPECT_TRUE(arena.HoldsDecisionNode(decision, 2 + thread_size * node_size));
+  sdd_vtree_free(vtree);
+}
@@ -0,0 +1,68 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <psdd/psdd_parameter.h>
+
+TEST(PSDD_PARAMETER_TEST, EQUALITY_TEST) {
+  auto zero = PsddParameter::CreateFromDecimal(0);
+  auto half = PsddParameter::CreateFromDecimal(0.5);
+  EXPECT_TRUE(zero == PsddParameter());
+  EXPECT_EQ(zero.hash_value(), PsddParameter().hash_value());
+  EXPECT_TRUE(zero != half);
+  EXPECT_TRUE(zero < half);
+  // Logarithms that agree to APPX_LEVEL digits are equal and hash alike.
+  auto noisy_half = PsddParameter::CreateFromLog(half.parameter() + 1e-12);
+  EXPECT_TRUE(noisy_half == half);
+  EXPECT_EQ(noisy_half.hash_value(), half.hash_value());
+  EXPECT_FALSE(noisy_half < half);
+}
+
+TEST(PSDD_PARAMETER_TEST, ACCUMULATE_TEST) {
+  auto quarter = PsddParameter::CreateFromDecimal(0.25);
+  auto sum = PsddParameter::CreateFromDecimal(0);
+  sum += quarter;
+  sum += quarter;
+  auto half = PsddParameter::CreateFromDecimal(0.5);
+  EXPECT_TRUE(sum == half);
+  EXPECT_EQ(sum.hash_value(), half.hash_value());
+  EXPECT_TRUE(quarter + quarter == half);
+}
+
+TEST(PSDD_PARAMETER_TEST, FAST_LOG_SUM_TEST) {
+  for (double x = 0; x < 40; x += 1.0 / 1024) {
+    EXPECT_NEAR(FastLog1pExpNegative(x), std::log1p(std::exp(-x)),
+                kFastLogSumError);
+  }
+  EXPECT_EQ(FastLog1pExpNegative(std::numeric_limits<double>::infinity()), 0);
+  auto zero = PsddParameter::CreateFromDecimal(0);
+  auto third = PsddParameter::CreateFromDecimal(1.0 / 3);
+  EXPECT_EQ(zero.Add(third, FAST_LOG_SUM).parameter(), third.parameter());
+  EXPECT_EQ(third.Add(zero, FAST_LOG_SUM).parameter(), third.parameter());
+  EXPECT_EQ(zero.Add(zero, FAST_LOG_SUM).parameter(), zero.parameter());
+  EXPECT_NEAR(third.Add(third, FAST_LOG_SUM).parameter(),
+              std::log(2.0 / 3), kFastLogSumError);
+  EXPECT_EQ(third.Add(third, EXACT_LOG_SUM).parameter(),
+            (third + third).parameter());
+}
+
+TEST(PSDD_PARAMETER_TEST, SUM_PARAMETERS_TEST) {
+  std::vector<PsddParameter> terms;
+  for (int i = 1; i <= 100; ++i) {
+    terms.push_back(PsddParameter::CreateFromDecimal(i));
+  }
+  terms.push_back(PsddParameter::CreateFromDecimal(0));
+  auto term = [&](size_t i) { return terms[i]; };
+  EXPECT_NEAR(SumParameters(terms.size(), term).parameter(), std::log(5050.0),
+              1e-14);
+  EXPECT_NEAR(SumParameters(terms.size(), term, FAST_LOG_SUM).parameter(),
+              std::log(5050.0), terms.size() * kFastLogSumError);
+  EXPECT_EQ(SumParameters(1, term).parameter(), terms[0].parameter());
+  auto zero = PsddParameter::CreateFromDecimal(0);
+  EXPECT_EQ(SumParameters(0, term).parameter(), zero.parameter());
+  auto zero_term = [&](size_t) { return zero; };
+  EXPECT_EQ(SumParameters(3, zero_term).parameter(), zero.parameter());
+}
@@ -0,0 +1,163 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <psdd/psdd_manager.h>
+#include <psdd/psdd_ref.h>
+#include <psdd/thread_pool.h>
+extern "C" {
+#include <sdd/sddapi.h>
+}
+
+#include "test_util.h"
+
+namespace {
+PsddNode *GetLiteralTerm(PsddManager *manager, int32_t literal) {
+  return manager->NormalizePsddNode(
+      manager->vtree(), manager->GetPsddLiteralNode(literal, 0), 0);
+}
+} // namespace
+
+TEST(PSDD_REF_TEST, DEREF_FREES_DEAD_NODES_TEST) {
+  Vtree *vtree = sdd_vtree_new(8, "balanced");
+  PsddManager *manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  sdd_vtree_free(vtree);
+  PsddNode *true_node = manager->GetTrueNode(manager->vtree(), 0);
+  size_t true_size = psdd_node_util::SerializePsddNodes(true_node).size();
+  EXPECT_EQ(manager->unique_table_stats().node_size, true_size);
+  {
+    PsddRef true_ref(manager, true_node);
+    EXPECT_EQ(true_node->ref_count(), 1);
+    PsddRef copied_ref = true_ref;
+    EXPECT_EQ(true_node->ref_count(), 2);
+    PsddRef moved_ref = std::move(copied_ref);
+    EXPECT_EQ(copied_ref.get(), nullptr);
+    EXPECT_EQ(true_node->ref_count(), 2);
+    moved_ref.Reset();
+    EXPECT_EQ(true_node->ref_count(), 1);
+  }
+  // The last reference took the node and every descendant with it.
+  EXPECT_EQ(manager->unique_table_stats().node_size, 0);
+  // Nodes that were never referenced are left alone.
+  PsddNode *one_true = GetLiteralTerm(manager, 1);
+  size_t one_true_size = manager->unique_table_stats().node_size;
+  EXPECT_EQ(one_true_size, psdd_node_util::SerializePsddNodes(one_true).size());
+  PsddRef null_ref(manager, nullptr);
+  null_ref.Reset();
+  EXPECT_EQ(manager->unique_table_stats().node_size, one_true_size);
+  delete (manager);
+}
+
+TEST(PSDD_REF_TEST, MULTIPLY_TEST) {
+  Vtree *vtree = sdd_vtree_new(8, "right");
+  PsddManager *manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  sdd_vtree_free(vtree);
+  PsddRef one_true(manager, GetLiteralTerm(manager, 1));
+  PsddRef two_false(manager, GetLiteralTerm(manager, -2));
+  PsddRef one_false(manager, GetLiteralTerm(manager, -1));
+  // Nothing is left over once every node is referenced.
+  EXPECT_EQ(manager->DeleteUnusedPsddNodes({}), 0);
+  auto raw_product =
+      manager->Multiply(one_true.get(), two_false.get(), /*flag_index*/ 0);
+  size_t node_size = manager->unique_table_stats().node_size;
+  auto product = manager->Multiply(one_true, two_false, /*flag_index*/ 0);
+  EXPECT_EQ(product.first.get(), raw_product.first);
+  EXPECT_EQ(product.second, raw_product.second);
+  EXPECT_EQ(manager->unique_table_stats().node_size, node_size);
+  // Under a new flag index the product of the first elements is a new
+  // literal node, which the contradiction does not use.
+  PsddRef two_true(manager, GetLiteralTerm(manager, 2));
+  node_size = manager->unique_table_stats().node_size;
+  auto contradiction = manager->Multiply(product.first, two_true, 1);
+  EXPECT_EQ(contradiction.first.get(), nullptr);
+  EXPECT_EQ(contradiction.second, PsddParameter::CreateFromDecimal(0));
+  EXPECT_EQ(manager->unique_table_stats().node_size, node_size);
+  EXPECT_EQ(manager->Multiply(product.first, one_false, 1).first.get(),
+            nullptr);
+  EXPECT_EQ(manager->unique_table_stats().node_size, node_size);
+  // Dropping the arguments frees every node the product does not share.
+  one_true.Reset();
+  two_false.Reset();
+  one_false.Reset();
+  two_true.Reset();
+  std::vector<PsddNode *> product_nodes =
+      psdd_node_util::SerializePsddNodes(product.first.get());
+  EXPECT_EQ(manager->unique_table_stats().node_size, product_nodes.size());
+  product.first.Reset();
+  EXPECT_EQ(manager->unique_table_stats().node_size, 0);
+  delete (manager);
+}
+
+TEST(PSDD_REF_TEST, MULTIPLY_LEAVES_NO_GARBAGE_TEST) {
+  Vtree *vtree = sdd_vtree_new(10, "balanced");
+  SddManager *sdd_manager = sdd_manager_new(vtree);
+  sdd_manager_auto_gc_and_minimize_off(sdd_manager);
+  PsddManager *manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  sdd_vtree_free(vtree);
+  std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>> cache;
+  std::vector<PsddRef> cards;
+  for (uint32_t k = 3; k <= 5; ++k) {
+    cards.emplace_back(manager,
+                       manager->ConvertSddToPsdd(
+                           test_util::CardinalityK(10, k, sdd_manager, &cache),
+                           sdd_manager_vtree(sdd_manager), 0));
+  }
+  cards.emplace_back(manager, GetLiteralTerm(manager, 3));
+  manager->DeleteUnusedPsddNodes({});
+  ThreadPool thread_pool(2);
+  std::vector<PsddRef> products;
+  for (size_t i = 0; i < cards.size(); ++i) {
+    for (size_t j = i; j < cards.size(); ++j) {
+      products.push_back(
+          manager->Multiply(cards[i], cards[j], /*flag_index*/ 1).first);
+      products.push_back(manager
+                             ->ParallelMultiply(cards[i], cards[j],
+                                                /*flag_index*/ 2, &thread_pool)
+                             .first);
+    }
+  }
+  // Every node left is reachable from a reference.
+  std::vector<PsddNode *> roots;
+  for (const auto &cur_ref : cards) {
+    roots.push_back(cur_ref.get());
+  }
+  for (const auto &cur_ref : products) {
+    if (cur_ref.get() != nullptr) {
+      roots.push_back(cur_ref.get());
+    }
+  }
+  EXPECT_EQ(manager->unique_table_stats().node_size,
+            psdd_node_util::SerializePsddNodes(roots).size());
+  products.clear();
+  cards.clear();
+  EXPECT_EQ(manager->unique_table_stats().node_size, 0);
+  delete (manager);
+  sdd_manager_free(sdd_manager);
+}
+
+TEST(PSDD_REF_TEST, DELETE_UNREFERENCED_TEST) {
+  Vtree *vtree = sdd_vtree_new(8, "right");
+  PsddManager *manager = PsddManager::GetPsddManagerFromVtree(vtree);
+  sdd_vtree_free(vtree);
+  // Held by pointer from before the sweep started, so it must survive.
+  PsddNode *one_true = GetLiteralTerm(manager, 1);
+  std::vector<PsddNode *> old_nodes =
+      psdd_node_util::SerializePsddNodes(one_true);
+  uintmax_t first_node_index = manager->next_node_index();
+  PsddRef two_false(manager, GetLiteralTerm(manager, -2));
+  GetLiteralTerm(manager, 3);
+  manager->Multiply(one_true, two_false.get(), /*flag_index*/ 0);
+  EXPECT_GT(manager->DeleteUnreferencedPsddNodes(first_node_index), 0);
+  EXPECT_EQ(manager->unique_table_stats().node_size,
+            psdd_node_util::SerializePsddNodes({one_true, two_false.get()})
+                .size());
+  for (PsddNode *cur_node : old_nodes) {
+    EXPECT_LT(cur_node->node_index(), first_node_index);
+  }
+  EXPECT_EQ(manager->DeleteUnreferencedPsddNodes(first_node_index), 0);
+  two_false.Reset();
+  delete (manager);
+}
@@ -0,0 +1,61 @@
+#include "test_util.h"
+
+namespace test_util {
+SddNode *CardinalityK(
+    uint32_t variable_size_usign, uint32_t k, SddManager *manager,
+    std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>>
+        *cache) {
+  auto variable_size = (SddLiteral)variable_size_usign;
+  auto cache_it = cache->find(variable_size_usign);
+  if (cache_it != cache->end()) {
+    auto second_cache_it = cache_it->second.find(k);
+    if (second_cache_it != cache_it->second.end()) {
+      return second_cache_it->second;
+    }
+  } else {
+    cache->insert({variable_size, {}});
+    cache_it = cache->find(variable_size_usign);
+  }
+  if (variable_size == 1) {
+    if (k == 0) {
+      SddNode *result = sdd_manager_literal(-1, manager);
+      cache_it->second.insert({0, result});
+      return result;
+    } else {
+      SddNode *result = sdd_manager_literal(1, manager);
+      cache_it->second.insert({1, result});
+      return result;
+    }
+  } else {
+    if (k == 0) {
+      SddNode *remaining =
+          CardinalityK(variable_size_usign - 1, 0, manager, cache);
+      SddNode *result = sdd_conjoin(
+          sdd_manager_literal(-variable_size, manager), remaining, manager);
+      cache_it->second.insert({0, result});
+      return result;
+    } else if (k == variable_size) {
+      SddNode *remaining =
+          CardinalityK(variable_size_usign - 1, k - 1, manager, cache);
+      SddNode *result = sdd_conjoin(sdd_manager_literal(variable_size, manager),
+                                    remaining, manager);
+      cache_it->second.insert({k, result});
+      return result;
+    } else {
+      SddNode *remaining_positive =
+          CardinalityK(variable_size_usign - 1, k - 1, manager, cache);
+      SddNode *remaining_negative =
+          CardinalityK(variable_size_usign - 1, k, manager, cache);
+      SddNode *positive_case =
+          sdd_conjoin(sdd_manager_literal(variable_size, manager),
+                      remaining_positive, manager);
+      SddNode *negative_case =
+          sdd_conjoin(sdd_manager_literal(-variable_size, manager),
+                      remaining_negative, manager);
+      SddNode *result = sdd_disjoin(positive_case, negative_case, manager);
+      cache_it->second.insert({k, result});
+      return result;
+    }
+  }
+}
+} // namespace test_util
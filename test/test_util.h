@@ -0,0 +1,19 @@
+#ifndef PSDD_TEST_TEST_UTIL_H
+#define PSDD_TEST_TEST_UTIL_H
+
+#include <cstdint>
+#include <unordered_map>
+extern "C" {
+#include <sdd/sddapi.h>
+}
+
+namespace test_util {
+// Returns the SDD over variables 1..variable_size_usign whose models set exactly k
+// of them. cache keeps the nodes built so far, keyed by variable size and k.
+SddNode *CardinalityK(
+    uint32_t variable_size_usign, uint32_t k, SddManager *manager,
+    std::unordered_map<uint32_t, std::unordered_map<uint32_t, SddNode *>>
+        *cache);
+} // namespace test_util
+
+#endif // PSDD_TEST_TEST_UTIL_H
@@ -0,0 +1,39 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <psdd/thread_pool.h>
+
+TEST(THREAD_POOL_TEST, RUN_TEST) {
+  for (uint32_t thread_size : {1u, 4u}) {
+    ThreadPool thread_pool(thread_size);
+    EXPECT_EQ(thread_pool.thread_size(), thread_size);
+    for (auto round = 0; round < 10; ++round) {
+      std::vector<int> visit_counts(1000, 0);
+      thread_pool.Run(visit_counts.size(),
+                      [&](size_t task_index, uint32_t worker_index) {
+                        EXPECT_LT(worker_index, thread_size);
+                        visit_counts[task_index] += 1;
+                      });
+      for (int visit_count : visit_counts) {
+        EXPECT_EQ(visit_count, 1);
+      }
+    }
+  }
+}
+
+TEST(THREAD_POOL_TEST, PARALLEL_FOR_TEST) {
+  ThreadPool thread_pool(4);
+  for (size_t size : {0, 1, 7, 1000}) {
+    std::vector<int> visit_counts(size, 0);
+    thread_pool.ParallelFor(size, 3,
+                            [&](size_t begin, size_t end, uint32_t) {
+                              EXPECT_LE(end, size);
+                              for (size_t i = begin; i < end; ++i) {
+                                visit_counts[i] += 1;
+                              }
+                            });
+    for (int visit_count : visit_counts) {
+      EXPECT_EQ(visit_count, 1);
+    }
+  }
+}
@@ -7,14 +7,33 @@
 #include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #include "psdd/pgm_compiler.h"
+#include "psdd/thread_pool.h"
 
 int main(int argc, const char* argv[]) {
+  // Options may appear anywhere; the remaining arguments are positional.
+  bool verbose = false;
+  bool parallel = false;
+  std::vector<const char*> args = {argv[0]};
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--verbose") == 0) {
+      verbose = true;
+    } else if (strcmp(argv[i], "--parallel") == 0) {
+      parallel = true;
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  argc = (int)args.size();
+  argv = args.data();
   if (argc < 3) {
-    std::cout
-        << "Usage <uai_fname> <vtree_method> <(optional) working_directory>"
-        << std::endl;
+    std::cout << "Usage <uai_fname> <vtree_method> <(optional) "
+                 "working_directory> [--verbose] [--parallel]"
+              << std::endl;
     std::cout << "vtree_method can be\n";
     std::cout << "  1 (hyper tree partition) \n";
     std::cout << "  2 (vtree from a join tree)\n";
@@ -28,6 +47,9 @@ int main(int argc, const char* argv[]) {
                  "configuration files are stored. The default is the current "
                  "directory."
               << std::endl;
+    std::cout << "--verbose prints statistics of the PSDD manager.\n";
+    std::cout << "--parallel multiplies factors on one thread per core."
+              << std::endl;
     exit(1);
   }
   const char* uai_fname = argv[1];
@@ -61,7 +83,24 @@ int main(int argc, const char* argv[]) {
   } else {
     pc.init_psdd_manager_from_vtree(vtree_method);
   }
-  auto result = pc.compile_network_dc(100);
+  std::unique_ptr<ThreadPool> thread_pool;
+  if (parallel) {
+    thread_pool.reset(
+        new ThreadPool(std::max(std::thread::hardware_concurrency(), 1u)));
+    pc.set_thread_pool(thread_pool.get());
+  }
+  auto result = pc.compile_network_dc();
+  if (verbose) {
+    PsddComputedTableStats computed_table_stats =
+        pc.psdd_manager()->computed_table_stats();
+    std::cout << "Computed table hits " << computed_table_stats.hit_size
+              << " of " << computed_table_stats.lookup_size << " lookups"
+              << std::endl;
+  }
+  if (result.first.get() == nullptr) {
+    std::cout << "The network has no models" << std::endl;
+    exit(1);
+  }
 
   // output filename
   char psdd_fname[1000];
@@ -69,10 +108,10 @@ int main(int argc, const char* argv[]) {
   sprintf(psdd_fname, "%s.psdd", uai_fname);
   sprintf(vtree_fname, "%s.vtree", uai_fname);
 
-  psdd_node_util::WritePsddToFile(result.first, psdd_fname);
+  psdd_node_util::WritePsddToFile(result.first.get(), psdd_fname);
   sdd_vtree_save(vtree_fname, pc.psdd_manager()->vtree());
   std::cout << "Final size "
-            << psdd_node_util::SerializePsddNodes(result.first).size()
+            << psdd_node_util::SerializePsddNodes(result.first.get()).size()
             << std::endl;
   std::cout << "Log Partition " << result.second.parameter() << std::endl;
 }